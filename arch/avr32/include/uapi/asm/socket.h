@@ -90,4 +90,6 @@
 
 #define SO_CNX_ADVICE		53
 
+#define SO_ZEROCOPY		60
+
 #endif /* _UAPI__ASM_AVR32_SOCKET_H */
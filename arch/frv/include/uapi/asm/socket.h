@@ -90,5 +90,7 @@
 
 #define SO_CNX_ADVICE		53
 
+#define SO_ZEROCOPY		60
+
 #endif /* _ASM_SOCKET_H */
 
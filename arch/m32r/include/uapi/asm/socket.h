@@ -90,4 +90,6 @@
 
 #define SO_CNX_ADVICE		53
 
+#define SO_ZEROCOPY		60
+
 #endif /* _ASM_M32R_SOCKET_H */
@@ -190,23 +190,30 @@ struct jit_context {
 	int cleanup_addr; /* epilogue code offset */
 	bool seen_ld_abs;
 	bool seen_ax_reg;
+	unsigned long *subprog_starts; /* insns that begin a bpf function */
+	int body_addr; /* offset of insn 0, past the prologue */
 };
 
 /* maximum number of bytes emitted while JITing one eBPF insn */
 #define BPF_MAX_INSN_SIZE	128
 #define BPF_INSN_SAFETY		64
 
-#define STACKSIZE \
-	(MAX_BPF_STACK + \
+#define FRAMESIZE(stack_depth) \
+	((stack_depth) + \
 	 32 /* space for rbx, r13, r14, r15 */ + \
 	 8 /* space for skb_copy_bits() buffer */)
 
+#define STACKSIZE	FRAMESIZE(MAX_BPF_STACK)
+
 #define PROLOGUE_SIZE 48
 
 /* emit x64 prologue code for BPF program and check it's size.
- * bpf_tail_call helper will skip it while jumping into another program
+ * bpf_tail_call helper will skip it while jumping into another program.
+ * Programs that may tail call always use a frame of STACKSIZE, functions
+ * of a program with bpf-to-bpf calls get the stack they were verified
+ * to use.
  */
-static void emit_prologue(u8 **pprog)
+static void emit_prologue(u8 **pprog, int stacksize)
 {
 	u8 *prog = *pprog;
 	int cnt = 0;
@@ -214,13 +221,13 @@ static void emit_prologue(u8 **pprog)
 	EMIT1(0x55); /* push rbp */
 	EMIT3(0x48, 0x89, 0xE5); /* mov rbp,rsp */
 
-	/* sub rsp, STACKSIZE */
-	EMIT3_off32(0x48, 0x81, 0xEC, STACKSIZE);
+	/* sub rsp, stacksize */
+	EMIT3_off32(0x48, 0x81, 0xEC, stacksize);
 
 	/* all classic BPF filters use R6(rbx) save it */
 
 	/* mov qword ptr [rbp-X],rbx */
-	EMIT3_off32(0x48, 0x89, 0x9D, -STACKSIZE);
+	EMIT3_off32(0x48, 0x89, 0x9D, -stacksize);
 
 	/* bpf_convert_filter() maps classic BPF register X to R7 and uses R8
 	 * as temporary, so all tcpdump filters need to spill/fill R7(r13) and
@@ -231,11 +238,11 @@ static void emit_prologue(u8 **pprog)
 	 */
 
 	/* mov qword ptr [rbp-X],r13 */
-	EMIT3_off32(0x4C, 0x89, 0xAD, -STACKSIZE + 8);
+	EMIT3_off32(0x4C, 0x89, 0xAD, -stacksize + 8);
 	/* mov qword ptr [rbp-X],r14 */
-	EMIT3_off32(0x4C, 0x89, 0xB5, -STACKSIZE + 16);
+	EMIT3_off32(0x4C, 0x89, 0xB5, -stacksize + 16);
 	/* mov qword ptr [rbp-X],r15 */
-	EMIT3_off32(0x4C, 0x89, 0xBD, -STACKSIZE + 24);
+	EMIT3_off32(0x4C, 0x89, 0xBD, -stacksize + 24);
 
 	/* Clear the tail call counter (tail_call_cnt): for eBPF tail calls
 	 * we need to reset the counter to 0. It's done in two instructions,
@@ -246,7 +253,7 @@ static void emit_prologue(u8 **pprog)
 	/* xor eax, eax */
 	EMIT2(0x31, 0xc0);
 	/* mov qword ptr [rbp-X], rax */
-	EMIT3_off32(0x48, 0x89, 0x85, -STACKSIZE + 32);
+	EMIT3_off32(0x48, 0x89, 0x85, -stacksize + 32);
 
 	BUILD_BUG_ON(cnt != PROLOGUE_SIZE);
 	*pprog = prog;
@@ -347,23 +354,41 @@ static void emit_load_skb_data_hlen(u8 **pprog)
 	*pprog = prog;
 }
 
+/* offset in the image a jump to insn @t lands on.  The prologue of a bpf
+ * function is part of the image of its first insn, but only calls enter
+ * through it.
+ */
+static int jmp_target(const struct jit_context *ctx, const int *addrs, int t)
+{
+	if (t == 0)
+		return ctx->body_addr;
+	if (ctx->subprog_starts && test_bit(t, ctx->subprog_starts))
+		return addrs[t - 1] + PROLOGUE_SIZE;
+	return addrs[t - 1];
+}
+
 static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 		  int oldproglen, struct jit_context *ctx)
 {
+	const u16 *frame_size = bpf_prog->aux->subprog_frame_size;
 	struct bpf_insn *insn = bpf_prog->insnsi;
 	int insn_cnt = bpf_prog->len;
 	bool seen_ld_abs = ctx->seen_ld_abs | (oldproglen == 0);
 	bool seen_ax_reg = ctx->seen_ax_reg | (oldproglen == 0);
 	bool seen_exit = false;
 	u8 temp[BPF_MAX_INSN_SIZE + BPF_INSN_SAFETY];
-	int i, cnt = 0;
+	int stacksize = STACKSIZE;
+	int i, cnt = 0, subprog = 0;
 	int proglen = 0;
 	u8 *prog = temp;
 
-	emit_prologue(&prog);
+	if (ctx->subprog_starts)
+		stacksize = FRAMESIZE(frame_size[0]);
+	emit_prologue(&prog, stacksize);
 
 	if (seen_ld_abs)
 		emit_load_skb_data_hlen(&prog);
+	ctx->body_addr = prog - temp;
 
 	for (i = 0; i < insn_cnt; i++, insn++) {
 		const s32 imm32 = insn->imm;
@@ -379,6 +404,16 @@ static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 		if (dst_reg == BPF_REG_AX || src_reg == BPF_REG_AX)
 			ctx->seen_ax_reg = seen_ax_reg = true;
 
+		/* every bpf function sets up its own stack frame and has its
+		 * own epilogue.  The insn before it is an exit or a jump, so
+		 * it is never entered by falling through.
+		 */
+		if (ctx->subprog_starts && test_bit(i, ctx->subprog_starts)) {
+			stacksize = FRAMESIZE(frame_size[++subprog]);
+			emit_prologue(&prog, stacksize);
+			seen_exit = false;
+		}
+
 		switch (insn->code) {
 			/* ALU */
 		case BPF_ALU | BPF_ADD | BPF_X:
@@ -548,7 +583,10 @@ static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 			EMIT2(0x31, 0xd2);
 
 			if (BPF_SRC(insn->code) == BPF_X) {
-				/* if (src_reg == 0) return 0 */
+				/* if (src_reg == 0) return 0, the verifier
+				 * keeps this out of programs with bpf-to-bpf
+				 * calls, so cleanup_addr is the only epilogue
+				 */
 
 				/* cmp r11, 0 */
 				EMIT4(0x49, 0x83, 0xFB, 0x00);
@@ -850,6 +888,14 @@ xadd:			if (is_imm8(insn->off))
 
 			/* call */
 		case BPF_JMP | BPF_CALL:
+			if (src_reg == BPF_PSEUDO_CALL) {
+				/* call the prologue of the bpf function,
+				 * which starts the image of its first insn
+				 */
+				jmp_offset = addrs[i + imm32] - addrs[i];
+				EMIT1_off32(0xE8, jmp_offset);
+				break;
+			}
 			func = (u8 *) __bpf_call_base + imm32;
 			jmp_offset = func - (image + addrs[i]);
 			if (seen_ld_abs) {
@@ -953,7 +999,8 @@ emit_cond_jmp:		/* convert BPF opcode to x86 */
 			default: /* to silence gcc warning */
 				return -EFAULT;
 			}
-			jmp_offset = addrs[i + insn->off] - addrs[i];
+			jmp_offset = jmp_target(ctx, addrs, i + insn->off + 1) -
+				     addrs[i];
 			if (is_imm8(jmp_offset)) {
 				EMIT2(jmp_cond, jmp_offset);
 			} else if (is_simm32(jmp_offset)) {
@@ -966,7 +1013,8 @@ emit_cond_jmp:		/* convert BPF opcode to x86 */
 			break;
 
 		case BPF_JMP | BPF_JA:
-			jmp_offset = addrs[i + insn->off] - addrs[i];
+			jmp_offset = jmp_target(ctx, addrs, i + insn->off + 1) -
+				     addrs[i];
 			if (!jmp_offset)
 				/* optimize out nop jumps */
 				break;
@@ -1043,13 +1091,13 @@ common_load:
 			/* update cleanup_addr */
 			ctx->cleanup_addr = proglen;
 			/* mov rbx, qword ptr [rbp-X] */
-			EMIT3_off32(0x48, 0x8B, 0x9D, -STACKSIZE);
+			EMIT3_off32(0x48, 0x8B, 0x9D, -stacksize);
 			/* mov r13, qword ptr [rbp-X] */
-			EMIT3_off32(0x4C, 0x8B, 0xAD, -STACKSIZE + 8);
+			EMIT3_off32(0x4C, 0x8B, 0xAD, -stacksize + 8);
 			/* mov r14, qword ptr [rbp-X] */
-			EMIT3_off32(0x4C, 0x8B, 0xB5, -STACKSIZE + 16);
+			EMIT3_off32(0x4C, 0x8B, 0xB5, -stacksize + 16);
 			/* mov r15, qword ptr [rbp-X] */
-			EMIT3_off32(0x4C, 0x8B, 0xBD, -STACKSIZE + 24);
+			EMIT3_off32(0x4C, 0x8B, 0xBD, -stacksize + 24);
 
 			EMIT1(0xC9); /* leave */
 			EMIT1(0xC3); /* ret */
@@ -1089,6 +1137,32 @@ void bpf_jit_compile(struct bpf_prog *prog)
 {
 }
 
+bool bpf_jit_supports_subprog_calls(void)
+{
+	return true;
+}
+
+static int jit_find_subprogs(struct bpf_prog *prog, struct jit_context *ctx)
+{
+	struct bpf_insn *insn = prog->insnsi;
+	int i;
+
+	for (i = 0; i < prog->len; i++, insn++) {
+		if (insn->code != (BPF_JMP | BPF_CALL) ||
+		    insn->src_reg != BPF_PSEUDO_CALL)
+			continue;
+		if (!ctx->subprog_starts) {
+			ctx->subprog_starts = kcalloc(BITS_TO_LONGS(prog->len),
+						      sizeof(unsigned long),
+						      GFP_KERNEL);
+			if (!ctx->subprog_starts)
+				return -ENOMEM;
+		}
+		set_bit(i + insn->imm + 1, ctx->subprog_starts);
+	}
+	return 0;
+}
+
 struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
 {
 	struct bpf_binary_header *header = NULL;
@@ -1115,6 +1189,11 @@ struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
 		prog = tmp;
 	}
 
+	if (jit_find_subprogs(prog, &ctx)) {
+		prog = orig_prog;
+		goto out;
+	}
+
 	addrs = kmalloc(prog->len * sizeof(*addrs), GFP_KERNEL);
 	if (!addrs) {
 		prog = orig_prog;
@@ -1179,6 +1258,7 @@ struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
 out_addrs:
 	kfree(addrs);
 out:
+	kfree(ctx.subprog_starts);
 	if (tmp_blinded)
 		bpf_jit_prog_release_other(prog, prog == orig_prog ?
 					   tmp : orig_prog);
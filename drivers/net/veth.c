@@ -36,6 +36,10 @@ struct veth_priv {
 	struct net_device __rcu	*peer;
 	atomic64_t		dropped;
 	unsigned		requested_headroom;
+	/* frames from the peer waiting for GRO, see veth_forward_skb() */
+	struct napi_struct	napi;
+	struct napi_struct __rcu *rx_napi;	/* &napi while the device is open */
+	struct sk_buff_head	rx_queue;
 };
 
 /*
@@ -106,6 +110,57 @@ static const struct ethtool_ops veth_ethtool_ops = {
 	.get_ethtool_stats	= veth_get_ethtool_stats,
 };
 
+/*
+ * Without GRO on the receiving end the frame goes through netif_rx() as
+ * if it came from a real wire. With GRO enabled (ethtool -K gro on) it is
+ * queued for the receiver's NAPI context, so that frames sent back to
+ * back, e.g. the segments of one GSO packet, get coalesced again.
+ */
+static int veth_forward_skb(struct net_device *rcv, struct sk_buff *skb)
+{
+	struct veth_priv *rcv_priv = netdev_priv(rcv);
+	struct napi_struct *napi = rcu_dereference(rcv_priv->rx_napi);
+
+	if (!(rcv->features & NETIF_F_GRO) || !napi)
+		return dev_forward_skb(rcv, skb);
+
+	if (__dev_forward_skb(rcv, skb))
+		return NET_RX_DROP;
+
+	if (unlikely(skb_queue_len(&rcv_priv->rx_queue) >=
+		     netdev_max_backlog)) {
+		atomic_long_inc(&rcv->rx_dropped);
+		kfree_skb(skb);
+		return NET_RX_DROP;
+	}
+
+	skb_queue_tail(&rcv_priv->rx_queue, skb);
+	napi_schedule(napi);
+	return NET_RX_SUCCESS;
+}
+
+static int veth_poll(struct napi_struct *napi, int budget)
+{
+	struct veth_priv *priv = container_of(napi, struct veth_priv, napi);
+	struct sk_buff *skb;
+	int done = 0;
+
+	while (done < budget && (skb = skb_dequeue(&priv->rx_queue))) {
+		napi_gro_receive(napi, skb);
+		done++;
+	}
+
+	if (done < budget) {
+		napi_complete_done(napi, done);
+		/* the peer may have queued after our last dequeue */
+		if (!skb_queue_empty(&priv->rx_queue) &&
+		    napi_schedule_prep(napi))
+			__napi_schedule(napi);
+	}
+
+	return done;
+}
+
 static netdev_tx_t veth_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct veth_priv *priv = netdev_priv(dev);
@@ -119,7 +174,7 @@ static netdev_tx_t veth_xmit(struct sk_buff *skb, struct net_device *dev)
 		goto drop;
 	}
 
-	if (likely(dev_forward_skb(rcv, skb) == NET_RX_SUCCESS)) {
+	if (likely(veth_forward_skb(rcv, skb) == NET_RX_SUCCESS)) {
 		struct pcpu_vstats *stats = this_cpu_ptr(dev->vstats);
 
 		u64_stats_update_begin(&stats->syncp);
@@ -197,6 +252,9 @@ static int veth_open(struct net_device *dev)
 	if (!peer)
 		return -ENOTCONN;
 
+	napi_enable(&priv->napi);
+	rcu_assign_pointer(priv->rx_napi, &priv->napi);
+
 	if (peer->flags & IFF_UP) {
 		netif_carrier_on(dev);
 		netif_carrier_on(peer);
@@ -213,6 +271,13 @@ static int veth_close(struct net_device *dev)
 	if (peer)
 		netif_carrier_off(peer);
 
+	/* the peer's veth_xmit() must be done with the queue first */
+	RCU_INIT_POINTER(priv->rx_napi, NULL);
+	synchronize_net();
+
+	napi_disable(&priv->napi);
+	skb_queue_purge(&priv->rx_queue);
+
 	return 0;
 }
 
@@ -231,18 +296,35 @@ static int veth_change_mtu(struct net_device *dev, int new_mtu)
 
 static int veth_dev_init(struct net_device *dev)
 {
+	struct veth_priv *priv = netdev_priv(dev);
+
 	dev->vstats = netdev_alloc_pcpu_stats(struct pcpu_vstats);
 	if (!dev->vstats)
 		return -ENOMEM;
+
+	skb_queue_head_init(&priv->rx_queue);
+	netif_napi_add(dev, &priv->napi, veth_poll, NAPI_POLL_WEIGHT);
 	return 0;
 }
 
 static void veth_dev_free(struct net_device *dev)
 {
+	struct veth_priv *priv = netdev_priv(dev);
+
+	/* catch frames queued while the device was going down */
+	skb_queue_purge(&priv->rx_queue);
 	free_percpu(dev->vstats);
 	free_netdev(dev);
 }
 
+/* GRO changes the receive path, keep it opt-in, see veth_forward_skb() */
+static void veth_disable_gro(struct net_device *dev)
+{
+	dev->features &= ~NETIF_F_GRO;
+	dev->wanted_features &= ~NETIF_F_GRO;
+	netdev_update_features(dev);
+}
+
 #ifdef CONFIG_NET_POLL_CONTROLLER
 static void veth_poll_controller(struct net_device *dev)
 {
@@ -432,6 +514,7 @@ static int veth_newlink(struct net *src_net, struct net_device *dev,
 		goto err_register_peer;
 
 	netif_carrier_off(peer);
+	veth_disable_gro(peer);
 
 	err = rtnl_configure_link(peer, ifmp);
 	if (err < 0)
@@ -457,6 +540,7 @@ static int veth_newlink(struct net *src_net, struct net_device *dev,
 		goto err_register_dev;
 
 	netif_carrier_off(dev);
+	veth_disable_gro(dev);
 
 	/*
 	 * tie the deviced together
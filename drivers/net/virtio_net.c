@@ -28,6 +28,7 @@
 #include <linux/cpu.h>
 #include <linux/average.h>
 #include <net/busy_poll.h>
+#include <net/page_pool.h>
 
 static int napi_weight = NAPI_POLL_WEIGHT;
 module_param(napi_weight, int, 0444);
@@ -92,6 +93,9 @@ struct receive_queue {
 	/* Chain pages by the private ptr. */
 	struct page *pages;
 
+	/* Page pool for big packet buffers */
+	struct page_pool *page_pool;
+
 	/* Average packet length for mergeable receive buffers. */
 	struct ewma_pkt_len mrg_avg_pkt_len;
 
@@ -224,7 +228,7 @@ static struct page *get_a_page(struct receive_queue *rq, gfp_t gfp_mask)
 		/* clear private here, it is used to chain pages */
 		p->private = 0;
 	} else
-		p = alloc_page(gfp_mask);
+		p = page_pool_alloc_pages(rq->page_pool, gfp_mask);
 	return p;
 }
 
@@ -1513,6 +1517,8 @@ static void virtnet_free_queues(struct virtnet_info *vi)
 	for (i = 0; i < vi->max_queue_pairs; i++) {
 		napi_hash_del(&vi->rq[i].napi);
 		netif_napi_del(&vi->rq[i].napi);
+		page_pool_destroy(vi->rq[i].page_pool);
+		vi->rq[i].page_pool = NULL;
 	}
 
 	/* We called napi_hash_del() before netif_napi_del(),
@@ -1529,8 +1535,11 @@ static void free_receive_bufs(struct virtnet_info *vi)
 	int i;
 
 	for (i = 0; i < vi->max_queue_pairs; i++) {
-		while (vi->rq[i].pages)
-			__free_pages(get_a_page(&vi->rq[i], GFP_KERNEL), 0);
+		struct receive_queue *rq = &vi->rq[i];
+
+		while (rq->pages)
+			page_pool_recycle_direct(rq->page_pool,
+						 get_a_page(rq, GFP_KERNEL));
 	}
 }
 
@@ -1685,6 +1694,41 @@ err_sq:
 	return -ENOMEM;
 }
 
+/* Big packets take whole pages from the pool and hand them to the
+ * stack as frags, so they come back to it when the skb is freed.
+ * Mergeable buffers are carved out of shared page frags instead and
+ * keep using those.
+ */
+static int virtnet_alloc_page_pools(struct virtnet_info *vi)
+{
+	struct page_pool_params pp_params = {
+		.order = 0,
+		.nid = NUMA_NO_NODE,
+	};
+	int i;
+
+	if (!vi->big_packets || vi->mergeable_rx_bufs)
+		return 0;
+
+	for (i = 0; i < vi->max_queue_pairs; i++) {
+		struct receive_queue *rq = &vi->rq[i];
+		struct page_pool *pool;
+
+		/* room for every page a full vq of buffers can use */
+		pp_params.pool_size =
+			min_t(unsigned int, PP_RING_SIZE_MAX,
+			      virtqueue_get_vring_size(rq->vq) *
+			      (MAX_SKB_FRAGS + 2));
+
+		pool = page_pool_create(&pp_params);
+		if (IS_ERR(pool))
+			return PTR_ERR(pool);
+		rq->page_pool = pool;
+	}
+
+	return 0;
+}
+
 static int init_vqs(struct virtnet_info *vi)
 {
 	int ret;
@@ -1698,12 +1742,18 @@ static int init_vqs(struct virtnet_info *vi)
 	if (ret)
 		goto err_free;
 
+	ret = virtnet_alloc_page_pools(vi);
+	if (ret)
+		goto err_del_vqs;
+
 	get_online_cpus();
 	virtnet_set_affinity(vi);
 	put_online_cpus();
 
 	return 0;
 
+err_del_vqs:
+	vi->vdev->config->del_vqs(vi->vdev);
 err_free:
 	virtnet_free_queues(vi);
 err:
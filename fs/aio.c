@@ -40,6 +40,8 @@
 #include <linux/ramfs.h>
 #include <linux/percpu-refcount.h>
 #include <linux/mount.h>
+#include <linux/cred.h>
+#include <linux/poll.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -169,8 +171,21 @@ struct kioctx {
  */
 #define KIOCB_CANCELLED		((void *) (~0ULL))
 
+struct poll_iocb {
+	struct file		*file;
+	wait_queue_head_t	*head;
+	__u32			events;
+	bool			arming;
+	bool			woken;
+	bool			cancelled;
+	wait_queue_t		wait;
+};
+
 struct aio_kiocb {
-	struct kiocb		common;
+	union {
+		struct kiocb		common;
+		struct poll_iocb	poll;
+	};
 
 	struct kioctx		*ki_ctx;
 	kiocb_cancel_fn		*ki_cancel;
@@ -186,6 +201,20 @@ struct aio_kiocb {
 	 * this is the underlying eventfd context to deliver events to.
 	 */
 	struct eventfd_ctx	*ki_eventfd;
+
+	/*
+	 * Requests that would block io_submit() are finished from aio_wq,
+	 * in the submitter's mm and with its credentials.  IOCB_CMD_POLL
+	 * reuses ki_work to re-poll after a wakeup.
+	 */
+	struct work_struct	ki_work;
+	struct mm_struct	*ki_mm;
+	const struct cred	*ki_cred;
+	unsigned int		ki_opcode;	/* IOCB_CMD_* of the request */
+	struct iov_iter		ki_iter;	/* what is left to transfer */
+	struct iovec		*ki_iovec;	/* ki_iter's copy of the iovec */
+	struct iovec		ki_fast_iov;
+	ssize_t			ki_done;	/* read inline before deferral */
 };
 
 /*------ sysctl variables----*/
@@ -197,6 +226,8 @@ unsigned long aio_max_nr = 0x10000; /* system wide maximum number of aio request
 static struct kmem_cache	*kiocb_cachep;
 static struct kmem_cache	*kioctx_cachep;
 
+static struct workqueue_struct	*aio_wq;
+
 static struct vfsmount *aio_mnt;
 
 static const struct file_operations aio_ring_fops;
@@ -248,8 +279,8 @@ static struct dentry *aio_mount(struct file_system_type *fs_type,
 }
 
 /* aio_setup
- *	Creates the slab caches used by the aio routines, panic on
- *	failure as this is done early during the boot sequence.
+ *	Creates the slab caches and workqueue used by the aio routines,
+ *	panic on failure as this is done early during the boot sequence.
  */
 static int __init aio_setup(void)
 {
@@ -265,6 +296,14 @@ static int __init aio_setup(void)
 	kiocb_cachep = KMEM_CACHE(aio_kiocb, SLAB_HWCACHE_ALIGN|SLAB_PANIC);
 	kioctx_cachep = KMEM_CACHE(kioctx,SLAB_HWCACHE_ALIGN|SLAB_PANIC);
 
+	/* kiocb_free() drops the file of a poll request through ki_filp */
+	BUILD_BUG_ON(offsetof(struct aio_kiocb, poll.file) !=
+		     offsetof(struct aio_kiocb, common.ki_filp));
+
+	aio_wq = alloc_workqueue("aio", WQ_UNBOUND, 0);
+	if (!aio_wq)
+		panic("Failed to create aio workqueue.");
+
 	pr_debug("sizeof(struct page) = %zu\n", sizeof(struct page));
 
 	return 0;
@@ -1036,6 +1075,10 @@ static void kiocb_free(struct aio_kiocb *req)
 		fput(req->common.ki_filp);
 	if (req->ki_eventfd != NULL)
 		eventfd_ctx_put(req->ki_eventfd);
+	if (req->ki_cred)
+		put_cred(req->ki_cred);
+	if (req->ki_iovec != &req->ki_fast_iov)
+		kfree(req->ki_iovec);
 	kmem_cache_free(kiocb_cachep, req);
 }
 
@@ -1069,36 +1112,14 @@ out:
 /* aio_complete
  *	Called when the io request on the given iocb is complete.
  */
-static void aio_complete(struct kiocb *kiocb, long res, long res2)
+static void aio_complete(struct aio_kiocb *iocb, long res, long res2)
 {
-	struct aio_kiocb *iocb = container_of(kiocb, struct aio_kiocb, common);
 	struct kioctx	*ctx = iocb->ki_ctx;
 	struct aio_ring	*ring;
 	struct io_event	*ev_page, *event;
 	unsigned tail, pos, head;
 	unsigned long	flags;
 
-	if (kiocb->ki_flags & IOCB_WRITE) {
-		struct file *file = kiocb->ki_filp;
-
-		/*
-		 * Tell lockdep we inherited freeze protection from submission
-		 * thread.
-		 */
-		if (S_ISREG(file_inode(file)->i_mode))
-			__sb_writers_acquired(file_inode(file)->i_sb, SB_FREEZE_WRITE);
-		file_end_write(file);
-	}
-
-	/*
-	 * Special case handling for sync iocbs:
-	 *  - events go directly into the iocb for fast handling
-	 *  - the sync task with the iocb in its stack holds the single iocb
-	 *    ref, no other paths have a way to get another ref
-	 *  - the sync task helpfully left a reference to itself in the iocb
-	 */
-	BUG_ON(is_sync_kiocb(kiocb));
-
 	if (iocb->ki_list.next) {
 		unsigned long flags;
 
@@ -1180,6 +1201,37 @@ static void aio_complete(struct kiocb *kiocb, long res, long res2)
 	percpu_ref_put(&ctx->reqs);
 }
 
+/* aio_complete_rw
+ *	->ki_complete for read and write iocbs.
+ */
+static void aio_complete_rw(struct kiocb *kiocb, long res, long res2)
+{
+	struct aio_kiocb *iocb = container_of(kiocb, struct aio_kiocb, common);
+
+	if (kiocb->ki_flags & IOCB_WRITE) {
+		struct file *file = kiocb->ki_filp;
+
+		/*
+		 * Tell lockdep we inherited freeze protection from submission
+		 * thread.
+		 */
+		if (S_ISREG(file_inode(file)->i_mode))
+			__sb_writers_acquired(file_inode(file)->i_sb, SB_FREEZE_WRITE);
+		file_end_write(file);
+	}
+
+	/*
+	 * Special case handling for sync iocbs:
+	 *  - events go directly into the iocb for fast handling
+	 *  - the sync task with the iocb in its stack holds the single iocb
+	 *    ref, no other paths have a way to get another ref
+	 *  - the sync task helpfully left a reference to itself in the iocb
+	 */
+	BUG_ON(is_sync_kiocb(kiocb));
+
+	aio_complete(iocb, res, res2);
+}
+
 /* aio_read_events_ring
  *	Pull an event off of the ioctx's event ring.  Returns the number of
  *	events fetched
@@ -1425,6 +1477,8 @@ static int aio_setup_rw(int rw, struct iocb *iocb, struct iovec **iovec,
 
 static inline ssize_t aio_ret(struct kiocb *req, ssize_t ret)
 {
+	struct aio_kiocb *iocb = container_of(req, struct aio_kiocb, common);
+
 	switch (ret) {
 	case -EIOCBQUEUED:
 		return ret;
@@ -1439,15 +1493,102 @@ static inline ssize_t aio_ret(struct kiocb *req, ssize_t ret)
 		ret = -EINTR;
 		/*FALLTHRU*/
 	default:
-		aio_complete(req, ret, 0);
+		/* account for what was read before the request was deferred */
+		if (iocb->ki_done)
+			ret = ret < 0 ? iocb->ki_done : iocb->ki_done + ret;
+		aio_complete_rw(req, ret, 0);
 		return 0;
 	}
 }
 
-static ssize_t aio_read(struct kiocb *req, struct iocb *iocb, bool vectored,
-		bool compat)
+static void aio_deferred_work(struct work_struct *work);
+
+/*
+ * Only I/O to regular files and block devices finishes in bounded time.
+ * A read from a pipe or a socket may wait forever, and would pin a worker
+ * and the kioctx with it, so such requests are issued inline as before.
+ */
+static bool aio_may_defer(struct file *file)
 {
-	struct file *file = req->ki_filp;
+	umode_t mode = file_inode(file)->i_mode;
+
+	return S_ISREG(mode) || S_ISBLK(mode);
+}
+
+/*
+ * Hand a request that would block the submitter over to aio_wq.  The user
+ * may reuse its iovec array once io_submit() returns, so @iter is copied
+ * into the request.  The file, mm and credentials pinned here are dropped
+ * by the worker and kiocb_free().  The request may be completed and freed
+ * before this returns.
+ */
+static ssize_t aio_defer(struct aio_kiocb *req, unsigned int opcode,
+		struct iov_iter *iter)
+{
+	struct mm_struct *mm = current->mm;
+
+	if (iter) {
+		if (iter->nr_segs == 1) {
+			req->ki_fast_iov = *iter->iov;
+			req->ki_iovec = &req->ki_fast_iov;
+		} else {
+			req->ki_iovec = kmemdup(iter->iov,
+					iter->nr_segs * sizeof(struct iovec),
+					GFP_KERNEL);
+			if (!req->ki_iovec)
+				return -ENOMEM;
+		}
+		req->ki_iter = *iter;
+		req->ki_iter.iov = req->ki_iovec;
+	}
+
+	atomic_inc(&mm->mm_users);
+	req->ki_mm = mm;
+	req->ki_cred = get_current_cred();
+	req->ki_opcode = opcode;
+	get_file(req->common.ki_filp);
+
+	INIT_WORK(&req->ki_work, aio_deferred_work);
+	queue_work(aio_wq, &req->ki_work);
+	return -EIOCBQUEUED;
+}
+
+/*
+ * Buffered reads are tried inline against the page cache if the file
+ * supports IOCB_NOWAIT.  Whatever is not cached, and any read from a file
+ * that cannot promise not to block, is finished from aio_wq.
+ */
+static ssize_t aio_read_buffered(struct aio_kiocb *req, unsigned int opcode,
+		struct iov_iter *iter)
+{
+	struct kiocb *kiocb = &req->common;
+	struct file *file = kiocb->ki_filp;
+	ssize_t ret;
+
+	if (!(file->f_mode & FMODE_AIO_NOWAIT))
+		return aio_defer(req, opcode, iter);
+
+	kiocb->ki_flags |= IOCB_NOWAIT;
+	ret = file->f_op->read_iter(kiocb, iter);
+	kiocb->ki_flags &= ~IOCB_NOWAIT;
+
+	/* a short read before EOF means we ran into an uncached page */
+	if (ret == -EAGAIN ||
+	    (ret > 0 && iov_iter_count(iter) &&
+	     kiocb->ki_pos < i_size_read(file->f_mapping->host))) {
+		req->ki_done = max_t(ssize_t, ret, 0);
+		ret = aio_defer(req, opcode, iter);
+		if (ret == -EIOCBQUEUED)
+			return ret;
+	}
+	return aio_ret(kiocb, ret);
+}
+
+static ssize_t aio_read(struct aio_kiocb *req, struct iocb *iocb,
+		bool vectored, bool compat)
+{
+	struct kiocb *kiocb = &req->common;
+	struct file *file = kiocb->ki_filp;
 	struct iovec inline_vecs[UIO_FASTIOV], *iovec = inline_vecs;
 	struct iov_iter iter;
 	ssize_t ret;
@@ -1460,17 +1601,42 @@ static ssize_t aio_read(struct kiocb *req, struct iocb *iocb, bool vectored,
 	ret = aio_setup_rw(READ, iocb, &iovec, vectored, compat, &iter);
 	if (ret)
 		return ret;
-	ret = rw_verify_area(READ, file, &req->ki_pos, iov_iter_count(&iter));
-	if (!ret)
-		ret = aio_ret(req, file->f_op->read_iter(req, &iter));
+	ret = rw_verify_area(READ, file, &kiocb->ki_pos, iov_iter_count(&iter));
+	if (!ret) {
+		if ((kiocb->ki_flags & IOCB_DIRECT) || !aio_may_defer(file))
+			ret = aio_ret(kiocb, file->f_op->read_iter(kiocb, &iter));
+		else
+			ret = aio_read_buffered(req, iocb->aio_lio_opcode,
+						&iter);
+	}
 	kfree(iovec);
 	return ret;
 }
 
-static ssize_t aio_write(struct kiocb *req, struct iocb *iocb, bool vectored,
-		bool compat)
+/* The request may be completed and freed before this returns */
+static ssize_t aio_write_iter(struct aio_kiocb *req, struct iov_iter *iter)
 {
-	struct file *file = req->ki_filp;
+	struct kiocb *kiocb = &req->common;
+	struct file *file = kiocb->ki_filp;
+
+	kiocb->ki_flags |= IOCB_WRITE;
+	file_start_write(file);
+	/*
+	 * We release freeze protection in aio_complete_rw(), which may run
+	 * before ->write_iter() returns.  Fool lockdep by telling it the
+	 * lock got released before the write is issued, so that it doesn't
+	 * complain about held lock when we return to userspace.
+	 */
+	if (S_ISREG(file_inode(file)->i_mode))
+		__sb_writers_release(file_inode(file)->i_sb, SB_FREEZE_WRITE);
+	return aio_ret(kiocb, file->f_op->write_iter(kiocb, iter));
+}
+
+static ssize_t aio_write(struct aio_kiocb *req, struct iocb *iocb,
+		bool vectored, bool compat)
+{
+	struct kiocb *kiocb = &req->common;
+	struct file *file = kiocb->ki_filp;
 	struct iovec inline_vecs[UIO_FASTIOV], *iovec = inline_vecs;
 	struct iov_iter iter;
 	ssize_t ret;
@@ -1483,23 +1649,259 @@ static ssize_t aio_write(struct kiocb *req, struct iocb *iocb, bool vectored,
 	ret = aio_setup_rw(WRITE, iocb, &iovec, vectored, compat, &iter);
 	if (ret)
 		return ret;
-	ret = rw_verify_area(WRITE, file, &req->ki_pos, iov_iter_count(&iter));
+	ret = rw_verify_area(WRITE, file, &kiocb->ki_pos, iov_iter_count(&iter));
 	if (!ret) {
-		req->ki_flags |= IOCB_WRITE;
-		file_start_write(file);
-		ret = aio_ret(req, file->f_op->write_iter(req, &iter));
 		/*
-		 * We release freeze protection in aio_complete().  Fool lockdep
-		 * by telling it the lock got released so that it doesn't
-		 * complain about held lock when we return to userspace.
+		 * Buffered writes can block on page allocation and writeback.
+		 * aio_wq doesn't run with the submitter's RLIMIT_FSIZE though,
+		 * so a write that may run into it is issued from here.
 		 */
-		if (S_ISREG(file_inode(file)->i_mode))
-			__sb_writers_release(file_inode(file)->i_sb, SB_FREEZE_WRITE);
+		if (!(kiocb->ki_flags & IOCB_DIRECT) && aio_may_defer(file) &&
+		    rw_fsize_may_defer(kiocb, iov_iter_count(&iter)))
+			ret = aio_defer(req, iocb->aio_lio_opcode, &iter);
+		else
+			ret = aio_write_iter(req, &iter);
 	}
 	kfree(iovec);
 	return ret;
 }
 
+static ssize_t aio_fsync(struct aio_kiocb *req, struct iocb *iocb)
+{
+	/* reject fields that are not defined for fsync */
+	if (unlikely(iocb->aio_buf || iocb->aio_offset || iocb->aio_nbytes))
+		return -EINVAL;
+	if (unlikely(!req->common.ki_filp->f_op->fsync))
+		return -EINVAL;
+
+	return aio_defer(req, iocb->aio_lio_opcode, NULL);
+}
+
+static void aio_deferred_work(struct work_struct *work)
+{
+	struct aio_kiocb *req = container_of(work, struct aio_kiocb, ki_work);
+	struct kiocb *kiocb = &req->common;
+	struct file *file = kiocb->ki_filp;
+	struct mm_struct *mm = req->ki_mm;
+	const struct cred *old_cred;
+	mm_segment_t oldfs = get_fs();
+
+	old_cred = override_creds(req->ki_cred);
+	set_fs(USER_DS);
+	use_mm(mm);
+
+	/* each case may complete and free the request */
+	switch (req->ki_opcode) {
+	case IOCB_CMD_PREAD:
+	case IOCB_CMD_PREADV:
+		aio_ret(kiocb, file->f_op->read_iter(kiocb, &req->ki_iter));
+		break;
+	case IOCB_CMD_PWRITE:
+	case IOCB_CMD_PWRITEV:
+		aio_write_iter(req, &req->ki_iter);
+		break;
+	case IOCB_CMD_FSYNC:
+	case IOCB_CMD_FDSYNC:
+		aio_complete(req, vfs_fsync(file,
+				req->ki_opcode == IOCB_CMD_FDSYNC), 0);
+		break;
+	}
+
+	unuse_mm(mm);
+	set_fs(oldfs);
+	revert_creds(old_cred);
+	mmput(mm);
+	fput(file);
+}
+
+/*
+ * IOCB_CMD_POLL waits on a single wait queue of the file.  A wakeup only
+ * takes the entry off the queue and kicks ki_work, which re-polls and either
+ * completes the request or re-arms it; completing from the wakeup itself is
+ * not safe as aio_complete() may need to signal the very same wait queue
+ * through an eventfd.
+ *
+ * While the request is being armed, ->arming keeps wakeups and cancellation
+ * from queueing ki_work; aio_poll_settle() looks at the outcome under
+ * ctx_lock and the wait queue lock, in that order.
+ *
+ * A POLLFREE wakeup, sent by signalfd before its wait queue goes away,
+ * clears ->head for good and cancels the request.  The head is rcu-safe
+ * until then, as for epoll.
+ */
+struct aio_poll_table {
+	struct poll_table_struct	pt;
+	struct aio_kiocb		*iocb;
+	int				error;
+};
+
+static void aio_poll_queue_proc(struct file *file, wait_queue_head_t *head,
+		struct poll_table_struct *p)
+{
+	struct aio_poll_table *pt = container_of(p, struct aio_poll_table, pt);
+
+	/* multiple wait queues per file are not supported */
+	if (unlikely(pt->iocb->poll.head)) {
+		pt->error = -EINVAL;
+		return;
+	}
+
+	pt->error = 0;
+	pt->iocb->poll.head = head;
+	add_wait_queue(head, &pt->iocb->poll.wait);
+}
+
+static int aio_poll_wake(wait_queue_t *wait, unsigned mode, int sync,
+		void *key)
+{
+	struct poll_iocb *req = container_of(wait, struct poll_iocb, wait);
+	struct aio_kiocb *iocb = container_of(req, struct aio_kiocb, poll);
+	unsigned long mask = (unsigned long)key;
+
+	if (mask & POLLFREE) {
+		req->cancelled = true;
+		list_del_init(&req->wait.task_list);
+		smp_store_release(&req->head, NULL);
+		req->woken = true;
+		if (!req->arming)
+			queue_work(aio_wq, &iocb->ki_work);
+		return 1;
+	}
+
+	/* for instances that support it check for an event match first */
+	if (mask && !(mask & req->events))
+		return 0;
+
+	list_del_init(&req->wait.task_list);
+	req->woken = true;
+	if (!req->arming)
+		queue_work(aio_wq, &iocb->ki_work);
+	return 1;
+}
+
+/* called from kiocb_cancel() with ctx_lock held and irqs disabled */
+static int aio_poll_cancel(struct kiocb *kiocb)
+{
+	struct aio_kiocb *iocb = container_of(kiocb, struct aio_kiocb, common);
+	struct poll_iocb *req = &iocb->poll;
+	wait_queue_head_t *head;
+
+	rcu_read_lock();
+	head = smp_load_acquire(&req->head);
+	if (head) {
+		spin_lock(&head->lock);
+		req->cancelled = true;
+		if (!req->arming && !list_empty(&req->wait.task_list)) {
+			list_del_init(&req->wait.task_list);
+			queue_work(aio_wq, &iocb->ki_work);
+		}
+		spin_unlock(&head->lock);
+	}
+	rcu_read_unlock();
+
+	return 0;
+}
+
+/*
+ * Finish arming: returns true if the request is done and must be completed
+ * by the caller, false if it stays queued waiting for an event.
+ */
+static bool aio_poll_settle(struct aio_kiocb *iocb, unsigned int mask,
+		int error)
+{
+	struct poll_iocb *req = &iocb->poll;
+	struct kioctx *ctx = iocb->ki_ctx;
+	wait_queue_head_t *head;
+	bool done = true;
+
+	spin_lock_irq(&ctx->ctx_lock);
+	rcu_read_lock();
+	head = smp_load_acquire(&req->head);
+	if (head)
+		spin_lock(&head->lock);
+	req->arming = false;
+	if (!head || mask || error || req->cancelled) {
+		list_del_init(&req->wait.task_list);
+	} else {
+		done = false;
+		if (!iocb->ki_cancel) {
+			list_add_tail(&iocb->ki_list, &ctx->active_reqs);
+			iocb->ki_cancel = aio_poll_cancel;
+		}
+		/* woken while arming, re-poll from the worker */
+		if (req->woken)
+			queue_work(aio_wq, &iocb->ki_work);
+	}
+	if (head)
+		spin_unlock(&head->lock);
+	rcu_read_unlock();
+	spin_unlock_irq(&ctx->ctx_lock);
+
+	return done;
+}
+
+static void aio_poll_work(struct work_struct *work)
+{
+	struct aio_kiocb *iocb = container_of(work, struct aio_kiocb, ki_work);
+	struct poll_iocb *req = &iocb->poll;
+	struct poll_table_struct pt = { ._key = req->events };
+	unsigned int mask = 0;
+
+	req->woken = false;
+	req->arming = true;
+	/* nothing to re-arm on after POLLFREE, aio_poll_settle() completes */
+	if (req->head)
+		add_wait_queue(req->head, &req->wait);
+
+	if (!READ_ONCE(req->cancelled))
+		mask = req->file->f_op->poll(req->file, &pt) & req->events;
+	if (aio_poll_settle(iocb, mask, 0))
+		aio_complete(iocb, mask, 0);
+}
+
+static int aio_poll(struct aio_kiocb *iocb, struct iocb *user_iocb)
+{
+	struct poll_iocb *req = &iocb->poll;
+	struct aio_poll_table apt;
+	unsigned int mask;
+
+	/* reject any unknown events outside the normal event mask. */
+	if ((u16)user_iocb->aio_buf != user_iocb->aio_buf)
+		return -EINVAL;
+	/* reject fields that are not defined for poll */
+	if (user_iocb->aio_offset || user_iocb->aio_nbytes)
+		return -EINVAL;
+	if (unlikely(!req->file->f_op->poll))
+		return -EINVAL;
+
+	INIT_WORK(&iocb->ki_work, aio_poll_work);
+	req->events = (u16)user_iocb->aio_buf | POLLERR | POLLHUP;
+	req->head = NULL;
+	req->arming = true;
+	req->woken = false;
+	req->cancelled = false;
+
+	apt.pt._qproc = aio_poll_queue_proc;
+	apt.pt._key = req->events;
+	apt.iocb = iocb;
+	apt.error = -EINVAL;	/* ->poll never queued us */
+
+	INIT_LIST_HEAD(&req->wait.task_list);
+	init_waitqueue_func_entry(&req->wait, aio_poll_wake);
+
+	mask = req->file->f_op->poll(req->file, &apt.pt) & req->events;
+	/* ->poll never queued us; after POLLFREE the error is cleared */
+	if (unlikely(!req->head) && apt.error)
+		return apt.error;
+
+	if (aio_poll_settle(iocb, mask, apt.error)) {
+		if (apt.error)
+			return apt.error;
+		aio_complete(iocb, mask, 0);
+	}
+	return 0;
+}
+
 static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 			 struct iocb *iocb, bool compat)
 {
@@ -1533,7 +1935,7 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 		goto out_put_req;
 	}
 	req->common.ki_pos = iocb->aio_offset;
-	req->common.ki_complete = aio_complete;
+	req->common.ki_complete = aio_complete_rw;
 	req->common.ki_flags = iocb_flags(req->common.ki_filp);
 
 	if (iocb->aio_flags & IOCB_FLAG_RESFD) {
@@ -1565,16 +1967,23 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	get_file(file);
 	switch (iocb->aio_lio_opcode) {
 	case IOCB_CMD_PREAD:
-		ret = aio_read(&req->common, iocb, false, compat);
+		ret = aio_read(req, iocb, false, compat);
 		break;
 	case IOCB_CMD_PWRITE:
-		ret = aio_write(&req->common, iocb, false, compat);
+		ret = aio_write(req, iocb, false, compat);
 		break;
 	case IOCB_CMD_PREADV:
-		ret = aio_read(&req->common, iocb, true, compat);
+		ret = aio_read(req, iocb, true, compat);
 		break;
 	case IOCB_CMD_PWRITEV:
-		ret = aio_write(&req->common, iocb, true, compat);
+		ret = aio_write(req, iocb, true, compat);
+		break;
+	case IOCB_CMD_FSYNC:
+	case IOCB_CMD_FDSYNC:
+		ret = aio_fsync(req, iocb);
+		break;
+	case IOCB_CMD_POLL:
+		ret = aio_poll(req, iocb);
 		break;
 	default:
 		pr_debug("invalid aio operation %d\n", iocb->aio_lio_opcode);
@@ -1561,6 +1561,7 @@ static int blkdev_open(struct inode * inode, struct file * filp)
 		filp->f_mode |= FMODE_EXCL;
 	if ((filp->f_flags & O_ACCMODE) == 3)
 		filp->f_mode |= FMODE_WRITE_IOCTL;
+	filp->f_mode |= FMODE_AIO_NOWAIT;
 
 	bdev = bd_acquire(inode);
 	if (bdev == NULL)
@@ -383,6 +383,8 @@ static int ext4_file_open(struct inode * inode, struct file * filp)
 		if (ret < 0)
 			return ret;
 	}
+
+	filp->f_mode |= FMODE_AIO_NOWAIT;
 	return dquot_file_open(inode, filp);
 }
 
@@ -150,6 +150,7 @@ extern struct dentry *d_alloc_cursor(struct dentry *);
  * read_write.c
  */
 extern int rw_verify_area(int, struct file *, const loff_t *, size_t);
+extern bool rw_fsize_may_defer(const struct kiocb *, size_t);
 
 /*
  * pipe.c
@@ -0,0 +1,1925 @@
+/*
+ * Shared application/kernel submission and completion ring pairs, for
+ * supporting fast/efficient IO.
+ *
+ * A note on the read/write ordering memory barriers that are matched between
+ * the application and kernel side. When the application reads the CQ ring
+ * tail, it must use an appropriate smp_rmb() to order with the smp_wmb()
+ * the kernel uses after writing the tail. Failure to do so could cause a
+ * delay in when the application notices that completion events available.
+ * This isn't a fatal condition. Likewise, the application must use an
+ * appropriate smp_wmb() both before writing the SQ tail, and after writing
+ * the SQ tail. The first one orders the sqe writes with the tail write, and
+ * the latter is paired with the smp_rmb() the kernel will issue before
+ * reading the SQ tail on submission.
+ *
+ * Also see the examples in tools/io_uring/ for how to use the interface
+ * from userspace.
+ *
+ * Requests that cannot be completed without blocking are handed off to a
+ * per-ring workqueue: buffered reads and writes and fsync always are, while
+ * O_DIRECT reads and writes are issued asynchronously from the submitting
+ * context. Socket operations are attempted non-blocking first, and if they
+ * would block they wait for readiness on the socket's wait queue and are
+ * retried from the workqueue once it signals.
+ *
+ * With IORING_SETUP_SQPOLL a kernel thread polls the SQ ring for new
+ * entries, so an application that keeps it busy can submit and reap IO
+ * without entering the kernel at all.
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/errno.h>
+#include <linux/syscalls.h>
+#include <linux/uio.h>
+
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/fdtable.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/mmu_context.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/kthread.h>
+#include <linux/net.h>
+#include <linux/poll.h>
+#include <linux/anon_inodes.h>
+#include <linux/uaccess.h>
+#include <linux/percpu-refcount.h>
+#include <net/sock.h>
+
+#include <uapi/linux/io_uring.h>
+
+#include "internal.h"
+
+#define IORING_MAX_ENTRIES	4096
+#define IORING_MAX_FIXED_FILES	1024
+
+struct io_uring {
+	u32 head ____cacheline_aligned_in_smp;
+	u32 tail ____cacheline_aligned_in_smp;
+};
+
+struct io_sq_ring {
+	struct io_uring		r;
+	u32			ring_mask;
+	u32			ring_entries;
+	u32			dropped;
+	u32			flags;
+	u32			array[];
+};
+
+struct io_cq_ring {
+	struct io_uring		r;
+	u32			ring_mask;
+	u32			ring_entries;
+	u32			overflow;
+	struct io_uring_cqe	cqes[];
+};
+
+struct io_ring_ctx {
+	struct {
+		struct percpu_ref	refs;
+	} ____cacheline_aligned_in_smp;
+
+	struct {
+		unsigned int		flags;
+		bool			account_mem;
+
+		/* SQ ring */
+		struct io_sq_ring	*sq_ring;
+		unsigned		cached_sq_head;
+		unsigned		sq_entries;
+		unsigned		sq_mask;
+		unsigned		sq_thread_idle;
+		struct io_uring_sqe	*sq_sqes;
+	} ____cacheline_aligned_in_smp;
+
+	/* IO offload */
+	struct workqueue_struct	*sqo_wq;
+	struct task_struct	*sqo_thread;	/* if using sq thread polling */
+	struct mm_struct	*sqo_mm;
+	wait_queue_head_t	sqo_wait;
+
+	struct {
+		/* CQ ring */
+		struct io_cq_ring	*cq_ring;
+		unsigned		cached_cq_tail;
+		unsigned		cq_entries;
+		unsigned		cq_mask;
+		wait_queue_head_t	cq_wait;
+	} ____cacheline_aligned_in_smp;
+
+	/*
+	 * If used, fixed file set. Only updated through io_uring_register(2),
+	 * both that and submission look it up under ->uring_lock.
+	 */
+	struct file		**user_files;
+	unsigned		nr_user_files;
+
+	struct user_struct	*user;
+	const struct cred	*creds;
+
+	struct completion	ctx_done;
+
+	struct {
+		struct mutex		uring_lock;
+		wait_queue_head_t	wait;
+	} ____cacheline_aligned_in_smp;
+
+	struct {
+		spinlock_t		completion_lock;
+		/*
+		 * ->cancel_list holds requests waiting on a file's wait
+		 * queue, i.e. poll commands and socket operations waiting
+		 * for readiness. ->inflight_list holds requests that use the
+		 * submitter's files_struct, which io_uring_flush() waits for.
+		 */
+		struct list_head	cancel_list;
+		struct list_head	inflight_list;
+		wait_queue_head_t	inflight_wait;
+	} ____cacheline_aligned_in_smp;
+};
+
+/*
+ * First field must be the file pointer in all the
+ * iocb unions! See also 'struct kiocb' in <linux/fs.h>
+ */
+struct io_poll_iocb {
+	struct file			*file;
+	wait_queue_head_t		*head;
+	__u32				events;
+	bool				arming;
+	wait_queue_t			wait;
+};
+
+/*
+ * NOTE! Each of the iocb union members has the file pointer
+ * as the first entry in their struct definition. So you can
+ * access the file pointer through any of the sub-structs,
+ * or directly as just 'ki_filp' in this struct.
+ */
+struct io_kiocb {
+	union {
+		struct file		*file;
+		struct kiocb		rw;
+		struct io_poll_iocb	poll;
+	};
+
+	struct io_uring_sqe	sqe;
+	struct io_ring_ctx	*ctx;
+	struct list_head	list;
+	struct list_head	inflight_entry;
+	struct files_struct	*files;
+	bool			canceled;
+	u64			user_data;
+
+	struct work_struct	work;
+};
+
+struct io_poll_table {
+	struct poll_table_struct pt;
+	struct io_kiocb *req;
+	int error;
+};
+
+static struct kmem_cache *req_cachep;
+
+static const struct file_operations io_uring_fops;
+
+static void io_ring_ctx_ref_free(struct percpu_ref *ref)
+{
+	struct io_ring_ctx *ctx = container_of(ref, struct io_ring_ctx, refs);
+
+	complete(&ctx->ctx_done);
+}
+
+static struct io_ring_ctx *io_ring_ctx_alloc(struct io_uring_params *p)
+{
+	struct io_ring_ctx *ctx;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return NULL;
+
+	if (percpu_ref_init(&ctx->refs, io_ring_ctx_ref_free, 0, GFP_KERNEL)) {
+		kfree(ctx);
+		return NULL;
+	}
+
+	ctx->flags = p->flags;
+	init_waitqueue_head(&ctx->sqo_wait);
+	init_waitqueue_head(&ctx->cq_wait);
+	init_completion(&ctx->ctx_done);
+	mutex_init(&ctx->uring_lock);
+	init_waitqueue_head(&ctx->wait);
+	spin_lock_init(&ctx->completion_lock);
+	INIT_LIST_HEAD(&ctx->cancel_list);
+	INIT_LIST_HEAD(&ctx->inflight_list);
+	init_waitqueue_head(&ctx->inflight_wait);
+	return ctx;
+}
+
+static void io_commit_cqring(struct io_ring_ctx *ctx)
+{
+	struct io_cq_ring *ring = ctx->cq_ring;
+
+	if (ctx->cached_cq_tail != READ_ONCE(ring->r.tail)) {
+		/* order cqe stores with ring update */
+		smp_store_release(&ring->r.tail, ctx->cached_cq_tail);
+
+		/*
+		 * Write side barrier of tail update, app has read side. See
+		 * comment at the top of this file.
+		 */
+		smp_wmb();
+
+		if (wq_has_sleeper(&ctx->cq_wait))
+			wake_up_interruptible(&ctx->cq_wait);
+	}
+}
+
+static struct io_uring_cqe *io_get_cqring(struct io_ring_ctx *ctx)
+{
+	struct io_cq_ring *ring = ctx->cq_ring;
+	unsigned tail;
+
+	tail = ctx->cached_cq_tail;
+	/* See comment at the top of the file */
+	smp_rmb();
+	if (tail - READ_ONCE(ring->r.head) == ring->ring_entries)
+		return NULL;
+
+	ctx->cached_cq_tail++;
+	return &ring->cqes[tail & ctx->cq_mask];
+}
+
+static void io_cqring_fill_event(struct io_ring_ctx *ctx, u64 ki_user_data,
+				 long res)
+{
+	struct io_uring_cqe *cqe;
+
+	/*
+	 * If we can't get a cq entry, userspace overflowed the
+	 * submission (by quite a lot). Increment the overflow count in
+	 * the ring.
+	 */
+	cqe = io_get_cqring(ctx);
+	if (cqe) {
+		WRITE_ONCE(cqe->user_data, ki_user_data);
+		WRITE_ONCE(cqe->res, res);
+		WRITE_ONCE(cqe->flags, 0);
+	} else {
+		unsigned overflow = READ_ONCE(ctx->cq_ring->overflow);
+
+		WRITE_ONCE(ctx->cq_ring->overflow, overflow + 1);
+	}
+}
+
+static void io_cqring_ev_posted(struct io_ring_ctx *ctx)
+{
+	if (wq_has_sleeper(&ctx->wait))
+		wake_up(&ctx->wait);
+}
+
+static void io_cqring_add_event(struct io_ring_ctx *ctx, u64 user_data,
+				long res)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ctx->completion_lock, flags);
+	io_cqring_fill_event(ctx, user_data, res);
+	io_commit_cqring(ctx);
+	spin_unlock_irqrestore(&ctx->completion_lock, flags);
+
+	io_cqring_ev_posted(ctx);
+}
+
+static struct io_kiocb *io_get_req(struct io_ring_ctx *ctx)
+{
+	struct io_kiocb *req;
+
+	if (!percpu_ref_tryget(&ctx->refs))
+		return NULL;
+
+	req = kmem_cache_alloc(req_cachep, GFP_KERNEL);
+	if (unlikely(!req)) {
+		percpu_ref_put(&ctx->refs);
+		return NULL;
+	}
+
+	req->ctx = ctx;
+	req->file = NULL;
+	req->files = NULL;
+	req->canceled = false;
+	INIT_LIST_HEAD(&req->list);
+	return req;
+}
+
+static void io_free_req(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+
+	if (req->file)
+		fput(req->file);
+	if (req->files) {
+		unsigned long flags;
+
+		spin_lock_irqsave(&ctx->completion_lock, flags);
+		list_del(&req->inflight_entry);
+		spin_unlock_irqrestore(&ctx->completion_lock, flags);
+		wake_up(&ctx->inflight_wait);
+	}
+	kmem_cache_free(req_cachep, req);
+	percpu_ref_put(&ctx->refs);
+}
+
+static void io_complete_req(struct io_kiocb *req, long res)
+{
+	io_cqring_add_event(req->ctx, req->user_data, res);
+	io_free_req(req);
+}
+
+static void io_complete_rw(struct kiocb *kiocb, long res, long res2)
+{
+	struct io_kiocb *req = container_of(kiocb, struct io_kiocb, rw);
+
+	if (kiocb->ki_flags & IOCB_WRITE) {
+		struct file *file = kiocb->ki_filp;
+
+		/*
+		 * Tell lockdep we inherited freeze protection from submission
+		 * thread.
+		 */
+		if (!is_sync_kiocb(kiocb) && S_ISREG(file_inode(file)->i_mode))
+			__sb_writers_acquired(file_inode(file)->i_sb, SB_FREEZE_WRITE);
+		file_end_write(file);
+	}
+
+	io_complete_req(req, res);
+}
+
+static int io_prep_rw(struct io_kiocb *req, bool force_nonblock)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	struct kiocb *kiocb = &req->rw;
+	unsigned int rw_flags = sqe->rw_flags;
+
+	if (sqe->ioprio)
+		return -EINVAL;
+	if (rw_flags & ~(RWF_HIPRI | RWF_DSYNC | RWF_SYNC))
+		return -EOPNOTSUPP;
+
+	kiocb->ki_pos = sqe->off;
+	kiocb->ki_flags = iocb_flags(kiocb->ki_filp);
+	if (rw_flags & RWF_HIPRI)
+		kiocb->ki_flags |= IOCB_HIPRI;
+	if (rw_flags & RWF_DSYNC)
+		kiocb->ki_flags |= IOCB_DSYNC;
+	if (rw_flags & RWF_SYNC)
+		kiocb->ki_flags |= (IOCB_DSYNC | IOCB_SYNC);
+
+	/*
+	 * Only O_DIRECT can be issued asynchronously from the submitter,
+	 * anything going through the page cache may block on reads or
+	 * writeback and is left to the workqueue, which issues it as a
+	 * plain synchronous kiocb.
+	 */
+	if (kiocb->ki_flags & IOCB_DIRECT) {
+		kiocb->ki_complete = io_complete_rw;
+	} else {
+		if (force_nonblock)
+			return -EAGAIN;
+		kiocb->ki_complete = NULL;
+	}
+	return 0;
+}
+
+static inline void io_rw_done(struct kiocb *kiocb, ssize_t ret)
+{
+	switch (ret) {
+	case -EIOCBQUEUED:
+		break;
+	case -ERESTARTSYS:
+	case -ERESTARTNOINTR:
+	case -ERESTARTNOHAND:
+	case -ERESTART_RESTARTBLOCK:
+		/*
+		 * We can't just restart the syscall, since previously
+		 * submitted sqes may already be in progress. Just fail this
+		 * IO with EINTR.
+		 */
+		ret = -EINTR;
+		/* fall through */
+	default:
+		io_complete_rw(kiocb, ret, 0);
+	}
+}
+
+static int io_import_iovec(struct io_kiocb *req, int rw,
+			   struct iovec **iovec, struct iov_iter *iter)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	void __user *buf = u64_to_user_ptr(sqe->addr);
+
+	return import_iovec(rw, buf, sqe->len, UIO_FASTIOV, iovec, iter);
+}
+
+static int io_read(struct io_kiocb *req, bool force_nonblock)
+{
+	struct iovec inline_vecs[UIO_FASTIOV], *iovec = inline_vecs;
+	struct kiocb *kiocb = &req->rw;
+	struct file *file = kiocb->ki_filp;
+	struct iov_iter iter;
+	ssize_t ret;
+
+	if (unlikely(!(file->f_mode & FMODE_READ)))
+		return -EBADF;
+	if (unlikely(!file->f_op->read_iter))
+		return -EINVAL;
+
+	ret = io_prep_rw(req, force_nonblock);
+	if (ret)
+		return ret;
+
+	ret = io_import_iovec(req, READ, &iovec, &iter);
+	if (ret)
+		return ret;
+
+	ret = rw_verify_area(READ, file, &kiocb->ki_pos, iov_iter_count(&iter));
+	if (!ret) {
+		/*
+		 * An O_DIRECT read may complete, and free the request along
+		 * with its file reference, before ->read_iter() returns.
+		 */
+		get_file(file);
+		io_rw_done(kiocb, file->f_op->read_iter(kiocb, &iter));
+		fput(file);
+	}
+	kfree(iovec);
+	return ret;
+}
+
+static int io_write(struct io_kiocb *req, bool force_nonblock)
+{
+	struct iovec inline_vecs[UIO_FASTIOV], *iovec = inline_vecs;
+	struct kiocb *kiocb = &req->rw;
+	struct file *file = kiocb->ki_filp;
+	struct iov_iter iter;
+	bool async;
+	ssize_t ret;
+
+	if (unlikely(!(file->f_mode & FMODE_WRITE)))
+		return -EBADF;
+	if (unlikely(!file->f_op->write_iter))
+		return -EINVAL;
+
+	/* whether a buffered write may be deferred depends on its size */
+	ret = io_prep_rw(req, false);
+	if (ret)
+		return ret;
+
+	ret = io_import_iovec(req, WRITE, &iovec, &iter);
+	if (ret)
+		return ret;
+
+	/*
+	 * Buffered writes are left to the workqueue like reads, see
+	 * io_prep_rw(). The workqueue doesn't run with the submitter's
+	 * RLIMIT_FSIZE though, so a write that may run into it is issued
+	 * here, blocking or not.
+	 */
+	if (force_nonblock && !(kiocb->ki_flags & IOCB_DIRECT) &&
+	    rw_fsize_may_defer(kiocb, iov_iter_count(&iter))) {
+		kfree(iovec);
+		return -EAGAIN;
+	}
+
+	ret = rw_verify_area(WRITE, file, &kiocb->ki_pos, iov_iter_count(&iter));
+	if (!ret) {
+		async = !is_sync_kiocb(kiocb);
+
+		kiocb->ki_flags |= IOCB_WRITE;
+		file_start_write(file);
+		/*
+		 * We release freeze protection in io_complete_rw(), which may
+		 * run before ->write_iter() returns. Fool lockdep by telling
+		 * it the lock got released before the write is issued, so
+		 * that it doesn't complain about held lock when we return to
+		 * userspace.
+		 */
+		if (async && S_ISREG(file_inode(file)->i_mode))
+			__sb_writers_release(file_inode(file)->i_sb, SB_FREEZE_WRITE);
+		/* see io_read(), the request may be gone before we return */
+		get_file(file);
+		io_rw_done(kiocb, file->f_op->write_iter(kiocb, &iter));
+		fput(file);
+	}
+	kfree(iovec);
+	return ret;
+}
+
+static int io_nop(struct io_kiocb *req)
+{
+	io_complete_req(req, 0);
+	return 0;
+}
+
+static int io_fsync(struct io_kiocb *req, bool force_nonblock)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	loff_t sqe_off = sqe->off;
+	loff_t sqe_len = sqe->len;
+	unsigned int fsync_flags;
+	int ret;
+
+	if (sqe->addr || sqe->ioprio)
+		return -EINVAL;
+
+	fsync_flags = sqe->fsync_flags;
+	if (unlikely(fsync_flags & ~IORING_FSYNC_DATASYNC))
+		return -EINVAL;
+
+	/* fsync always requires a blocking context */
+	if (force_nonblock)
+		return -EAGAIN;
+
+	ret = vfs_fsync_range(req->file, sqe_off,
+			      sqe_len ? sqe_off + sqe_len - 1 : LLONG_MAX,
+			      fsync_flags & IORING_FSYNC_DATASYNC);
+	io_complete_req(req, ret);
+	return 0;
+}
+
+/*
+ * A request is cancelled when the ring is going away, or when the
+ * files_struct it was submitted from is being flushed. Must be called
+ * with ->completion_lock held.
+ */
+static bool io_req_canceled(struct io_ring_ctx *ctx, struct io_kiocb *req)
+{
+	return req->canceled || percpu_ref_is_dying(&ctx->refs);
+}
+
+/*
+ * Must be called with ->completion_lock held. If the request is still on
+ * the file's wait queue, the work item is queued to complete it.
+ */
+static void io_poll_remove_one(struct io_kiocb *req)
+{
+	struct io_poll_iocb *poll = &req->poll;
+	wait_queue_head_t *head;
+
+	req->canceled = true;
+	rcu_read_lock();
+	/*
+	 * A POLLFREE wakeup clears ->head and queues the work itself, see
+	 * io_poll_wake(). The head is rcu-safe until then.
+	 */
+	head = smp_load_acquire(&poll->head);
+	if (head) {
+		spin_lock(&head->lock);
+		if (!list_empty(&poll->wait.task_list)) {
+			list_del_init(&poll->wait.task_list);
+			queue_work(req->ctx->sqo_wq, &req->work);
+		}
+		spin_unlock(&head->lock);
+	}
+	rcu_read_unlock();
+
+	list_del_init(&req->list);
+}
+
+static void io_poll_remove_all(struct io_ring_ctx *ctx)
+{
+	struct io_kiocb *req;
+
+	spin_lock_irq(&ctx->completion_lock);
+	while (!list_empty(&ctx->cancel_list)) {
+		req = list_first_entry(&ctx->cancel_list, struct io_kiocb, list);
+		io_poll_remove_one(req);
+	}
+	spin_unlock_irq(&ctx->completion_lock);
+}
+
+/*
+ * Find a running poll command that matches one specified in sqe->addr,
+ * and remove it if found.
+ */
+static int io_poll_remove(struct io_ring_ctx *ctx, struct io_kiocb *req)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	struct io_kiocb *poll_req, *next;
+	int ret = -ENOENT;
+
+	if (sqe->ioprio || sqe->off || sqe->len)
+		return -EINVAL;
+
+	spin_lock_irq(&ctx->completion_lock);
+	list_for_each_entry_safe(poll_req, next, &ctx->cancel_list, list) {
+		if (poll_req->sqe.opcode == IORING_OP_POLL_ADD &&
+		    sqe->addr == poll_req->user_data) {
+			io_poll_remove_one(poll_req);
+			ret = 0;
+			break;
+		}
+	}
+	spin_unlock_irq(&ctx->completion_lock);
+
+	io_complete_req(req, ret);
+	return 0;
+}
+
+static void io_poll_complete_work(struct work_struct *work)
+{
+	struct io_kiocb *req = container_of(work, struct io_kiocb, work);
+	struct io_poll_iocb *poll = &req->poll;
+	struct poll_table_struct pt = { ._key = poll->events };
+	struct io_ring_ctx *ctx = req->ctx;
+	unsigned int mask = 0;
+	long res;
+
+	if (!READ_ONCE(req->canceled))
+		mask = poll->file->f_op->poll(poll->file, &pt) & poll->events;
+
+	/*
+	 * Note that ->canceled may be set from io_poll_remove_one() while we
+	 * were polling, hence the re-check under ->completion_lock. It is
+	 * also set when a POLLFREE wakeup took the wait queue away.
+	 */
+	spin_lock_irq(&ctx->completion_lock);
+	if (!mask && !io_req_canceled(ctx, req) && poll->head) {
+		add_wait_queue(poll->head, &poll->wait);
+		if (list_empty(&req->list))
+			list_add_tail(&req->list, &ctx->cancel_list);
+		spin_unlock_irq(&ctx->completion_lock);
+		return;
+	}
+	list_del_init(&req->list);
+	res = mask ? mask : -ECANCELED;
+	io_cqring_fill_event(ctx, req->user_data, res);
+	io_commit_cqring(ctx);
+	spin_unlock_irq(&ctx->completion_lock);
+
+	io_cqring_ev_posted(ctx);
+	io_free_req(req);
+}
+
+static int io_poll_wake(wait_queue_t *wait, unsigned mode, int sync,
+			void *key)
+{
+	struct io_poll_iocb *poll = container_of(wait, struct io_poll_iocb,
+						 wait);
+	struct io_kiocb *req = container_of(poll, struct io_kiocb, poll);
+	unsigned long mask = (unsigned long) key;
+
+	/*
+	 * The wait queue is about to be freed, as signalfd does on exit.
+	 * Never re-arm on it, the request is completed as canceled.
+	 */
+	if (mask & POLLFREE) {
+		WRITE_ONCE(req->canceled, true);
+		list_del_init(&poll->wait.task_list);
+		smp_store_release(&poll->head, NULL);
+		if (!poll->arming)
+			queue_work(req->ctx->sqo_wq, &req->work);
+		return 1;
+	}
+
+	/* for instances that support it check for an event match first: */
+	if (mask && !(mask & poll->events))
+		return 0;
+
+	list_del_init(&poll->wait.task_list);
+	/* io_poll_arm() queues the work itself once it's done with us */
+	if (!poll->arming)
+		queue_work(req->ctx->sqo_wq, &req->work);
+	return 1;
+}
+
+static void io_poll_queue_proc(struct file *file, wait_queue_head_t *head,
+			       struct poll_table_struct *p)
+{
+	struct io_poll_table *pt = container_of(p, struct io_poll_table, pt);
+
+	if (unlikely(pt->req->poll.head)) {
+		pt->error = -EINVAL;
+		return;
+	}
+
+	pt->error = 0;
+	pt->req->poll.head = head;
+	add_wait_queue(head, &pt->req->poll.wait);
+}
+
+/*
+ * Wait for @events on the request's file. Returns the ready mask if the
+ * file is ready already, in which case nothing has been armed; 0 if the
+ * request is now waiting and req->work will run once the file signals;
+ * or a negative error.
+ */
+static int io_poll_arm(struct io_ring_ctx *ctx, struct io_kiocb *req,
+		       unsigned int events)
+{
+	struct io_poll_iocb *poll = &req->poll;
+	struct file *file = poll->file;
+	struct io_poll_table ipt;
+	wait_queue_head_t *head;
+	bool canceled = false;
+	unsigned int mask;
+	int ret;
+
+	if (!file->f_op->poll)
+		return -EOPNOTSUPP;
+
+	poll->head = NULL;
+	poll->events = events | POLLERR | POLLHUP;
+	poll->arming = true;
+
+	ipt.pt._qproc = io_poll_queue_proc;
+	ipt.pt._key = poll->events;
+	ipt.req = req;
+	ipt.error = -EINVAL; /* same as no support for poll */
+
+	/* initialized the list so that we can do list_empty checks */
+	INIT_LIST_HEAD(&poll->wait.task_list);
+	init_waitqueue_func_entry(&poll->wait, io_poll_wake);
+
+	mask = file->f_op->poll(file, &ipt.pt) & poll->events;
+
+	spin_lock_irq(&ctx->completion_lock);
+	rcu_read_lock();
+	head = smp_load_acquire(&poll->head);
+	if (likely(head)) {
+		spin_lock(&head->lock);
+		poll->arming = false;
+		if (unlikely(list_empty(&poll->wait.task_list))) {
+			/*
+			 * Woken up before we got here. The work item takes
+			 * ->completion_lock first thing, so it can't run
+			 * until we're done looking at the request.
+			 */
+			queue_work(ctx->sqo_wq, &req->work);
+			spin_unlock(&head->lock);
+			rcu_read_unlock();
+			spin_unlock_irq(&ctx->completion_lock);
+			return 0;
+		}
+		canceled = io_req_canceled(ctx, req);
+		if (mask || ipt.error || canceled)
+			list_del_init(&poll->wait.task_list);
+		else
+			list_add_tail(&req->list, &ctx->cancel_list);
+		spin_unlock(&head->lock);
+	} else {
+		/* never queued, or a POLLFREE wakeup took us off again */
+		poll->arming = false;
+		canceled = io_req_canceled(ctx, req);
+	}
+	rcu_read_unlock();
+	spin_unlock_irq(&ctx->completion_lock);
+
+	if (mask)
+		ret = mask;
+	else if (ipt.error)
+		ret = ipt.error;
+	else if (canceled)
+		ret = -ECANCELED;
+	else
+		ret = 0;
+	return ret;
+}
+
+static int io_poll_add(struct io_ring_ctx *ctx, struct io_kiocb *req)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	int ret;
+
+	if (sqe->addr || sqe->ioprio || sqe->off || sqe->len)
+		return -EINVAL;
+
+	ret = io_poll_arm(ctx, req, sqe->poll_events);
+	if (ret > 0) {
+		io_complete_req(req, ret);
+		return 0;
+	}
+	return ret;
+}
+
+static int __io_sock_op(struct io_kiocb *req, struct socket *sock)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	unsigned int flags = sqe->msg_flags | MSG_DONTWAIT;
+	struct msghdr msg;
+	struct iovec iov;
+	int ret;
+
+	switch (sqe->opcode) {
+	case IORING_OP_SENDMSG:
+		return __sys_sendmsg_sock(sock, u64_to_user_ptr(sqe->addr),
+					  flags);
+	case IORING_OP_RECVMSG:
+		return __sys_recvmsg_sock(sock, u64_to_user_ptr(sqe->addr),
+					  flags);
+	case IORING_OP_ACCEPT:
+		return __sys_accept4_file(req->file,
+					  req->file->f_flags | O_NONBLOCK,
+					  u64_to_user_ptr(sqe->addr),
+					  u64_to_user_ptr(sqe->addr2),
+					  sqe->accept_flags);
+	}
+
+	ret = import_single_range(sqe->opcode == IORING_OP_SEND ? WRITE : READ,
+				  u64_to_user_ptr(sqe->addr), sqe->len, &iov,
+				  &msg.msg_iter);
+	if (unlikely(ret))
+		return ret;
+
+	msg.msg_name = NULL;
+	msg.msg_namelen = 0;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
+	msg.msg_iocb = NULL;
+	msg.msg_flags = flags;
+
+	if (sqe->opcode == IORING_OP_SEND)
+		return sock_sendmsg(sock, &msg);
+	return sock_recvmsg(sock, &msg, flags);
+}
+
+/*
+ * Socket operations never block the issuing context. They are tried
+ * non-blocking, and if that would block they wait for readiness on the
+ * socket and are issued again from the workqueue, unless the application
+ * asked for non-blocking semantics itself.
+ */
+static int io_sock_issue(struct io_ring_ctx *ctx, struct io_kiocb *req)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	unsigned int events = POLLIN;
+	struct socket *sock;
+	bool nonblock;
+	int ret;
+
+	if (sqe->ioprio)
+		return -EINVAL;
+
+	sock = sock_from_file(req->file, &ret);
+	if (!sock)
+		return ret;
+
+	switch (sqe->opcode) {
+	case IORING_OP_SENDMSG:
+	case IORING_OP_SEND:
+		events = POLLOUT;
+		/* fall through */
+	case IORING_OP_RECVMSG:
+	case IORING_OP_RECV:
+		if (sqe->msg_flags & MSG_CMSG_COMPAT)
+			return -EINVAL;
+		nonblock = sqe->msg_flags & MSG_DONTWAIT;
+		break;
+	default:
+		nonblock = false;
+		break;
+	}
+	nonblock |= req->file->f_flags & O_NONBLOCK;
+
+	for (;;) {
+		ret = __io_sock_op(req, sock);
+		if (ret != -EAGAIN || nonblock)
+			break;
+
+		ret = io_poll_arm(ctx, req, events);
+		if (!ret)
+			return 0;
+		if (ret < 0)
+			break;
+	}
+
+	io_complete_req(req, ret);
+	return 0;
+}
+
+/*
+ * Returns 0 once the request has been completed or handed off, -EAGAIN if
+ * it must be retried from a context that is allowed to block, or another
+ * error if it could not be issued at all.
+ */
+static int __io_submit_sqe(struct io_ring_ctx *ctx, struct io_kiocb *req,
+			   bool force_nonblock)
+{
+	switch (req->sqe.opcode) {
+	case IORING_OP_NOP:
+		return io_nop(req);
+	case IORING_OP_READV:
+		return io_read(req, force_nonblock);
+	case IORING_OP_WRITEV:
+		return io_write(req, force_nonblock);
+	case IORING_OP_FSYNC:
+		return io_fsync(req, force_nonblock);
+	case IORING_OP_POLL_ADD:
+		return io_poll_add(ctx, req);
+	case IORING_OP_POLL_REMOVE:
+		return io_poll_remove(ctx, req);
+	case IORING_OP_SENDMSG:
+	case IORING_OP_RECVMSG:
+	case IORING_OP_SEND:
+	case IORING_OP_RECV:
+	case IORING_OP_ACCEPT:
+		return io_sock_issue(ctx, req);
+	default:
+		return -EINVAL;
+	}
+}
+
+static void io_sq_wq_submit_work(struct work_struct *work)
+{
+	struct io_kiocb *req = container_of(work, struct io_kiocb, work);
+	struct io_ring_ctx *ctx = req->ctx;
+	struct files_struct *files = req->files;
+	struct files_struct *old_files = NULL;
+	const struct cred *old_cred;
+	mm_segment_t old_fs;
+	bool canceled;
+	int ret;
+
+	/* we may be here because a socket we were waiting on signalled */
+	spin_lock_irq(&ctx->completion_lock);
+	list_del_init(&req->list);
+	canceled = req->canceled;
+	spin_unlock_irq(&ctx->completion_lock);
+
+	if (canceled) {
+		ret = -ECANCELED;
+		goto err;
+	}
+	if (!mmget_not_zero(ctx->sqo_mm)) {
+		ret = -EFAULT;
+		goto err;
+	}
+
+	old_cred = override_creds(ctx->creds);
+	old_fs = get_fs();
+	set_fs(USER_DS);
+	use_mm(ctx->sqo_mm);
+	if (files) {
+		task_lock(current);
+		old_files = current->files;
+		current->files = files;
+		task_unlock(current);
+	}
+
+	/* req may be gone once this returns 0 */
+	ret = __io_submit_sqe(ctx, req, false);
+
+	if (files) {
+		task_lock(current);
+		current->files = old_files;
+		task_unlock(current);
+	}
+	unuse_mm(ctx->sqo_mm);
+	set_fs(old_fs);
+	mmput(ctx->sqo_mm);
+	revert_creds(old_cred);
+
+	if (!ret)
+		return;
+err:
+	io_complete_req(req, ret);
+}
+
+static int io_req_set_file(struct io_ring_ctx *ctx, struct io_kiocb *req)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	int fd = sqe->fd;
+
+	if (sqe->flags & IOSQE_FIXED_FILE) {
+		if (unlikely(!ctx->user_files ||
+		    (unsigned) fd >= ctx->nr_user_files))
+			return -EBADF;
+		req->file = get_file(ctx->user_files[fd]);
+	} else {
+		/* the SQ thread has no file table to look the fd up in */
+		if (ctx->flags & IORING_SETUP_SQPOLL)
+			return -EBADF;
+		req->file = fget(fd);
+		if (unlikely(!req->file))
+			return -EBADF;
+		/* a ring waiting on itself would never be released */
+		if (unlikely(req->file->f_op == &io_uring_fops))
+			return -EBADF;
+	}
+	return 0;
+}
+
+static int io_req_prep(struct io_ring_ctx *ctx, struct io_kiocb *req)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	int ret;
+
+	if (unlikely(sqe->flags & ~IOSQE_FIXED_FILE))
+		return -EINVAL;
+
+	if (sqe->opcode == IORING_OP_POLL_ADD)
+		INIT_WORK(&req->work, io_poll_complete_work);
+	else
+		INIT_WORK(&req->work, io_sq_wq_submit_work);
+
+	switch (sqe->opcode) {
+	case IORING_OP_NOP:
+	case IORING_OP_POLL_REMOVE:
+		return 0;
+	case IORING_OP_ACCEPT:
+		/*
+		 * The new descriptor goes into the submitter's file table,
+		 * which the workqueue borrows if the accept has to wait.
+		 */
+		if (ctx->flags & IORING_SETUP_SQPOLL)
+			return -EINVAL;
+		req->files = current->files;
+		spin_lock_irq(&ctx->completion_lock);
+		list_add(&req->inflight_entry, &ctx->inflight_list);
+		spin_unlock_irq(&ctx->completion_lock);
+		/* fall through */
+	default:
+		ret = io_req_set_file(ctx, req);
+		break;
+	}
+	return ret;
+}
+
+static int io_submit_sqe(struct io_ring_ctx *ctx,
+			 const struct io_uring_sqe *sqe)
+{
+	struct io_kiocb *req;
+	int ret;
+
+	req = io_get_req(ctx);
+	if (unlikely(!req))
+		return -EAGAIN;
+
+	/* the application owns the sqe again once the SQ head moves on */
+	memcpy(&req->sqe, sqe, sizeof(req->sqe));
+	req->user_data = req->sqe.user_data;
+
+	ret = io_req_prep(ctx, req);
+	if (!ret)
+		ret = __io_submit_sqe(ctx, req, true);
+	if (ret == -EAGAIN) {
+		queue_work(ctx->sqo_wq, &req->work);
+		return 0;
+	}
+	if (ret)
+		io_free_req(req);
+	return ret;
+}
+
+static void io_commit_sqring(struct io_ring_ctx *ctx)
+{
+	struct io_sq_ring *ring = ctx->sq_ring;
+
+	if (ctx->cached_sq_head != READ_ONCE(ring->r.head)) {
+		/*
+		 * Ensure any loads from the SQEs are done at this point,
+		 * since once we write the new head, the application could
+		 * write new data to them.
+		 */
+		smp_store_release(&ring->r.head, ctx->cached_sq_head);
+
+		/*
+		 * write side barrier of head update, app has read side. See
+		 * comment at the top of this file
+		 */
+		smp_wmb();
+	}
+}
+
+static unsigned io_sqring_entries(struct io_ring_ctx *ctx)
+{
+	struct io_sq_ring *ring = ctx->sq_ring;
+
+	/* make sure SQ entry isn't read before tail */
+	return smp_load_acquire(&ring->r.tail) - ctx->cached_sq_head;
+}
+
+/*
+ * Fetch an sqe, if one is available. Note that the returned sqe points to
+ * memory shared with the application, so it must be copied before the SQ
+ * head is committed.
+ */
+static const struct io_uring_sqe *io_get_sqring(struct io_ring_ctx *ctx)
+{
+	struct io_sq_ring *ring = ctx->sq_ring;
+	unsigned head;
+
+	/*
+	 * The cached sq head (or cq tail) serves two purposes:
+	 *
+	 * 1) allows us to batch the cost of updating the user visible
+	 *    head updates.
+	 * 2) allows the kernel side to track the head on its own, even
+	 *    though the application is the one updating it.
+	 */
+	head = ctx->cached_sq_head;
+	if (head == smp_load_acquire(&ring->r.tail))
+		return NULL;
+
+	head = READ_ONCE(ring->array[head & ctx->sq_mask]);
+	ctx->cached_sq_head++;
+	if (head < ctx->sq_entries)
+		return &ctx->sq_sqes[head];
+
+	/* drop invalid entries */
+	WRITE_ONCE(ring->dropped, ring->dropped + 1);
+	return NULL;
+}
+
+/*
+ * Submit up to @to_submit sqes. Requests that fail to submit are completed
+ * with the error right away, so the application sees every sqe it queued
+ * come back on the CQ ring. Must be called with ->uring_lock held.
+ */
+static int io_ring_submit(struct io_ring_ctx *ctx, unsigned int to_submit,
+			  bool mm_fault)
+{
+	const struct io_uring_sqe *sqe;
+	int i, submit = 0;
+
+	for (i = 0; i < to_submit; i++) {
+		int ret;
+
+		sqe = io_get_sqring(ctx);
+		if (!sqe)
+			break;
+
+		ret = mm_fault ? -EFAULT : io_submit_sqe(ctx, sqe);
+		if (ret)
+			io_cqring_add_event(ctx, READ_ONCE(sqe->user_data), ret);
+		submit++;
+	}
+	io_commit_sqring(ctx);
+
+	return submit;
+}
+
+static int io_sq_thread(void *data)
+{
+	struct io_ring_ctx *ctx = data;
+	struct mm_struct *cur_mm = NULL;
+	const struct cred *old_cred;
+	mm_segment_t old_fs;
+	DEFINE_WAIT(wait);
+	unsigned long timeout;
+
+	old_fs = get_fs();
+	set_fs(USER_DS);
+	old_cred = override_creds(ctx->creds);
+
+	timeout = jiffies + ctx->sq_thread_idle;
+	while (!kthread_should_stop()) {
+		unsigned int to_submit;
+		bool mm_fault = false;
+
+		to_submit = io_sqring_entries(ctx);
+		if (!to_submit) {
+			/*
+			 * Drop the mm while we spin, so that an exiting
+			 * application isn't held up by us.
+			 */
+			if (cur_mm) {
+				unuse_mm(cur_mm);
+				mmput(cur_mm);
+				cur_mm = NULL;
+			}
+
+			/*
+			 * Keep spinning for a while after the last
+			 * submission, so a busy application never needs
+			 * to wake us up.
+			 */
+			if (time_before(jiffies, timeout)) {
+				cond_resched();
+				continue;
+			}
+
+			prepare_to_wait(&ctx->sqo_wait, &wait,
+					TASK_INTERRUPTIBLE);
+
+			/* Tell userspace we may need a wakeup call */
+			ctx->sq_ring->flags |= IORING_SQ_NEED_WAKEUP;
+			/* make sure to read SQ tail after writing flags */
+			smp_mb();
+
+			to_submit = io_sqring_entries(ctx);
+			if (!to_submit) {
+				if (kthread_should_stop()) {
+					finish_wait(&ctx->sqo_wait, &wait);
+					break;
+				}
+				schedule();
+				finish_wait(&ctx->sqo_wait, &wait);
+
+				ctx->sq_ring->flags &= ~IORING_SQ_NEED_WAKEUP;
+				smp_wmb();
+				continue;
+			}
+			finish_wait(&ctx->sqo_wait, &wait);
+
+			ctx->sq_ring->flags &= ~IORING_SQ_NEED_WAKEUP;
+			smp_wmb();
+		}
+
+		/* user buffers and iovecs are resolved in the application mm */
+		if (!cur_mm) {
+			mm_fault = !mmget_not_zero(ctx->sqo_mm);
+			if (!mm_fault) {
+				use_mm(ctx->sqo_mm);
+				cur_mm = ctx->sqo_mm;
+			}
+		}
+
+		to_submit = min(to_submit, ctx->sq_entries);
+		mutex_lock(&ctx->uring_lock);
+		io_ring_submit(ctx, to_submit, mm_fault);
+		mutex_unlock(&ctx->uring_lock);
+
+		timeout = jiffies + ctx->sq_thread_idle;
+	}
+
+	set_fs(old_fs);
+	if (cur_mm) {
+		unuse_mm(cur_mm);
+		mmput(cur_mm);
+	}
+	revert_creds(old_cred);
+
+	return 0;
+}
+
+static unsigned io_cqring_events(struct io_cq_ring *ring)
+{
+	return READ_ONCE(ring->r.tail) - READ_ONCE(ring->r.head);
+}
+
+/*
+ * Wait until events become available, if we don't already have some. The
+ * application must reap them itself, as they reside on the shared cq ring.
+ */
+static int io_cqring_wait(struct io_ring_ctx *ctx, int min_events,
+			  const sigset_t __user *sig, size_t sigsz)
+{
+	struct io_cq_ring *ring = ctx->cq_ring;
+	sigset_t ksigmask, sigsaved;
+	int ret;
+
+	if (io_cqring_events(ring) >= min_events)
+		return 0;
+
+	/*
+	 * If the caller wants a certain signal mask to be set during the wait,
+	 * we apply it here.
+	 */
+	if (sig) {
+		if (sigsz != sizeof(sigset_t))
+			return -EINVAL;
+		if (copy_from_user(&ksigmask, sig, sizeof(ksigmask)))
+			return -EFAULT;
+		sigsaved = current->blocked;
+		set_current_blocked(&ksigmask);
+	}
+
+	ret = wait_event_interruptible(ctx->wait,
+				       io_cqring_events(ring) >= min_events);
+	if (ret == -ERESTARTSYS)
+		ret = -EINTR;
+
+	/*
+	 * If we changed the signal mask, we need to restore the original one.
+	 * In case we've got a signal while waiting, we do not restore the
+	 * signal mask yet, and we allow do_signal() to deliver the signal on
+	 * the way back to userspace, before the signal mask is restored.
+	 */
+	if (sig) {
+		if (ret == -EINTR) {
+			memcpy(&current->saved_sigmask, &sigsaved,
+			       sizeof(sigsaved));
+			set_restore_sigmask();
+		} else
+			set_current_blocked(&sigsaved);
+	}
+
+	return READ_ONCE(ring->r.head) == READ_ONCE(ring->r.tail) ? ret : 0;
+}
+
+static int io_sqe_files_unregister(struct io_ring_ctx *ctx)
+{
+	int i;
+
+	if (!ctx->user_files)
+		return -ENXIO;
+
+	for (i = 0; i < ctx->nr_user_files; i++)
+		fput(ctx->user_files[i]);
+
+	kfree(ctx->user_files);
+	ctx->user_files = NULL;
+	ctx->nr_user_files = 0;
+	return 0;
+}
+
+static int io_sqe_files_register(struct io_ring_ctx *ctx, void __user *arg,
+				 unsigned nr_args)
+{
+	__s32 __user *fds = (__s32 __user *) arg;
+	int fd, ret = 0;
+	unsigned i;
+
+	if (ctx->user_files)
+		return -EBUSY;
+	if (!nr_args)
+		return -EINVAL;
+	if (nr_args > IORING_MAX_FIXED_FILES)
+		return -EMFILE;
+
+	ctx->user_files = kcalloc(nr_args, sizeof(struct file *), GFP_KERNEL);
+	if (!ctx->user_files)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_args; i++) {
+		ret = -EFAULT;
+		if (copy_from_user(&fd, &fds[i], sizeof(fd)))
+			break;
+
+		ctx->user_files[i] = fget(fd);
+
+		ret = -EBADF;
+		if (!ctx->user_files[i])
+			break;
+		/*
+		 * Don't allow io_uring instances to be registered. If UNIX
+		 * isn't enabled, then this causes a reference cycle and this
+		 * instance can never get freed.
+		 */
+		if (ctx->user_files[i]->f_op == &io_uring_fops) {
+			fput(ctx->user_files[i]);
+			break;
+		}
+		ctx->nr_user_files++;
+		ret = 0;
+	}
+
+	if (ret)
+		io_sqe_files_unregister(ctx);
+
+	return ret;
+}
+
+static void io_sq_thread_stop(struct io_ring_ctx *ctx)
+{
+	if (ctx->sqo_thread) {
+		kthread_stop(ctx->sqo_thread);
+		ctx->sqo_thread = NULL;
+	}
+}
+
+static void io_finish_async(struct io_ring_ctx *ctx)
+{
+	io_sq_thread_stop(ctx);
+
+	if (ctx->sqo_wq) {
+		destroy_workqueue(ctx->sqo_wq);
+		ctx->sqo_wq = NULL;
+	}
+}
+
+static int io_sq_offload_start(struct io_ring_ctx *ctx,
+			       struct io_uring_params *p)
+{
+	int ret;
+
+	atomic_inc(&current->mm->mm_count);
+	ctx->sqo_mm = current->mm;
+
+	/* Do QD, or 2 * CPUS, whatever is smallest */
+	ctx->sqo_wq = alloc_workqueue("io_ring-wq", WQ_UNBOUND | WQ_FREEZABLE,
+			min(ctx->sq_entries, 2 * num_online_cpus()));
+	if (!ctx->sqo_wq) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	if (ctx->flags & IORING_SETUP_SQPOLL) {
+		ret = -EPERM;
+		if (!capable(CAP_SYS_ADMIN))
+			goto err;
+
+		ctx->sq_thread_idle = msecs_to_jiffies(p->sq_thread_idle);
+		if (!ctx->sq_thread_idle)
+			ctx->sq_thread_idle = HZ;
+
+		if (p->flags & IORING_SETUP_SQ_AFF) {
+			int cpu = p->sq_thread_cpu;
+
+			ret = -EINVAL;
+			if (cpu >= nr_cpu_ids || !cpu_online(cpu))
+				goto err;
+
+			ctx->sqo_thread = kthread_create_on_cpu(io_sq_thread,
+							ctx, cpu,
+							"io_uring-sq/%u");
+		} else {
+			ctx->sqo_thread = kthread_create(io_sq_thread, ctx,
+							"io_uring-sq");
+		}
+		if (IS_ERR(ctx->sqo_thread)) {
+			ret = PTR_ERR(ctx->sqo_thread);
+			ctx->sqo_thread = NULL;
+			goto err;
+		}
+		wake_up_process(ctx->sqo_thread);
+	} else if (p->flags & IORING_SETUP_SQ_AFF) {
+		/* Can't have SQ_AFF without SQPOLL */
+		ret = -EINVAL;
+		goto err;
+	}
+
+	return 0;
+err:
+	io_finish_async(ctx);
+	mmdrop(ctx->sqo_mm);
+	ctx->sqo_mm = NULL;
+	return ret;
+}
+
+static void io_unaccount_mem(struct user_struct *user, unsigned long nr_pages)
+{
+	atomic_long_sub(nr_pages, &user->locked_vm);
+}
+
+static int io_account_mem(struct user_struct *user, unsigned long nr_pages)
+{
+	unsigned long memlock_limit = rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT;
+
+	atomic_long_add(nr_pages, &user->locked_vm);
+	if (atomic_long_read(&user->locked_vm) > memlock_limit) {
+		atomic_long_sub(nr_pages, &user->locked_vm);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static void io_mem_free(void *ptr)
+{
+	struct page *page;
+
+	if (!ptr)
+		return;
+
+	page = virt_to_head_page(ptr);
+	__free_pages(page, compound_order(page));
+}
+
+static void *io_mem_alloc(size_t size)
+{
+	gfp_t gfp_flags = GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN | __GFP_COMP |
+				__GFP_NORETRY;
+
+	return (void *) __get_free_pages(gfp_flags, get_order(size));
+}
+
+static size_t io_sq_ring_size(unsigned sq_entries)
+{
+	return sizeof(struct io_sq_ring) + sq_entries * sizeof(u32);
+}
+
+static size_t io_cq_ring_size(unsigned cq_entries)
+{
+	return sizeof(struct io_cq_ring) +
+		cq_entries * sizeof(struct io_uring_cqe);
+}
+
+static unsigned long ring_pages(unsigned sq_entries, unsigned cq_entries)
+{
+	unsigned long pages;
+
+	pages = 1UL << get_order(io_sq_ring_size(sq_entries));
+	pages += 1UL << get_order(sizeof(struct io_uring_sqe) * sq_entries);
+	pages += 1UL << get_order(io_cq_ring_size(cq_entries));
+
+	return pages;
+}
+
+static void io_ring_ctx_free(struct io_ring_ctx *ctx)
+{
+	io_finish_async(ctx);
+	if (ctx->sqo_mm)
+		mmdrop(ctx->sqo_mm);
+	io_sqe_files_unregister(ctx);
+
+	io_mem_free(ctx->sq_ring);
+	io_mem_free(ctx->sq_sqes);
+	io_mem_free(ctx->cq_ring);
+
+	percpu_ref_exit(&ctx->refs);
+	if (ctx->account_mem)
+		io_unaccount_mem(ctx->user,
+				ring_pages(ctx->sq_entries, ctx->cq_entries));
+	free_uid(ctx->user);
+	if (ctx->creds)
+		put_cred(ctx->creds);
+	kfree(ctx);
+}
+
+static unsigned int io_uring_poll(struct file *file, poll_table *wait)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+	unsigned int mask = 0;
+
+	poll_wait(file, &ctx->cq_wait, wait);
+	/* See comment at the top of this file */
+	smp_rmb();
+	if (READ_ONCE(ctx->sq_ring->r.tail) - ctx->cached_sq_head !=
+	    ctx->sq_ring->ring_entries)
+		mask |= POLLOUT | POLLWRNORM;
+	if (READ_ONCE(ctx->cq_ring->r.head) != ctx->cached_cq_tail)
+		mask |= POLLIN | POLLRDNORM;
+
+	return mask;
+}
+
+static void io_ring_ctx_wait_and_kill(struct io_ring_ctx *ctx)
+{
+	/* no new submissions once the SQ thread is gone and refs are dead */
+	io_sq_thread_stop(ctx);
+
+	mutex_lock(&ctx->uring_lock);
+	percpu_ref_kill(&ctx->refs);
+	mutex_unlock(&ctx->uring_lock);
+
+	io_poll_remove_all(ctx);
+	wait_for_completion(&ctx->ctx_done);
+	io_ring_ctx_free(ctx);
+}
+
+static int io_uring_release(struct inode *inode, struct file *file)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+
+	file->private_data = NULL;
+	io_ring_ctx_wait_and_kill(ctx);
+	return 0;
+}
+
+static bool io_files_inflight(struct io_ring_ctx *ctx,
+			      struct files_struct *files)
+{
+	struct io_kiocb *req;
+	bool found = false;
+
+	spin_lock_irq(&ctx->completion_lock);
+	list_for_each_entry(req, &ctx->inflight_list, inflight_entry) {
+		if (req->files == files) {
+			found = true;
+			break;
+		}
+	}
+	spin_unlock_irq(&ctx->completion_lock);
+
+	return found;
+}
+
+/*
+ * Requests that install descriptors borrow the submitter's files_struct
+ * without holding a reference to it, since that would pin the ring in a
+ * reference cycle. Cancel and wait for them when the table closes the ring,
+ * which includes its teardown on exit.
+ */
+static int io_uring_flush(struct file *file, fl_owner_t id)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+	struct files_struct *files = id;
+	struct io_kiocb *req, *next;
+
+	if (list_empty_careful(&ctx->inflight_list))
+		return 0;
+
+	spin_lock_irq(&ctx->completion_lock);
+	list_for_each_entry(req, &ctx->inflight_list, inflight_entry) {
+		if (req->files == files)
+			req->canceled = true;
+	}
+	list_for_each_entry_safe(req, next, &ctx->cancel_list, list) {
+		if (req->files == files)
+			io_poll_remove_one(req);
+	}
+	spin_unlock_irq(&ctx->completion_lock);
+
+	wait_event(ctx->inflight_wait, !io_files_inflight(ctx, files));
+	return 0;
+}
+
+static int io_uring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	loff_t offset = (loff_t) vma->vm_pgoff << PAGE_SHIFT;
+	unsigned long sz = vma->vm_end - vma->vm_start;
+	struct io_ring_ctx *ctx = file->private_data;
+	unsigned long pfn;
+	struct page *page;
+	void *ptr;
+
+	switch (offset) {
+	case IORING_OFF_SQ_RING:
+		ptr = ctx->sq_ring;
+		break;
+	case IORING_OFF_SQES:
+		ptr = ctx->sq_sqes;
+		break;
+	case IORING_OFF_CQ_RING:
+		ptr = ctx->cq_ring;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	page = virt_to_head_page(ptr);
+	if (sz > (PAGE_SIZE << compound_order(page)))
+		return -EINVAL;
+
+	pfn = virt_to_phys(ptr) >> PAGE_SHIFT;
+	return remap_pfn_range(vma, vma->vm_start, pfn, sz, vma->vm_page_prot);
+}
+
+SYSCALL_DEFINE6(io_uring_enter, unsigned int, fd, u32, to_submit,
+		u32, min_complete, u32, flags, const sigset_t __user *, sig,
+		size_t, sigsz)
+{
+	struct io_ring_ctx *ctx;
+	long ret = -EBADF;
+	int submitted = 0;
+	struct fd f;
+
+	if (flags & ~(IORING_ENTER_GETEVENTS | IORING_ENTER_SQ_WAKEUP))
+		return -EINVAL;
+
+	f = fdget(fd);
+	if (!f.file)
+		return -EBADF;
+
+	ret = -EOPNOTSUPP;
+	if (f.file->f_op != &io_uring_fops)
+		goto out_fput;
+
+	ret = -ENXIO;
+	ctx = f.file->private_data;
+	if (!percpu_ref_tryget(&ctx->refs))
+		goto out_fput;
+
+	/*
+	 * For SQ polling, the thread will do all submissions and completions.
+	 * Just return the requested submit count, and wake the thread if
+	 * we were asked to.
+	 */
+	ret = 0;
+	if (ctx->flags & IORING_SETUP_SQPOLL) {
+		if (flags & IORING_ENTER_SQ_WAKEUP)
+			wake_up(&ctx->sqo_wait);
+		submitted = to_submit;
+	} else if (to_submit) {
+		to_submit = min(to_submit, ctx->sq_entries);
+
+		mutex_lock(&ctx->uring_lock);
+		submitted = io_ring_submit(ctx, to_submit, false);
+		mutex_unlock(&ctx->uring_lock);
+	}
+	if (flags & IORING_ENTER_GETEVENTS) {
+		min_complete = min(min_complete, ctx->cq_entries);
+		ret = io_cqring_wait(ctx, min_complete, sig, sigsz);
+	}
+
+	percpu_ref_put(&ctx->refs);
+out_fput:
+	fdput(f);
+	return submitted ? submitted : ret;
+}
+
+static const struct file_operations io_uring_fops = {
+	.release	= io_uring_release,
+	.flush		= io_uring_flush,
+	.mmap		= io_uring_mmap,
+	.poll		= io_uring_poll,
+	.llseek		= noop_llseek,
+};
+
+static int io_allocate_scq_urings(struct io_ring_ctx *ctx,
+				  struct io_uring_params *p)
+{
+	struct io_sq_ring *sq_ring;
+	struct io_cq_ring *cq_ring;
+	size_t size;
+
+	/* set first, io_ring_ctx_free() unaccounts the memory based on these */
+	ctx->sq_entries = p->sq_entries;
+	ctx->sq_mask = p->sq_entries - 1;
+	ctx->cq_entries = p->cq_entries;
+	ctx->cq_mask = p->cq_entries - 1;
+
+	sq_ring = io_mem_alloc(io_sq_ring_size(p->sq_entries));
+	if (!sq_ring)
+		return -ENOMEM;
+
+	ctx->sq_ring = sq_ring;
+	sq_ring->ring_mask = ctx->sq_mask;
+	sq_ring->ring_entries = ctx->sq_entries;
+
+	size = sizeof(struct io_uring_sqe) * p->sq_entries;
+	ctx->sq_sqes = io_mem_alloc(size);
+	if (!ctx->sq_sqes)
+		return -ENOMEM;
+
+	cq_ring = io_mem_alloc(io_cq_ring_size(p->cq_entries));
+	if (!cq_ring)
+		return -ENOMEM;
+
+	ctx->cq_ring = cq_ring;
+	cq_ring->ring_mask = ctx->cq_mask;
+	cq_ring->ring_entries = ctx->cq_entries;
+	return 0;
+}
+
+static int io_uring_create(unsigned entries, struct io_uring_params *p,
+			   struct io_uring_params __user *params)
+{
+	struct user_struct *user = NULL;
+	struct io_ring_ctx *ctx;
+	bool account_mem;
+	int ret;
+
+	if (!entries || entries > IORING_MAX_ENTRIES)
+		return -EINVAL;
+
+	/*
+	 * Use twice as many entries for the CQ ring. It's possible for the
+	 * application to drive a higher depth than the size of the SQ ring,
+	 * since the sqes are only used at submission time. This allows for
+	 * some flexibility in overcommitting a bit.
+	 */
+	p->sq_entries = roundup_pow_of_two(entries);
+	p->cq_entries = 2 * p->sq_entries;
+
+	user = get_uid(current_user());
+	account_mem = !capable(CAP_IPC_LOCK);
+
+	if (account_mem) {
+		ret = io_account_mem(user,
+				ring_pages(p->sq_entries, p->cq_entries));
+		if (ret) {
+			free_uid(user);
+			return ret;
+		}
+	}
+
+	ctx = io_ring_ctx_alloc(p);
+	if (!ctx) {
+		if (account_mem)
+			io_unaccount_mem(user, ring_pages(p->sq_entries,
+								p->cq_entries));
+		free_uid(user);
+		return -ENOMEM;
+	}
+	ctx->account_mem = account_mem;
+	ctx->user = user;
+	ctx->creds = get_current_cred();
+
+	ret = io_allocate_scq_urings(ctx, p);
+	if (ret)
+		goto err;
+
+	ret = io_sq_offload_start(ctx, p);
+	if (ret)
+		goto err;
+
+	memset(&p->sq_off, 0, sizeof(p->sq_off));
+	p->sq_off.head = offsetof(struct io_sq_ring, r.head);
+	p->sq_off.tail = offsetof(struct io_sq_ring, r.tail);
+	p->sq_off.ring_mask = offsetof(struct io_sq_ring, ring_mask);
+	p->sq_off.ring_entries = offsetof(struct io_sq_ring, ring_entries);
+	p->sq_off.flags = offsetof(struct io_sq_ring, flags);
+	p->sq_off.dropped = offsetof(struct io_sq_ring, dropped);
+	p->sq_off.array = offsetof(struct io_sq_ring, array);
+
+	memset(&p->cq_off, 0, sizeof(p->cq_off));
+	p->cq_off.head = offsetof(struct io_cq_ring, r.head);
+	p->cq_off.tail = offsetof(struct io_cq_ring, r.tail);
+	p->cq_off.ring_mask = offsetof(struct io_cq_ring, ring_mask);
+	p->cq_off.ring_entries = offsetof(struct io_cq_ring, ring_entries);
+	p->cq_off.overflow = offsetof(struct io_cq_ring, overflow);
+	p->cq_off.cqes = offsetof(struct io_cq_ring, cqes);
+
+	/* an fd the application never learns about would leak the ring */
+	if (copy_to_user(params, p, sizeof(*p))) {
+		ret = -EFAULT;
+		goto err;
+	}
+
+	/* the file owns the ctx from here on, no more error unwinding */
+	ret = anon_inode_getfd("[io_uring]", &io_uring_fops, ctx,
+				O_RDWR | O_CLOEXEC);
+	if (ret < 0)
+		goto err;
+	return ret;
+err:
+	io_ring_ctx_wait_and_kill(ctx);
+	return ret;
+}
+
+/*
+ * Sets up an aio uring context, and returns the fd. Applications asks for a
+ * ring size, we return the actual sq/cq ring sizes (among other things) in the
+ * params structure passed in.
+ */
+static long io_uring_setup(u32 entries, struct io_uring_params __user *params)
+{
+	struct io_uring_params p;
+	int i;
+
+	if (copy_from_user(&p, params, sizeof(p)))
+		return -EFAULT;
+	for (i = 0; i < ARRAY_SIZE(p.resv); i++) {
+		if (p.resv[i])
+			return -EINVAL;
+	}
+
+	if (p.flags & ~(IORING_SETUP_SQPOLL | IORING_SETUP_SQ_AFF))
+		return -EINVAL;
+
+	return io_uring_create(entries, &p, params);
+}
+
+SYSCALL_DEFINE2(io_uring_setup, u32, entries,
+		struct io_uring_params __user *, params)
+{
+	return io_uring_setup(entries, params);
+}
+
+static int __io_uring_register(struct io_ring_ctx *ctx, unsigned opcode,
+			       void __user *arg, unsigned nr_args)
+{
+	int ret;
+
+	switch (opcode) {
+	case IORING_REGISTER_FILES:
+		ret = io_sqe_files_register(ctx, arg, nr_args);
+		break;
+	case IORING_UNREGISTER_FILES:
+		ret = -EINVAL;
+		if (arg || nr_args)
+			break;
+		ret = io_sqe_files_unregister(ctx);
+		break;
+	default:
+		ret = -EINVAL;
+		break;
+	}
+
+	return ret;
+}
+
+SYSCALL_DEFINE4(io_uring_register, unsigned int, fd, unsigned int, opcode,
+		void __user *, arg, unsigned int, nr_args)
+{
+	struct io_ring_ctx *ctx;
+	long ret = -EBADF;
+	struct fd f;
+
+	f = fdget(fd);
+	if (!f.file)
+		return -EBADF;
+
+	ret = -EOPNOTSUPP;
+	if (f.file->f_op != &io_uring_fops)
+		goto out_fput;
+
+	ctx = f.file->private_data;
+
+	/*
+	 * Each request holds its own reference to the file it uses, fixed
+	 * or not, so the set can be swapped under ->uring_lock alone.
+	 */
+	mutex_lock(&ctx->uring_lock);
+	ret = __io_uring_register(ctx, opcode, arg, nr_args);
+	mutex_unlock(&ctx->uring_lock);
+out_fput:
+	fdput(f);
+	return ret;
+}
+
+static int __init io_uring_init(void)
+{
+	req_cachep = KMEM_CACHE(io_kiocb, SLAB_HWCACHE_ALIGN | SLAB_PANIC);
+	return 0;
+};
+__initcall(io_uring_init);
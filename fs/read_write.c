@@ -428,6 +428,24 @@ int rw_verify_area(int read_write, struct file *file, const loff_t *ppos, size_t
 				read_write == READ ? MAY_READ : MAY_WRITE);
 }
 
+/*
+ * ->write_iter() limits writes to RLIMIT_FSIZE of the current task and
+ * sends it SIGXFSZ.  Returns true if a write of @count bytes at @kiocb
+ * cannot run into that limit, so that another task may issue it.
+ */
+bool rw_fsize_may_defer(const struct kiocb *kiocb, size_t count)
+{
+	unsigned long limit = rlimit(RLIMIT_FSIZE);
+	loff_t pos = kiocb->ki_pos;
+
+	if (limit == RLIM_INFINITY)
+		return true;
+	/* appends land at i_size, which is only stable under the inode lock */
+	if (kiocb->ki_flags & IOCB_APPEND)
+		return false;
+	return pos >= 0 && pos < limit && count <= limit - pos;
+}
+
 static ssize_t new_sync_read(struct file *filp, char __user *buf, size_t len, loff_t *ppos)
 {
 	struct iovec iov = { .iov_base = buf, .iov_len = len };
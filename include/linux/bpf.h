@@ -15,6 +15,8 @@
 
 struct perf_event;
 struct bpf_map;
+struct sk_buff;
+struct sock;
 
 /* map is generic key/value storage optionally accesible by eBPF programs */
 struct bpf_map_ops {
@@ -29,7 +31,7 @@ struct bpf_map_ops {
 	int (*map_update_elem)(struct bpf_map *map, void *key, void *value, u64 flags);
 	int (*map_delete_elem)(struct bpf_map *map, void *key);
 
-	/* funcs called by prog_array and perf_event_array map */
+	/* funcs called by prog_array, perf_event_array and map-in-map */
 	void *(*map_fd_get_ptr)(struct bpf_map *map, struct file *map_file,
 				int fd);
 	void (*map_fd_put_ptr)(void *ptr);
@@ -47,6 +49,7 @@ struct bpf_map {
 	const struct bpf_map_ops *ops;
 	struct work_struct work;
 	atomic_t usercnt;
+	struct bpf_map *inner_map_meta;
 };
 
 struct bpf_map_type_list {
@@ -176,6 +179,8 @@ struct bpf_prog_aux {
 	atomic_t refcnt;
 	u32 used_map_cnt;
 	u32 max_ctx_offset;
+	bool has_subprog_calls; /* uses bpf-to-bpf function calls */
+	u16 *subprog_frame_size; /* stack of each function, for the JIT */
 	const struct bpf_verifier_ops *ops;
 	struct bpf_map **used_maps;
 	struct bpf_prog *prog;
@@ -266,6 +271,12 @@ int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value);
 int bpf_fd_array_map_update_elem(struct bpf_map *map, struct file *map_file,
 				 void *key, void *value, u64 map_flags);
 void bpf_fd_array_map_clear(struct bpf_map *map);
+int bpf_fd_htab_map_update_elem(struct bpf_map *map, struct file *map_file,
+				void *key, void *value, u64 map_flags);
+
+/* XDP_REDIRECT targets, see kernel/bpf/devmap.c, cpumap.c and xskmap.c */
+int dev_map_enqueue(struct bpf_map *map, u32 key, struct sk_buff *skb);
+void __dev_map_flush(struct bpf_map *map);
 
 /* memcpy that is used with 8-byte aligned pointers, power-of-8 size and
  * forced to use 'long' read/writes to try to atomically copy long counters.
@@ -312,8 +323,70 @@ static inline struct bpf_prog *bpf_prog_inc(struct bpf_prog *prog)
 {
 	return ERR_PTR(-EOPNOTSUPP);
 }
+
+static inline int dev_map_enqueue(struct bpf_map *map, u32 key,
+				  struct sk_buff *skb)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline void __dev_map_flush(struct bpf_map *map)
+{
+}
 #endif /* CONFIG_BPF_SYSCALL */
 
+#if defined(CONFIG_BPF_SYSCALL) && defined(CONFIG_RPS)
+int cpu_map_enqueue(struct bpf_map *map, u32 key, struct sk_buff *skb);
+void __cpu_map_flush(struct bpf_map *map);
+#else
+static inline int cpu_map_enqueue(struct bpf_map *map, u32 key,
+				  struct sk_buff *skb)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline void __cpu_map_flush(struct bpf_map *map)
+{
+}
+#endif
+
+#ifdef CONFIG_XDP_SOCKETS
+int xsk_map_enqueue(struct bpf_map *map, u32 key, struct sk_buff *skb);
+void __xsk_map_flush(struct bpf_map *map);
+#else
+static inline int xsk_map_enqueue(struct bpf_map *map, u32 key,
+				  struct sk_buff *skb)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline void __xsk_map_flush(struct bpf_map *map)
+{
+}
+#endif
+
+#ifdef CONFIG_BPF_STREAM_PARSER
+struct sock *__sock_map_lookup_elem(struct bpf_map *map, u32 key);
+int sock_map_prog(struct bpf_map *map, struct bpf_prog *prog, u32 type);
+void sock_map_clear(struct bpf_map *map);
+#else
+static inline struct sock *__sock_map_lookup_elem(struct bpf_map *map,
+						   u32 key)
+{
+	return NULL;
+}
+
+static inline int sock_map_prog(struct bpf_map *map, struct bpf_prog *prog,
+				u32 type)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline void sock_map_clear(struct bpf_map *map)
+{
+}
+#endif
+
 /* verifier prototypes for helper functions called from eBPF programs */
 extern const struct bpf_func_proto bpf_map_lookup_elem_proto;
 extern const struct bpf_func_proto bpf_map_update_elem_proto;
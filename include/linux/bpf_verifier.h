@@ -16,6 +16,21 @@
 #define BPF_REGISTER_MAX_RANGE (1024 * 1024 * 1024)
 #define BPF_REGISTER_MIN_RANGE -1
 
+/* Liveness marks, used for registers in explored states
+ * Read marks propagate upwards until they find a write mark; they record that
+ * "one of this state's descendants read this reg (and therefore the reg is
+ * relevant for states_equal() checks)".
+ * Write marks collect downwards and do not propagate; they record that "the
+ * straight-line code that reached this state (from its parent) wrote this reg"
+ * (and therefore that reads propagated from this state or its descendants
+ * should not propagate to its parent).
+ */
+enum bpf_reg_liveness {
+	REG_LIVE_NONE = 0, /* reg hasn't been read or written this branch */
+	REG_LIVE_READ, /* reg was read, so we're sensitive to initial value */
+	REG_LIVE_WRITTEN, /* reg was written first, screening off later reads */
+};
+
 struct bpf_reg_state {
 	enum bpf_reg_type type;
 	union {
@@ -33,6 +48,10 @@ struct bpf_reg_state {
 		 */
 		struct bpf_map *map_ptr;
 	};
+	/* valid when type == FRAME_PTR | PTR_TO_STACK: the call frame
+	 * whose stack the pointer refers to
+	 */
+	u32 frameno;
 	u32 id;
 	/* Used to determine if any memory access using this register will
 	 * result in a bad access. These two fields must be last.
@@ -41,6 +60,8 @@ struct bpf_reg_state {
 	s64 min_value;
 	u64 max_value;
 	bool value_from_signed;
+	/* This field must be last, for states_equal() reasons. */
+	enum bpf_reg_liveness live;
 };
 
 enum bpf_stack_slot_type {
@@ -51,15 +72,34 @@ enum bpf_stack_slot_type {
 
 #define BPF_REG_SIZE 8	/* size of eBPF register in bytes */
 
-/* state of the program:
+/* state of one function in the call chain:
  * type of all registers and stack info
  */
-struct bpf_verifier_state {
+struct bpf_func_state {
 	struct bpf_reg_state regs[MAX_BPF_REG];
+	/* index of the call instruction that entered this function */
+	int callsite;
+	/* position of this function in the call chain, 0 is the main program */
+	u32 frameno;
+	/* index of this function in bpf_verifier_env->subprog_starts[] */
+	u32 subprogno;
 	u8 stack_slot_type[MAX_BPF_STACK];
 	struct bpf_reg_state spilled_regs[MAX_BPF_STACK / BPF_REG_SIZE];
 };
 
+/* state of the program: the chain of active function frames */
+struct bpf_verifier_state {
+	struct bpf_func_state *frame[MAX_CALL_FRAMES];
+	u32 curframe;
+	/* the explored state this one descends from and the number of
+	 * paths from this state that are still being walked. A state with
+	 * pending branches is not proven safe yet, and meeting it again on
+	 * the current path means the program went around a loop.
+	 */
+	struct bpf_verifier_state *parent;
+	u32 branches;
+};
+
 /* linked list of verifier states used to prune search */
 struct bpf_verifier_state_list {
 	struct bpf_verifier_state state;
@@ -71,6 +111,7 @@ struct bpf_insn_aux_data {
 };
 
 #define MAX_USED_MAPS 64 /* max number of maps accessed by one eBPF program */
+#define BPF_MAX_SUBPROGS 256 /* max number of bpf-to-bpf functions, main included */
 
 struct bpf_verifier_env;
 struct bpf_ext_analyzer_ops {
@@ -85,7 +126,7 @@ struct bpf_verifier_env {
 	struct bpf_prog *prog;		/* eBPF program being verified */
 	struct bpf_verifier_stack_elem *head; /* stack of verifier states to be processed */
 	int stack_size;			/* number of states to be processed */
-	struct bpf_verifier_state cur_state; /* current verifier state */
+	struct bpf_verifier_state *cur_state; /* current verifier state */
 	struct bpf_verifier_state_list **explored_states; /* search pruning optimization */
 	const struct bpf_ext_analyzer_ops *analyzer_ops; /* external analyzer ops */
 	void *analyzer_priv; /* pointer to external analyzer's private data */
@@ -96,6 +137,14 @@ struct bpf_verifier_env {
 	bool seen_direct_write;
 	bool varlen_map_value_access;
 	struct bpf_insn_aux_data *insn_aux_data; /* array of per-insn state */
+	u32 subprog_starts[BPF_MAX_SUBPROGS]; /* sorted, [0] is the main program */
+	u16 subprog_stack_depth[BPF_MAX_SUBPROGS]; /* max stack used by each */
+	u32 subprog_cnt;		/* number of functions, main included */
+	u32 insn_processed;		/* number of insns walked by do_check() */
+	u32 prev_insn_processed;	/* insn_processed when a state was last saved */
+	u32 total_states;		/* number of states saved for pruning */
+	u32 peak_states;		/* max saved + queued states at any time */
+	u32 pruned_states;		/* paths cut short by an equivalent state */
 };
 
 int bpf_analyzer(struct bpf_prog *prog, const struct bpf_ext_analyzer_ops *ops,
@@ -56,6 +56,9 @@ struct bpf_prog_aux;
 /* BPF program can access up to 512 bytes of stack space. */
 #define MAX_BPF_STACK	512
 
+/* Maximum nesting of bpf-to-bpf calls, the main program included. */
+#define MAX_CALL_FRAMES	8
+
 /* Helper macros for filter block array initializers. */
 
 /* ALU ops on registers, bpf_add|sub|...: dst_reg += src_reg */
@@ -467,6 +470,15 @@ static inline u8 *bpf_skb_cb(struct sk_buff *skb)
 	return qdisc_skb_cb(skb)->data;
 }
 
+/* Socket picked by bpf_sk_redirect_map() from a stream verdict program.
+ * BPF_PROG_TYPE_SK_SKB programs have no access to skb->cb[], so the
+ * scratch area is free to carry it back to the sockmap.
+ */
+static inline struct sock **bpf_sk_redir(struct sk_buff *skb)
+{
+	return (struct sock **)bpf_skb_cb(skb);
+}
+
 static inline u32 bpf_prog_run_save_cb(const struct bpf_prog *prog,
 				       struct sk_buff *skb)
 {
@@ -590,12 +602,22 @@ void sk_filter_uncharge(struct sock *sk, struct sk_filter *fp);
 u64 __bpf_call_base(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5);
 
 struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog);
+bool bpf_jit_supports_subprog_calls(void);
 bool bpf_helper_changes_skb_data(void *func);
 
 struct bpf_prog *bpf_patch_insn_single(struct bpf_prog *prog, u32 off,
 				       const struct bpf_insn *patch, u32 len);
 void bpf_warn_invalid_xdp_action(u32 act);
 
+/* xdp_do_generic_redirect() consumes the skb, also when it fails.  Packets
+ * queued to a map target are sent in batches; xdp_do_flush_map() must run
+ * before the current NAPI poll, or the current receive call outside of
+ * NAPI, returns.
+ */
+int xdp_do_generic_redirect(struct net_device *dev, struct sk_buff *skb,
+			    struct bpf_prog *xdp_prog);
+void xdp_do_flush_map(void);
+
 #ifdef CONFIG_BPF_JIT
 extern int bpf_jit_enable;
 extern int bpf_jit_harden;
@@ -23,6 +23,7 @@
 
 struct address_space;
 struct mem_cgroup;
+struct page_pool;
 
 #define USE_SPLIT_PTE_PTLOCKS	(NR_CPUS >= CONFIG_SPLIT_PTLOCK_CPUS)
 #define USE_SPLIT_PMD_PTLOCKS	(USE_SPLIT_PTE_PTLOCKS && \
@@ -141,6 +142,10 @@ struct page {
 		struct rcu_head rcu_head;	/* Used by SLAB
 						 * when destroying via RCU
 						 */
+		struct {		/* page_pool used by netstack */
+			unsigned long pp_magic;	/* PP_SIGNATURE */
+			struct page_pool *pp;	/* owning pool */
+		};
 		/* Tail pages of compound page */
 		struct {
 			unsigned long compound_head; /* If bit zero is set */
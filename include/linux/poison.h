@@ -29,6 +29,13 @@
  */
 #define TIMER_ENTRY_STATIC	((void *) 0x300 + POISON_POINTER_DELTA)
 
+/********** net/core/page_pool.c **********/
+/*
+ * Stored in page->pp_magic of pages owned by a page_pool; like the list
+ * poison it is never a valid pointer and keeps bit 0 (PageTail) clear.
+ */
+#define PP_SIGNATURE		(0x40 + POISON_POINTER_DELTA)
+
 /********** mm/debug-pagealloc.c **********/
 #ifdef CONFIG_PAGE_POISONING_ZERO
 #define PAGE_POISON 0x00
@@ -903,4 +903,13 @@ asmlinkage long sys_pkey_mprotect(unsigned long start, size_t len,
 asmlinkage long sys_pkey_alloc(unsigned long flags, unsigned long init_val);
 asmlinkage long sys_pkey_free(int pkey);
 
+struct io_uring_params;
+asmlinkage long sys_io_uring_setup(u32 entries,
+				   struct io_uring_params __user *p);
+asmlinkage long sys_io_uring_enter(unsigned int fd, u32 to_submit,
+				   u32 min_complete, u32 flags,
+				   const sigset_t __user *sig, size_t sigsz);
+asmlinkage long sys_io_uring_register(unsigned int fd, unsigned int op,
+				      void __user *arg, unsigned int nr_args);
+
 #endif
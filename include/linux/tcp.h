@@ -194,6 +194,10 @@ struct tcp_sock {
 	struct list_head tsq_node; /* anchor in tsq_tasklet.head list */
 	unsigned long	tsq_flags;
 
+	struct hrtimer	pacing_timer;	/* releases next skb for internal pacing */
+	u64	pacing_limited_stamp;	/* ns, start of current pacing-limited period */
+	u64	pacing_limited_ns;	/* total time held back by internal pacing */
+
 	/* Data for direct copy to user */
 	struct {
 		struct sk_buff_head	prequeue;
@@ -49,12 +49,14 @@ struct udp_sock {
 	unsigned int	 corkflag;	/* Cork is required */
 	__u8		 encap_type;	/* Is this an Encapsulation socket? */
 	unsigned char	 no_check6_tx:1,/* Send zero UDP6 checksums on TX? */
-			 no_check6_rx:1;/* Allow zero UDP6 checksums on RX? */
+			 no_check6_rx:1,/* Allow zero UDP6 checksums on RX? */
+			 gro_enabled:1;	/* Coalesce datagrams with UDP GRO? */
 	/*
 	 * Following member retains the information to create a UDP header
 	 * when the socket is uncorked.
 	 */
 	__u16		 len;		/* total length of pending frames */
+	__u16		 gso_size;	/* UDP_SEGMENT: payload per datagram */
 	/*
 	 * Fields specific to UDP-Lite.
 	 */
@@ -81,6 +83,9 @@ struct udp_sock {
 						int nhoff);
 };
 
+/* Upper bound on the datagrams a single UDP_SEGMENT send may carry */
+#define UDP_MAX_SEGMENTS	(1 << 6UL)
+
 static inline struct udp_sock *udp_sk(const struct sock *sk)
 {
 	return (struct udp_sock *)sk;
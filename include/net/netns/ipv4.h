@@ -97,6 +97,10 @@ struct netns_ipv4 {
 	int sysctl_tcp_probe_threshold;
 	u32 sysctl_tcp_probe_interval;
 
+	int sysctl_tcp_lbbr_alpha;
+	int sysctl_tcp_lbbr_max_rtt_inc_us;
+	int sysctl_tcp_lbbr_full_bw_thresh;
+
 	int sysctl_tcp_keepalive_time;
 	int sysctl_tcp_keepalive_probes;
 	int sysctl_tcp_keepalive_intvl;
@@ -0,0 +1,113 @@
+/*
+ * page_pool.h - recycling page allocator for network drivers
+ *
+ * A page_pool hands out pages for one RX queue and takes them back,
+ * either directly from the driver or when the skb holding them is
+ * freed, so that steady state receive does not go through the page
+ * allocator.
+ *
+ * Allocation is lockless: it is served from a small array cache, which
+ * is refilled from a ptr_ring of pages returned by other CPUs.  It must
+ * only be done from the context that owns the RX queue, i.e. its NAPI
+ * poll routine or process context while NAPI is disabled.
+ *
+ * A pool only keeps pages it is the sole user of.  A page that still
+ * has other references when it comes back is released from the pool
+ * (and DMA-unmapped) and left to the page allocator.  Pages that are
+ * freed with put_page() instead of going back to the pool must be
+ * released with page_pool_release_page() first, or page_pool_destroy()
+ * keeps waiting for them.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+#ifndef _NET_PAGE_POOL_H
+#define _NET_PAGE_POOL_H
+
+#include <linux/mm.h>
+#include <linux/ptr_ring.h>
+#include <linux/dma-direction.h>
+#include <linux/workqueue.h>
+
+#define PP_FLAG_DMA_MAP		1 /* Let the pool DMA-map its pages, the
+				   * address is read with
+				   * page_pool_get_dma_addr()
+				   */
+#define PP_FLAG_ALL		PP_FLAG_DMA_MAP
+
+#define PP_ALLOC_CACHE_SIZE	128
+#define PP_ALLOC_CACHE_REFILL	64
+#define PP_RING_SIZE_DEFAULT	1024
+#define PP_RING_SIZE_MAX	32768
+
+struct pp_alloc_cache {
+	u32 count;
+	void *cache[PP_ALLOC_CACHE_SIZE];
+};
+
+struct page_pool_params {
+	unsigned int	flags;
+	unsigned int	order;
+	unsigned int	pool_size;	/* ring size, 0 for the default */
+	int		nid;		/* NUMA node to allocate pages on */
+	struct device	*dev;		/* device for DMA mapping */
+	enum dma_data_direction dma_dir;
+};
+
+struct page_pool {
+	struct page_pool_params p;
+
+	/* only touched by the owner of the RX queue */
+	u32 pages_state_hold_cnt;
+	struct pp_alloc_cache alloc ____cacheline_aligned_in_smp;
+
+	/* pages returned from other contexts, e.g. by skb free */
+	struct ptr_ring ring;
+
+	atomic_t pages_state_release_cnt;
+
+	struct delayed_work release_dw;
+	unsigned long defer_start;
+	unsigned long defer_warn;
+
+	struct rcu_head rcu;
+};
+
+struct page *page_pool_alloc_pages(struct page_pool *pool, gfp_t gfp);
+
+static inline struct page *page_pool_dev_alloc_pages(struct page_pool *pool)
+{
+	return page_pool_alloc_pages(pool, GFP_ATOMIC | __GFP_NOWARN);
+}
+
+struct page_pool *page_pool_create(const struct page_pool_params *params);
+void page_pool_destroy(struct page_pool *pool);
+
+void __page_pool_put_page(struct page_pool *pool, struct page *page,
+			  bool allow_direct);
+void page_pool_release_page(struct page_pool *pool, struct page *page);
+
+/* Return a page from any context; it goes through the ring */
+static inline void page_pool_put_page(struct page_pool *pool,
+				      struct page *page)
+{
+	__page_pool_put_page(pool, page, false);
+}
+
+/* Return a page from the context that owns the pool, straight into
+ * the alloc cache
+ */
+static inline void page_pool_recycle_direct(struct page_pool *pool,
+					    struct page *page)
+{
+	__page_pool_put_page(pool, page, true);
+}
+
+static inline dma_addr_t page_pool_get_dma_addr(struct page *page)
+{
+	return (dma_addr_t)page_private(page);
+}
+
+#endif /* _NET_PAGE_POOL_H */
@@ -73,6 +73,8 @@ enum bpf_cmd {
 	BPF_PROG_LOAD,
 	BPF_OBJ_PIN,
 	BPF_OBJ_GET,
+	BPF_PROG_ATTACH,
+	BPF_PROG_DETACH,
 };
 
 enum bpf_map_type {
@@ -85,6 +87,18 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_PERCPU_ARRAY,
 	BPF_MAP_TYPE_STACK_TRACE,
 	BPF_MAP_TYPE_CGROUP_ARRAY,
+	BPF_MAP_TYPE_LRU_HASH,
+	BPF_MAP_TYPE_LRU_PERCPU_HASH,
+	BPF_MAP_TYPE_LPM_TRIE,
+	BPF_MAP_TYPE_ARRAY_OF_MAPS,
+	BPF_MAP_TYPE_HASH_OF_MAPS,
+	/* numbered as upstream, so loaders built against newer headers
+	 * agree with us on the map types we have
+	 */
+	BPF_MAP_TYPE_DEVMAP = 14,
+	BPF_MAP_TYPE_SOCKMAP = 15,
+	BPF_MAP_TYPE_CPUMAP = 16,
+	BPF_MAP_TYPE_XSKMAP = 17,
 };
 
 enum bpf_prog_type {
@@ -96,16 +110,58 @@ enum bpf_prog_type {
 	BPF_PROG_TYPE_TRACEPOINT,
 	BPF_PROG_TYPE_XDP,
 	BPF_PROG_TYPE_PERF_EVENT,
+	BPF_PROG_TYPE_CGROUP_SKB,
+	BPF_PROG_TYPE_CGROUP_SOCK,
+	/* numbered as upstream, see enum bpf_map_type */
+	BPF_PROG_TYPE_SK_SKB = 14,
+};
+
+enum bpf_attach_type {
+	BPF_CGROUP_INET_INGRESS,
+	BPF_CGROUP_INET_EGRESS,
+	BPF_CGROUP_INET_SOCK_CREATE,
+	/* numbered as upstream, see enum bpf_map_type */
+	BPF_SK_SKB_STREAM_PARSER = 4,
+	BPF_SK_SKB_STREAM_VERDICT,
+	__MAX_BPF_ATTACH_TYPE
 };
 
+#define MAX_BPF_ATTACH_TYPE __MAX_BPF_ATTACH_TYPE
+
+/* If BPF_F_ALLOW_OVERRIDE flag is used in BPF_PROG_ATTACH command
+ * to the given target_fd cgroup the descendent cgroup will be able to
+ * override effective bpf program that was inherited from this cgroup
+ */
+#define BPF_F_ALLOW_OVERRIDE	(1U << 0)
+
 #define BPF_PSEUDO_MAP_FD	1
 
+/* when bpf_call->src_reg == BPF_PSEUDO_CALL, bpf_call->imm == pc-relative
+ * offset to another bpf function
+ */
+#define BPF_PSEUDO_CALL		1
+
 /* flags for BPF_MAP_UPDATE_ELEM command */
 #define BPF_ANY		0 /* create new element or update existing */
 #define BPF_NOEXIST	1 /* create new element if it didn't exist */
 #define BPF_EXIST	2 /* update existing element */
 
 #define BPF_F_NO_PREALLOC	(1U << 0)
+/* Instead of having one common LRU list in the
+ * BPF_MAP_TYPE_LRU_[PERCPU_]HASH map, use a percpu LRU list
+ * which can scale and perform better.
+ * Note, the LRU nodes (including free nodes) cannot be moved
+ * across different LRU lists.
+ */
+#define BPF_F_NO_COMMON_LRU	(1U << 1)
+
+/* Key of a BPF_MAP_TYPE_LPM_TRIE entry. Such maps must be created with
+ * BPF_F_NO_PREALLOC.
+ */
+struct bpf_lpm_trie_key {
+	__u32	prefixlen;	/* up to 32 for AF_INET, 128 for AF_INET6 */
+	__u8	data[0];	/* Arbitrary size, in network byte order */
+};
 
 union bpf_attr {
 	struct { /* anonymous struct used by BPF_MAP_CREATE command */
@@ -114,6 +170,7 @@ union bpf_attr {
 		__u32	value_size;	/* size of value in bytes */
 		__u32	max_entries;	/* max number of entries in a map */
 		__u32	map_flags;	/* prealloc or not */
+		__u32	inner_map_fd;	/* fd pointing to the inner map */
 	};
 
 	struct { /* anonymous struct used by BPF_MAP_*_ELEM commands */
@@ -135,12 +192,21 @@ union bpf_attr {
 		__u32		log_size;	/* size of user buffer */
 		__aligned_u64	log_buf;	/* user supplied buffer */
 		__u32		kern_version;	/* checked when prog_type=kprobe */
+		__u32		stats_size;	/* size of user stats buffer */
+		__aligned_u64	stats;		/* user supplied struct bpf_verifier_stats */
 	};
 
 	struct { /* anonymous struct used by BPF_OBJ_* commands */
 		__aligned_u64	pathname;
 		__u32		bpf_fd;
 	};
+
+	struct { /* anonymous struct used by BPF_PROG_ATTACH/DETACH commands */
+		__u32		target_fd;	/* container object to attach to */
+		__u32		attach_bpf_fd;	/* eBPF program to attach */
+		__u32		attach_type;
+		__u32		attach_flags;
+	};
 } __attribute__((aligned(8)));
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
@@ -258,7 +324,7 @@ enum bpf_func_id {
 	 * @ifindex: ifindex of the net device
 	 * @flags: bit 0 - if set, redirect to ingress instead of egress
 	 *         other bits - reserved
-	 * Return: TC_ACT_REDIRECT
+	 * Return: TC_ACT_REDIRECT, or XDP_REDIRECT from an XDP program
 	 */
 	BPF_FUNC_redirect,
 
@@ -426,6 +492,28 @@ enum bpf_func_id {
 	 */
 	BPF_FUNC_set_hash_invalid,
 
+	/**
+	 * bpf_redirect_map(map, key, flags) - redirect an XDP packet to the
+	 * target held in a map
+	 * @map: pointer to BPF_MAP_TYPE_DEVMAP, BPF_MAP_TYPE_CPUMAP or
+	 *	  BPF_MAP_TYPE_XSKMAP
+	 * @key: index of the net device, cpu or XDP socket entry
+	 * @flags: reserved, must be zero
+	 * Return: XDP_REDIRECT on success or XDP_ABORTED on error
+	 */
+	BPF_FUNC_redirect_map = 51,
+
+	/**
+	 * bpf_sk_redirect_map(skb, map, key, flags) - send the message to
+	 * the socket held in a sockmap
+	 * @skb: pointer to skb, the context of a stream verdict program
+	 * @map: pointer to BPF_MAP_TYPE_SOCKMAP
+	 * @key: index of the socket in @map
+	 * @flags: reserved, must be zero
+	 * Return: SK_PASS on success or SK_DROP on error
+	 */
+	BPF_FUNC_sk_redirect_map,
+
 	__BPF_FUNC_MAX_ID,
 };
 
@@ -501,6 +589,16 @@ struct bpf_tunnel_key {
 	__u32 tunnel_label;
 };
 
+/* user accessible mirror of in-kernel sock, context of
+ * BPF_PROG_TYPE_CGROUP_SOCK programs
+ */
+struct bpf_sock {
+	__u32 bound_dev_if;
+	__u32 family;
+	__u32 type;
+	__u32 protocol;
+};
+
 /* User return codes for XDP prog type.
  * A valid XDP program must return one of these defined values. All other
  * return codes are reserved for future use. Unknown return codes will result
@@ -511,6 +609,16 @@ enum xdp_action {
 	XDP_DROP,
 	XDP_PASS,
 	XDP_TX,
+	XDP_REDIRECT,
+};
+
+/* Return codes of BPF_PROG_TYPE_SK_SKB stream verdict programs. SK_PASS
+ * sends the message out on the socket picked with bpf_sk_redirect_map();
+ * a message without such a target is dropped, just as on SK_DROP.
+ */
+enum sk_action {
+	SK_DROP = 0,
+	SK_PASS,
 };
 
 /* user accessible metadata for XDP packet hook
@@ -521,4 +629,16 @@ struct xdp_md {
 	__u32 data_end;
 };
 
+/* Verifier statistics of a BPF_PROG_LOAD, written to attr.stats (up to
+ * attr.stats_size bytes) whether or not the program was accepted.
+ * new fields must be added to the end of this structure
+ */
+struct bpf_verifier_stats {
+	__u64 verification_time_ns;
+	__u32 insn_processed;	/* insns walked, revisits included */
+	__u32 total_states;	/* states saved for pruning */
+	__u32 peak_states;	/* most states saved and queued at once */
+	__u32 pruned_states;	/* paths cut short by an equivalent state */
+};
+
 #endif /* _UAPI__LINUX_BPF_H__ */
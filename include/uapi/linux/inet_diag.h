@@ -176,6 +176,10 @@ struct tcp_lbbr_info {
 	__u32	lbbr_min_rtt;		/* Min filtered RTT in uSec */
 	__u32	lbbr_ssthresh;		/* ssthresh defined in LBBR */
 	__u32	lbbr_target_cwnd;	/* Target cwnd */
+	__u32	lbbr_mode;		/* 0: increase, 1: decrease, 2: probe_rtt */
+	__u32	lbbr_cycle_idx;		/* phase in the pacing gain cycle */
+	__u32	lbbr_pacing_gain;	/* pacing gain shifted left 8 bits */
+	__u32	lbbr_cwnd_gain;		/* cwnd gain shifted left 8 bits */
 };
 
 union tcp_cc_info {
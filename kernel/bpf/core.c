@@ -152,6 +152,16 @@ static void bpf_adj_branches(struct bpf_prog *prog, u32 pos, u32 delta)
 	u32 i, insn_cnt = prog->len;
 
 	for (i = 0; i < insn_cnt; i++, insn++) {
+		if (insn->code == (BPF_JMP | BPF_CALL) &&
+		    insn->src_reg == BPF_PSEUDO_CALL) {
+			/* bpf-to-bpf calls keep their target in imm */
+			if (i < pos && i + insn->imm + 1 > pos)
+				insn->imm += delta;
+			else if (i > pos + delta &&
+				 i + insn->imm + 1 <= pos + delta)
+				insn->imm -= delta;
+			continue;
+		}
 		if (!bpf_is_jmp_and_has_target(insn))
 			continue;
 
@@ -469,6 +479,12 @@ static unsigned int __bpf_prog_run(void *ctx, const struct bpf_insn *insn)
 {
 	u64 stack[MAX_BPF_STACK / sizeof(u64)];
 	u64 regs[MAX_BPF_REG], tmp;
+	/* callee saved registers and return address of bpf-to-bpf calls */
+	struct {
+		const struct bpf_insn *insn;
+		u64 regs[BPF_REG_FP - BPF_REG_6 + 1];
+	} frames[MAX_CALL_FRAMES - 1];
+	u32 call_depth = 0;
 	static const void *jumptable[256] = {
 		[0 ... 255] = &&default_label,
 		/* Now overwrite non-defaults ... */
@@ -703,6 +719,19 @@ select_insn:
 
 	/* CALL */
 	JMP_CALL:
+		if (insn->src_reg == BPF_PSEUDO_CALL) {
+			/* bpf-to-bpf call: the callee gets its own part of
+			 * the stack below the caller's, the verifier stored
+			 * the size of the caller's frame in insn->off
+			 */
+			frames[call_depth].insn = insn;
+			memcpy(frames[call_depth].regs, &regs[BPF_REG_6],
+			       sizeof(frames[call_depth].regs));
+			call_depth++;
+			FP -= insn->off;
+			insn += insn->imm;
+			CONT;
+		}
 		/* Function call scratches BPF_R1-BPF_R5 registers,
 		 * preserves BPF_R6-BPF_R9, and stores return value
 		 * into BPF_R0.
@@ -827,6 +856,13 @@ out:
 		}
 		CONT;
 	JMP_EXIT:
+		if (call_depth) {
+			call_depth--;
+			insn = frames[call_depth].insn;
+			memcpy(&regs[BPF_REG_6], frames[call_depth].regs,
+			       sizeof(frames[call_depth].regs));
+			CONT;
+		}
 		return BPF_R0;
 
 	/* STX and ST and LDX*/
@@ -978,7 +1014,8 @@ struct bpf_prog *bpf_prog_select_runtime(struct bpf_prog *fp, int *err)
 	 * valid program, which in this case would simply not
 	 * be JITed, but falls back to the interpreter.
 	 */
-	fp = bpf_int_jit_compile(fp);
+	if (!fp->aux->has_subprog_calls || bpf_jit_supports_subprog_calls())
+		fp = bpf_int_jit_compile(fp);
 	bpf_prog_lock_ro(fp);
 
 	/* The tail call compatibility check can only be done at
@@ -1077,6 +1114,14 @@ struct bpf_prog * __weak bpf_int_jit_compile(struct bpf_prog *prog)
 	return prog;
 }
 
+/* Programs with bpf-to-bpf calls stay with the interpreter unless the
+ * eBPF JIT of the architecture knows how to emit them.
+ */
+bool __weak bpf_jit_supports_subprog_calls(void)
+{
+	return false;
+}
+
 bool __weak bpf_helper_changes_skb_data(void *func)
 {
 	return false;
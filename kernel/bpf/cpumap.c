@@ -0,0 +1,332 @@
+/* CPU map for XDP_REDIRECT
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ */
+
+/* A cpumap is indexed by CPU number.  An XDP program that redirects a
+ * packet into an entry with bpf_redirect_map() moves the rest of its
+ * receive processing to that CPU, the way RPS would but under the
+ * control of the program, e.g. to fix up the spreading of a NIC whose
+ * RSS hash is poor for the traffic at hand.
+ *
+ * The value of an entry is the length of the remote backlog past which
+ * packets redirected through it are dropped.
+ *
+ * Redirected packets are first collected in a per-cpu queue of the
+ * entry and then appended to the backlog of the target CPU as one batch
+ * by netif_rx_cpu_bulk(), when the queue fills up or at the end of the
+ * NAPI poll.  The lifetime rules are those of the devmap.
+ */
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/netdevice.h>
+#include <linux/slab.h>
+
+#define CPU_MAP_BULK_SIZE 8
+
+struct bpf_cpu_map_entry;
+
+struct xdp_cpu_bulk_queue {
+	struct sk_buff *q[CPU_MAP_BULK_SIZE];
+	unsigned int count;
+	struct list_head flush_node;
+	struct bpf_cpu_map_entry *obj;
+};
+
+struct bpf_cpu_map_entry {
+	u32 cpu;
+	u32 qsize;
+	struct xdp_cpu_bulk_queue __percpu *bulkq;
+	struct rcu_head rcu;
+};
+
+struct bpf_cpu_map {
+	struct bpf_map map;
+	struct bpf_cpu_map_entry **cpu_map;
+	struct list_head __percpu *flush_list;
+};
+
+/* Called from syscall */
+static struct bpf_map *cpu_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_cpu_map *cmap;
+	int err = -EINVAL;
+	u64 cost;
+	int cpu;
+
+	if (!capable(CAP_NET_ADMIN))
+		return ERR_PTR(-EPERM);
+
+	/* check sanity of attributes */
+	if (attr->max_entries == 0 || attr->key_size != 4 ||
+	    attr->value_size != 4 || attr->map_flags)
+		return ERR_PTR(-EINVAL);
+
+	/* entries are indexed by CPU number */
+	if (attr->max_entries > NR_CPUS)
+		return ERR_PTR(-E2BIG);
+
+	cmap = kzalloc(sizeof(*cmap), GFP_USER);
+	if (!cmap)
+		return ERR_PTR(-ENOMEM);
+
+	/* mandatory map attributes */
+	cmap->map.map_type = attr->map_type;
+	cmap->map.key_size = attr->key_size;
+	cmap->map.value_size = attr->value_size;
+	cmap->map.max_entries = attr->max_entries;
+	cmap->map.map_flags = attr->map_flags;
+
+	cost = (u64) cmap->map.max_entries * sizeof(struct bpf_cpu_map_entry *);
+	cost += (u64) sizeof(struct list_head) * num_possible_cpus();
+	cmap->map.pages = round_up(cost, PAGE_SIZE) >> PAGE_SHIFT;
+
+	/* if map size is larger than memlock limit, reject it early */
+	err = bpf_map_precharge_memlock(cmap->map.pages);
+	if (err)
+		goto free_cmap;
+
+	err = -ENOMEM;
+	cmap->flush_list = alloc_percpu(struct list_head);
+	if (!cmap->flush_list)
+		goto free_cmap;
+
+	for_each_possible_cpu(cpu)
+		INIT_LIST_HEAD(per_cpu_ptr(cmap->flush_list, cpu));
+
+	cmap->cpu_map = bpf_map_area_alloc(cmap->map.max_entries *
+					   sizeof(struct bpf_cpu_map_entry *));
+	if (!cmap->cpu_map)
+		goto free_percpu;
+
+	return &cmap->map;
+
+free_percpu:
+	free_percpu(cmap->flush_list);
+free_cmap:
+	kfree(cmap);
+	return ERR_PTR(err);
+}
+
+static void cpu_map_entry_free(struct bpf_cpu_map_entry *rcpu)
+{
+	free_percpu(rcpu->bulkq);
+	kfree(rcpu);
+}
+
+static void __cpu_map_entry_free(struct rcu_head *rcu)
+{
+	cpu_map_entry_free(container_of(rcu, struct bpf_cpu_map_entry, rcu));
+}
+
+/* Called when map->refcnt goes to zero, either from workqueue or from syscall */
+static void cpu_map_free(struct bpf_map *map)
+{
+	struct bpf_cpu_map *cmap = container_of(map, struct bpf_cpu_map, map);
+	int i;
+
+	/* No program references the map anymore, wait for the ones that
+	 * did to finish their redirects and for the flushes that follow.
+	 */
+	synchronize_sched();
+
+	for (i = 0; i < cmap->map.max_entries; i++) {
+		struct bpf_cpu_map_entry *rcpu = cmap->cpu_map[i];
+
+		if (rcpu)
+			cpu_map_entry_free(rcpu);
+	}
+
+	free_percpu(cmap->flush_list);
+	bpf_map_area_free(cmap->cpu_map);
+	kfree(cmap);
+}
+
+static int cpu_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
+{
+	struct bpf_cpu_map *cmap = container_of(map, struct bpf_cpu_map, map);
+	u32 index = *(u32 *)key;
+	u32 *next = next_key;
+
+	if (index >= cmap->map.max_entries) {
+		*next = 0;
+		return 0;
+	}
+
+	if (index == cmap->map.max_entries - 1)
+		return -ENOENT;
+
+	*next = index + 1;
+	return 0;
+}
+
+static struct bpf_cpu_map_entry *__cpu_map_lookup_elem(struct bpf_map *map,
+						       u32 key)
+{
+	struct bpf_cpu_map *cmap = container_of(map, struct bpf_cpu_map, map);
+
+	if (key >= map->max_entries)
+		return NULL;
+
+	return READ_ONCE(cmap->cpu_map[key]);
+}
+
+/* Called from syscall only, programs use bpf_redirect_map() */
+static void *cpu_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_cpu_map_entry *rcpu = __cpu_map_lookup_elem(map, *(u32 *)key);
+
+	return rcpu ? &rcpu->qsize : NULL;
+}
+
+static void bq_flush_to_cpu(struct xdp_cpu_bulk_queue *bq)
+{
+	struct bpf_cpu_map_entry *rcpu = bq->obj;
+
+	if (!bq->count)
+		return;
+
+	netif_rx_cpu_bulk(bq->q, bq->count, rcpu->cpu, rcpu->qsize);
+	bq->count = 0;
+}
+
+/* Called from the XDP_REDIRECT path with preemption disabled.  Takes
+ * ownership of the skb on success.
+ */
+int cpu_map_enqueue(struct bpf_map *map, u32 key, struct sk_buff *skb)
+{
+	struct bpf_cpu_map *cmap = container_of(map, struct bpf_cpu_map, map);
+	struct bpf_cpu_map_entry *rcpu = __cpu_map_lookup_elem(map, key);
+	struct xdp_cpu_bulk_queue *bq;
+
+	if (unlikely(!rcpu))
+		return -EINVAL;
+	if (unlikely(!cpu_online(rcpu->cpu)))
+		return -ENETDOWN;
+
+	bq = this_cpu_ptr(rcpu->bulkq);
+	if (unlikely(bq->count == CPU_MAP_BULK_SIZE))
+		bq_flush_to_cpu(bq);
+
+	bq->q[bq->count++] = skb;
+	if (list_empty(&bq->flush_node))
+		list_add(&bq->flush_node, this_cpu_ptr(cmap->flush_list));
+
+	return 0;
+}
+
+void __cpu_map_flush(struct bpf_map *map)
+{
+	struct bpf_cpu_map *cmap = container_of(map, struct bpf_cpu_map, map);
+	struct list_head *flush_list = this_cpu_ptr(cmap->flush_list);
+	struct xdp_cpu_bulk_queue *bq, *tmp;
+
+	list_for_each_entry_safe(bq, tmp, flush_list, flush_node) {
+		bq_flush_to_cpu(bq);
+		list_del_init(&bq->flush_node);
+	}
+}
+
+static int cpu_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_cpu_map *cmap = container_of(map, struct bpf_cpu_map, map);
+	struct bpf_cpu_map_entry *old_rcpu;
+	u32 k = *(u32 *)key;
+
+	if (k >= map->max_entries)
+		return -EINVAL;
+
+	old_rcpu = xchg(&cmap->cpu_map[k], NULL);
+	if (old_rcpu)
+		call_rcu_sched(&old_rcpu->rcu, __cpu_map_entry_free);
+	return 0;
+}
+
+/* Called from syscall, with rcu_read_lock held and preemption disabled */
+static int cpu_map_update_elem(struct bpf_map *map, void *key, void *value,
+			       u64 map_flags)
+{
+	struct bpf_cpu_map *cmap = container_of(map, struct bpf_cpu_map, map);
+	struct bpf_cpu_map_entry *rcpu, *old_rcpu;
+	u32 qsize = *(u32 *)value;
+	u32 key_cpu = *(u32 *)key;
+	int cpu;
+
+	if (unlikely(map_flags > BPF_EXIST))
+		/* unknown flags */
+		return -EINVAL;
+
+	if (unlikely(key_cpu >= cmap->map.max_entries))
+		/* all elements were pre-allocated, cannot insert a new one */
+		return -E2BIG;
+
+	if (unlikely(map_flags == BPF_NOEXIST))
+		/* all elements already exist */
+		return -EEXIST;
+
+	/* the key is the CPU packets are steered to */
+	if (key_cpu >= nr_cpumask_bits || !cpu_possible(key_cpu))
+		return -ENODEV;
+
+	if (!qsize) {
+		rcpu = NULL;
+	} else {
+		rcpu = kmalloc(sizeof(*rcpu), GFP_ATOMIC | __GFP_NOWARN);
+		if (!rcpu)
+			return -ENOMEM;
+
+		rcpu->bulkq = __alloc_percpu_gfp(sizeof(*rcpu->bulkq),
+						 sizeof(void *),
+						 GFP_ATOMIC | __GFP_NOWARN);
+		if (!rcpu->bulkq) {
+			kfree(rcpu);
+			return -ENOMEM;
+		}
+
+		for_each_possible_cpu(cpu) {
+			struct xdp_cpu_bulk_queue *bq;
+
+			bq = per_cpu_ptr(rcpu->bulkq, cpu);
+			bq->count = 0;
+			INIT_LIST_HEAD(&bq->flush_node);
+			bq->obj = rcpu;
+		}
+
+		rcpu->cpu = key_cpu;
+		rcpu->qsize = qsize;
+	}
+
+	old_rcpu = xchg(&cmap->cpu_map[key_cpu], rcpu);
+	if (old_rcpu)
+		call_rcu_sched(&old_rcpu->rcu, __cpu_map_entry_free);
+
+	return 0;
+}
+
+static const struct bpf_map_ops cpu_map_ops = {
+	.map_alloc = cpu_map_alloc,
+	.map_free = cpu_map_free,
+	.map_get_next_key = cpu_map_get_next_key,
+	.map_lookup_elem = cpu_map_lookup_elem,
+	.map_update_elem = cpu_map_update_elem,
+	.map_delete_elem = cpu_map_delete_elem,
+};
+
+static struct bpf_map_type_list cpu_map_type __read_mostly = {
+	.ops = &cpu_map_ops,
+	.type = BPF_MAP_TYPE_CPUMAP,
+};
+
+static int __init register_cpu_map(void)
+{
+	bpf_register_map_type(&cpu_map_type);
+	return 0;
+}
+late_initcall(register_cpu_map);
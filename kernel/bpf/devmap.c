@@ -0,0 +1,393 @@
+/* Device map for XDP_REDIRECT
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ */
+
+/* A devmap is an array of net devices, indexed like an array map and
+ * updated from user space with ifindex values.  XDP programs select an
+ * entry with bpf_redirect_map() and the packet is transmitted on that
+ * device, bypassing the qdisc like XDP_TX does.
+ *
+ * Packets are not sent one at a time.  Each entry has a small per-cpu
+ * queue, and a redirected packet is only appended there.  The queue is
+ * handed to the driver as one batch, under one tx lock acquisition, when
+ * it fills up or when xdp_do_flush_map() runs at the end of the NAPI
+ * poll.  Queues holding packets sit on a per-cpu flush list of the map,
+ * so the flush only visits those.
+ *
+ * Enqueue and flush always happen in the same preempt-disabled section,
+ * so an entry replaced or removed from the map is freed after an
+ * RCU-sched grace period, at which point its queues are empty.  Entries
+ * hold a reference on their device, and are dropped from all maps when
+ * the device unregisters.
+ */
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/netdevice.h>
+#include <linux/slab.h>
+
+#define DEV_MAP_BULK_SIZE 16
+
+struct bpf_dtab_netdev;
+
+struct xdp_bulk_queue {
+	struct sk_buff *q[DEV_MAP_BULK_SIZE];
+	unsigned int count;
+	struct list_head flush_node;
+	struct bpf_dtab_netdev *obj;
+};
+
+struct bpf_dtab_netdev {
+	struct net_device *dev;
+	struct xdp_bulk_queue __percpu *bulkq;
+	struct rcu_head rcu;
+};
+
+struct bpf_dtab {
+	struct bpf_map map;
+	struct bpf_dtab_netdev **netdev_map;
+	struct list_head __percpu *flush_list;
+	struct list_head list;
+};
+
+static DEFINE_SPINLOCK(dev_map_lock);
+static LIST_HEAD(dev_map_list);
+
+/* Called from syscall */
+static struct bpf_map *dev_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_dtab *dtab;
+	int err = -EINVAL;
+	u64 cost;
+	int cpu;
+
+	if (!capable(CAP_NET_ADMIN))
+		return ERR_PTR(-EPERM);
+
+	/* check sanity of attributes */
+	if (attr->max_entries == 0 || attr->key_size != 4 ||
+	    attr->value_size != 4 || attr->map_flags)
+		return ERR_PTR(-EINVAL);
+
+	dtab = kzalloc(sizeof(*dtab), GFP_USER);
+	if (!dtab)
+		return ERR_PTR(-ENOMEM);
+
+	/* mandatory map attributes */
+	dtab->map.map_type = attr->map_type;
+	dtab->map.key_size = attr->key_size;
+	dtab->map.value_size = attr->value_size;
+	dtab->map.max_entries = attr->max_entries;
+	dtab->map.map_flags = attr->map_flags;
+
+	/* make sure page count doesn't overflow */
+	cost = (u64) dtab->map.max_entries * sizeof(struct bpf_dtab_netdev *);
+	cost += (u64) sizeof(struct list_head) * num_possible_cpus();
+	if (cost >= U32_MAX - PAGE_SIZE)
+		goto free_dtab;
+
+	dtab->map.pages = round_up(cost, PAGE_SIZE) >> PAGE_SHIFT;
+
+	/* if map size is larger than memlock limit, reject it early */
+	err = bpf_map_precharge_memlock(dtab->map.pages);
+	if (err)
+		goto free_dtab;
+
+	err = -ENOMEM;
+	dtab->flush_list = alloc_percpu(struct list_head);
+	if (!dtab->flush_list)
+		goto free_dtab;
+
+	for_each_possible_cpu(cpu)
+		INIT_LIST_HEAD(per_cpu_ptr(dtab->flush_list, cpu));
+
+	dtab->netdev_map = bpf_map_area_alloc(dtab->map.max_entries *
+					      sizeof(struct bpf_dtab_netdev *));
+	if (!dtab->netdev_map)
+		goto free_percpu;
+
+	spin_lock(&dev_map_lock);
+	list_add_tail_rcu(&dtab->list, &dev_map_list);
+	spin_unlock(&dev_map_lock);
+
+	return &dtab->map;
+
+free_percpu:
+	free_percpu(dtab->flush_list);
+free_dtab:
+	kfree(dtab);
+	return ERR_PTR(err);
+}
+
+static void dev_map_entry_free(struct bpf_dtab_netdev *dev)
+{
+	free_percpu(dev->bulkq);
+	dev_put(dev->dev);
+	kfree(dev);
+}
+
+static void __dev_map_entry_free(struct rcu_head *rcu)
+{
+	dev_map_entry_free(container_of(rcu, struct bpf_dtab_netdev, rcu));
+}
+
+/* Called when map->refcnt goes to zero, either from workqueue or from syscall */
+static void dev_map_free(struct bpf_map *map)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	int i;
+
+	spin_lock(&dev_map_lock);
+	list_del_rcu(&dtab->list);
+	spin_unlock(&dev_map_lock);
+
+	/* No program references the map anymore.  Wait for the ones that
+	 * did to finish their redirects and for the flushes that follow,
+	 * and for the netdev notifier to stop looking at the map.
+	 */
+	synchronize_sched();
+	synchronize_rcu();
+
+	for (i = 0; i < dtab->map.max_entries; i++) {
+		struct bpf_dtab_netdev *dev = dtab->netdev_map[i];
+
+		if (dev)
+			dev_map_entry_free(dev);
+	}
+
+	free_percpu(dtab->flush_list);
+	bpf_map_area_free(dtab->netdev_map);
+	kfree(dtab);
+}
+
+static int dev_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	u32 index = *(u32 *)key;
+	u32 *next = next_key;
+
+	if (index >= dtab->map.max_entries) {
+		*next = 0;
+		return 0;
+	}
+
+	if (index == dtab->map.max_entries - 1)
+		return -ENOENT;
+
+	*next = index + 1;
+	return 0;
+}
+
+static struct bpf_dtab_netdev *__dev_map_lookup_elem(struct bpf_map *map,
+						     u32 key)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+
+	if (key >= map->max_entries)
+		return NULL;
+
+	return READ_ONCE(dtab->netdev_map[key]);
+}
+
+/* Called from syscall only, programs use bpf_redirect_map() */
+static void *dev_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_dtab_netdev *dev = __dev_map_lookup_elem(map, *(u32 *)key);
+
+	return dev ? &dev->dev->ifindex : NULL;
+}
+
+static void bq_xmit_all(struct xdp_bulk_queue *bq)
+{
+	if (!bq->count)
+		return;
+
+	generic_xdp_xmit(bq->obj->dev, bq->q, bq->count);
+	bq->count = 0;
+}
+
+/* Called from the XDP_REDIRECT path with preemption disabled.  Takes
+ * ownership of the skb on success.
+ */
+int dev_map_enqueue(struct bpf_map *map, u32 key, struct sk_buff *skb)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	struct bpf_dtab_netdev *dst = __dev_map_lookup_elem(map, key);
+	struct xdp_bulk_queue *bq;
+	struct net_device *dev;
+
+	if (unlikely(!dst))
+		return -EINVAL;
+
+	dev = dst->dev;
+	if (unlikely(!(dev->flags & IFF_UP)))
+		return -ENETDOWN;
+
+	__skb_push(skb, skb->data - skb_mac_header(skb));
+	if (unlikely(skb->len > dev->mtu + dev->hard_header_len))
+		return -EMSGSIZE;
+
+	skb->dev = dev;
+
+	bq = this_cpu_ptr(dst->bulkq);
+	if (unlikely(bq->count == DEV_MAP_BULK_SIZE))
+		bq_xmit_all(bq);
+
+	bq->q[bq->count++] = skb;
+	if (list_empty(&bq->flush_node))
+		list_add(&bq->flush_node, this_cpu_ptr(dtab->flush_list));
+
+	return 0;
+}
+
+void __dev_map_flush(struct bpf_map *map)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	struct list_head *flush_list = this_cpu_ptr(dtab->flush_list);
+	struct xdp_bulk_queue *bq, *tmp;
+
+	list_for_each_entry_safe(bq, tmp, flush_list, flush_node) {
+		bq_xmit_all(bq);
+		list_del_init(&bq->flush_node);
+	}
+}
+
+static int dev_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	struct bpf_dtab_netdev *old_dev;
+	u32 k = *(u32 *)key;
+
+	if (k >= map->max_entries)
+		return -EINVAL;
+
+	old_dev = xchg(&dtab->netdev_map[k], NULL);
+	if (old_dev)
+		call_rcu_sched(&old_dev->rcu, __dev_map_entry_free);
+	return 0;
+}
+
+/* Called from syscall, with rcu_read_lock held and preemption disabled */
+static int dev_map_update_elem(struct bpf_map *map, void *key, void *value,
+			       u64 map_flags)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	struct net *net = current->nsproxy->net_ns;
+	struct bpf_dtab_netdev *dev, *old_dev;
+	u32 ifindex = *(u32 *)value;
+	u32 i = *(u32 *)key;
+	int cpu;
+
+	if (unlikely(map_flags > BPF_EXIST))
+		/* unknown flags */
+		return -EINVAL;
+
+	if (unlikely(i >= dtab->map.max_entries))
+		/* all elements were pre-allocated, cannot insert a new one */
+		return -E2BIG;
+
+	if (unlikely(map_flags == BPF_NOEXIST))
+		/* all elements already exist */
+		return -EEXIST;
+
+	if (!ifindex) {
+		dev = NULL;
+	} else {
+		dev = kmalloc(sizeof(*dev), GFP_ATOMIC | __GFP_NOWARN);
+		if (!dev)
+			return -ENOMEM;
+
+		dev->bulkq = __alloc_percpu_gfp(sizeof(*dev->bulkq),
+						sizeof(void *),
+						GFP_ATOMIC | __GFP_NOWARN);
+		if (!dev->bulkq) {
+			kfree(dev);
+			return -ENOMEM;
+		}
+
+		for_each_possible_cpu(cpu) {
+			struct xdp_bulk_queue *bq = per_cpu_ptr(dev->bulkq, cpu);
+
+			bq->count = 0;
+			INIT_LIST_HEAD(&bq->flush_node);
+			bq->obj = dev;
+		}
+
+		dev->dev = dev_get_by_index(net, ifindex);
+		if (!dev->dev) {
+			free_percpu(dev->bulkq);
+			kfree(dev);
+			return -EINVAL;
+		}
+	}
+
+	old_dev = xchg(&dtab->netdev_map[i], dev);
+	if (old_dev)
+		call_rcu_sched(&old_dev->rcu, __dev_map_entry_free);
+
+	return 0;
+}
+
+static const struct bpf_map_ops dev_map_ops = {
+	.map_alloc = dev_map_alloc,
+	.map_free = dev_map_free,
+	.map_get_next_key = dev_map_get_next_key,
+	.map_lookup_elem = dev_map_lookup_elem,
+	.map_update_elem = dev_map_update_elem,
+	.map_delete_elem = dev_map_delete_elem,
+};
+
+static struct bpf_map_type_list dev_map_type __read_mostly = {
+	.ops = &dev_map_ops,
+	.type = BPF_MAP_TYPE_DEVMAP,
+};
+
+static int dev_map_notification(struct notifier_block *notifier,
+				ulong event, void *ptr)
+{
+	struct net_device *netdev = netdev_notifier_info_to_dev(ptr);
+	struct bpf_dtab *dtab;
+	int i;
+
+	if (event != NETDEV_UNREGISTER)
+		return NOTIFY_OK;
+
+	/* The device cannot finish unregistering while a map still holds
+	 * it, so drop it from every map it was inserted in.
+	 */
+	rcu_read_lock();
+	list_for_each_entry_rcu(dtab, &dev_map_list, list) {
+		for (i = 0; i < dtab->map.max_entries; i++) {
+			struct bpf_dtab_netdev *dev, *odev;
+
+			dev = READ_ONCE(dtab->netdev_map[i]);
+			if (!dev || dev->dev != netdev)
+				continue;
+			odev = cmpxchg(&dtab->netdev_map[i], dev, NULL);
+			if (dev == odev)
+				call_rcu_sched(&dev->rcu, __dev_map_entry_free);
+		}
+	}
+	rcu_read_unlock();
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block dev_map_notifier = {
+	.notifier_call = dev_map_notification,
+};
+
+static int __init register_dev_map(void)
+{
+	register_netdevice_notifier(&dev_map_notifier);
+	bpf_register_map_type(&dev_map_type);
+	return 0;
+}
+late_initcall(register_dev_map);
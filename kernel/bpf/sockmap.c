@@ -0,0 +1,813 @@
+/* SOCKMAP used for redirecting messages between TCP sockets
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ */
+
+/* A sockmap is an array of established TCP sockets, updated from user
+ * space with socket file descriptors.
+ *
+ * The map may have two BPF_PROG_TYPE_SK_SKB programs attached to it.  A
+ * BPF_SK_SKB_STREAM_PARSER program returns the length of the next
+ * message in the receive stream, a BPF_SK_SKB_STREAM_VERDICT program
+ * then sees each whole message and may pick another socket of the map
+ * with bpf_sk_redirect_map(), to which the message is sent as is.  The
+ * data never reaches the receive queue of the socket it arrived on.
+ *
+ * Sockets pick the programs up when they are added to a map that has
+ * both of them attached; attaching programs later does not change
+ * sockets already in the map.  A socket may be in several maps, but
+ * runs a single parser and verdict pair: adding it to a map with other
+ * programs fails with -EBUSY.  Sockets in a map without programs can
+ * only be redirect targets.
+ *
+ * Per socket state lives in a smap_psock hung off sk_user_data.  It
+ * holds a reference on the socket and is itself referenced by every map
+ * slot the socket is in; its fields are protected by sk_callback_lock.
+ * Closing the socket takes it out of all maps, for which sockets in a
+ * map run with a copy of their struct proto with close() overridden.
+ */
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/list.h>
+#include <linux/net.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <net/inet_connection_sock.h>
+#include <net/sock.h>
+#include <net/strparser.h>
+
+struct bpf_stab {
+	struct bpf_map map;
+	struct sock **sock_map;
+	struct bpf_prog *bpf_parse;
+	struct bpf_prog *bpf_verdict;
+	/* serializes updates, and program attach against them */
+	spinlock_t lock;
+};
+
+enum smap_psock_state {
+	SMAP_TX_RUNNING,
+};
+
+struct smap_psock_map_entry {
+	struct list_head list;
+	struct sock **entry;
+};
+
+struct smap_psock {
+	struct rcu_head	rcu;
+	/* refcnt and maps are protected by sk_callback_lock */
+	int refcnt;
+	struct list_head maps;
+
+	/* messages redirected to this socket, sent from tx_work */
+	struct sk_buff_head rxqueue;
+
+	/* partially sent skb, resumed once the socket has room again */
+	struct sk_buff *save_skb;
+	int save_rem;
+	int save_off;
+
+	struct strparser strp;
+	struct bpf_prog *bpf_parse;
+	struct bpf_prog *bpf_verdict;
+
+	struct sock *sock;
+	unsigned long state;
+
+	struct work_struct tx_work;
+	struct work_struct gc_work;
+
+	struct proto *sk_proto;
+	void (*save_data_ready)(struct sock *sk);
+	void (*save_write_space)(struct sock *sk);
+};
+
+static void bpf_tcp_close(struct sock *sk, long timeout);
+
+static inline struct smap_psock *smap_psock_sk(const struct sock *sk)
+{
+	if (sk->sk_prot->close != bpf_tcp_close)
+		return NULL;
+
+	return rcu_dereference_sk_user_data(sk);
+}
+
+/* One copy of struct proto per base proto, i.e. for TCP over IPv4 and
+ * over IPv6.  Copies are made on first use and never freed.
+ */
+static struct proto bpf_tcp_prots[2];
+static struct proto *bpf_tcp_bases[2];
+static DEFINE_SPINLOCK(bpf_tcp_prots_lock);
+
+static struct proto *bpf_tcp_prot(struct proto *base)
+{
+	struct proto *prot = NULL;
+	int i;
+
+	spin_lock_bh(&bpf_tcp_prots_lock);
+	for (i = 0; i < ARRAY_SIZE(bpf_tcp_prots); i++) {
+		if (!bpf_tcp_bases[i]) {
+			bpf_tcp_prots[i] = *base;
+			bpf_tcp_prots[i].close = bpf_tcp_close;
+			bpf_tcp_bases[i] = base;
+		}
+		if (bpf_tcp_bases[i] == base) {
+			prot = &bpf_tcp_prots[i];
+			break;
+		}
+	}
+	spin_unlock_bh(&bpf_tcp_prots_lock);
+
+	return prot;
+}
+
+static int smap_parse_func_strparser(struct strparser *strp,
+				     struct sk_buff *skb)
+{
+	struct smap_psock *psock = container_of(strp, struct smap_psock, strp);
+	unsigned int offset = strp_rx_msg(skb)->offset;
+	struct sk_buff *msg = skb;
+	struct bpf_prog *prog;
+	int rc;
+
+	rcu_read_lock();
+	prog = READ_ONCE(psock->bpf_parse);
+
+	/* The head skb of a message may still carry the tail of the one
+	 * before, the parser gets to see the new message from its first
+	 * byte on.
+	 */
+	if (offset > skb_headlen(skb)) {
+		msg = skb_clone(skb, GFP_ATOMIC);
+		if (!msg || !pskb_pull(msg, offset)) {
+			kfree_skb(msg);
+			rcu_read_unlock();
+			return -ENOMEM;
+		}
+	} else {
+		__skb_pull(skb, offset);
+	}
+
+	bpf_compute_data_end(msg);
+	rc = BPF_PROG_RUN(prog, msg);
+
+	if (msg != skb)
+		consume_skb(msg);
+	else
+		__skb_push(skb, offset);
+	rcu_read_unlock();
+
+	return rc;
+}
+
+/* The strparser hands over a message in the skb it was assembled in,
+ * possibly with data of neighbouring messages before and after it.
+ */
+static int smap_trim_msg(struct sk_buff *skb)
+{
+	struct strp_rx_msg *rxm = strp_rx_msg(skb);
+	int len = rxm->full_len;
+
+	if (rxm->offset && !pskb_pull(skb, rxm->offset))
+		return -ENOMEM;
+
+	return pskb_trim(skb, len);
+}
+
+static int smap_verdict_func(struct smap_psock *psock, struct sk_buff *skb)
+{
+	struct bpf_prog *prog = READ_ONCE(psock->bpf_verdict);
+
+	*bpf_sk_redir(skb) = NULL;
+	bpf_compute_data_end(skb);
+
+	return BPF_PROG_RUN(prog, skb) == SK_PASS ? SK_PASS : SK_DROP;
+}
+
+static void smap_do_verdict(struct smap_psock *psock, struct sk_buff *skb)
+{
+	struct smap_psock *peer;
+	struct sock *sk;
+
+	if (smap_verdict_func(psock, skb) != SK_PASS)
+		goto drop;
+
+	sk = *bpf_sk_redir(skb);
+	if (unlikely(!sk))
+		goto drop;
+
+	peer = smap_psock_sk(sk);
+	if (likely(peer && test_bit(SMAP_TX_RUNNING, &peer->state) &&
+		   !sock_flag(sk, SOCK_DEAD) && sock_writeable(sk))) {
+		skb_set_owner_w(skb, sk);
+		skb_queue_tail(&peer->rxqueue, skb);
+		schedule_work(&peer->tx_work);
+		return;
+	}
+drop:
+	kfree_skb(skb);
+}
+
+static void smap_read_sock_strparser(struct strparser *strp,
+				     struct sk_buff *skb)
+{
+	struct smap_psock *psock = container_of(strp, struct smap_psock, strp);
+
+	if (unlikely(smap_trim_msg(skb))) {
+		kfree_skb(skb);
+		return;
+	}
+
+	rcu_read_lock();
+	smap_do_verdict(psock, skb);
+	rcu_read_unlock();
+}
+
+static void smap_data_ready(struct sock *sk)
+{
+	struct smap_psock *psock;
+
+	read_lock_bh(&sk->sk_callback_lock);
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (likely(psock))
+		strp_data_ready(&psock->strp);
+	else
+		sk->sk_data_ready(sk);
+	rcu_read_unlock();
+	read_unlock_bh(&sk->sk_callback_lock);
+}
+
+static void smap_report_sk_error(struct smap_psock *psock, int err)
+{
+	struct sock *sk = psock->sock;
+
+	sk->sk_err = err;
+	sk->sk_error_report(sk);
+}
+
+static void smap_tx_work(struct work_struct *w)
+{
+	struct smap_psock *psock;
+	struct sk_buff *skb;
+	int rem, off, n;
+
+	psock = container_of(w, struct smap_psock, tx_work);
+
+	/* lock sock to avoid losing sk_socket during loop */
+	lock_sock(psock->sock);
+	if (psock->save_skb) {
+		skb = psock->save_skb;
+		rem = psock->save_rem;
+		off = psock->save_off;
+		psock->save_skb = NULL;
+		goto start;
+	}
+
+	while ((skb = skb_dequeue(&psock->rxqueue))) {
+		rem = skb->len;
+		off = 0;
+start:
+		do {
+			if (likely(psock->sock->sk_socket))
+				n = skb_send_sock_locked(psock->sock,
+							 skb, off, rem);
+			else
+				n = -EINVAL;
+			if (n <= 0) {
+				if (n == -EAGAIN) {
+					/* Retry when space is available */
+					psock->save_skb = skb;
+					psock->save_rem = rem;
+					psock->save_off = off;
+					goto out;
+				}
+				/* Hard errors break pipe and stop xmit */
+				smap_report_sk_error(psock, n ? -n : EPIPE);
+				clear_bit(SMAP_TX_RUNNING, &psock->state);
+				kfree_skb(skb);
+				goto out;
+			}
+			rem -= n;
+			off += n;
+		} while (rem);
+		kfree_skb(skb);
+	}
+out:
+	release_sock(psock->sock);
+}
+
+static void smap_write_space(struct sock *sk)
+{
+	void (*write_space)(struct sock *sk);
+	struct smap_psock *psock;
+
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (likely(psock)) {
+		if (test_bit(SMAP_TX_RUNNING, &psock->state))
+			schedule_work(&psock->tx_work);
+		write_space = psock->save_write_space;
+	} else {
+		write_space = sk->sk_write_space;
+	}
+	rcu_read_unlock();
+
+	write_space(sk);
+}
+
+static void smap_gc_work(struct work_struct *w)
+{
+	struct smap_psock *psock = container_of(w, struct smap_psock, gc_work);
+
+	/* No longer reachable from the socket nor from any map */
+	if (psock->bpf_parse) {
+		strp_done(&psock->strp);
+		bpf_prog_put(psock->bpf_parse);
+		bpf_prog_put(psock->bpf_verdict);
+	}
+
+	cancel_work_sync(&psock->tx_work);
+	__skb_queue_purge(&psock->rxqueue);
+	kfree_skb(psock->save_skb);
+
+	sock_put(psock->sock);
+	kfree(psock);
+}
+
+static void smap_gc_rcu(struct rcu_head *rcu)
+{
+	struct smap_psock *psock = container_of(rcu, struct smap_psock, rcu);
+
+	schedule_work(&psock->gc_work);
+}
+
+/* Drops the reference of one map slot, with sk_callback_lock held for
+ * writing.  The last one gives the socket its callbacks and proto back.
+ */
+static void smap_release_sock(struct smap_psock *psock, struct sock *sock)
+{
+	if (--psock->refcnt)
+		return;
+
+	if (psock->bpf_parse) {
+		sock->sk_data_ready = psock->save_data_ready;
+		strp_stop(&psock->strp);
+	}
+	clear_bit(SMAP_TX_RUNNING, &psock->state);
+	sock->sk_write_space = psock->save_write_space;
+	sock->sk_prot = psock->sk_proto;
+	rcu_assign_sk_user_data(sock, NULL);
+
+	call_rcu(&psock->rcu, smap_gc_rcu);
+}
+
+static void bpf_tcp_close(struct sock *sk, long timeout)
+{
+	void (*close_fun)(struct sock *sk, long timeout);
+	struct smap_psock_map_entry *e, *tmp;
+	struct smap_psock *psock;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (unlikely(!psock)) {
+		/* released since close() looked at sk_prot */
+		rcu_read_unlock();
+		write_unlock_bh(&sk->sk_callback_lock);
+		sk->sk_prot->close(sk, timeout);
+		return;
+	}
+
+	close_fun = psock->sk_proto->close;
+	list_for_each_entry_safe(e, tmp, &psock->maps, list) {
+		/* a slot already cleared belongs to whoever cleared it */
+		if (cmpxchg(e->entry, sk, NULL) != sk)
+			continue;
+		list_del(&e->list);
+		kfree(e);
+		smap_release_sock(psock, sk);
+	}
+	rcu_read_unlock();
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	close_fun(sk, timeout);
+}
+
+static struct smap_psock *smap_init_psock(struct sock *sock)
+{
+	struct smap_psock *psock;
+
+	psock = kzalloc(sizeof(*psock), GFP_ATOMIC | __GFP_NOWARN);
+	if (!psock)
+		return NULL;
+
+	psock->sock = sock;
+	psock->refcnt = 1;
+	INIT_LIST_HEAD(&psock->maps);
+	skb_queue_head_init(&psock->rxqueue);
+	INIT_WORK(&psock->tx_work, smap_tx_work);
+	INIT_WORK(&psock->gc_work, smap_gc_work);
+	set_bit(SMAP_TX_RUNNING, &psock->state);
+
+	return psock;
+}
+
+static int smap_start_sock(struct smap_psock *psock, struct sock *sk,
+			   struct bpf_prog *parse, struct bpf_prog *verdict)
+{
+	struct strp_callbacks cb = {
+		.rcv_msg = smap_read_sock_strparser,
+		.parse_msg = smap_parse_func_strparser,
+	};
+	int err;
+
+	err = strp_init(&psock->strp, sk, &cb);
+	if (err)
+		return err;
+
+	parse = bpf_prog_inc(parse);
+	if (IS_ERR(parse))
+		return PTR_ERR(parse);
+
+	verdict = bpf_prog_inc(verdict);
+	if (IS_ERR(verdict)) {
+		bpf_prog_put(parse);
+		return PTR_ERR(verdict);
+	}
+
+	psock->bpf_parse = parse;
+	psock->bpf_verdict = verdict;
+	psock->save_data_ready = sk->sk_data_ready;
+	sk->sk_data_ready = smap_data_ready;
+
+	/* pick up whatever was received before */
+	strp_check_rcv(&psock->strp);
+	return 0;
+}
+
+/* Takes @sock, already cleared from slot @i of @stab, off its psock */
+static void smap_map_remove(struct bpf_stab *stab, u32 i, struct sock *sock)
+{
+	struct smap_psock_map_entry *e;
+	struct smap_psock *psock;
+
+	write_lock_bh(&sock->sk_callback_lock);
+	psock = smap_psock_sk(sock);
+	if (likely(psock)) {
+		list_for_each_entry(e, &psock->maps, list) {
+			if (e->entry != &stab->sock_map[i])
+				continue;
+			list_del(&e->list);
+			kfree(e);
+			smap_release_sock(psock, sock);
+			break;
+		}
+	}
+	write_unlock_bh(&sock->sk_callback_lock);
+}
+
+/* Called from syscall */
+static struct bpf_map *sock_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_stab *stab;
+	int err = -EINVAL;
+	u64 cost;
+
+	if (!capable(CAP_NET_ADMIN))
+		return ERR_PTR(-EPERM);
+
+	/* check sanity of attributes */
+	if (attr->max_entries == 0 || attr->key_size != 4 ||
+	    attr->value_size != 4 || attr->map_flags)
+		return ERR_PTR(-EINVAL);
+
+	stab = kzalloc(sizeof(*stab), GFP_USER);
+	if (!stab)
+		return ERR_PTR(-ENOMEM);
+
+	/* mandatory map attributes */
+	stab->map.map_type = attr->map_type;
+	stab->map.key_size = attr->key_size;
+	stab->map.value_size = attr->value_size;
+	stab->map.max_entries = attr->max_entries;
+	stab->map.map_flags = attr->map_flags;
+
+	cost = (u64) stab->map.max_entries * sizeof(struct sock *);
+	stab->map.pages = round_up(cost, PAGE_SIZE) >> PAGE_SHIFT;
+
+	/* if map size is larger than memlock limit, reject it early */
+	err = bpf_map_precharge_memlock(stab->map.pages);
+	if (err)
+		goto free_stab;
+
+	err = -ENOMEM;
+	stab->sock_map = bpf_map_area_alloc(stab->map.max_entries *
+					    sizeof(struct sock *));
+	if (!stab->sock_map)
+		goto free_stab;
+
+	spin_lock_init(&stab->lock);
+	return &stab->map;
+
+free_stab:
+	kfree(stab);
+	return ERR_PTR(err);
+}
+
+/* Called once user space dropped its last reference.  The verdict
+ * program commonly refers to the map it is attached to, so without
+ * dropping programs and sockets here the map would never be freed.
+ */
+void sock_map_clear(struct bpf_map *map)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	struct bpf_prog *parse, *verdict;
+	u32 i;
+
+	spin_lock_bh(&stab->lock);
+	parse = stab->bpf_parse;
+	verdict = stab->bpf_verdict;
+	stab->bpf_parse = NULL;
+	stab->bpf_verdict = NULL;
+	spin_unlock_bh(&stab->lock);
+
+	if (parse)
+		bpf_prog_put(parse);
+	if (verdict)
+		bpf_prog_put(verdict);
+
+	rcu_read_lock();
+	for (i = 0; i < stab->map.max_entries; i++) {
+		struct sock *sock = xchg(&stab->sock_map[i], NULL);
+
+		if (sock)
+			smap_map_remove(stab, i, sock);
+	}
+	rcu_read_unlock();
+}
+
+/* Called when map->refcnt goes to zero, either from workqueue or from syscall */
+static void sock_map_free(struct bpf_map *map)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+
+	/* wait for programs that still had the map to finish redirects */
+	synchronize_rcu();
+
+	sock_map_clear(map);
+	bpf_map_area_free(stab->sock_map);
+	kfree(stab);
+}
+
+static int sock_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	u32 index = *(u32 *)key;
+	u32 *next = next_key;
+
+	if (index >= stab->map.max_entries) {
+		*next = 0;
+		return 0;
+	}
+
+	if (index == stab->map.max_entries - 1)
+		return -ENOENT;
+
+	*next = index + 1;
+	return 0;
+}
+
+/* Called from bpf_sk_redirect_map() under rcu_read_lock */
+struct sock *__sock_map_lookup_elem(struct bpf_map *map, u32 key)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+
+	if (key >= map->max_entries)
+		return NULL;
+
+	return READ_ONCE(stab->sock_map[key]);
+}
+
+/* Called from syscall only, as for the xskmap there is nothing in a
+ * socket that means anything to user space.
+ */
+static void *sock_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	return NULL;
+}
+
+static int sock_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	u32 k = *(u32 *)key;
+	struct sock *sock;
+
+	if (k >= map->max_entries)
+		return -EINVAL;
+
+	sock = xchg(&stab->sock_map[k], NULL);
+	if (!sock)
+		return -EINVAL;
+
+	smap_map_remove(stab, k, sock);
+	return 0;
+}
+
+static int sock_map_ctx_update_elem(struct bpf_stab *stab, u32 i,
+				    struct sock *sock, u64 flags)
+{
+	struct bpf_prog *parse, *verdict;
+	struct smap_psock_map_entry *e;
+	struct smap_psock *psock;
+	bool start_strp = false;
+	struct sock *osock;
+	struct proto *prot = NULL;
+	bool new = false;
+	int err;
+
+	if (sock->sk_type != SOCK_STREAM ||
+	    sock->sk_protocol != IPPROTO_TCP ||
+	    (sock->sk_family != AF_INET && sock->sk_family != AF_INET6))
+		return -EOPNOTSUPP;
+
+	if (sock->sk_state != TCP_ESTABLISHED)
+		return -ENOTCONN;
+
+	/* An upper layer protocol such as tls has replaced sk_prot, it
+	 * cannot be wrapped again.
+	 */
+	if (inet_csk(sock)->icsk_ulp_ops)
+		return -EINVAL;
+
+	e = kzalloc(sizeof(*e), GFP_ATOMIC | __GFP_NOWARN);
+	if (!e)
+		return -ENOMEM;
+	e->entry = &stab->sock_map[i];
+
+	spin_lock_bh(&stab->lock);
+	osock = stab->sock_map[i];
+	if (osock && flags == BPF_NOEXIST) {
+		err = -EEXIST;
+		goto out_unlock;
+	}
+	if (!osock && flags == BPF_EXIST) {
+		err = -ENOENT;
+		goto out_unlock;
+	}
+
+	write_lock_bh(&sock->sk_callback_lock);
+	psock = smap_psock_sk(sock);
+	if (!psock) {
+		/* sk_user_data is taken by another user, e.g. kcm */
+		err = -EBUSY;
+		if (sock->sk_user_data)
+			goto out_cb_unlock;
+
+		err = -EOPNOTSUPP;
+		prot = bpf_tcp_prot(sock->sk_prot);
+		if (!prot)
+			goto out_cb_unlock;
+
+		err = -ENOMEM;
+		psock = smap_init_psock(sock);
+		if (!psock)
+			goto out_cb_unlock;
+		new = true;
+	}
+
+	parse = stab->bpf_parse;
+	verdict = stab->bpf_verdict;
+	if (parse && verdict) {
+		err = -EBUSY;
+		if (!psock->bpf_parse)
+			start_strp = true;
+		else if (psock->bpf_parse != parse ||
+			 psock->bpf_verdict != verdict)
+			goto out_free_psock;
+	}
+
+	if (start_strp) {
+		err = smap_start_sock(psock, sock, parse, verdict);
+		if (err)
+			goto out_free_psock;
+	}
+
+	if (new) {
+		sock_hold(sock);
+		psock->sk_proto = sock->sk_prot;
+		psock->save_write_space = sock->sk_write_space;
+		sock->sk_write_space = smap_write_space;
+		sock->sk_prot = prot;
+		rcu_assign_sk_user_data(sock, psock);
+	} else {
+		psock->refcnt++;
+	}
+	list_add_tail(&e->list, &psock->maps);
+	write_unlock_bh(&sock->sk_callback_lock);
+
+	osock = xchg(&stab->sock_map[i], sock);
+	if (osock)
+		smap_map_remove(stab, i, osock);
+	spin_unlock_bh(&stab->lock);
+	return 0;
+
+out_free_psock:
+	if (new)
+		kfree(psock);
+out_cb_unlock:
+	write_unlock_bh(&sock->sk_callback_lock);
+out_unlock:
+	spin_unlock_bh(&stab->lock);
+	kfree(e);
+	return err;
+}
+
+/* Called from syscall, with rcu_read_lock held and preemption disabled */
+static int sock_map_update_elem(struct bpf_map *map, void *key, void *value,
+				u64 flags)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	u32 i = *(u32 *)key, fd = *(u32 *)value;
+	struct socket *socket;
+	int err;
+
+	if (unlikely(flags > BPF_EXIST))
+		/* unknown flags */
+		return -EINVAL;
+
+	if (unlikely(i >= stab->map.max_entries))
+		/* all elements were pre-allocated, cannot insert a new one */
+		return -E2BIG;
+
+	socket = sockfd_lookup(fd, &err);
+	if (!socket)
+		return err;
+
+	/* The file reference keeps close() away until the socket is in */
+	err = sock_map_ctx_update_elem(stab, i, socket->sk, flags);
+	sockfd_put(socket);
+	return err;
+}
+
+int sock_map_prog(struct bpf_map *map, struct bpf_prog *prog, u32 type)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	struct bpf_prog *orig;
+
+	if (unlikely(map->map_type != BPF_MAP_TYPE_SOCKMAP))
+		return -EINVAL;
+
+	spin_lock_bh(&stab->lock);
+	switch (type) {
+	case BPF_SK_SKB_STREAM_PARSER:
+		orig = stab->bpf_parse;
+		stab->bpf_parse = prog;
+		break;
+	case BPF_SK_SKB_STREAM_VERDICT:
+		orig = stab->bpf_verdict;
+		stab->bpf_verdict = prog;
+		break;
+	default:
+		spin_unlock_bh(&stab->lock);
+		return -EOPNOTSUPP;
+	}
+	spin_unlock_bh(&stab->lock);
+
+	if (orig)
+		bpf_prog_put(orig);
+	else if (!prog)
+		return -ENOENT;
+
+	return 0;
+}
+
+static const struct bpf_map_ops sock_map_ops = {
+	.map_alloc = sock_map_alloc,
+	.map_free = sock_map_free,
+	.map_lookup_elem = sock_map_lookup_elem,
+	.map_get_next_key = sock_map_get_next_key,
+	.map_update_elem = sock_map_update_elem,
+	.map_delete_elem = sock_map_delete_elem,
+};
+
+static struct bpf_map_type_list sock_map_type __read_mostly = {
+	.ops = &sock_map_ops,
+	.type = BPF_MAP_TYPE_SOCKMAP,
+};
+
+static int __init register_sock_map(void)
+{
+	bpf_register_map_type(&sock_map_type);
+	return 0;
+}
+late_initcall(register_sock_map);
@@ -19,6 +19,8 @@
 #include <net/netlink.h>
 #include <linux/file.h>
 #include <linux/vmalloc.h>
+#include <linux/bsearch.h>
+#include <linux/sort.h>
 
 /* bpf_check() is a static code analyzer that walks eBPF program
  * instruction by instruction and updates register/stack state.
@@ -27,9 +29,12 @@
  * The first pass is depth-first-search to check that the program is a DAG.
  * It rejects the following programs:
  * - larger than BPF_MAXINSNS insns
- * - if loop is present (detected via back-edge)
+ * - if loop is present (detected via back-edge) and the loader is unprivileged
+ * - recursive bpf-to-bpf calls (back-edge along a call)
  * - unreachable insns exist (shouldn't be a forest. program = one function)
  * - out of bounds or malformed jumps
+ * Loops of privileged programs are walked by the second pass like any other
+ * path, so they are only accepted when the verifier can see them terminate.
  * The second pass is all possible path descent from the 1st insn.
  * Since it's analyzing all pathes through the program, the length of the
  * analysis is limited to 32k insn, which may be hit even if total number of
@@ -125,6 +130,14 @@
  *
  * After the call R0 is set to return type of the function and registers R1-R5
  * are set to NOT_INIT to indicate that they are no longer readable.
+ *
+ * A BPF_CALL with src_reg == BPF_PSEUDO_CALL calls another function of the
+ * same program instead of a helper. The verifier descends into the callee
+ * with a fresh frame: R1-R5 are copied from the caller, R10 points to the
+ * callee's own stack, and on BPF_EXIT R0 is handed back to the caller.
+ * Pointers into a caller's stack may be passed down, but never returned or
+ * stored into a caller's frame. Stack usage of all the functions along any
+ * call chain must fit into MAX_BPF_STACK.
  */
 
 /* verifier_state + insn_idx are pushed to stack when branch is encountered */
@@ -190,18 +203,23 @@ static const char * const reg_type_str[] = {
 	[PTR_TO_PACKET_END]	= "pkt_end",
 };
 
-static void print_verifier_state(struct bpf_verifier_state *state)
+static void print_verifier_state(struct bpf_func_state *state)
 {
 	struct bpf_reg_state *reg;
 	enum bpf_reg_type t;
 	int i;
 
+	if (state->frameno)
+		verbose(" frame%d:", state->frameno);
 	for (i = 0; i < MAX_BPF_REG; i++) {
 		reg = &state->regs[i];
 		t = reg->type;
 		if (t == NOT_INIT)
 			continue;
 		verbose(" R%d=%s", i, reg_type_str[t]);
+		if ((t == FRAME_PTR || t == PTR_TO_STACK) &&
+		    reg->frameno != state->frameno)
+			verbose("[%d]", reg->frameno);
 		if (t == CONST_IMM || t == PTR_TO_STACK)
 			verbose("%lld", reg->imm);
 		else if (t == PTR_TO_PACKET)
@@ -365,7 +383,12 @@ static void print_bpf_insn(const struct bpf_verifier_env *env,
 		u8 opcode = BPF_OP(insn->code);
 
 		if (opcode == BPF_CALL) {
-			verbose("(%02x) call %d\n", insn->code, insn->imm);
+			if (insn->src_reg == BPF_PSEUDO_CALL)
+				verbose("(%02x) call pc%+d\n", insn->code,
+					insn->imm);
+			else
+				verbose("(%02x) call %d\n", insn->code,
+					insn->imm);
 		} else if (insn->code == (BPF_JMP | BPF_JA)) {
 			verbose("(%02x) goto pc%+d\n",
 				insn->code, insn->off);
@@ -387,48 +410,151 @@ static void print_bpf_insn(const struct bpf_verifier_env *env,
 	}
 }
 
-static int pop_stack(struct bpf_verifier_env *env, int *prev_insn_idx)
+static struct bpf_func_state *cur_func(struct bpf_verifier_env *env)
 {
-	struct bpf_verifier_stack_elem *elem;
-	int insn_idx;
+	struct bpf_verifier_state *cur = env->cur_state;
 
-	if (env->head == NULL)
-		return -1;
+	return cur->frame[cur->curframe];
+}
+
+static struct bpf_reg_state *cur_regs(struct bpf_verifier_env *env)
+{
+	return cur_func(env)->regs;
+}
 
-	memcpy(&env->cur_state, &env->head->st, sizeof(env->cur_state));
-	insn_idx = env->head->insn_idx;
+/* the frame whose stack a FRAME_PTR or PTR_TO_STACK register points to */
+static struct bpf_func_state *reg_frame(struct bpf_verifier_env *env,
+					const struct bpf_reg_state *reg)
+{
+	return env->cur_state->frame[reg->frameno];
+}
+
+static void free_verifier_state(struct bpf_verifier_state *state,
+				bool free_self)
+{
+	int i;
+
+	for (i = 0; i <= state->curframe; i++) {
+		kfree(state->frame[i]);
+		state->frame[i] = NULL;
+	}
+	if (free_self)
+		kfree(state);
+}
+
+/* copy verifier state from src to dst, growing or shrinking the set of
+ * frames dst owns to match src
+ */
+static int copy_verifier_state(struct bpf_verifier_state *dst,
+			       const struct bpf_verifier_state *src)
+{
+	int i;
+
+	for (i = src->curframe + 1; i <= dst->curframe; i++) {
+		kfree(dst->frame[i]);
+		dst->frame[i] = NULL;
+	}
+	dst->curframe = src->curframe;
+	dst->parent = src->parent;
+	dst->branches = src->branches;
+	for (i = 0; i <= src->curframe; i++) {
+		if (!dst->frame[i]) {
+			dst->frame[i] = kmalloc(sizeof(struct bpf_func_state),
+						GFP_KERNEL);
+			if (!dst->frame[i])
+				return -ENOMEM;
+		}
+		memcpy(dst->frame[i], src->frame[i],
+		       sizeof(struct bpf_func_state));
+	}
+	return 0;
+}
+
+/* a path through the program has ended: walk up the chain of explored
+ * states it went through and retire every state that has no more
+ * pending paths, so that it can be used for pruning from now on
+ */
+static void update_branch_counts(struct bpf_verifier_state *st)
+{
+	while (st) {
+		u32 br = --st->branches;
+
+		WARN_ON_ONCE((int)br < 0);
+		if (br)
+			break;
+		st = st->parent;
+	}
+}
+
+/* states are never freed before the end of the verification, so the
+ * number of saved and queued states is the memory footprint of the run
+ */
+static void update_peak_states(struct bpf_verifier_env *env)
+{
+	u32 cur = env->total_states + env->stack_size;
+
+	if (cur > env->peak_states)
+		env->peak_states = cur;
+}
+
+static int pop_stack(struct bpf_verifier_env *env, int *prev_insn_idx,
+		     int *insn_idx)
+{
+	struct bpf_verifier_state *cur = env->cur_state;
+	struct bpf_verifier_stack_elem *elem, *head = env->head;
+	int err;
+
+	if (head == NULL)
+		return -ENOENT;
+
+	if (cur) {
+		err = copy_verifier_state(cur, &head->st);
+		if (err)
+			return err;
+	}
+	if (insn_idx)
+		*insn_idx = head->insn_idx;
 	if (prev_insn_idx)
-		*prev_insn_idx = env->head->prev_insn_idx;
-	elem = env->head->next;
-	kfree(env->head);
+		*prev_insn_idx = head->prev_insn_idx;
+	elem = head->next;
+	free_verifier_state(&head->st, false);
+	kfree(head);
 	env->head = elem;
 	env->stack_size--;
-	return insn_idx;
+	return 0;
 }
 
 static struct bpf_verifier_state *push_stack(struct bpf_verifier_env *env,
 					     int insn_idx, int prev_insn_idx)
 {
 	struct bpf_verifier_stack_elem *elem;
+	int err;
 
-	elem = kmalloc(sizeof(struct bpf_verifier_stack_elem), GFP_KERNEL);
+	elem = kzalloc(sizeof(struct bpf_verifier_stack_elem), GFP_KERNEL);
 	if (!elem)
 		goto err;
 
-	memcpy(&elem->st, &env->cur_state, sizeof(env->cur_state));
 	elem->insn_idx = insn_idx;
 	elem->prev_insn_idx = prev_insn_idx;
 	elem->next = env->head;
 	env->head = elem;
 	env->stack_size++;
+	err = copy_verifier_state(&elem->st, env->cur_state);
+	if (err)
+		goto err;
+	if (elem->st.parent)
+		elem->st.parent->branches++;
+	update_peak_states(env);
 	if (env->stack_size > BPF_COMPLEXITY_LIMIT_STACK) {
 		verbose("BPF program is too complex\n");
 		goto err;
 	}
 	return &elem->st;
 err:
+	free_verifier_state(env->cur_state, true);
+	env->cur_state = NULL;
 	/* pop all elements and return */
-	while (pop_stack(env, NULL) >= 0);
+	while (!pop_stack(env, NULL, NULL));
 	return NULL;
 }
 
@@ -455,9 +581,20 @@ static void init_reg_state(struct bpf_reg_state *regs)
 	regs[BPF_REG_1].type = PTR_TO_CTX;
 }
 
+static void init_func_state(struct bpf_func_state *state, int callsite,
+			    u32 frameno, u32 subprogno)
+{
+	state->callsite = callsite;
+	state->frameno = frameno;
+	state->subprogno = subprogno;
+	init_reg_state(state->regs);
+	state->regs[BPF_REG_FP].frameno = frameno;
+}
+
 static void __mark_reg_unknown_value(struct bpf_reg_state *regs, u32 regno)
 {
 	regs[regno].type = UNKNOWN_VALUE;
+	regs[regno].frameno = 0;
 	regs[regno].id = 0;
 	regs[regno].imm = 0;
 }
@@ -474,15 +611,53 @@ static void reset_reg_range_values(struct bpf_reg_state *regs, u32 regno)
 	regs[regno].max_value = BPF_REGISTER_MAX_RANGE;
 }
 
+static void mark_reg_not_init(struct bpf_reg_state *regs, u32 regno)
+{
+	BUG_ON(regno >= MAX_BPF_REG);
+	__mark_reg_unknown_value(regs, regno);
+	reset_reg_range_values(regs, regno);
+	regs[regno].type = NOT_INIT;
+}
+
 enum reg_arg_type {
 	SRC_OP,		/* register is used as source operand */
 	DST_OP,		/* register is used as destination operand */
 	DST_OP_NO_MARK	/* same as above, check only, don't mark */
 };
 
-static int check_reg_arg(struct bpf_reg_state *regs, u32 regno,
+/* Liveness is only tracked for programs without bpf-to-bpf calls, where
+ * every explored state has the single frame of the main program. With
+ * calls all registers are considered live.
+ */
+static bool track_liveness(const struct bpf_verifier_env *env)
+{
+	return env->subprog_cnt <= 1;
+}
+
+static void mark_reg_read(struct bpf_verifier_env *env, u32 regno)
+{
+	struct bpf_verifier_state *state = env->cur_state;
+	struct bpf_verifier_state *parent = state->parent;
+
+	if (!track_liveness(env) || regno == BPF_REG_FP)
+		return;
+
+	while (parent) {
+		/* if read wasn't screened by an earlier write ... */
+		if (state->frame[0]->regs[regno].live & REG_LIVE_WRITTEN)
+			break;
+		/* ... then we depend on parent's value */
+		parent->frame[0]->regs[regno].live |= REG_LIVE_READ;
+		state = parent;
+		parent = state->parent;
+	}
+}
+
+static int check_reg_arg(struct bpf_verifier_env *env, u32 regno,
 			 enum reg_arg_type t)
 {
+	struct bpf_reg_state *regs = cur_regs(env);
+
 	if (regno >= MAX_BPF_REG) {
 		verbose("R%d is invalid\n", regno);
 		return -EINVAL;
@@ -494,12 +669,14 @@ static int check_reg_arg(struct bpf_reg_state *regs, u32 regno,
 			verbose("R%d !read_ok\n", regno);
 			return -EACCES;
 		}
+		mark_reg_read(env, regno);
 	} else {
 		/* check whether register used as dest operand can be written to */
 		if (regno == BPF_REG_FP) {
 			verbose("frame pointer is read only\n");
 			return -EACCES;
 		}
+		regs[regno].live |= REG_LIVE_WRITTEN;
 		if (t == DST_OP)
 			mark_reg_unknown_value(regs, regno);
 	}
@@ -537,19 +714,33 @@ static bool is_spillable_regtype(enum bpf_reg_type type)
 	}
 }
 
+/* record how deep into its stack the function owning @state reaches */
+static void update_stack_depth(struct bpf_verifier_env *env,
+			       const struct bpf_func_state *state, int off)
+{
+	u16 *depth = &env->subprog_stack_depth[state->subprogno];
+
+	if (*depth < -off)
+		*depth = -off;
+}
+
 /* check_stack_read/write functions track spill/fill of registers,
  * stack boundary and alignment are checked in check_mem_access()
+ * @state is the frame that owns the stack being accessed, while
+ * value_regno refers to a register of the current frame
  */
-static int check_stack_write(struct bpf_verifier_state *state, int off,
+static int check_stack_write(struct bpf_verifier_env *env,
+			     struct bpf_func_state *state, int off,
 			     int size, int value_regno)
 {
+	struct bpf_reg_state *regs = cur_regs(env);
 	int i;
 	/* caller checked that off % size == 0 and -MAX_BPF_STACK <= off < 0,
 	 * so it's aligned access and [off, off + size) are within stack limits
 	 */
 
 	if (value_regno >= 0 &&
-	    is_spillable_regtype(state->regs[value_regno].type)) {
+	    is_spillable_regtype(regs[value_regno].type)) {
 
 		/* register containing pointer is being spilled into stack */
 		if (size != BPF_REG_SIZE) {
@@ -557,9 +748,17 @@ static int check_stack_write(struct bpf_verifier_state *state, int off,
 			return -EACCES;
 		}
 
+		/* the callee's stack is gone once it returns */
+		if ((regs[value_regno].type == FRAME_PTR ||
+		     regs[value_regno].type == PTR_TO_STACK) &&
+		    regs[value_regno].frameno > state->frameno) {
+			verbose("cannot spill pointers to stack into stack frame of the caller\n");
+			return -EINVAL;
+		}
+
 		/* save register state */
 		state->spilled_regs[(MAX_BPF_STACK + off) / BPF_REG_SIZE] =
-			state->regs[value_regno];
+			regs[value_regno];
 
 		for (i = 0; i < BPF_REG_SIZE; i++)
 			state->stack_slot_type[MAX_BPF_STACK + off + i] = STACK_SPILL;
@@ -574,9 +773,11 @@ static int check_stack_write(struct bpf_verifier_state *state, int off,
 	return 0;
 }
 
-static int check_stack_read(struct bpf_verifier_state *state, int off, int size,
+static int check_stack_read(struct bpf_verifier_env *env,
+			    struct bpf_func_state *state, int off, int size,
 			    int value_regno)
 {
+	struct bpf_reg_state *regs = cur_regs(env);
 	u8 *slot_type;
 	int i;
 
@@ -594,10 +795,13 @@ static int check_stack_read(struct bpf_verifier_state *state, int off, int size,
 			}
 		}
 
-		if (value_regno >= 0)
+		if (value_regno >= 0) {
 			/* restore register state from stack */
-			state->regs[value_regno] =
+			regs[value_regno] =
 				state->spilled_regs[(MAX_BPF_STACK + off) / BPF_REG_SIZE];
+			/* the fill is a write of the register */
+			regs[value_regno].live |= REG_LIVE_WRITTEN;
+		}
 		return 0;
 	} else {
 		for (i = 0; i < size; i++) {
@@ -609,7 +813,7 @@ static int check_stack_read(struct bpf_verifier_state *state, int off, int size,
 		}
 		if (value_regno >= 0)
 			/* have read misc data from the stack */
-			mark_reg_unknown_value(state->regs, value_regno);
+			mark_reg_unknown_value(regs, value_regno);
 		return 0;
 	}
 }
@@ -618,7 +822,7 @@ static int check_stack_read(struct bpf_verifier_state *state, int off, int size,
 static int check_map_access(struct bpf_verifier_env *env, u32 regno, int off,
 			    int size)
 {
-	struct bpf_map *map = env->cur_state.regs[regno].map_ptr;
+	struct bpf_map *map = cur_regs(env)[regno].map_ptr;
 
 	if (off < 0 || off + size > map->value_size) {
 		verbose("invalid access to map value, value_size=%d off=%d size=%d\n",
@@ -650,7 +854,7 @@ static bool may_access_direct_pkt_data(struct bpf_verifier_env *env,
 static int check_packet_access(struct bpf_verifier_env *env, u32 regno, int off,
 			       int size)
 {
-	struct bpf_reg_state *regs = env->cur_state.regs;
+	struct bpf_reg_state *regs = cur_regs(env);
 	struct bpf_reg_state *reg = &regs[regno];
 
 	off += reg->off;
@@ -699,7 +903,7 @@ static bool __is_pointer_value(bool allow_ptr_leaks,
 
 static bool is_pointer_value(struct bpf_verifier_env *env, int regno)
 {
-	return __is_pointer_value(env->allow_ptr_leaks, &env->cur_state.regs[regno]);
+	return __is_pointer_value(env->allow_ptr_leaks, &cur_regs(env)[regno]);
 }
 
 static int check_ptr_alignment(struct bpf_verifier_env *env,
@@ -744,7 +948,7 @@ static int check_mem_access(struct bpf_verifier_env *env, u32 regno, int off,
 			    int bpf_size, enum bpf_access_type t,
 			    int value_regno)
 {
-	struct bpf_verifier_state *state = &env->cur_state;
+	struct bpf_func_state *state = cur_func(env);
 	struct bpf_reg_state *reg = &state->regs[regno];
 	int size, err = 0;
 
@@ -825,20 +1029,25 @@ static int check_mem_access(struct bpf_verifier_env *env, u32 regno, int off,
 		}
 
 	} else if (reg->type == FRAME_PTR || reg->type == PTR_TO_STACK) {
+		struct bpf_func_state *frame = reg_frame(env, reg);
+
 		if (off >= 0 || off < -MAX_BPF_STACK) {
 			verbose("invalid stack off=%d size=%d\n", off, size);
 			return -EACCES;
 		}
+		update_stack_depth(env, frame, off);
 		if (t == BPF_WRITE) {
 			if (!env->allow_ptr_leaks &&
-			    state->stack_slot_type[MAX_BPF_STACK + off] == STACK_SPILL &&
+			    frame->stack_slot_type[MAX_BPF_STACK + off] == STACK_SPILL &&
 			    size != BPF_REG_SIZE) {
 				verbose("attempt to corrupt spilled pointer on stack\n");
 				return -EACCES;
 			}
-			err = check_stack_write(state, off, size, value_regno);
+			err = check_stack_write(env, frame, off, size,
+						value_regno);
 		} else {
-			err = check_stack_read(state, off, size, value_regno);
+			err = check_stack_read(env, frame, off, size,
+					       value_regno);
 		}
 	} else if (state->regs[regno].type == PTR_TO_PACKET) {
 		if (t == BPF_WRITE && !may_access_direct_pkt_data(env, NULL)) {
@@ -872,7 +1081,7 @@ static int check_mem_access(struct bpf_verifier_env *env, u32 regno, int off,
 
 static int check_xadd(struct bpf_verifier_env *env, struct bpf_insn *insn)
 {
-	struct bpf_reg_state *regs = env->cur_state.regs;
+	struct bpf_reg_state *regs = cur_regs(env);
 	int err;
 
 	if ((BPF_SIZE(insn->code) != BPF_W && BPF_SIZE(insn->code) != BPF_DW) ||
@@ -882,12 +1091,12 @@ static int check_xadd(struct bpf_verifier_env *env, struct bpf_insn *insn)
 	}
 
 	/* check src1 operand */
-	err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+	err = check_reg_arg(env, insn->src_reg, SRC_OP);
 	if (err)
 		return err;
 
 	/* check src2 operand */
-	err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+	err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 	if (err)
 		return err;
 
@@ -915,8 +1124,8 @@ static int check_stack_boundary(struct bpf_verifier_env *env, int regno,
 				int access_size, bool zero_size_allowed,
 				struct bpf_call_arg_meta *meta)
 {
-	struct bpf_verifier_state *state = &env->cur_state;
-	struct bpf_reg_state *regs = state->regs;
+	struct bpf_reg_state *regs = cur_regs(env);
+	struct bpf_func_state *state;
 	int off, i;
 
 	if (regs[regno].type != PTR_TO_STACK) {
@@ -939,6 +1148,9 @@ static int check_stack_boundary(struct bpf_verifier_env *env, int regno,
 		return -EACCES;
 	}
 
+	state = reg_frame(env, &regs[regno]);
+	update_stack_depth(env, state, off);
+
 	if (meta && meta->raw_mode) {
 		meta->access_size = access_size;
 		meta->regno = regno;
@@ -959,17 +1171,16 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 regno,
 			  enum bpf_arg_type arg_type,
 			  struct bpf_call_arg_meta *meta)
 {
-	struct bpf_reg_state *regs = env->cur_state.regs, *reg = &regs[regno];
+	struct bpf_reg_state *regs = cur_regs(env), *reg = &regs[regno];
 	enum bpf_reg_type expected_type, type = reg->type;
 	int err = 0;
 
 	if (arg_type == ARG_DONTCARE)
 		return 0;
 
-	if (type == NOT_INIT) {
-		verbose("R%d !read_ok\n", regno);
-		return -EACCES;
-	}
+	err = check_reg_arg(env, regno, SRC_OP);
+	if (err)
+		return err;
 
 	if (arg_type == ARG_ANYTHING) {
 		if (is_pointer_value(env, regno)) {
@@ -1111,6 +1322,21 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 		    func_id != BPF_FUNC_current_task_under_cgroup)
 			goto error;
 		break;
+	case BPF_MAP_TYPE_DEVMAP:
+	case BPF_MAP_TYPE_CPUMAP:
+	case BPF_MAP_TYPE_XSKMAP:
+		if (func_id != BPF_FUNC_redirect_map)
+			goto error;
+		break;
+	case BPF_MAP_TYPE_SOCKMAP:
+		if (func_id != BPF_FUNC_sk_redirect_map)
+			goto error;
+		break;
+	case BPF_MAP_TYPE_ARRAY_OF_MAPS:
+	case BPF_MAP_TYPE_HASH_OF_MAPS:
+		if (func_id != BPF_FUNC_map_lookup_elem)
+			goto error;
+		break;
 	default:
 		break;
 	}
@@ -1135,6 +1361,16 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 		if (map->map_type != BPF_MAP_TYPE_CGROUP_ARRAY)
 			goto error;
 		break;
+	case BPF_FUNC_redirect_map:
+		if (map->map_type != BPF_MAP_TYPE_DEVMAP &&
+		    map->map_type != BPF_MAP_TYPE_CPUMAP &&
+		    map->map_type != BPF_MAP_TYPE_XSKMAP)
+			goto error;
+		break;
+	case BPF_FUNC_sk_redirect_map:
+		if (map->map_type != BPF_MAP_TYPE_SOCKMAP)
+			goto error;
+		break;
 	default:
 		break;
 	}
@@ -1164,9 +1400,8 @@ static int check_raw_mode(const struct bpf_func_proto *fn)
 	return count > 1 ? -EINVAL : 0;
 }
 
-static void clear_all_pkt_pointers(struct bpf_verifier_env *env)
+static void __clear_all_pkt_pointers(struct bpf_func_state *state)
 {
-	struct bpf_verifier_state *state = &env->cur_state;
 	struct bpf_reg_state *regs = state->regs, *reg;
 	int i;
 
@@ -1187,11 +1422,226 @@ static void clear_all_pkt_pointers(struct bpf_verifier_env *env)
 	}
 }
 
+static void clear_all_pkt_pointers(struct bpf_verifier_env *env)
+{
+	struct bpf_verifier_state *vstate = env->cur_state;
+	int i;
+
+	for (i = 0; i <= vstate->curframe; i++)
+		__clear_all_pkt_pointers(vstate->frame[i]);
+}
+
+static int find_subprog_cmp(const void *a, const void *b)
+{
+	return *(const u32 *)a - *(const u32 *)b;
+}
+
+static int find_subprog(struct bpf_verifier_env *env, int off)
+{
+	u32 *p;
+
+	p = bsearch(&off, env->subprog_starts, env->subprog_cnt,
+		    sizeof(env->subprog_starts[0]), find_subprog_cmp);
+	if (!p)
+		return -ENOENT;
+	return p - env->subprog_starts;
+}
+
+static int add_subprog(struct bpf_verifier_env *env, int off)
+{
+	int insn_cnt = env->prog->len;
+	int ret;
+
+	if (off >= insn_cnt || off < 0) {
+		verbose("call to invalid destination\n");
+		return -EINVAL;
+	}
+	ret = find_subprog(env, off);
+	if (ret >= 0)
+		return 0;
+	if (env->subprog_cnt >= BPF_MAX_SUBPROGS) {
+		verbose("too many subprograms\n");
+		return -E2BIG;
+	}
+	env->subprog_starts[env->subprog_cnt++] = off;
+	sort(env->subprog_starts, env->subprog_cnt,
+	     sizeof(env->subprog_starts[0]), find_subprog_cmp, NULL);
+	return 0;
+}
+
+/* split the program into functions at the targets of bpf-to-bpf calls
+ * and make sure that jumps never cross function boundaries
+ */
+static int check_subprogs(struct bpf_verifier_env *env)
+{
+	int i, ret, subprog = 0, subprog_start, subprog_end, off;
+	struct bpf_insn *insn = env->prog->insnsi;
+	int insn_cnt = env->prog->len;
+
+	/* the main program is function number zero */
+	ret = add_subprog(env, 0);
+	if (ret < 0)
+		return ret;
+
+	/* determine subprog starts. The end is one before the next starts */
+	for (i = 0; i < insn_cnt; i++) {
+		if (insn[i].code != (BPF_JMP | BPF_CALL))
+			continue;
+		if (insn[i].src_reg != BPF_PSEUDO_CALL)
+			continue;
+		if (!env->allow_ptr_leaks) {
+			verbose("function calls to other bpf functions are allowed for root only\n");
+			return -EPERM;
+		}
+		ret = add_subprog(env, i + insn[i].imm + 1);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (log_level > 1)
+		for (i = 0; i < env->subprog_cnt; i++)
+			verbose("func#%d @%d\n", i, env->subprog_starts[i]);
+
+	/* now check that all jumps are within the same subprog */
+	subprog_start = 0;
+	subprog_end = subprog + 1 < env->subprog_cnt ?
+		      env->subprog_starts[subprog + 1] : insn_cnt;
+	for (i = 0; i < insn_cnt; i++) {
+		u8 code = insn[i].code;
+
+		if (BPF_CLASS(code) != BPF_JMP)
+			goto next;
+		if (BPF_OP(code) == BPF_EXIT || BPF_OP(code) == BPF_CALL)
+			goto next;
+		off = i + insn[i].off + 1;
+		if (off < subprog_start || off >= subprog_end) {
+			verbose("jump out of range from insn %d to %d\n", i, off);
+			return -EINVAL;
+		}
+next:
+		if (i == subprog_end - 1) {
+			/* to avoid fall-through from one subprog into another
+			 * the last insn of the subprog should be either exit
+			 * or unconditional jump back
+			 */
+			if (env->subprog_cnt > 1 &&
+			    code != (BPF_JMP | BPF_EXIT) &&
+			    code != (BPF_JMP | BPF_JA)) {
+				verbose("last insn is not an exit or jmp\n");
+				return -EINVAL;
+			}
+			subprog_start = subprog_end;
+			if (++subprog < env->subprog_cnt)
+				subprog_end = subprog + 1 < env->subprog_cnt ?
+					      env->subprog_starts[subprog + 1] :
+					      insn_cnt;
+		}
+	}
+	return 0;
+}
+
+static int check_func_call(struct bpf_verifier_env *env, struct bpf_insn *insn,
+			   int *insn_idx)
+{
+	struct bpf_verifier_state *state = env->cur_state;
+	struct bpf_func_state *caller, *callee;
+	int i, subprog, target_insn;
+
+	if (state->curframe + 1 >= MAX_CALL_FRAMES) {
+		verbose("the call stack of %d frames is too deep\n",
+			state->curframe + 2);
+		return -E2BIG;
+	}
+
+	target_insn = *insn_idx + insn->imm;
+	subprog = find_subprog(env, target_insn + 1);
+	if (subprog < 0) {
+		verbose("verifier bug. No program starts at insn %d\n",
+			target_insn + 1);
+		return -EFAULT;
+	}
+
+	caller = state->frame[state->curframe];
+	if (state->frame[state->curframe + 1]) {
+		verbose("verifier bug. Frame %d already allocated\n",
+			state->curframe + 1);
+		return -EFAULT;
+	}
+
+	callee = kzalloc(sizeof(*callee), GFP_KERNEL);
+	if (!callee)
+		return -ENOMEM;
+	state->frame[state->curframe + 1] = callee;
+
+	/* callee cannot access r0, r6 - r9 for reading and has to write
+	 * into its own stack before reading from it.
+	 * callee can read/write into caller's stack
+	 */
+	init_func_state(callee, *insn_idx, state->curframe + 1, subprog);
+
+	/* copy r1 - r5 args that callee can access */
+	for (i = BPF_REG_1; i <= BPF_REG_5; i++)
+		callee->regs[i] = caller->regs[i];
+
+	/* after the call registers r0 - r5 were scratched */
+	for (i = 0; i < CALLER_SAVED_REGS; i++)
+		mark_reg_not_init(caller->regs, caller_saved[i]);
+
+	state->curframe++;
+
+	/* and go analyze first insn of the callee */
+	*insn_idx = target_insn;
+
+	if (log_level) {
+		verbose("caller:\n");
+		print_verifier_state(caller);
+		verbose("callee:\n");
+		print_verifier_state(callee);
+	}
+	return 0;
+}
+
+static int prepare_func_exit(struct bpf_verifier_env *env, int *insn_idx)
+{
+	struct bpf_verifier_state *state = env->cur_state;
+	struct bpf_func_state *caller, *callee;
+	struct bpf_reg_state *r0;
+
+	callee = state->frame[state->curframe];
+	r0 = &callee->regs[BPF_REG_0];
+	if (r0->type == FRAME_PTR || r0->type == PTR_TO_STACK) {
+		/* technically it's ok to return caller's stack pointer
+		 * (or caller's caller's pointer) back to the caller,
+		 * since these pointers are valid. Only current stack
+		 * pointer will be invalid as soon as function exits,
+		 * but let's be conservative
+		 */
+		verbose("cannot return stack pointer to the caller\n");
+		return -EINVAL;
+	}
+
+	state->curframe--;
+	caller = state->frame[state->curframe];
+	/* return to the caller whatever r0 had in the callee */
+	caller->regs[BPF_REG_0] = *r0;
+
+	*insn_idx = callee->callsite + 1;
+	if (log_level) {
+		verbose("returning from callee:\n");
+		print_verifier_state(callee);
+		verbose("to caller at %d:\n", *insn_idx);
+		print_verifier_state(caller);
+	}
+	/* clear everything in the callee */
+	kfree(callee);
+	state->frame[state->curframe + 1] = NULL;
+	return 0;
+}
+
 static int check_call(struct bpf_verifier_env *env, int func_id)
 {
-	struct bpf_verifier_state *state = &env->cur_state;
 	const struct bpf_func_proto *fn = NULL;
-	struct bpf_reg_state *regs = state->regs;
+	struct bpf_reg_state *regs = cur_regs(env);
 	struct bpf_reg_state *reg;
 	struct bpf_call_arg_meta meta;
 	bool changes_data;
@@ -1217,6 +1667,12 @@ static int check_call(struct bpf_verifier_env *env, int func_id)
 		return -EINVAL;
 	}
 
+	/* a tail call would leave the frames of the callers behind */
+	if (func_id == BPF_FUNC_tail_call && env->subprog_cnt > 1) {
+		verbose("tail_calls are not allowed in programs with bpf-to-bpf calls\n");
+		return -EINVAL;
+	}
+
 	changes_data = bpf_helper_changes_skb_data(fn->func);
 
 	memset(&meta, 0, sizeof(meta));
@@ -1262,6 +1718,7 @@ static int check_call(struct bpf_verifier_env *env, int func_id)
 		reg = regs + caller_saved[i];
 		reg->type = NOT_INIT;
 		reg->imm = 0;
+		reg->live |= REG_LIVE_WRITTEN;
 	}
 
 	/* update return register */
@@ -1300,7 +1757,7 @@ static int check_call(struct bpf_verifier_env *env, int func_id)
 static int check_packet_ptr_add(struct bpf_verifier_env *env,
 				struct bpf_insn *insn)
 {
-	struct bpf_reg_state *regs = env->cur_state.regs;
+	struct bpf_reg_state *regs = cur_regs(env);
 	struct bpf_reg_state *dst_reg = &regs[insn->dst_reg];
 	struct bpf_reg_state *src_reg = &regs[insn->src_reg];
 	struct bpf_reg_state tmp_reg;
@@ -1330,6 +1787,7 @@ add_imm:
 			/* R6=pkt(id=0,off=0,r=62) R7=imm22; r7 += r6 */
 			tmp_reg = *dst_reg;  /* save r7 state */
 			*dst_reg = *src_reg; /* copy pkt_ptr state r6 into r7 */
+			dst_reg->live |= REG_LIVE_WRITTEN;
 			src_reg = &tmp_reg;  /* pretend it's src_reg state */
 			/* if the checks below reject it, the copy won't matter,
 			 * since we're rejecting the whole program. If all ok,
@@ -1373,7 +1831,7 @@ add_imm:
 
 static int evaluate_reg_alu(struct bpf_verifier_env *env, struct bpf_insn *insn)
 {
-	struct bpf_reg_state *regs = env->cur_state.regs;
+	struct bpf_reg_state *regs = cur_regs(env);
 	struct bpf_reg_state *dst_reg = &regs[insn->dst_reg];
 	u8 opcode = BPF_OP(insn->code);
 	s64 imm_log2;
@@ -1476,7 +1934,7 @@ static int evaluate_reg_alu(struct bpf_verifier_env *env, struct bpf_insn *insn)
 static int evaluate_reg_imm_alu_unknown(struct bpf_verifier_env *env,
 					struct bpf_insn *insn)
 {
-	struct bpf_reg_state *regs = env->cur_state.regs;
+	struct bpf_reg_state *regs = cur_regs(env);
 	struct bpf_reg_state *dst_reg = &regs[insn->dst_reg];
 	struct bpf_reg_state *src_reg = &regs[insn->src_reg];
 	u8 opcode = BPF_OP(insn->code);
@@ -1535,7 +1993,7 @@ static int evaluate_reg_imm_alu_unknown(struct bpf_verifier_env *env,
 static int evaluate_reg_imm_alu(struct bpf_verifier_env *env,
 				struct bpf_insn *insn)
 {
-	struct bpf_reg_state *regs = env->cur_state.regs;
+	struct bpf_reg_state *regs = cur_regs(env);
 	struct bpf_reg_state *dst_reg = &regs[insn->dst_reg];
 	struct bpf_reg_state *src_reg = &regs[insn->src_reg];
 	u8 opcode = BPF_OP(insn->code);
@@ -1568,7 +2026,7 @@ static void check_reg_overflow(struct bpf_reg_state *reg)
 static void adjust_reg_min_max_vals(struct bpf_verifier_env *env,
 				    struct bpf_insn *insn)
 {
-	struct bpf_reg_state *regs = env->cur_state.regs, *dst_reg;
+	struct bpf_reg_state *regs = cur_regs(env), *dst_reg;
 	s64 min_val = BPF_REGISTER_MIN_RANGE;
 	u64 max_val = BPF_REGISTER_MAX_RANGE;
 	bool min_set = false, max_set = false;
@@ -1706,7 +2164,7 @@ static void adjust_reg_min_max_vals(struct bpf_verifier_env *env,
 /* check validity of 32-bit and 64-bit arithmetic operations */
 static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 {
-	struct bpf_reg_state *regs = env->cur_state.regs, *dst_reg;
+	struct bpf_reg_state *regs = cur_regs(env), *dst_reg;
 	u8 opcode = BPF_OP(insn->code);
 	int err;
 
@@ -1728,7 +2186,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check src operand */
-		err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+		err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 		if (err)
 			return err;
 
@@ -1739,7 +2197,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check dest operand */
-		err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+		err = check_reg_arg(env, insn->dst_reg, DST_OP);
 		if (err)
 			return err;
 
@@ -1752,7 +2210,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 			}
 
 			/* check src operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 		} else {
@@ -1763,7 +2221,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check dest operand */
-		err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+		err = check_reg_arg(env, insn->dst_reg, DST_OP);
 		if (err)
 			return err;
 
@@ -1778,6 +2236,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 				 * copy register state to dest reg
 				 */
 				regs[insn->dst_reg] = regs[insn->src_reg];
+				regs[insn->dst_reg].live |= REG_LIVE_WRITTEN;
 			} else {
 				if (is_pointer_value(env, insn->src_reg)) {
 					verbose("R%d partial copy of pointer\n",
@@ -1788,12 +2247,17 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 			}
 		} else {
 			/* case: R = imm
-			 * remember the value we stored into this reg
+			 * remember the value we stored into this reg, a 32-bit
+			 * move zero-extends the immediate rather than sign
+			 * extending it
 			 */
+			s64 imm = BPF_CLASS(insn->code) == BPF_ALU64 ?
+				  insn->imm : (u32)insn->imm;
+
 			regs[insn->dst_reg].type = CONST_IMM;
-			regs[insn->dst_reg].imm = insn->imm;
-			regs[insn->dst_reg].max_value = insn->imm;
-			regs[insn->dst_reg].min_value = insn->imm;
+			regs[insn->dst_reg].imm = imm;
+			regs[insn->dst_reg].max_value = imm;
+			regs[insn->dst_reg].min_value = imm;
 		}
 
 	} else if (opcode > BPF_END) {
@@ -1808,7 +2272,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 				return -EINVAL;
 			}
 			/* check src1 operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 		} else {
@@ -1819,7 +2283,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check src2 operand */
-		err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+		err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 		if (err)
 			return err;
 
@@ -1829,6 +2293,15 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 			return -EINVAL;
 		}
 
+		/* a zero divisor ends the program with return value 0, from
+		 * a callee that would only leave the current function
+		 */
+		if ((opcode == BPF_MOD || opcode == BPF_DIV) &&
+		    BPF_SRC(insn->code) == BPF_X && env->subprog_cnt > 1) {
+			verbose("division by register is not allowed in programs with bpf-to-bpf calls\n");
+			return -EINVAL;
+		}
+
 		if ((opcode == BPF_LSH || opcode == BPF_RSH ||
 		     opcode == BPF_ARSH) && BPF_SRC(insn->code) == BPF_K) {
 			int size = BPF_CLASS(insn->code) == BPF_ALU64 ? 64 : 32;
@@ -1840,7 +2313,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check dest operand */
-		err = check_reg_arg(regs, insn->dst_reg, DST_OP_NO_MARK);
+		err = check_reg_arg(env, insn->dst_reg, DST_OP_NO_MARK);
 		if (err)
 			return err;
 
@@ -1911,11 +2384,12 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 	return 0;
 }
 
-static void find_good_pkt_pointers(struct bpf_verifier_state *state,
+static void find_good_pkt_pointers(struct bpf_verifier_state *vstate,
 				   struct bpf_reg_state *dst_reg)
 {
-	struct bpf_reg_state *regs = state->regs, *reg;
-	int i;
+	struct bpf_func_state *state;
+	struct bpf_reg_state *regs, *reg;
+	int i, j;
 
 	/* LLVM can generate two kind of checks:
 	 *
@@ -1947,17 +2421,25 @@ static void find_good_pkt_pointers(struct bpf_verifier_state *state,
 	 * so that range of bytes [r3, r3 + 8) is safe to access.
 	 */
 
-	for (i = 0; i < MAX_BPF_REG; i++)
-		if (regs[i].type == PTR_TO_PACKET && regs[i].id == dst_reg->id)
-			/* keep the maximum range already checked */
-			regs[i].range = max(regs[i].range, dst_reg->off);
+	for (j = 0; j <= vstate->curframe; j++) {
+		state = vstate->frame[j];
+		regs = state->regs;
 
-	for (i = 0; i < MAX_BPF_STACK; i += BPF_REG_SIZE) {
-		if (state->stack_slot_type[i] != STACK_SPILL)
-			continue;
-		reg = &state->spilled_regs[i / BPF_REG_SIZE];
-		if (reg->type == PTR_TO_PACKET && reg->id == dst_reg->id)
-			reg->range = max(reg->range, dst_reg->off);
+		for (i = 0; i < MAX_BPF_REG; i++)
+			if (regs[i].type == PTR_TO_PACKET &&
+			    regs[i].id == dst_reg->id)
+				/* keep the maximum range already checked */
+				regs[i].range = max(regs[i].range,
+						    dst_reg->off);
+
+		for (i = 0; i < MAX_BPF_STACK; i += BPF_REG_SIZE) {
+			if (state->stack_slot_type[i] != STACK_SPILL)
+				continue;
+			reg = &state->spilled_regs[i / BPF_REG_SIZE];
+			if (reg->type == PTR_TO_PACKET &&
+			    reg->id == dst_reg->id)
+				reg->range = max(reg->range, dst_reg->off);
+		}
 	}
 }
 
@@ -2128,6 +2610,13 @@ static void mark_map_reg(struct bpf_reg_state *regs, u32 regno, u32 id,
 
 	if (reg->type == PTR_TO_MAP_VALUE_OR_NULL && reg->id == id) {
 		reg->type = type;
+		/* a lookup in a map-in-map yields the inner map, which is
+		 * checked against the template it was created with
+		 */
+		if (type == PTR_TO_MAP_VALUE && reg->map_ptr->inner_map_meta) {
+			reg->type = CONST_PTR_TO_MAP;
+			reg->map_ptr = reg->map_ptr->inner_map_meta;
+		}
 		/* We don't need id from this point onwards anymore, thus we
 		 * should better reset it, so that state pruning has chances
 		 * to take effect.
@@ -2141,30 +2630,68 @@ static void mark_map_reg(struct bpf_reg_state *regs, u32 regno, u32 id,
 /* The logic is similar to find_good_pkt_pointers(), both could eventually
  * be folded together at some point.
  */
-static void mark_map_regs(struct bpf_verifier_state *state, u32 regno,
+static void mark_map_regs(struct bpf_verifier_state *vstate, u32 regno,
 			  enum bpf_reg_type type)
 {
-	struct bpf_reg_state *regs = state->regs;
-	u32 id = regs[regno].id;
-	int i;
+	struct bpf_func_state *state = vstate->frame[vstate->curframe];
+	u32 id = state->regs[regno].id;
+	int i, j;
 
-	for (i = 0; i < MAX_BPF_REG; i++)
-		mark_map_reg(regs, i, id, type);
+	for (j = 0; j <= vstate->curframe; j++) {
+		state = vstate->frame[j];
 
-	for (i = 0; i < MAX_BPF_STACK; i += BPF_REG_SIZE) {
-		if (state->stack_slot_type[i] != STACK_SPILL)
-			continue;
-		mark_map_reg(state->spilled_regs, i / BPF_REG_SIZE, id, type);
+		for (i = 0; i < MAX_BPF_REG; i++)
+			mark_map_reg(state->regs, i, id, type);
+
+		for (i = 0; i < MAX_BPF_STACK; i += BPF_REG_SIZE) {
+			if (state->stack_slot_type[i] != STACK_SPILL)
+				continue;
+			mark_map_reg(state->spilled_regs, i / BPF_REG_SIZE,
+				     id, type);
+		}
 	}
 }
 
+/* compute branch direction of the expression "if (reg opcode val) goto target;"
+ * and return:
+ *  1 - branch will be taken and "goto target" will be executed
+ *  0 - branch will not be taken and fall-through to next insn
+ * -1 - unknown. Example: "if (reg < 5)" is unknown when register value range [0,10]
+ * only registers holding a known constant are evaluated
+ */
+static int is_branch_taken(struct bpf_reg_state *reg, u64 val, u8 opcode)
+{
+	u64 imm = reg->imm;
+
+	if (reg->type != CONST_IMM)
+		return -1;
+
+	switch (opcode) {
+	case BPF_JEQ:
+		return imm == val;
+	case BPF_JNE:
+		return imm != val;
+	case BPF_JSET:
+		return (imm & val) != 0;
+	case BPF_JGT:
+		return imm > val;
+	case BPF_JGE:
+		return imm >= val;
+	case BPF_JSGT:
+		return (s64)imm > (s64)val;
+	case BPF_JSGE:
+		return (s64)imm >= (s64)val;
+	}
+	return -1;
+}
+
 static int check_cond_jmp_op(struct bpf_verifier_env *env,
 			     struct bpf_insn *insn, int *insn_idx)
 {
-	struct bpf_verifier_state *other_branch, *this_branch = &env->cur_state;
-	struct bpf_reg_state *regs = this_branch->regs, *dst_reg;
+	struct bpf_verifier_state *other_branch, *this_branch = env->cur_state;
+	struct bpf_reg_state *regs = cur_regs(env), *other_regs, *dst_reg;
 	u8 opcode = BPF_OP(insn->code);
-	int err;
+	int err, pred = -1;
 
 	if (opcode > BPF_EXIT) {
 		verbose("invalid BPF_JMP opcode %x\n", opcode);
@@ -2178,7 +2705,7 @@ static int check_cond_jmp_op(struct bpf_verifier_env *env,
 		}
 
 		/* check src1 operand */
-		err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+		err = check_reg_arg(env, insn->src_reg, SRC_OP);
 		if (err)
 			return err;
 
@@ -2195,49 +2722,51 @@ static int check_cond_jmp_op(struct bpf_verifier_env *env,
 	}
 
 	/* check src2 operand */
-	err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+	err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 	if (err)
 		return err;
 
 	dst_reg = &regs[insn->dst_reg];
 
-	/* detect if R == 0 where R was initialized to zero earlier */
-	if (BPF_SRC(insn->code) == BPF_K &&
-	    (opcode == BPF_JEQ || opcode == BPF_JNE) &&
-	    dst_reg->type == CONST_IMM && dst_reg->imm == insn->imm) {
-		if (opcode == BPF_JEQ) {
-			/* if (imm == imm) goto pc+off;
-			 * only follow the goto, ignore fall-through
-			 */
-			*insn_idx += insn->off;
-			return 0;
-		} else {
-			/* if (imm != imm) goto pc+off;
-			 * only follow fall-through branch, since
-			 * that's where the program will go
-			 */
-			return 0;
-		}
+	/* detect if the outcome of the comparison is known, e.g. R == 0
+	 * where R was initialized to zero earlier, or the exit condition
+	 * of a loop with a constant induction variable
+	 */
+	if (BPF_SRC(insn->code) == BPF_K)
+		pred = is_branch_taken(dst_reg, (u64)(s64)insn->imm, opcode);
+	else if (regs[insn->src_reg].type == CONST_IMM)
+		pred = is_branch_taken(dst_reg, regs[insn->src_reg].imm,
+				       opcode);
+	if (pred == 1) {
+		/* only follow the goto, ignore fall-through */
+		*insn_idx += insn->off;
+		return 0;
+	} else if (pred == 0) {
+		/* only follow fall-through branch, since
+		 * that's where the program will go
+		 */
+		return 0;
 	}
 
 	other_branch = push_stack(env, *insn_idx + insn->off + 1, *insn_idx);
 	if (!other_branch)
 		return -EFAULT;
+	other_regs = other_branch->frame[other_branch->curframe]->regs;
 
 	/* detect if we are comparing against a constant value so we can adjust
 	 * our min/max values for our dst register.
 	 */
 	if (BPF_SRC(insn->code) == BPF_X) {
 		if (regs[insn->src_reg].type == CONST_IMM)
-			reg_set_min_max(&other_branch->regs[insn->dst_reg],
+			reg_set_min_max(&other_regs[insn->dst_reg],
 					dst_reg, regs[insn->src_reg].imm,
 					opcode);
 		else if (dst_reg->type == CONST_IMM)
-			reg_set_min_max_inv(&other_branch->regs[insn->src_reg],
+			reg_set_min_max_inv(&other_regs[insn->src_reg],
 					    &regs[insn->src_reg], dst_reg->imm,
 					    opcode);
 	} else {
-		reg_set_min_max(&other_branch->regs[insn->dst_reg],
+		reg_set_min_max(&other_regs[insn->dst_reg],
 					dst_reg, insn->imm, opcode);
 	}
 
@@ -2265,7 +2794,7 @@ static int check_cond_jmp_op(struct bpf_verifier_env *env,
 		return -EACCES;
 	}
 	if (log_level)
-		print_verifier_state(this_branch);
+		print_verifier_state(this_branch->frame[this_branch->curframe]);
 	return 0;
 }
 
@@ -2280,7 +2809,7 @@ static struct bpf_map *ld_imm64_to_map_ptr(struct bpf_insn *insn)
 /* verify BPF_LD_IMM64 instruction */
 static int check_ld_imm(struct bpf_verifier_env *env, struct bpf_insn *insn)
 {
-	struct bpf_reg_state *regs = env->cur_state.regs;
+	struct bpf_reg_state *regs = cur_regs(env);
 	int err;
 
 	if (BPF_SIZE(insn->code) != BPF_DW) {
@@ -2292,7 +2821,7 @@ static int check_ld_imm(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		return -EINVAL;
 	}
 
-	err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+	err = check_reg_arg(env, insn->dst_reg, DST_OP);
 	if (err)
 		return err;
 
@@ -2347,7 +2876,7 @@ static bool may_access_skb(enum bpf_prog_type type)
  */
 static int check_ld_abs(struct bpf_verifier_env *env, struct bpf_insn *insn)
 {
-	struct bpf_reg_state *regs = env->cur_state.regs;
+	struct bpf_reg_state *regs = cur_regs(env);
 	u8 mode = BPF_MODE(insn->code);
 	struct bpf_reg_state *reg;
 	int i, err;
@@ -2357,6 +2886,18 @@ static int check_ld_abs(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		return -EINVAL;
 	}
 
+	if (env->subprog_cnt > 1) {
+		/* when program has LD_ABS insn JITs and interpreter assume
+		 * that r1 == ctx == skb which is not the case for callees
+		 * that can have arbitrary arguments. It's problematic
+		 * for main prog as well since JITs would need to analyze
+		 * all functions in order to make proper register save/restore
+		 * decisions in the main prog. Hence disallow LD_ABS with calls
+		 */
+		verbose("BPF_LD_[ABS|IND] instructions cannot be mixed with bpf-to-bpf calls\n");
+		return -EINVAL;
+	}
+
 	if (insn->dst_reg != BPF_REG_0 || insn->off != 0 ||
 	    BPF_SIZE(insn->code) == BPF_DW ||
 	    (mode == BPF_ABS && insn->src_reg != BPF_REG_0)) {
@@ -2365,7 +2906,7 @@ static int check_ld_abs(struct bpf_verifier_env *env, struct bpf_insn *insn)
 	}
 
 	/* check whether implicit source operand (register R6) is readable */
-	err = check_reg_arg(regs, BPF_REG_6, SRC_OP);
+	err = check_reg_arg(env, BPF_REG_6, SRC_OP);
 	if (err)
 		return err;
 
@@ -2376,7 +2917,7 @@ static int check_ld_abs(struct bpf_verifier_env *env, struct bpf_insn *insn)
 
 	if (mode == BPF_IND) {
 		/* check explicit source operand */
-		err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+		err = check_reg_arg(env, insn->src_reg, SRC_OP);
 		if (err)
 			return err;
 	}
@@ -2386,6 +2927,7 @@ static int check_ld_abs(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		reg = regs + caller_saved[i];
 		reg->type = NOT_INIT;
 		reg->imm = 0;
+		reg->live |= REG_LIVE_WRITTEN;
 	}
 
 	/* mark destination R0 register as readable, since it contains
@@ -2446,7 +2988,8 @@ static int *insn_state;
  * w - next instruction
  * e - edge
  */
-static int push_insn(int t, int w, int e, struct bpf_verifier_env *env)
+static int push_insn(int t, int w, int e, struct bpf_verifier_env *env,
+		     bool loop_ok)
 {
 	if (e == FALLTHROUGH && insn_state[t] >= (DISCOVERED | FALLTHROUGH))
 		return 0;
@@ -2472,6 +3015,13 @@ static int push_insn(int t, int w, int e, struct bpf_verifier_env *env)
 		insn_stack[cur_stack++] = w;
 		return 1;
 	} else if ((insn_state[w] & 0xF0) == DISCOVERED) {
+		/* loops are bounded by the verifier walking them until
+		 * the exit condition is known, see is_state_visited()
+		 */
+		if (loop_ok && env->allow_ptr_leaks) {
+			insn_state[t] = DISCOVERED | e;
+			return 0;
+		}
 		verbose("back-edge from insn %d to %d\n", t, w);
 		return -EINVAL;
 	} else if (insn_state[w] == EXPLORED) {
@@ -2485,7 +3035,8 @@ static int push_insn(int t, int w, int e, struct bpf_verifier_env *env)
 }
 
 /* non-recursive depth-first-search to detect loops in BPF program
- * loop == back-edge in directed graph
+ * loop == back-edge in directed graph. Back-edges of jumps are
+ * accepted for privileged programs, do_check() then bounds the loop.
  */
 static int check_cfg(struct bpf_verifier_env *env)
 {
@@ -2519,13 +3070,26 @@ peek_stack:
 		if (opcode == BPF_EXIT) {
 			goto mark_explored;
 		} else if (opcode == BPF_CALL) {
-			ret = push_insn(t, t + 1, FALLTHROUGH, env);
+			ret = push_insn(t, t + 1, FALLTHROUGH, env, false);
 			if (ret == 1)
 				goto peek_stack;
 			else if (ret < 0)
 				goto err_free;
 			if (t + 1 < insn_cnt)
 				env->explored_states[t + 1] = STATE_LIST_MARK;
+			if (insns[t].src_reg == BPF_PSEUDO_CALL) {
+				/* the callee is walked like a branch target,
+				 * calling back into a function that is still
+				 * being walked is recursion and is rejected
+				 */
+				env->explored_states[t] = STATE_LIST_MARK;
+				ret = push_insn(t, t + insns[t].imm + 1,
+						BRANCH, env, false);
+				if (ret == 1)
+					goto peek_stack;
+				else if (ret < 0)
+					goto err_free;
+			}
 		} else if (opcode == BPF_JA) {
 			if (BPF_SRC(insns[t].code) != BPF_K) {
 				ret = -EINVAL;
@@ -2533,7 +3097,7 @@ peek_stack:
 			}
 			/* unconditional jump with single edge */
 			ret = push_insn(t, t + insns[t].off + 1,
-					FALLTHROUGH, env);
+					FALLTHROUGH, env, true);
 			if (ret == 1)
 				goto peek_stack;
 			else if (ret < 0)
@@ -2543,16 +3107,20 @@ peek_stack:
 			 */
 			if (t + 1 < insn_cnt)
 				env->explored_states[t + 1] = STATE_LIST_MARK;
+			/* the target may be the head of a loop */
+			env->explored_states[t + insns[t].off + 1] =
+				STATE_LIST_MARK;
 		} else {
 			/* conditional jump with two edges */
 			env->explored_states[t] = STATE_LIST_MARK;
-			ret = push_insn(t, t + 1, FALLTHROUGH, env);
+			ret = push_insn(t, t + 1, FALLTHROUGH, env, true);
 			if (ret == 1)
 				goto peek_stack;
 			else if (ret < 0)
 				goto err_free;
 
-			ret = push_insn(t, t + insns[t].off + 1, BRANCH, env);
+			ret = push_insn(t, t + insns[t].off + 1, BRANCH, env,
+					true);
 			if (ret == 1)
 				goto peek_stack;
 			else if (ret < 0)
@@ -2562,7 +3130,7 @@ peek_stack:
 		/* all other non-branch instructions with single
 		 * fall-through edge
 		 */
-		ret = push_insn(t, t + 1, FALLTHROUGH, env);
+		ret = push_insn(t, t + 1, FALLTHROUGH, env, false);
 		if (ret == 1)
 			goto peek_stack;
 		else if (ret < 0)
@@ -2673,9 +3241,9 @@ static bool compare_ptrs_to_packet(struct bpf_reg_state *old,
  * whereas register type in current state is meaningful, it means that
  * the current state will reach 'bpf_exit' instruction safely
  */
-static bool states_equal(struct bpf_verifier_env *env,
-			 struct bpf_verifier_state *old,
-			 struct bpf_verifier_state *cur)
+static bool func_states_equal(struct bpf_verifier_env *env,
+			      struct bpf_func_state *old,
+			      struct bpf_func_state *cur)
 {
 	bool varlen_map_access = env->varlen_map_value_access;
 	struct bpf_reg_state *rold, *rcur;
@@ -2685,7 +3253,13 @@ static bool states_equal(struct bpf_verifier_env *env,
 		rold = &old->regs[i];
 		rcur = &cur->regs[i];
 
-		if (memcmp(rold, rcur, sizeof(*rold)) == 0)
+		/* the explored state's descendants never read the register,
+		 * so whatever it holds now cannot make a difference
+		 */
+		if (track_liveness(env) && !(rold->live & REG_LIVE_READ))
+			continue;
+
+		if (memcmp(rold, rcur, offsetof(struct bpf_reg_state, live)) == 0)
 			continue;
 
 		/* If the ranges were not the same, but everything else was and
@@ -2731,7 +3305,7 @@ static bool states_equal(struct bpf_verifier_env *env,
 			continue;
 		if (memcmp(&old->spilled_regs[i / BPF_REG_SIZE],
 			   &cur->spilled_regs[i / BPF_REG_SIZE],
-			   sizeof(old->spilled_regs[0])))
+			   offsetof(struct bpf_reg_state, live)))
 			/* when explored and current stack slot types are
 			 * the same, check that stored pointers types
 			 * are the same as well.
@@ -2749,10 +3323,76 @@ static bool states_equal(struct bpf_verifier_env *env,
 	return true;
 }
 
+static bool states_equal(struct bpf_verifier_env *env,
+			 struct bpf_verifier_state *old,
+			 struct bpf_verifier_state *cur)
+{
+	int i;
+
+	if (old->curframe != cur->curframe)
+		return false;
+
+	/* for states to be equal callsites have to be the same
+	 * and all frame states need to be equivalent
+	 */
+	for (i = 0; i <= old->curframe; i++) {
+		if (old->frame[i]->callsite != cur->frame[i]->callsite)
+			return false;
+		if (!func_states_equal(env, old->frame[i], cur->frame[i]))
+			return false;
+	}
+	return true;
+}
+
+/* an explored state that still has paths in flight is an ancestor of the
+ * current state on the same path, i.e. the program went around a loop.
+ * If no register of the innermost frame changed on the way, nothing can
+ * make the next iteration behave any differently.
+ */
+static bool states_maybe_looping(struct bpf_verifier_state *old,
+				 struct bpf_verifier_state *cur)
+{
+	struct bpf_func_state *fold, *fcur;
+	int i = old->curframe;
+
+	if (old->curframe != cur->curframe)
+		return false;
+
+	fold = old->frame[i];
+	fcur = cur->frame[i];
+	for (i = 0; i < MAX_BPF_REG; i++)
+		if (memcmp(&fold->regs[i], &fcur->regs[i],
+			   offsetof(struct bpf_reg_state, live)))
+			return false;
+	return true;
+}
+
+/* the current state is as good as an explored one, so every register the
+ * explored state's descendants read is also read after the current state.
+ * Make its ancestors aware of that.
+ */
+static void propagate_liveness(struct bpf_verifier_env *env,
+			       const struct bpf_verifier_state *old)
+{
+	int i;
+
+	if (!track_liveness(env))
+		return;
+
+	/* We don't need to worry about FP liveness because it's read-only */
+	for (i = 0; i < BPF_REG_FP; i++)
+		if (old->frame[0]->regs[i].live & REG_LIVE_READ)
+			mark_reg_read(env, i);
+}
+
+
 static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 {
+	struct bpf_verifier_state *cur = env->cur_state, *new;
 	struct bpf_verifier_state_list *new_sl;
 	struct bpf_verifier_state_list *sl;
+	bool add_new_state = true;
+	int i, j, err;
 
 	sl = env->explored_states[insn_idx];
 	if (!sl)
@@ -2762,28 +3402,71 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 		return 0;
 
 	while (sl != STATE_LIST_MARK) {
-		if (states_equal(env, &sl->state, &env->cur_state))
+		if (sl->state.branches) {
+			/* the state is still being explored, so it is not
+			 * proven safe and cannot be used for pruning
+			 */
+			if (states_maybe_looping(&sl->state, cur) &&
+			    states_equal(env, &sl->state, cur)) {
+				verbose("infinite loop detected at insn %d\n",
+					insn_idx);
+				return -EINVAL;
+			}
+			/* different loop iterations have distinct states
+			 * and rarely help future pruning, so don't add new
+			 * states too often while processing a loop
+			 */
+			if (env->insn_processed - env->prev_insn_processed < 100)
+				add_new_state = false;
+		} else if (states_equal(env, &sl->state, cur)) {
 			/* reached equivalent register/stack state,
 			 * prune the search
 			 */
+			propagate_liveness(env, &sl->state);
+			env->pruned_states++;
 			return 1;
+		}
 		sl = sl->next;
 	}
 
+	if (!add_new_state)
+		return 0;
+
 	/* there were no equivalent states, remember current one.
 	 * technically the current state is not proven to be safe yet,
 	 * but it will either reach bpf_exit (which means it's safe) or
-	 * it will be rejected. Since there are no loops, we won't be
-	 * seeing this 'insn_idx' instruction again on the way to bpf_exit
+	 * it will be rejected. Until then its branch count stays non-zero,
+	 * which keeps it from being used for pruning.
 	 */
-	new_sl = kmalloc(sizeof(struct bpf_verifier_state_list), GFP_USER);
+	new_sl = kzalloc(sizeof(struct bpf_verifier_state_list), GFP_USER);
 	if (!new_sl)
 		return -ENOMEM;
 
+	new = &new_sl->state;
+	err = copy_verifier_state(new, cur);
+	if (err) {
+		free_verifier_state(new, false);
+		kfree(new_sl);
+		return err;
+	}
+
 	/* add new state to the head of linked list */
-	memcpy(&new_sl->state, &env->cur_state, sizeof(env->cur_state));
 	new_sl->next = env->explored_states[insn_idx];
 	env->explored_states[insn_idx] = new_sl;
+
+	/* the current state now descends from the one just recorded */
+	cur->parent = new;
+	env->prev_insn_processed = env->insn_processed;
+	env->total_states++;
+	update_peak_states(env);
+
+	/* clear write marks in current state: the current state is now a
+	 * child of new, so writes to regs between now and the next
+	 * checkpoint should screen reads from new
+	 */
+	for (j = 0; j <= cur->curframe; j++)
+		for (i = 0; i < MAX_BPF_REG; i++)
+			cur->frame[j]->regs[i].live = REG_LIVE_NONE;
 	return 0;
 }
 
@@ -2798,15 +3481,29 @@ static int ext_analyzer_insn_hook(struct bpf_verifier_env *env,
 
 static int do_check(struct bpf_verifier_env *env)
 {
-	struct bpf_verifier_state *state = &env->cur_state;
+	struct bpf_verifier_state *state;
 	struct bpf_insn *insns = env->prog->insnsi;
-	struct bpf_reg_state *regs = state->regs;
+	struct bpf_reg_state *regs;
 	int insn_cnt = env->prog->len;
 	int insn_idx, prev_insn_idx = 0;
-	int insn_processed = 0;
 	bool do_print_state = false;
 
-	init_reg_state(regs);
+	state = kzalloc(sizeof(struct bpf_verifier_state), GFP_KERNEL);
+	if (!state)
+		return -ENOMEM;
+	state->curframe = 0;
+	state->parent = NULL;
+	state->branches = 1;
+	state->frame[0] = kzalloc(sizeof(struct bpf_func_state), GFP_KERNEL);
+	if (!state->frame[0]) {
+		kfree(state);
+		return -ENOMEM;
+	}
+	env->cur_state = state;
+	init_func_state(state->frame[0],
+			-1 /* main program has no callsite */,
+			0 /* frameno */,
+			0 /* subprogno, zero == main subprog */);
 	insn_idx = 0;
 	env->varlen_map_value_access = false;
 	for (;;) {
@@ -2822,10 +3519,12 @@ static int do_check(struct bpf_verifier_env *env)
 
 		insn = &insns[insn_idx];
 		class = BPF_CLASS(insn->code);
+		/* frames come and go with calls and branches */
+		regs = cur_regs(env);
 
-		if (++insn_processed > BPF_COMPLEXITY_LIMIT_INSNS) {
+		if (++env->insn_processed > BPF_COMPLEXITY_LIMIT_INSNS) {
 			verbose("BPF program is too large. Proccessed %d insn\n",
-				insn_processed);
+				env->insn_processed);
 			return -E2BIG;
 		}
 
@@ -2849,7 +3548,7 @@ static int do_check(struct bpf_verifier_env *env)
 
 		if (log_level && do_print_state) {
 			verbose("\nfrom %d to %d:", prev_insn_idx, insn_idx);
-			print_verifier_state(&env->cur_state);
+			print_verifier_state(cur_func(env));
 			do_print_state = false;
 		}
 
@@ -2873,11 +3572,11 @@ static int do_check(struct bpf_verifier_env *env)
 			/* check for reserved fields is already done */
 
 			/* check src operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 
-			err = check_reg_arg(regs, insn->dst_reg, DST_OP_NO_MARK);
+			err = check_reg_arg(env, insn->dst_reg, DST_OP_NO_MARK);
 			if (err)
 				return err;
 
@@ -2934,11 +3633,11 @@ static int do_check(struct bpf_verifier_env *env)
 			}
 
 			/* check src1 operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 			/* check src2 operand */
-			err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+			err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 			if (err)
 				return err;
 
@@ -2969,7 +3668,7 @@ static int do_check(struct bpf_verifier_env *env)
 				return -EINVAL;
 			}
 			/* check src operand */
-			err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+			err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 			if (err)
 				return err;
 
@@ -2986,13 +3685,17 @@ static int do_check(struct bpf_verifier_env *env)
 			if (opcode == BPF_CALL) {
 				if (BPF_SRC(insn->code) != BPF_K ||
 				    insn->off != 0 ||
-				    insn->src_reg != BPF_REG_0 ||
+				    (insn->src_reg != BPF_REG_0 &&
+				     insn->src_reg != BPF_PSEUDO_CALL) ||
 				    insn->dst_reg != BPF_REG_0) {
 					verbose("BPF_CALL uses reserved fields\n");
 					return -EINVAL;
 				}
 
-				err = check_call(env, insn->imm);
+				if (insn->src_reg == BPF_PSEUDO_CALL)
+					err = check_func_call(env, insn, &insn_idx);
+				else
+					err = check_call(env, insn->imm);
 				if (err)
 					return err;
 
@@ -3023,23 +3726,34 @@ static int do_check(struct bpf_verifier_env *env)
 				 * of bpf_exit, which means that program wrote
 				 * something into it earlier
 				 */
-				err = check_reg_arg(regs, BPF_REG_0, SRC_OP);
+				err = check_reg_arg(env, BPF_REG_0, SRC_OP);
 				if (err)
 					return err;
 
+				if (state->curframe) {
+					/* exit from nested function */
+					prev_insn_idx = insn_idx;
+					err = prepare_func_exit(env, &insn_idx);
+					if (err)
+						return err;
+					do_print_state = true;
+					continue;
+				}
+
 				if (is_pointer_value(env, BPF_REG_0)) {
 					verbose("R0 leaks addr as return value\n");
 					return -EACCES;
 				}
 
 process_bpf_exit:
-				insn_idx = pop_stack(env, &prev_insn_idx);
-				if (insn_idx < 0) {
+				update_branch_counts(env->cur_state);
+				err = pop_stack(env, &prev_insn_idx, &insn_idx);
+				if (err == -ENOENT)
 					break;
-				} else {
-					do_print_state = true;
-					continue;
-				}
+				if (err)
+					return err;
+				do_print_state = true;
+				continue;
 			} else {
 				err = check_cond_jmp_op(env, insn, &insn_idx);
 				if (err)
@@ -3072,7 +3786,6 @@ process_bpf_exit:
 		insn_idx++;
 	}
 
-	verbose("processed %d insns\n", insn_processed);
 	return 0;
 }
 
@@ -3080,9 +3793,16 @@ static int check_map_prog_compatibility(struct bpf_map *map,
 					struct bpf_prog *prog)
 
 {
-	if (prog->type == BPF_PROG_TYPE_PERF_EVENT &&
-	    (map->map_type == BPF_MAP_TYPE_HASH ||
-	     map->map_type == BPF_MAP_TYPE_PERCPU_HASH) &&
+	if (prog->type != BPF_PROG_TYPE_PERF_EVENT)
+		return 0;
+
+	if (map->inner_map_meta &&
+	    check_map_prog_compatibility(map->inner_map_meta, prog))
+		return -EINVAL;
+
+	if ((map->map_type == BPF_MAP_TYPE_HASH ||
+	     map->map_type == BPF_MAP_TYPE_PERCPU_HASH ||
+	     map->map_type == BPF_MAP_TYPE_HASH_OF_MAPS) &&
 	    (map->map_flags & BPF_F_NO_PREALLOC)) {
 		verbose("perf_event programs can only use preallocated hash map\n");
 		return -EINVAL;
@@ -3278,6 +3998,107 @@ static int convert_ctx_accesses(struct bpf_verifier_env *env)
 	return 0;
 }
 
+static u32 subprog_frame_size(struct bpf_verifier_env *env, int subprog)
+{
+	return round_up(max_t(u32, env->subprog_stack_depth[subprog], 1), 32);
+}
+
+/* starting from main bpf function walk all instructions of the function
+ * and recursively walk all callees that given function can call.
+ * Since recursion is prevented by check_cfg() this algorithm
+ * only needs a local stack of MAX_CALL_FRAMES to remember callsites
+ */
+static int check_max_stack_depth(struct bpf_verifier_env *env)
+{
+	int depth = 0, frame = 0, subprog = 0, i = 0, subprog_end;
+	struct bpf_insn *insn = env->prog->insnsi;
+	int insn_cnt = env->prog->len;
+	int ret_insn[MAX_CALL_FRAMES];
+	int ret_prog[MAX_CALL_FRAMES];
+
+process_func:
+	depth += subprog_frame_size(env, subprog);
+	if (depth > MAX_BPF_STACK) {
+		verbose("combined stack size of %d calls is %d. Too large\n",
+			frame + 1, depth);
+		return -EACCES;
+	}
+continue_func:
+	subprog_end = subprog + 1 < env->subprog_cnt ?
+		      env->subprog_starts[subprog + 1] : insn_cnt;
+	for (; i < subprog_end; i++) {
+		if (insn[i].code != (BPF_JMP | BPF_CALL))
+			continue;
+		if (insn[i].src_reg != BPF_PSEUDO_CALL)
+			continue;
+		/* remember insn and function to return to */
+		ret_insn[frame] = i + 1;
+		ret_prog[frame] = subprog;
+
+		/* find the callee */
+		i = i + insn[i].imm + 1;
+		subprog = find_subprog(env, i);
+		if (subprog < 0) {
+			verbose("verifier bug. No program starts at insn %d\n",
+				i);
+			return -EFAULT;
+		}
+		frame++;
+		if (frame >= MAX_CALL_FRAMES) {
+			verbose("verifier bug. Call stack is too deep\n");
+			return -EFAULT;
+		}
+		goto process_func;
+	}
+	/* end of for() loop means the last insn of the 'subprog'
+	 * was reached. Doesn't matter whether it was JA or EXIT
+	 */
+	if (frame == 0)
+		return 0;
+	depth -= subprog_frame_size(env, subprog);
+	frame--;
+	i = ret_insn[frame];
+	subprog = ret_prog[frame];
+	goto continue_func;
+}
+
+/* every frame is given the stack its function was verified to use,
+ * the interpreter moves the frame pointer of the callee by the stack
+ * size of the caller which is recorded in the call insn, JITs size the
+ * frame each function sets up from aux->subprog_frame_size[]
+ */
+static int fixup_call_args(struct bpf_verifier_env *env)
+{
+	struct bpf_insn *insn = env->prog->insnsi;
+	struct bpf_prog_aux *aux = env->prog->aux;
+	int insn_cnt = env->prog->len;
+	int i, subprog;
+
+	aux->has_subprog_calls = env->subprog_cnt > 1;
+	if (env->subprog_cnt <= 1)
+		return 0;
+
+	aux->subprog_frame_size = kcalloc(env->subprog_cnt,
+					  sizeof(aux->subprog_frame_size[0]),
+					  GFP_KERNEL);
+	if (!aux->subprog_frame_size)
+		return -ENOMEM;
+	for (subprog = 0; subprog < env->subprog_cnt; subprog++)
+		aux->subprog_frame_size[subprog] =
+			subprog_frame_size(env, subprog);
+
+	for (subprog = 0, i = 0; i < insn_cnt; i++, insn++) {
+		if (subprog + 1 < env->subprog_cnt &&
+		    i == env->subprog_starts[subprog + 1])
+			subprog++;
+		if (insn->code != (BPF_JMP | BPF_CALL) ||
+		    insn->src_reg != BPF_PSEUDO_CALL)
+			continue;
+		insn->off = subprog_frame_size(env, subprog);
+	}
+	return 0;
+}
+
 static void free_states(struct bpf_verifier_env *env)
 {
 	struct bpf_verifier_state_list *sl, *sln;
@@ -3292,6 +4113,7 @@ static void free_states(struct bpf_verifier_env *env)
 		if (sl)
 			while (sl != STATE_LIST_MARK) {
 				sln = sl->next;
+				free_verifier_state(&sl->state, false);
 				kfree(sl);
 				sl = sln;
 			}
@@ -3300,12 +4122,34 @@ static void free_states(struct bpf_verifier_env *env)
 	kfree(env->explored_states);
 }
 
+static int copy_verifier_stats(struct bpf_verifier_env *env,
+			       const union bpf_attr *attr, u64 start_time)
+{
+	struct bpf_verifier_stats stats = {};
+	u32 size = min_t(u32, attr->stats_size, sizeof(stats));
+
+	stats.verification_time_ns = ktime_get_ns() - start_time;
+	stats.insn_processed = env->insn_processed;
+	stats.total_states = env->total_states;
+	stats.peak_states = env->peak_states;
+	stats.pruned_states = env->pruned_states;
+
+	if (copy_to_user((void __user *) (unsigned long) attr->stats,
+			 &stats, size))
+		return -EFAULT;
+	return 0;
+}
+
 int bpf_check(struct bpf_prog **prog, union bpf_attr *attr)
 {
 	char __user *log_ubuf = NULL;
 	struct bpf_verifier_env *env;
+	u64 start_time;
 	int ret = -EINVAL;
 
+	if (!attr->stats != !attr->stats_size)
+		return -EINVAL;
+
 	if ((*prog)->len <= 0 || (*prog)->len > BPF_MAXINSNS)
 		return -E2BIG;
 
@@ -3349,6 +4193,8 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr)
 		log_level = 0;
 	}
 
+	start_time = ktime_get_ns();
+
 	ret = replace_map_fd_with_map_ptr(env);
 	if (ret < 0)
 		goto skip_full_check;
@@ -3360,18 +4206,35 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr)
 	if (!env->explored_states)
 		goto skip_full_check;
 
-	ret = check_cfg(env);
+	env->allow_ptr_leaks = capable(CAP_SYS_ADMIN);
+
+	ret = check_subprogs(env);
 	if (ret < 0)
 		goto skip_full_check;
 
-	env->allow_ptr_leaks = capable(CAP_SYS_ADMIN);
+	ret = check_cfg(env);
+	if (ret < 0)
+		goto skip_full_check;
 
 	ret = do_check(env);
+	if (env->cur_state) {
+		free_verifier_state(env->cur_state, true);
+		env->cur_state = NULL;
+	}
+	verbose("processed %d insns, %d states saved (peak %d), %d pruned\n",
+		env->insn_processed, env->total_states, env->peak_states,
+		env->pruned_states);
 
 skip_full_check:
-	while (pop_stack(env, NULL) >= 0);
+	while (!pop_stack(env, NULL, NULL));
 	free_states(env);
 
+	if (ret == 0)
+		ret = check_max_stack_depth(env);
+
+	if (ret == 0)
+		ret = fixup_call_args(env);
+
 	if (ret == 0)
 		/* program is valid, convert *(u32*)(ctx + off) accesses */
 		ret = convert_ctx_accesses(env);
@@ -3389,6 +4252,12 @@ skip_full_check:
 		goto free_log_buf;
 	}
 
+	/* statistics are returned for rejected programs as well */
+	if (attr->stats && copy_verifier_stats(env, attr, start_time)) {
+		ret = -EFAULT;
+		goto free_log_buf;
+	}
+
 	if (ret == 0 && env->used_map_cnt) {
 		/* if program passed verifier, update used_maps in bpf_prog_info */
 		env->prog->aux->used_maps = kmalloc_array(env->used_map_cnt,
@@ -3458,16 +4327,24 @@ int bpf_analyzer(struct bpf_prog *prog, const struct bpf_ext_analyzer_ops *ops,
 	if (!env->explored_states)
 		goto skip_full_check;
 
-	ret = check_cfg(env);
+	env->allow_ptr_leaks = capable(CAP_SYS_ADMIN);
+
+	ret = check_subprogs(env);
 	if (ret < 0)
 		goto skip_full_check;
 
-	env->allow_ptr_leaks = capable(CAP_SYS_ADMIN);
+	ret = check_cfg(env);
+	if (ret < 0)
+		goto skip_full_check;
 
 	ret = do_check(env);
+	if (env->cur_state) {
+		free_verifier_state(env->cur_state, true);
+		env->cur_state = NULL;
+	}
 
 skip_full_check:
-	while (pop_stack(env, NULL) >= 0);
+	while (!pop_stack(env, NULL, NULL));
 	free_states(env);
 
 	mutex_unlock(&bpf_verifier_lock);
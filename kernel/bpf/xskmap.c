@@ -0,0 +1,320 @@
+/* XSKMAP used for AF_XDP sockets
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ */
+
+/* An xskmap is an array of AF_XDP sockets, updated from user space with
+ * socket file descriptors.  XDP programs select an entry with
+ * bpf_redirect_map() and the packet is copied into the rx ring of that
+ * socket right away; what is deferred to xdp_do_flush_map() is waking
+ * up the reader, once per NAPI poll instead of once per packet.
+ *
+ * Entries hold a reference on their socket and follow the lifetime
+ * rules of the devmap.
+ */
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/net.h>
+#include <linux/slab.h>
+#include <net/xdp_sock.h>
+
+struct xsk_map_entry;
+
+struct xsk_flush_node {
+	struct list_head flush_node;
+	struct xsk_map_entry *obj;
+};
+
+struct xsk_map_entry {
+	struct xdp_sock *xs;
+	struct xsk_flush_node __percpu *flush;
+	struct rcu_head rcu;
+};
+
+struct xsk_map {
+	struct bpf_map map;
+	struct xsk_map_entry **xsk_map;
+	struct list_head __percpu *flush_list;
+};
+
+/* Called from syscall */
+static struct bpf_map *xsk_map_alloc(union bpf_attr *attr)
+{
+	struct xsk_map *m;
+	int err = -EINVAL;
+	u64 cost;
+	int cpu;
+
+	if (!capable(CAP_NET_ADMIN))
+		return ERR_PTR(-EPERM);
+
+	/* check sanity of attributes */
+	if (attr->max_entries == 0 || attr->key_size != 4 ||
+	    attr->value_size != 4 || attr->map_flags)
+		return ERR_PTR(-EINVAL);
+
+	m = kzalloc(sizeof(*m), GFP_USER);
+	if (!m)
+		return ERR_PTR(-ENOMEM);
+
+	/* mandatory map attributes */
+	m->map.map_type = attr->map_type;
+	m->map.key_size = attr->key_size;
+	m->map.value_size = attr->value_size;
+	m->map.max_entries = attr->max_entries;
+	m->map.map_flags = attr->map_flags;
+
+	cost = (u64) m->map.max_entries * sizeof(struct xsk_map_entry *);
+	cost += (u64) sizeof(struct list_head) * num_possible_cpus();
+	m->map.pages = round_up(cost, PAGE_SIZE) >> PAGE_SHIFT;
+
+	/* if map size is larger than memlock limit, reject it early */
+	err = bpf_map_precharge_memlock(m->map.pages);
+	if (err)
+		goto free_m;
+
+	err = -ENOMEM;
+	m->flush_list = alloc_percpu(struct list_head);
+	if (!m->flush_list)
+		goto free_m;
+
+	for_each_possible_cpu(cpu)
+		INIT_LIST_HEAD(per_cpu_ptr(m->flush_list, cpu));
+
+	m->xsk_map = bpf_map_area_alloc(m->map.max_entries *
+					sizeof(struct xsk_map_entry *));
+	if (!m->xsk_map)
+		goto free_percpu;
+
+	return &m->map;
+
+free_percpu:
+	free_percpu(m->flush_list);
+free_m:
+	kfree(m);
+	return ERR_PTR(err);
+}
+
+static void xsk_map_entry_free(struct xsk_map_entry *entry)
+{
+	sock_put(&entry->xs->sk);
+	free_percpu(entry->flush);
+	kfree(entry);
+}
+
+static void __xsk_map_entry_free(struct rcu_head *rcu)
+{
+	xsk_map_entry_free(container_of(rcu, struct xsk_map_entry, rcu));
+}
+
+/* Called when map->refcnt goes to zero, either from workqueue or from syscall */
+static void xsk_map_free(struct bpf_map *map)
+{
+	struct xsk_map *m = container_of(map, struct xsk_map, map);
+	int i;
+
+	/* No program references the map anymore, wait for the ones that
+	 * did to finish their redirects and for the flushes that follow.
+	 */
+	synchronize_sched();
+
+	for (i = 0; i < m->map.max_entries; i++) {
+		struct xsk_map_entry *entry = m->xsk_map[i];
+
+		if (entry)
+			xsk_map_entry_free(entry);
+	}
+
+	free_percpu(m->flush_list);
+	bpf_map_area_free(m->xsk_map);
+	kfree(m);
+}
+
+static int xsk_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
+{
+	struct xsk_map *m = container_of(map, struct xsk_map, map);
+	u32 index = *(u32 *)key;
+	u32 *next = next_key;
+
+	if (index >= m->map.max_entries) {
+		*next = 0;
+		return 0;
+	}
+
+	if (index == m->map.max_entries - 1)
+		return -ENOENT;
+
+	*next = index + 1;
+	return 0;
+}
+
+static struct xsk_map_entry *__xsk_map_lookup_elem(struct bpf_map *map,
+						   u32 key)
+{
+	struct xsk_map *m = container_of(map, struct xsk_map, map);
+
+	if (key >= map->max_entries)
+		return NULL;
+
+	return READ_ONCE(m->xsk_map[key]);
+}
+
+/* Called from syscall only, programs use bpf_redirect_map().  A socket
+ * has no value that means anything to user space, so there is nothing
+ * to look up.
+ */
+static void *xsk_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	return NULL;
+}
+
+/* Called from the XDP_REDIRECT path with preemption disabled.  Takes
+ * ownership of the skb on success.
+ */
+int xsk_map_enqueue(struct bpf_map *map, u32 key, struct sk_buff *skb)
+{
+	struct xsk_map *m = container_of(map, struct xsk_map, map);
+	struct xsk_map_entry *entry = __xsk_map_lookup_elem(map, key);
+	struct xsk_flush_node *fn;
+	int err;
+
+	if (unlikely(!entry))
+		return -EINVAL;
+
+	err = xsk_generic_rcv(entry->xs, skb);
+	if (err)
+		return err;
+
+	fn = this_cpu_ptr(entry->flush);
+	if (list_empty(&fn->flush_node))
+		list_add(&fn->flush_node, this_cpu_ptr(m->flush_list));
+
+	return 0;
+}
+
+void __xsk_map_flush(struct bpf_map *map)
+{
+	struct xsk_map *m = container_of(map, struct xsk_map, map);
+	struct list_head *flush_list = this_cpu_ptr(m->flush_list);
+	struct xsk_flush_node *fn, *tmp;
+
+	list_for_each_entry_safe(fn, tmp, flush_list, flush_node) {
+		xsk_flush(fn->obj->xs);
+		list_del_init(&fn->flush_node);
+	}
+}
+
+static int xsk_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct xsk_map *m = container_of(map, struct xsk_map, map);
+	struct xsk_map_entry *old_entry;
+	u32 k = *(u32 *)key;
+
+	if (k >= map->max_entries)
+		return -EINVAL;
+
+	old_entry = xchg(&m->xsk_map[k], NULL);
+	if (old_entry)
+		call_rcu_sched(&old_entry->rcu, __xsk_map_entry_free);
+	return 0;
+}
+
+/* Called from syscall, with rcu_read_lock held and preemption disabled */
+static int xsk_map_update_elem(struct bpf_map *map, void *key, void *value,
+			       u64 map_flags)
+{
+	struct xsk_map *m = container_of(map, struct xsk_map, map);
+	struct xsk_map_entry *entry, *old_entry;
+	u32 i = *(u32 *)key, fd = *(u32 *)value;
+	struct socket *sock;
+	struct xdp_sock *xs;
+	int err, cpu;
+
+	if (unlikely(map_flags > BPF_EXIST))
+		/* unknown flags */
+		return -EINVAL;
+
+	if (unlikely(i >= m->map.max_entries))
+		/* all elements were pre-allocated, cannot insert a new one */
+		return -E2BIG;
+
+	if (unlikely(map_flags == BPF_NOEXIST))
+		/* all elements already exist */
+		return -EEXIST;
+
+	sock = sockfd_lookup(fd, &err);
+	if (!sock)
+		return err;
+
+	if (sock->sk->sk_family != PF_XDP) {
+		sockfd_put(sock);
+		return -EOPNOTSUPP;
+	}
+
+	xs = xdp_sk(sock->sk);
+	if (!xsk_is_setup_for_bpf_map(xs)) {
+		sockfd_put(sock);
+		return -EOPNOTSUPP;
+	}
+
+	entry = kmalloc(sizeof(*entry), GFP_ATOMIC | __GFP_NOWARN);
+	if (!entry)
+		goto out_nomem;
+
+	entry->flush = __alloc_percpu_gfp(sizeof(*entry->flush),
+					  sizeof(void *),
+					  GFP_ATOMIC | __GFP_NOWARN);
+	if (!entry->flush) {
+		kfree(entry);
+		goto out_nomem;
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct xsk_flush_node *fn = per_cpu_ptr(entry->flush, cpu);
+
+		INIT_LIST_HEAD(&fn->flush_node);
+		fn->obj = entry;
+	}
+
+	sock_hold(sock->sk);
+	entry->xs = xs;
+	sockfd_put(sock);
+
+	old_entry = xchg(&m->xsk_map[i], entry);
+	if (old_entry)
+		call_rcu_sched(&old_entry->rcu, __xsk_map_entry_free);
+
+	return 0;
+
+out_nomem:
+	sockfd_put(sock);
+	return -ENOMEM;
+}
+
+static const struct bpf_map_ops xsk_map_ops = {
+	.map_alloc = xsk_map_alloc,
+	.map_free = xsk_map_free,
+	.map_get_next_key = xsk_map_get_next_key,
+	.map_lookup_elem = xsk_map_lookup_elem,
+	.map_update_elem = xsk_map_update_elem,
+	.map_delete_elem = xsk_map_delete_elem,
+};
+
+static struct bpf_map_type_list xsk_map_type __read_mostly = {
+	.ops = &xsk_map_ops,
+	.type = BPF_MAP_TYPE_XSKMAP,
+};
+
+static int __init register_xsk_map(void)
+{
+	bpf_register_map_type(&xsk_map_type);
+	return 0;
+}
+late_initcall(register_xsk_map);
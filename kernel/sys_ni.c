@@ -255,3 +255,8 @@ cond_syscall(sys_membarrier);
 cond_syscall(sys_pkey_mprotect);
 cond_syscall(sys_pkey_alloc);
 cond_syscall(sys_pkey_free);
+
+/* shared ring async I/O */
+cond_syscall(sys_io_uring_setup);
+cond_syscall(sys_io_uring_enter);
+cond_syscall(sys_io_uring_register);
@@ -95,6 +95,7 @@
 #include <linux/notifier.h>
 #include <linux/skbuff.h>
 #include <linux/bpf.h>
+#include <linux/filter.h>
 #include <net/net_namespace.h>
 #include <net/sock.h>
 #include <net/busy_poll.h>
@@ -1828,7 +1829,7 @@ static inline int deliver_skb(struct sk_buff *skb,
 			      struct packet_type *pt_prev,
 			      struct net_device *orig_dev)
 {
-	if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 		return -ENOMEM;
 	atomic_inc(&skb->users);
 	return pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
@@ -3464,6 +3465,55 @@ int dev_queue_xmit_accel(struct sk_buff *skb, void *accel_priv)
 }
 EXPORT_SYMBOL(dev_queue_xmit_accel);
 
+/**
+ *	dev_direct_xmit - transmit a buffer on a given queue, bypassing qdiscs
+ *	@skb: buffer to transmit
+ *	@queue_id: transmit queue of skb->dev to use
+ *
+ *	Hands a fully built frame straight to the driver, for sockets that
+ *	do their own queueing (PF_PACKET with PACKET_QDISC_BYPASS, AF_XDP).
+ *	The buffer is always consumed; NET_XMIT_DROP is returned when the
+ *	device is down or the frame did not validate, NETDEV_TX_BUSY when
+ *	the queue was stopped.
+ */
+int dev_direct_xmit(struct sk_buff *skb, u16 queue_id)
+{
+	struct net_device *dev = skb->dev;
+	struct sk_buff *orig_skb = skb;
+	struct netdev_queue *txq;
+	int ret = NETDEV_TX_BUSY;
+
+	if (unlikely(!netif_running(dev) ||
+		     !netif_carrier_ok(dev)))
+		goto drop;
+
+	skb = validate_xmit_skb_list(skb, dev);
+	if (skb != orig_skb)
+		goto drop;
+
+	skb_set_queue_mapping(skb, queue_id);
+	txq = skb_get_tx_queue(dev, skb);
+
+	local_bh_disable();
+
+	HARD_TX_LOCK(dev, txq, smp_processor_id());
+	if (!netif_xmit_frozen_or_drv_stopped(txq))
+		ret = netdev_start_xmit(skb, dev, txq, false);
+	HARD_TX_UNLOCK(dev, txq);
+
+	local_bh_enable();
+
+	if (!dev_xmit_complete(ret))
+		kfree_skb(skb);
+
+	return ret;
+drop:
+	atomic_long_inc(&dev->tx_dropped);
+	kfree_skb_list(skb);
+	return NET_XMIT_DROP;
+}
+EXPORT_SYMBOL(dev_direct_xmit);
+
 
 /*=======================================================================
 			Receiver routines
@@ -3475,6 +3525,7 @@ EXPORT_SYMBOL(netdev_max_backlog);
 int netdev_tstamp_prequeue __read_mostly = 1;
 int netdev_budget __read_mostly = 300;
 int weight_p __read_mostly = 64;            /* old backlog weight */
+int gro_normal_batch __read_mostly = 8;
 
 /* Called with irq disabled */
 static inline void ____napi_schedule(struct softnet_data *sd,
@@ -3802,6 +3853,211 @@ drop:
 	return NET_RX_DROP;
 }
 
+#ifdef CONFIG_RPS
+/**
+ *	netif_rx_cpu_bulk - queue received packets to a CPU's backlog
+ *	@skbs: packets, already past eth_type_trans()
+ *	@n: number of packets
+ *	@cpu: CPU whose backlog receives them
+ *	@limit: backlog length past which packets are dropped
+ *
+ *	Like RPS steering, but the whole batch is queued under one lock
+ *	acquisition and costs at most one IPI.  Used by the XDP cpumap.
+ *	Called with preemption disabled, returns the number of packets
+ *	queued; the others are freed.
+ */
+unsigned int netif_rx_cpu_bulk(struct sk_buff **skbs, unsigned int n, int cpu,
+			       unsigned int limit)
+{
+	struct sk_buff *skb, *drop = NULL;
+	unsigned int i, qlen, qtail, queued = 0;
+	struct softnet_data *sd;
+	unsigned long flags;
+
+	sd = &per_cpu(softnet_data, cpu);
+	limit = min_t(unsigned int, limit, netdev_max_backlog);
+
+	local_irq_save(flags);
+	rps_lock(sd);
+	qlen = skb_queue_len(&sd->input_pkt_queue);
+	for (i = 0; i < n; i++) {
+		skb = skbs[i];
+		if (!netif_running(skb->dev) || qlen >= limit) {
+			sd->dropped++;
+			skb->next = drop;
+			drop = skb;
+			continue;
+		}
+
+		/* Schedule NAPI for backlog device, see enqueue_to_backlog() */
+		if (!qlen &&
+		    !__test_and_set_bit(NAPI_STATE_SCHED, &sd->backlog.state)) {
+			if (!rps_ipi_queued(sd))
+				____napi_schedule(sd, &sd->backlog);
+		}
+		__skb_queue_tail(&sd->input_pkt_queue, skb);
+		input_queue_tail_incr_save(sd, &qtail);
+		queued++;
+		qlen++;
+	}
+	rps_unlock(sd);
+	local_irq_restore(flags);
+
+	while (drop) {
+		skb = drop;
+		drop = skb->next;
+		skb->next = NULL;
+		atomic_long_inc(&skb->dev->rx_dropped);
+		kfree_skb(skb);
+	}
+
+	return queued;
+}
+EXPORT_SYMBOL_GPL(netif_rx_cpu_bulk);
+#endif
+
+static struct static_key generic_xdp_needed __read_mostly;
+
+static void generic_xdp_count(struct net_device *dev, u32 act)
+{
+	struct netdev_xdp_stats *stats = this_cpu_ptr(dev->xdp_stats);
+
+	u64_stats_update_begin(&stats->syncp);
+	switch (act) {
+	case XDP_PASS:
+		stats->pass++;
+		break;
+	case XDP_TX:
+		stats->tx++;
+		break;
+	case XDP_REDIRECT:
+		stats->redirect++;
+		break;
+	default:
+		stats->drop++;
+		break;
+	}
+	u64_stats_update_end(&stats->syncp);
+}
+
+/* Run the program on the linear packet, starting at the MAC header, the
+ * way a driver with native XDP would present it.  The skb is consumed
+ * unless the verdict is XDP_PASS, XDP_TX or XDP_REDIRECT.
+ */
+static u32 netif_receive_generic_xdp(struct sk_buff *skb,
+				     struct bpf_prog *xdp_prog)
+{
+	struct xdp_buff xdp;
+	u32 act = XDP_DROP;
+	u32 mac_len;
+
+	/* Reinjected packets coming from act_mirred or similar should
+	 * not get XDP generic processing.
+	 */
+	if (skb_cloned(skb) || !skb_mac_header_was_set(skb))
+		return XDP_PASS;
+
+	if (skb_linearize(skb))
+		goto do_drop;
+
+	mac_len = skb->data - skb_mac_header(skb);
+	xdp.data = skb->data - mac_len;
+	xdp.data_end = skb->data + skb_headlen(skb);
+
+	act = bpf_prog_run_xdp(xdp_prog, &xdp);
+
+	switch (act) {
+	case XDP_TX:
+		__skb_push(skb, mac_len);
+		/* fall through */
+	case XDP_REDIRECT:
+	case XDP_PASS:
+		break;
+
+	default:
+		bpf_warn_invalid_xdp_action(act);
+		/* fall through */
+	case XDP_ABORTED:
+	case XDP_DROP:
+	do_drop:
+		kfree_skb(skb);
+		break;
+	}
+
+	return act;
+}
+
+/**
+ *	generic_xdp_xmit - send XDP packets straight to a driver
+ *	@dev: device to transmit on
+ *	@skbs: packets, with the MAC header at skb->data
+ *	@n: number of packets
+ *
+ *	Transmit like a native XDP_TX would, without going through the
+ *	qdisc.  The whole batch uses the tx queue picked for the first
+ *	packet and a single lock acquisition, with xmit_more set on all but
+ *	the last packet.  Packets the device refuses are freed.  Called with
+ *	preemption disabled, returns the number of packets sent.
+ */
+unsigned int generic_xdp_xmit(struct net_device *dev, struct sk_buff **skbs,
+			      unsigned int n)
+{
+	struct netdev_queue *txq;
+	unsigned int i, sent = 0;
+	u16 queue;
+	int cpu, rc;
+
+	txq = netdev_pick_tx(dev, skbs[0], NULL);
+	queue = skb_get_queue_mapping(skbs[0]);
+	cpu = smp_processor_id();
+	HARD_TX_LOCK(dev, txq, cpu);
+	for (i = 0; i < n; i++) {
+		if (netif_xmit_stopped(txq))
+			break;
+		skb_set_queue_mapping(skbs[i], queue);
+		rc = netdev_start_xmit(skbs[i], dev, txq, i + 1 < n);
+		if (!dev_xmit_complete(rc))
+			break;
+		sent++;
+	}
+	HARD_TX_UNLOCK(dev, txq);
+
+	for (i = sent; i < n; i++)
+		kfree_skb(skbs[i]);
+
+	return sent;
+}
+EXPORT_SYMBOL_GPL(generic_xdp_xmit);
+
+/* Called with rcu_read_lock and preemption disabled */
+static int do_xdp_generic(struct sk_buff *skb)
+{
+	struct bpf_prog *xdp_prog = rcu_dereference(skb->dev->xdp_prog);
+	struct net_device *dev = skb->dev;
+	u32 act;
+
+	if (!xdp_prog)
+		return XDP_PASS;
+
+	act = netif_receive_generic_xdp(skb, xdp_prog);
+	switch (act) {
+	case XDP_TX:
+		/* send the packet back out of the device it came in on */
+		if (!generic_xdp_xmit(dev, &skb, 1))
+			act = XDP_DROP;
+		break;
+	case XDP_REDIRECT:
+		if (xdp_do_generic_redirect(dev, skb, xdp_prog))
+			act = XDP_DROP;
+		else if (!__this_cpu_read(softnet_data.xdp_flush_at_poll_end))
+			xdp_do_flush_map();
+		break;
+	}
+	generic_xdp_count(dev, act);
+
+	return act == XDP_PASS ? XDP_PASS : XDP_DROP;
+}
+
 static int netif_rx_internal(struct sk_buff *skb)
 {
 	int ret;
@@ -3809,6 +4065,30 @@ static int netif_rx_internal(struct sk_buff *skb)
 	net_timestamp_check(netdev_tstamp_prequeue, skb);
 
 	trace_netif_rx(skb);
+
+	if (static_key_false(&generic_xdp_needed)) {
+		/* XDP_TX and XDP_REDIRECT take tx locks and touch the
+		 * per-cpu redirect queues, which is not safe from hard irq
+		 * context.  Leave the program to process_backlog() there.
+		 */
+		if (!in_softirq() || in_irq()) {
+			skb->xdp_defer = 1;
+		} else {
+			preempt_disable();
+			rcu_read_lock();
+			ret = do_xdp_generic(skb);
+			rcu_read_unlock();
+			preempt_enable();
+
+			/* Consider XDP consuming the packet a success from
+			 * the netdev point of view we do not want to count
+			 * this as an error.
+			 */
+			if (ret != XDP_PASS)
+				return NET_RX_SUCCESS;
+		}
+	}
+
 #ifdef CONFIG_RPS
 	if (static_key_false(&rps_needed)) {
 		struct rps_dev_flow voidflow, *rflow = &voidflow;
@@ -3901,8 +4181,6 @@ static __latent_entropy void net_tx_action(struct softirq_action *h)
 			else
 				__kfree_skb_defer(skb);
 		}
-
-		__kfree_skb_flush();
 	}
 
 	if (sd->output_queue) {
@@ -4100,10 +4378,12 @@ static inline int nf_ingress(struct sk_buff *skb, struct packet_type **pt_prev,
 	return 0;
 }
 
-static int __netif_receive_skb_core(struct sk_buff *skb, bool pfmemalloc)
+static int __netif_receive_skb_core(struct sk_buff **pskb, bool pfmemalloc,
+				    struct packet_type **ppt_prev)
 {
 	struct packet_type *ptype, *pt_prev;
 	rx_handler_func_t *rx_handler;
+	struct sk_buff *skb = *pskb;
 	struct net_device *orig_dev;
 	bool deliver_exact = false;
 	int ret = NET_RX_DROP;
@@ -4234,10 +4514,9 @@ ncls:
 	}
 
 	if (pt_prev) {
-		if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+		if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 			goto drop;
-		else
-			ret = pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
+		*ppt_prev = pt_prev;
 	} else {
 drop:
 		if (!deliver_exact)
@@ -4252,6 +4531,22 @@ drop:
 	}
 
 out:
+	/* The packet may have been untagged or replaced by an rx_handler,
+	 * hand the final skb back to the caller for delivery.
+	 */
+	*pskb = skb;
+	return ret;
+}
+
+static int __netif_receive_skb_one_core(struct sk_buff *skb, bool pfmemalloc)
+{
+	struct net_device *orig_dev = skb->dev;
+	struct packet_type *pt_prev = NULL;
+	int ret;
+
+	ret = __netif_receive_skb_core(&skb, pfmemalloc, &pt_prev);
+	if (pt_prev)
+		ret = pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
 	return ret;
 }
 
@@ -4272,14 +4567,94 @@ static int __netif_receive_skb(struct sk_buff *skb)
 		 * context down to all allocation sites.
 		 */
 		current->flags |= PF_MEMALLOC;
-		ret = __netif_receive_skb_core(skb, true);
+		ret = __netif_receive_skb_one_core(skb, true);
 		tsk_restore_flags(current, pflags, PF_MEMALLOC);
 	} else
-		ret = __netif_receive_skb_core(skb, false);
+		ret = __netif_receive_skb_one_core(skb, false);
 
 	return ret;
 }
 
+static void __netif_receive_skb_list_ptype(struct sk_buff_head *list,
+					   struct packet_type *pt_prev,
+					   struct net_device *orig_dev)
+{
+	struct sk_buff *skb;
+
+	if (!pt_prev)
+		return;
+	if (pt_prev->list_func) {
+		pt_prev->list_func(list, pt_prev, orig_dev);
+		return;
+	}
+	while ((skb = __skb_dequeue(list)) != NULL)
+		pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
+}
+
+static void __netif_receive_skb_list_core(struct sk_buff_head *list,
+					  bool pfmemalloc)
+{
+	/* Taps, ingress and rx_handlers still run per packet in
+	 * __netif_receive_skb_core().  Only the final packet_type is
+	 * deferred: consecutive packets that end up at the same one (and
+	 * came in through the same device) are handed to it as a single
+	 * sublist.  Since each sublist is flushed before the next one is
+	 * started, no packet_type ever sees packets out of order.
+	 */
+	struct packet_type *pt_curr = NULL;
+	struct net_device *od_curr = NULL;
+	struct sk_buff_head sublist;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&sublist);
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		struct net_device *orig_dev = skb->dev;
+		struct packet_type *pt_prev = NULL;
+
+		__netif_receive_skb_core(&skb, pfmemalloc, &pt_prev);
+		if (!pt_prev)
+			continue;
+		if (pt_curr != pt_prev || od_curr != orig_dev) {
+			__netif_receive_skb_list_ptype(&sublist, pt_curr,
+						       od_curr);
+			pt_curr = pt_prev;
+			od_curr = orig_dev;
+		}
+		__skb_queue_tail(&sublist, skb);
+	}
+	__netif_receive_skb_list_ptype(&sublist, pt_curr, od_curr);
+}
+
+static void __netif_receive_skb_list(struct sk_buff_head *list)
+{
+	unsigned long pflags = current->flags;
+	struct sk_buff_head sublist;
+	bool pfmemalloc = false;
+	struct sk_buff *skb;
+
+	/* PFMEMALLOC skbs need PF_MEMALLOC set while they are processed,
+	 * see __netif_receive_skb(); split the list wherever that changes.
+	 */
+	__skb_queue_head_init(&sublist);
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		if ((sk_memalloc_socks() && skb_pfmemalloc(skb)) != pfmemalloc) {
+			if (!skb_queue_empty(&sublist))
+				__netif_receive_skb_list_core(&sublist,
+							      pfmemalloc);
+			pfmemalloc = !pfmemalloc;
+			if (pfmemalloc)
+				current->flags |= PF_MEMALLOC;
+			else
+				tsk_restore_flags(current, pflags, PF_MEMALLOC);
+		}
+		__skb_queue_tail(&sublist, skb);
+	}
+	if (!skb_queue_empty(&sublist))
+		__netif_receive_skb_list_core(&sublist, pfmemalloc);
+	if (pfmemalloc)
+		tsk_restore_flags(current, pflags, PF_MEMALLOC);
+}
+
 static int netif_receive_skb_internal(struct sk_buff *skb)
 {
 	int ret;
@@ -4291,6 +4666,17 @@ static int netif_receive_skb_internal(struct sk_buff *skb)
 
 	rcu_read_lock();
 
+	if (static_key_false(&generic_xdp_needed)) {
+		preempt_disable();
+		ret = do_xdp_generic(skb);
+		preempt_enable();
+
+		if (ret != XDP_PASS) {
+			rcu_read_unlock();
+			return NET_RX_SUCCESS;
+		}
+	}
+
 #ifdef CONFIG_RPS
 	if (static_key_false(&rps_needed)) {
 		struct rps_dev_flow voidflow, *rflow = &voidflow;
@@ -4308,6 +4694,48 @@ static int netif_receive_skb_internal(struct sk_buff *skb)
 	return ret;
 }
 
+static void netif_receive_skb_list_internal(struct sk_buff_head *list)
+{
+	struct sk_buff_head sublist;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&sublist);
+
+	rcu_read_lock();
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		net_timestamp_check(netdev_tstamp_prequeue, skb);
+
+		if (skb_defer_rx_timestamp(skb))
+			continue;
+
+		if (static_key_false(&generic_xdp_needed)) {
+			int ret;
+
+			preempt_disable();
+			ret = do_xdp_generic(skb);
+			preempt_enable();
+
+			if (ret != XDP_PASS)
+				continue;
+		}
+
+#ifdef CONFIG_RPS
+		if (static_key_false(&rps_needed)) {
+			struct rps_dev_flow voidflow, *rflow = &voidflow;
+			int cpu = get_rps_cpu(skb->dev, skb, &rflow);
+
+			if (cpu >= 0) {
+				enqueue_to_backlog(skb, cpu, &rflow->last_qtail);
+				continue;
+			}
+		}
+#endif
+		__skb_queue_tail(&sublist, skb);
+	}
+	__netif_receive_skb_list(&sublist);
+	rcu_read_unlock();
+}
+
 /**
  *	netif_receive_skb - process receive buffer from network
  *	@skb: buffer to process
@@ -4331,6 +4759,28 @@ int netif_receive_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(netif_receive_skb);
 
+/**
+ *	netif_receive_skb_list - process many receive buffers from network
+ *	@list: list of skbs to process
+ *
+ *	Like netif_receive_skb(), but hands a whole batch to the stack so
+ *	that each protocol layer processes it in one go.  The list is
+ *	consumed; the return value of netif_receive_skb() is usually
+ *	ignored and has no meaning for a list, so there is none.
+ *
+ *	This function may only be called from softirq context and interrupts
+ *	should be enabled.
+ */
+void netif_receive_skb_list(struct sk_buff_head *list)
+{
+	struct sk_buff *skb;
+
+	skb_queue_walk(list, skb)
+		trace_netif_receive_skb_entry(skb);
+	netif_receive_skb_list_internal(list);
+}
+EXPORT_SYMBOL(netif_receive_skb_list);
+
 DEFINE_PER_CPU(struct work_struct, flush_works);
 
 /* Network device is going away, flush any packets still pending */
@@ -4380,7 +4830,25 @@ static void flush_all_backlogs(void)
 	put_online_cpus();
 }
 
-static int napi_gro_complete(struct sk_buff *skb)
+/* Pass the GRO_NORMAL skbs batched on @napi up to the stack */
+static void gro_normal_list(struct napi_struct *napi)
+{
+	if (!skb_queue_len(&napi->rx_list))
+		return;
+	netif_receive_skb_list_internal(&napi->rx_list);
+}
+
+/* Queue one GRO_NORMAL skb for list processing, flushing the batch
+ * once it holds gro_normal_batch packets.
+ */
+static void gro_normal_one(struct napi_struct *napi, struct sk_buff *skb)
+{
+	__skb_queue_tail(&napi->rx_list, skb);
+	if (skb_queue_len(&napi->rx_list) >= gro_normal_batch)
+		gro_normal_list(napi);
+}
+
+static int napi_gro_complete(struct napi_struct *napi, struct sk_buff *skb)
 {
 	struct packet_offload *ptype;
 	__be16 type = skb->protocol;
@@ -4411,7 +4879,8 @@ static int napi_gro_complete(struct sk_buff *skb)
 	}
 
 out:
-	return netif_receive_skb_internal(skb);
+	gro_normal_one(napi, skb);
+	return NET_RX_SUCCESS;
 }
 
 /* napi->gro_list contains packets ordered by age.
@@ -4435,7 +4904,7 @@ void napi_gro_flush(struct napi_struct *napi, bool flush_old)
 			return;
 
 		prev = skb->prev;
-		napi_gro_complete(skb);
+		napi_gro_complete(napi, skb);
 		napi->gro_count--;
 	}
 
@@ -4523,7 +4992,7 @@ static enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff
 	enum gro_result ret;
 	int grow;
 
-	if (!(skb->dev->features & NETIF_F_GRO))
+	if (netif_elide_gro(skb->dev))
 		goto normal;
 
 	if (skb_is_gso(skb) || skb_has_frag_list(skb) || skb->csum_bad)
@@ -4579,7 +5048,7 @@ static enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff
 
 		*pp = nskb->next;
 		nskb->next = NULL;
-		napi_gro_complete(nskb);
+		napi_gro_complete(napi, nskb);
 		napi->gro_count--;
 	}
 
@@ -4599,7 +5068,7 @@ static enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff
 		}
 		*pp = NULL;
 		nskb->next = NULL;
-		napi_gro_complete(nskb);
+		napi_gro_complete(napi, nskb);
 	} else {
 		napi->gro_count++;
 	}
@@ -4657,12 +5126,13 @@ static void napi_skb_free_stolen_head(struct sk_buff *skb)
 	kmem_cache_free(skbuff_head_cache, skb);
 }
 
-static gro_result_t napi_skb_finish(gro_result_t ret, struct sk_buff *skb)
+static gro_result_t napi_skb_finish(struct napi_struct *napi,
+				    struct sk_buff *skb,
+				    gro_result_t ret)
 {
 	switch (ret) {
 	case GRO_NORMAL:
-		if (netif_receive_skb_internal(skb))
-			ret = GRO_DROP;
+		gro_normal_one(napi, skb);
 		break;
 
 	case GRO_DROP:
@@ -4691,7 +5161,7 @@ gro_result_t napi_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 
 	skb_gro_reset_offset(skb);
 
-	return napi_skb_finish(dev_gro_receive(napi, skb), skb);
+	return napi_skb_finish(napi, skb, dev_gro_receive(napi, skb));
 }
 EXPORT_SYMBOL(napi_gro_receive);
 
@@ -4738,8 +5208,8 @@ static gro_result_t napi_frags_finish(struct napi_struct *napi,
 	case GRO_HELD:
 		__skb_push(skb, ETH_HLEN);
 		skb->protocol = eth_type_trans(skb, skb->dev);
-		if (ret == GRO_NORMAL && netif_receive_skb_internal(skb))
-			ret = GRO_DROP;
+		if (ret == GRO_NORMAL)
+			gro_normal_one(napi, skb);
 		break;
 
 	case GRO_DROP:
@@ -4896,7 +5366,13 @@ static int process_backlog(struct napi_struct *napi, int quota)
 
 		while ((skb = __skb_dequeue(&sd->process_queue))) {
 			rcu_read_lock();
-			__netif_receive_skb(skb);
+			if (unlikely(skb->xdp_defer)) {
+				skb->xdp_defer = 0;
+				if (do_xdp_generic(skb) != XDP_PASS)
+					skb = NULL;
+			}
+			if (skb)
+				__netif_receive_skb(skb);
 			rcu_read_unlock();
 			input_queue_head_incr(sd);
 			if (++work >= quota)
@@ -4990,6 +5466,8 @@ void napi_complete_done(struct napi_struct *n, int work_done)
 		else
 			napi_gro_flush(n, false);
 	}
+	gro_normal_list(n);
+
 	if (likely(list_empty(&n->poll_list))) {
 		WARN_ON_ONCE(!test_and_clear_bit(NAPI_STATE_SCHED, &n->state));
 	} else {
@@ -5016,16 +5494,25 @@ static struct napi_struct *napi_by_id(unsigned int napi_id)
 
 #if defined(CONFIG_NET_RX_BUSY_POLL)
 #define BUSY_POLL_BUDGET 8
-bool sk_busy_loop(struct sock *sk, int nonblock)
+
+/**
+ * napi_busy_loop - busy poll a NAPI context
+ * @napi_id: id of the NAPI context to poll
+ * @end_time: busy_loop_us_clock() time to give up at
+ * @loop_end: returns true once the caller has what it was waiting for;
+ *	if NULL, the context is polled only once
+ * @loop_end_arg: argument passed to @loop_end
+ */
+void napi_busy_loop(unsigned int napi_id, unsigned long end_time,
+		    bool (*loop_end)(void *), void *loop_end_arg)
 {
-	unsigned long end_time = !nonblock ? sk_busy_loop_end_time(sk) : 0;
 	int (*busy_poll)(struct napi_struct *dev);
 	struct napi_struct *napi;
-	int rc = false;
+	int rc;
 
 	rcu_read_lock();
 
-	napi = napi_by_id(sk->sk_napi_id);
+	napi = napi_by_id(napi_id);
 	if (!napi)
 		goto out;
 
@@ -5035,6 +5522,7 @@ bool sk_busy_loop(struct sock *sk, int nonblock)
 	do {
 		rc = 0;
 		local_bh_disable();
+		__this_cpu_write(softnet_data.xdp_flush_at_poll_end, true);
 		if (busy_poll) {
 			rc = busy_poll(napi);
 		} else if (napi_schedule_prep(napi)) {
@@ -5050,8 +5538,10 @@ bool sk_busy_loop(struct sock *sk, int nonblock)
 			}
 			netpoll_poll_unlock(have);
 		}
+		__this_cpu_write(softnet_data.xdp_flush_at_poll_end, false);
+		xdp_do_flush_map();
 		if (rc > 0)
-			__NET_ADD_STATS(sock_net(sk),
+			__NET_ADD_STATS(dev_net(napi->dev),
 					LINUX_MIB_BUSYPOLLRXPACKETS, rc);
 		local_bh_enable();
 
@@ -5059,13 +5549,28 @@ bool sk_busy_loop(struct sock *sk, int nonblock)
 			break; /* permanent failure */
 
 		cpu_relax();
-	} while (!nonblock && skb_queue_empty(&sk->sk_receive_queue) &&
+	} while (loop_end && !loop_end(loop_end_arg) &&
 		 !need_resched() && !busy_loop_timeout(end_time));
-
-	rc = !skb_queue_empty(&sk->sk_receive_queue);
 out:
 	rcu_read_unlock();
-	return rc;
+}
+EXPORT_SYMBOL(napi_busy_loop);
+
+static bool sk_busy_loop_end(void *p)
+{
+	struct sock *sk = p;
+
+	return !skb_queue_empty(&sk->sk_receive_queue);
+}
+
+bool sk_busy_loop(struct sock *sk, int nonblock)
+{
+	unsigned long end_time = !nonblock ? sk_busy_loop_end_time(sk) : 0;
+
+	napi_busy_loop(sk->sk_napi_id, end_time,
+		       nonblock ? NULL : sk_busy_loop_end, sk);
+
+	return !skb_queue_empty(&sk->sk_receive_queue);
 }
 EXPORT_SYMBOL(sk_busy_loop);
 
@@ -5079,10 +5584,10 @@ void napi_hash_add(struct napi_struct *napi)
 
 	spin_lock(&napi_hash_lock);
 
-	/* 0..NR_CPUS+1 range is reserved for sender_cpu use */
+	/* 0..NR_CPUS range is reserved for sender_cpu use */
 	do {
-		if (unlikely(++napi_gen_id < NR_CPUS + 1))
-			napi_gen_id = NR_CPUS + 1;
+		if (unlikely(++napi_gen_id < MIN_NAPI_ID))
+			napi_gen_id = MIN_NAPI_ID;
 	} while (napi_by_id(napi_gen_id));
 	napi->napi_id = napi_gen_id;
 
@@ -5130,6 +5635,7 @@ void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 	napi->timer.function = napi_watchdog;
 	napi->gro_count = 0;
 	napi->gro_list = NULL;
+	__skb_queue_head_init(&napi->rx_list);
 	napi->skb = NULL;
 	napi->poll = poll;
 	if (weight > NAPI_POLL_WEIGHT)
@@ -5197,7 +5703,10 @@ static int napi_poll(struct napi_struct *n, struct list_head *repoll)
 	 */
 	work = 0;
 	if (test_bit(NAPI_STATE_SCHED, &n->state)) {
+		__this_cpu_write(softnet_data.xdp_flush_at_poll_end, true);
 		work = n->poll(n, weight);
+		__this_cpu_write(softnet_data.xdp_flush_at_poll_end, false);
+		xdp_do_flush_map();
 		trace_napi_poll(n, work, weight);
 	}
 
@@ -5222,6 +5731,7 @@ static int napi_poll(struct napi_struct *n, struct list_head *repoll)
 		 */
 		napi_gro_flush(n, HZ >= 1000);
 	}
+	gro_normal_list(n);
 
 	/* Some drivers may have called napi_schedule
 	 * prior to exhausting their budget.
@@ -5275,7 +5785,6 @@ static __latent_entropy void net_rx_action(struct softirq_action *h)
 		}
 	}
 
-	__kfree_skb_flush();
 	local_irq_disable();
 
 	list_splice_tail_init(&sd->poll_list, &list);
@@ -6691,23 +7200,91 @@ int dev_change_proto_down(struct net_device *dev, bool proto_down)
 }
 EXPORT_SYMBOL(dev_change_proto_down);
 
+static int generic_xdp_install(struct net_device *dev, struct netdev_xdp *xdp)
+{
+	struct bpf_prog *old = rtnl_dereference(dev->xdp_prog);
+	struct bpf_prog *new = xdp->prog;
+	int ret = 0;
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		if (new && !dev->xdp_stats) {
+			dev->xdp_stats = netdev_alloc_pcpu_stats(struct netdev_xdp_stats);
+			if (!dev->xdp_stats)
+				return -ENOMEM;
+		}
+
+		rcu_assign_pointer(dev->xdp_prog, new);
+		if (old)
+			bpf_prog_put(old);
+
+		if (old && !new) {
+			static_key_slow_dec(&generic_xdp_needed);
+		} else if (new && !old) {
+			static_key_slow_inc(&generic_xdp_needed);
+			dev_disable_lro(dev);
+		}
+		break;
+
+	case XDP_QUERY_PROG:
+		xdp->prog_attached = !!old;
+		break;
+
+	default:
+		ret = -EINVAL;
+		break;
+	}
+
+	return ret;
+}
+
+static bool dev_xdp_attached(struct net_device *dev,
+			     int (*xdp_op)(struct net_device *dev,
+					   struct netdev_xdp *xdp))
+{
+	struct netdev_xdp xdp = {};
+
+	xdp.command = XDP_QUERY_PROG;
+	if (xdp_op(dev, &xdp) < 0)
+		return false;
+	return xdp.prog_attached;
+}
+
 /**
  *	dev_change_xdp_fd - set or clear a bpf program for a device rx path
  *	@dev: device
  *	@fd: new program fd or negative value to clear
+ *	@flags: xdp-related flags
  *
- *	Set or clear a bpf program for a device
+ *	Set or clear a bpf program for a device.  Devices without ndo_xdp,
+ *	or any device when XDP_FLAGS_SKB_MODE is given, run the program in
+ *	the generic skb receive path.  Only one of the two can be in use.
  */
-int dev_change_xdp_fd(struct net_device *dev, int fd)
+int dev_change_xdp_fd(struct net_device *dev, int fd, u32 flags)
 {
+	int (*xdp_op)(struct net_device *dev, struct netdev_xdp *xdp);
 	const struct net_device_ops *ops = dev->netdev_ops;
 	struct bpf_prog *prog = NULL;
 	struct netdev_xdp xdp = {};
 	int err;
 
-	if (!ops->ndo_xdp)
-		return -EOPNOTSUPP;
+	ASSERT_RTNL();
+
+	xdp_op = ops->ndo_xdp;
+	if (!xdp_op || (flags & XDP_FLAGS_SKB_MODE))
+		xdp_op = generic_xdp_install;
+
 	if (fd >= 0) {
+		if (xdp_op == generic_xdp_install && ops->ndo_xdp &&
+		    dev_xdp_attached(dev, ops->ndo_xdp))
+			return -EEXIST;
+		if (xdp_op != generic_xdp_install &&
+		    dev_xdp_attached(dev, generic_xdp_install))
+			return -EEXIST;
+		if ((flags & XDP_FLAGS_UPDATE_IF_NOEXIST) &&
+		    dev_xdp_attached(dev, xdp_op))
+			return -EBUSY;
+
 		prog = bpf_prog_get_type(fd, BPF_PROG_TYPE_XDP);
 		if (IS_ERR(prog))
 			return PTR_ERR(prog);
@@ -6715,7 +7292,7 @@ int dev_change_xdp_fd(struct net_device *dev, int fd)
 
 	xdp.command = XDP_SETUP_PROG;
 	xdp.prog = prog;
-	err = ops->ndo_xdp(dev, &xdp);
+	err = xdp_op(dev, &xdp);
 	if (err < 0 && prog)
 		bpf_prog_put(prog);
 
@@ -6723,6 +7300,42 @@ int dev_change_xdp_fd(struct net_device *dev, int fd)
 }
 EXPORT_SYMBOL(dev_change_xdp_fd);
 
+/**
+ *	dev_get_xdp_stats - sum the generic XDP counters of a device
+ *	@dev: device
+ *	@stats: where to store the drop, pass and tx totals
+ */
+void dev_get_xdp_stats(const struct net_device *dev,
+		       struct netdev_xdp_stats *stats)
+{
+	int cpu;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!dev->xdp_stats)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		const struct netdev_xdp_stats *xstats;
+		u64 drop, pass, tx, redirect;
+		unsigned int start;
+
+		xstats = per_cpu_ptr(dev->xdp_stats, cpu);
+		do {
+			start = u64_stats_fetch_begin_irq(&xstats->syncp);
+			drop = xstats->drop;
+			pass = xstats->pass;
+			tx = xstats->tx;
+			redirect = xstats->redirect;
+		} while (u64_stats_fetch_retry_irq(&xstats->syncp, start));
+
+		stats->drop += drop;
+		stats->pass += pass;
+		stats->tx += tx;
+		stats->redirect += redirect;
+	}
+}
+EXPORT_SYMBOL(dev_get_xdp_stats);
+
 /**
  *	dev_new_index	-	allocate an ifindex
  *	@net: the applicable net namespace
@@ -6798,6 +7411,15 @@ static void rollback_registered_many(struct list_head *head)
 		/* Shutdown queueing discipline. */
 		dev_shutdown(dev);
 
+		/* Release a generic XDP program, drivers handle their own */
+		if (rtnl_dereference(dev->xdp_prog)) {
+			struct netdev_xdp xdp = {
+				.command = XDP_SETUP_PROG,
+				.prog = NULL,
+			};
+
+			generic_xdp_install(dev, &xdp);
+		}
 
 		/* Notify protocols, that we are about to destroy
 		   this device. They should clean all the things.
@@ -7780,6 +8402,9 @@ void free_netdev(struct net_device *dev)
 	free_percpu(dev->pcpu_refcnt);
 	dev->pcpu_refcnt = NULL;
 
+	free_percpu(dev->xdp_stats);
+	dev->xdp_stats = NULL;
+
 	/*  Compatibility with error handling in drivers */
 	if (dev->reg_state == NETREG_UNINITIALIZED) {
 		netdev_freemem(dev);
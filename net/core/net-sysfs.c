@@ -626,6 +626,51 @@ static struct attribute_group netstat_group = {
 	.attrs  = netstat_attrs,
 };
 
+/* Show a counter of the generic XDP hook */
+static ssize_t xdp_generic_show(const struct device *d, char *buf,
+				unsigned long offset)
+{
+	struct net_device *dev = to_net_dev(d);
+	ssize_t ret = -EINVAL;
+
+	read_lock(&dev_base_lock);
+	if (dev_isalive(dev)) {
+		struct netdev_xdp_stats stats;
+
+		dev_get_xdp_stats(dev, &stats);
+		ret = sprintf(buf, fmt_u64, *(u64 *)(((u8 *)&stats) + offset));
+	}
+	read_unlock(&dev_base_lock);
+	return ret;
+}
+
+#define XDP_GENERIC_ENTRY(name)						\
+static ssize_t name##_show(struct device *d,				\
+			   struct device_attribute *attr, char *buf)	\
+{									\
+	return xdp_generic_show(d, buf,					\
+				offsetof(struct netdev_xdp_stats, name));	\
+}									\
+static DEVICE_ATTR_RO(name)
+
+XDP_GENERIC_ENTRY(drop);
+XDP_GENERIC_ENTRY(pass);
+XDP_GENERIC_ENTRY(tx);
+XDP_GENERIC_ENTRY(redirect);
+
+static struct attribute *xdp_generic_attrs[] = {
+	&dev_attr_drop.attr,
+	&dev_attr_pass.attr,
+	&dev_attr_tx.attr,
+	&dev_attr_redirect.attr,
+	NULL
+};
+
+static struct attribute_group xdp_generic_group = {
+	.name  = "xdp_generic",
+	.attrs  = xdp_generic_attrs,
+};
+
 #if IS_ENABLED(CONFIG_WIRELESS_EXT) || IS_ENABLED(CONFIG_CFG80211)
 static struct attribute *wireless_attrs[] = {
 	NULL
@@ -1554,6 +1599,7 @@ int netdev_register_kobject(struct net_device *ndev)
 		groups++;
 
 	*groups++ = &netstat_group;
+	*groups++ = &xdp_generic_group;
 
 #if IS_ENABLED(CONFIG_WIRELESS_EXT) || IS_ENABLED(CONFIG_CFG80211)
 	if (ndev->ieee80211_ptr)
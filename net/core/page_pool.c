@@ -0,0 +1,372 @@
+/*
+ * page_pool.c - recycling page allocator for network drivers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/device.h>
+#include <linux/dma-mapping.h>
+#include <linux/mm.h>
+#include <linux/poison.h>
+#include <linux/interrupt.h>
+#include <linux/rcupdate.h>
+#include <linux/export.h>
+
+#include <net/page_pool.h>
+
+#define DEFER_TIME		(msecs_to_jiffies(1000))
+#define DEFER_WARN_INTERVAL	(60 * HZ)
+
+static int page_pool_init(struct page_pool *pool,
+			  const struct page_pool_params *params)
+{
+	unsigned int ring_qsize = PP_RING_SIZE_DEFAULT;
+
+	memcpy(&pool->p, params, sizeof(pool->p));
+
+	if (pool->p.flags & ~PP_FLAG_ALL)
+		return -EINVAL;
+
+	if (pool->p.pool_size)
+		ring_qsize = pool->p.pool_size;
+
+	/* Sanity limit mem that can be pinned down */
+	if (ring_qsize > PP_RING_SIZE_MAX)
+		return -E2BIG;
+
+	if (pool->p.flags & PP_FLAG_DMA_MAP) {
+		/* Pages are only mapped for receive */
+		if (pool->p.dma_dir != DMA_FROM_DEVICE &&
+		    pool->p.dma_dir != DMA_BIDIRECTIONAL)
+			return -EINVAL;
+
+		/* The DMA address is kept in page->private */
+		if (sizeof(dma_addr_t) > sizeof(unsigned long))
+			return -EINVAL;
+	}
+
+	if (ptr_ring_init(&pool->ring, ring_qsize, GFP_KERNEL) < 0)
+		return -ENOMEM;
+
+	atomic_set(&pool->pages_state_release_cnt, 0);
+
+	if (pool->p.flags & PP_FLAG_DMA_MAP)
+		get_device(pool->p.dev);
+
+	return 0;
+}
+
+/**
+ * page_pool_create - create a page pool for an RX queue
+ * @params: configuration of the pool
+ *
+ * Returns the new pool or an ERR_PTR().
+ */
+struct page_pool *page_pool_create(const struct page_pool_params *params)
+{
+	struct page_pool *pool;
+	int err;
+
+	pool = kzalloc_node(sizeof(*pool), GFP_KERNEL, params->nid);
+	if (!pool)
+		return ERR_PTR(-ENOMEM);
+
+	err = page_pool_init(pool, params);
+	if (err < 0) {
+		pr_warn("%s() gave up with errno %d\n", __func__, err);
+		kfree(pool);
+		return ERR_PTR(err);
+	}
+
+	return pool;
+}
+EXPORT_SYMBOL(page_pool_create);
+
+static struct page *__page_pool_get_cached(struct page_pool *pool)
+{
+	struct page *page;
+
+	/* The caller owns the pool, see page_pool.h */
+	if (likely(pool->alloc.count))
+		return pool->alloc.cache[--pool->alloc.count];
+
+	/* Refill the alloc cache from the ring in one go.  The owner is
+	 * the only consumer of the ring, so no consumer_lock is needed.
+	 */
+	while (pool->alloc.count < PP_ALLOC_CACHE_REFILL) {
+		page = __ptr_ring_consume(&pool->ring);
+		if (!page)
+			break;
+		pool->alloc.cache[pool->alloc.count++] = page;
+	}
+
+	if (likely(pool->alloc.count))
+		return pool->alloc.cache[--pool->alloc.count];
+
+	return NULL;
+}
+
+static struct page *__page_pool_alloc_pages_slow(struct page_pool *pool,
+						 gfp_t gfp)
+{
+	struct page *page;
+	dma_addr_t dma;
+
+	if (pool->p.order)
+		gfp |= __GFP_COMP;
+
+	page = alloc_pages_node(pool->p.nid, gfp, pool->p.order);
+	if (!page)
+		return NULL;
+
+	if (pool->p.flags & PP_FLAG_DMA_MAP) {
+		dma = dma_map_page(pool->p.dev, page, 0,
+				   PAGE_SIZE << pool->p.order,
+				   pool->p.dma_dir);
+		if (dma_mapping_error(pool->p.dev, dma)) {
+			put_page(page);
+			return NULL;
+		}
+		set_page_private(page, dma);
+	}
+
+	page->pp_magic = PP_SIGNATURE;
+	page->pp = pool;
+	pool->pages_state_hold_cnt++;
+
+	return page;
+}
+
+/**
+ * page_pool_alloc_pages - allocate a page from a page pool
+ * @pool: pool to allocate from
+ * @gfp: allocation flags, used when the pool has to ask the page
+ *	 allocator for a new page
+ *
+ * Must be called from the context that owns @pool.
+ */
+struct page *page_pool_alloc_pages(struct page_pool *pool, gfp_t gfp)
+{
+	struct page *page;
+
+	page = __page_pool_get_cached(pool);
+	if (page)
+		return page;
+
+	return __page_pool_alloc_pages_slow(pool, gfp);
+}
+EXPORT_SYMBOL(page_pool_alloc_pages);
+
+static s32 page_pool_inflight(struct page_pool *pool)
+{
+	u32 release_cnt = atomic_read(&pool->pages_state_release_cnt);
+
+	return (s32)(pool->pages_state_hold_cnt - release_cnt);
+}
+
+/**
+ * page_pool_release_page - disconnect a page from its pool
+ * @pool: pool @page was allocated from
+ * @page: page to release, the caller still holds its reference
+ *
+ * A driver that frees a pool page with put_page(), or hands it to
+ * something that will, must release it first.  Every holder of a shared
+ * page may get here, only the one that clears pp_magic releases it;
+ * page->pp is left alone for the others.
+ */
+void page_pool_release_page(struct page_pool *pool, struct page *page)
+{
+	if (cmpxchg(&page->pp_magic, PP_SIGNATURE, 0) != PP_SIGNATURE)
+		return;
+
+	if (pool->p.flags & PP_FLAG_DMA_MAP) {
+		dma_unmap_page(pool->p.dev, page_pool_get_dma_addr(page),
+			       PAGE_SIZE << pool->p.order, pool->p.dma_dir);
+		set_page_private(page, 0);
+	}
+
+	/* This must be the last access to @pool: once every page has been
+	 * released, a destroyed pool is freed, see page_pool_release().
+	 */
+	smp_mb__before_atomic();
+	atomic_inc(&pool->pages_state_release_cnt);
+}
+EXPORT_SYMBOL(page_pool_release_page);
+
+static void page_pool_return_page(struct page_pool *pool, struct page *page)
+{
+	page_pool_release_page(pool, page);
+	put_page(page);
+}
+
+static bool page_pool_recycle_in_ring(struct page_pool *pool,
+				      struct page *page)
+{
+	int ret;
+
+	/* Once the page is in the ring, a pool being destroyed can scrub
+	 * it and be freed before producer_lock is dropped; the pool is
+	 * only freed after an RCU grace period.
+	 */
+	rcu_read_lock();
+
+	/* producer_lock is never taken from hard irq context */
+	if (in_serving_softirq())
+		ret = ptr_ring_produce(&pool->ring, page);
+	else if (!in_irq() && !irqs_disabled())
+		ret = ptr_ring_produce_bh(&pool->ring, page);
+	else
+		ret = -EBUSY;
+
+	rcu_read_unlock();
+
+	return ret == 0;
+}
+
+void __page_pool_put_page(struct page_pool *pool, struct page *page,
+			  bool allow_direct)
+{
+	/* Only pages the pool is the sole user of can be recycled; an
+	 * emergency reserve page should go back to the page allocator.
+	 * A shared page is released from the pool before our reference
+	 * is dropped, so whoever ends up freeing it can use put_page().
+	 */
+	if (likely(page_ref_count(page) == 1 && !page_is_pfmemalloc(page))) {
+		/* Another holder may have released the page before
+		 * dropping its reference, pairs with the cmpxchg() in
+		 * page_pool_release_page().
+		 */
+		smp_rmb();
+		if (unlikely(READ_ONCE(page->pp_magic) != PP_SIGNATURE)) {
+			put_page(page);
+			return;
+		}
+
+		if (allow_direct && in_serving_softirq() &&
+		    pool->alloc.count < PP_ALLOC_CACHE_SIZE) {
+			pool->alloc.cache[pool->alloc.count++] = page;
+			return;
+		}
+
+		if (page_pool_recycle_in_ring(pool, page))
+			return;
+	}
+
+	page_pool_return_page(pool, page);
+}
+EXPORT_SYMBOL(__page_pool_put_page);
+
+/* Called by skb free for pages carrying PP_SIGNATURE */
+void page_pool_return_skb_page(struct page *page)
+{
+	struct page_pool *pool;
+
+	/* Another holder may release the page and let its pool go away
+	 * after our caller checked pp_magic, look again under RCU.
+	 */
+	rcu_read_lock();
+	pool = READ_ONCE(page->pp);
+	if (likely(READ_ONCE(page->pp_magic) == PP_SIGNATURE))
+		__page_pool_put_page(pool, page, false);
+	else
+		put_page(page);
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL(page_pool_return_skb_page);
+
+static void page_pool_scrub(struct page_pool *pool)
+{
+	struct page *page;
+
+	while (pool->alloc.count) {
+		page = pool->alloc.cache[--pool->alloc.count];
+		page_pool_return_page(pool, page);
+	}
+
+	while ((page = ptr_ring_consume_bh(&pool->ring)) != NULL)
+		page_pool_return_page(pool, page);
+}
+
+static void page_pool_free_rcu(struct rcu_head *rcu)
+{
+	struct page_pool *pool = container_of(rcu, struct page_pool, rcu);
+
+	ptr_ring_cleanup(&pool->ring, NULL);
+
+	if (pool->p.flags & PP_FLAG_DMA_MAP)
+		put_device(pool->p.dev);
+
+	kfree(pool);
+}
+
+/* Pages are put into the ring and skbs look up page->pp under RCU */
+static void page_pool_free(struct page_pool *pool)
+{
+	call_rcu(&pool->rcu, page_pool_free_rcu);
+}
+
+/* Returns the number of pages still in flight, the pool is freed once
+ * that reaches zero
+ */
+static s32 page_pool_release(struct page_pool *pool)
+{
+	s32 inflight;
+
+	page_pool_scrub(pool);
+
+	inflight = page_pool_inflight(pool);
+	WARN_ON(inflight < 0);
+	if (inflight <= 0)
+		page_pool_free(pool);
+
+	return inflight;
+}
+
+static void page_pool_release_retry(struct work_struct *wq)
+{
+	struct delayed_work *dwq = to_delayed_work(wq);
+	struct page_pool *pool = container_of(dwq, typeof(*pool), release_dw);
+	s32 inflight;
+
+	inflight = page_pool_release(pool);
+	if (inflight <= 0)
+		return;
+
+	if (time_after_eq(jiffies, pool->defer_warn)) {
+		pr_warn("%s() stalled pool shutdown, %d pages inflight for %u sec\n",
+			__func__, inflight,
+			jiffies_to_msecs(jiffies - pool->defer_start) / 1000);
+		pool->defer_warn = jiffies + DEFER_WARN_INTERVAL;
+	}
+
+	schedule_delayed_work(&pool->release_dw, DEFER_TIME);
+}
+
+/**
+ * page_pool_destroy - tear down a page pool
+ * @pool: pool to destroy, may be NULL
+ *
+ * The caller must have stopped allocating from @pool.  Pages that are
+ * still held by skbs are released as they come back; the pool itself
+ * is freed after the last one.
+ */
+void page_pool_destroy(struct page_pool *pool)
+{
+	if (!pool)
+		return;
+
+	if (page_pool_release(pool) <= 0)
+		return;
+
+	pool->defer_start = jiffies;
+	pool->defer_warn = jiffies + DEFER_WARN_INTERVAL;
+
+	INIT_DELAYED_WORK(&pool->release_dw, page_pool_release_retry);
+	schedule_delayed_work(&pool->release_dw, DEFER_TIME);
+}
+EXPORT_SYMBOL(page_pool_destroy);
@@ -887,7 +887,7 @@ static void bbr_set_state(struct sock *sk, u8 new_state)
 }
 
 static struct tcp_congestion_ops tcp_bbr_cong_ops __read_mostly = {
-	.flags		= TCP_CONG_NON_RESTRICTED,
+	.flags		= TCP_CONG_NON_RESTRICTED | TCP_CONG_NEEDS_PACING,
 	.name		= "bbr",
 	.owner		= THIS_MODULE,
 	.init		= bbr_init,
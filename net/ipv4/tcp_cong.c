@@ -186,6 +186,9 @@ void tcp_init_congestion_control(struct sock *sk)
 		INET_ECN_xmit(sk);
 	else
 		INET_ECN_dontxmit(sk);
+	if (tcp_ca_needs_pacing(sk))
+		cmpxchg(&sk->sk_pacing_status, SK_PACING_NONE,
+			SK_PACING_NEEDED);
 }
 
 static void tcp_reinit_congestion_control(struct sock *sk,
@@ -2,6 +2,7 @@
 #include <net/tcp.h>
 #include <linux/inet_diag.h>
 #include <linux/inet.h>
+#include <linux/random.h>
 #include <linux/win_minmax.h>
 
 #define BW_SCALE	24
@@ -13,6 +14,7 @@
 enum lbbr_mode {
 	LBBR_INCREASE,		/* phase where increasing the cwnd */
 	LBBR_DECREASE,		/* phase where decreasing the cwnd */
+	LBBR_PROBE_RTT,		/* cut cwnd to min to probe min_rtt */
 };
 
 struct lbbr {
@@ -30,9 +32,18 @@ struct lbbr {
 		cwnd_gain:10,		/* current gain for setting cwnd */
 		cur_cnt:8,		/* current offset */
 		has_seen_rtt:1;		/* have we seen an RTT sample yet ? */
-	u32	mode;
+	u32	mode:2,			/* current lbbr_mode in state machine */
+		cycle_idx:3,		/* current index in pacing_gain cycle array */
+		round_start:1,		/* start of packet-timed tx->ack round? */
+		probe_rtt_round_done:1,	/* a LBBR_PROBE_RTT round at 4 pkts? */
+		unused:25;
+	u32	prior_cwnd;		/* cwnd before entering LBBR_PROBE_RTT */
+	u32	probe_rtt_done_stamp;	/* end time for LBBR_PROBE_RTT mode */
+	struct skb_mstamp cycle_mstamp;	/* time of this cycle phase start */
 };
 
+#define CYCLE_LEN	8	/* number of phases in a pacing gain cycle */
+
 /* Window length of bw filter (in rounds): */
 static const int lbbr_bw_rtts = 10;
 /* Window length of min_rtt filter (in sec): */
@@ -44,10 +55,20 @@ static const u32 lbbr_probe_rtt_mode_ms = 200;
 static const int lbbr_startup_gain = LBBR_UNIT * 2885 / 1000 + 1;
 /* The gain for deriving steady-state cwnd tolerates delayed/stretched ACKs: */
 static const int lbbr_cwnd_gain = LBBR_UNIT * 2;
+/* The pacing_gain values for the steady-state gain cycle, to discover/share bw: */
+static const int lbbr_pacing_gain[] = {
+	LBBR_UNIT * 5 / 4,	/* probe for more available bw */
+	LBBR_UNIT * 3 / 4,	/* drain queue and/or yield bw to other flows */
+	LBBR_UNIT, LBBR_UNIT, LBBR_UNIT,	/* cruise at 1.0*bw to utilize pipe, */
+	LBBR_UNIT, LBBR_UNIT, LBBR_UNIT		/* without creating excess queue... */
+};
+/* Randomize the starting gain cycling phase over N phases: */
+static const u32 lbbr_cycle_rand = 7;
 
-/* If bw has increased significantly (1.25x), there may be more bw available */
-static const u32 lbbr_full_bw_thresh = LBBR_UNIT * 5 / 4;
-/* But after 3 rounds w/o significant bw growth, estimate pipe is full */
+/* If bw has increased significantly (net.ipv4.tcp_lbbr_full_bw_thresh,
+ * 1.25x by default), there may be more bw available.
+ * But after 3 rounds w/o significant bw growth, estimate pipe is full
+ */
 static const u32 lbbr_full_bw_count = 3;
 
 /* Try to keep at least this many packets in flight, if things go smoothly. For
@@ -56,13 +77,29 @@ static const u32 lbbr_full_bw_count = 3;
  */
 static const u32 lbbr_cwnd_min_target = 4;
 
-/* parameter to update max_bw */
-static const u32 lbbr_alpha = 8;
-/* We can only tolerate 5ms */
-static const u32 lbbr_max_rtt_inc_us = 5000;
 /* Max released time */
 static const u32 lbbr_max_rtt_dec_us = 5000;
 
+/* Tunables, per netns (net.ipv4.tcp_lbbr_*) */
+
+/* Weight 1/alpha of a new delivery rate sample in the max_bw average */
+static u32 lbbr_alpha(const struct sock *sk)
+{
+	return sock_net(sk)->ipv4.sysctl_tcp_lbbr_alpha;
+}
+
+/* Queueing delay above min_rtt we tolerate before decreasing cwnd */
+static u32 lbbr_max_rtt_inc_us(const struct sock *sk)
+{
+	return sock_net(sk)->ipv4.sysctl_tcp_lbbr_max_rtt_inc_us;
+}
+
+/* Bw growth per round that means the pipe is not full yet, << LBBR_SCALE */
+static u32 lbbr_full_bw_thresh(const struct sock *sk)
+{
+	return LBBR_UNIT * sock_net(sk)->ipv4.sysctl_tcp_lbbr_full_bw_thresh / 100;
+}
+
 static bool lbbr_full_bw_reached(const struct sock *sk)
 {
 	const struct lbbr *lbbr = inet_csk_ca(sk);
@@ -78,6 +115,17 @@ static u32 lbbr_max_bw(struct sock *sk)
 	return lbbr->max_bw;
 }
 
+/* Bandwidth the pacing gains apply to: the max of delivery rate samples
+ * over the last lbbr_bw_rtts round trips.  Old samples age out of the
+ * window, so pacing follows the path down after a bandwidth drop.
+ */
+static u32 lbbr_pacing_bw(struct sock *sk)
+{
+	const struct lbbr *lbbr = inet_csk_ca(sk);
+
+	return minmax_get(&lbbr->bw);
+}
+
 static u32 lbbr_min_rtt(struct sock *sk)
 {
 	const struct lbbr *lbbr = inet_csk_ca(sk);
@@ -94,7 +142,7 @@ static void lbbr_check_full_bw_reached(struct sock *sk,
 	if (lbbr_full_bw_reached(sk) || rs->is_app_limited)
 		return;
 
-	bw_thresh = (u64)lbbr->full_bw * lbbr_full_bw_thresh >> LBBR_SCALE;
+	bw_thresh = (u64)lbbr->full_bw * lbbr_full_bw_thresh(sk) >> LBBR_SCALE;
 	if (lbbr_max_bw(sk) >= bw_thresh) {
 		lbbr->full_bw = lbbr_max_bw(sk);
 		lbbr->full_bw_count = 0;
@@ -216,6 +264,17 @@ static u32 lbbr_slow_start(struct sock *sk, u32 acked)
 	return acked;
 }
 
+/* Has queueing delay grown beyond what we tolerate on top of min_rtt? */
+static bool lbbr_rtt_inflated(struct sock *sk, const struct rate_sample *rs)
+{
+	const struct lbbr *lbbr = inet_csk_ca(sk);
+
+	if (rs->rtt_us < 0 || lbbr->min_rtt_us == ~0U)
+		return false;
+
+	return rs->rtt_us > (u64)lbbr->min_rtt_us + lbbr_max_rtt_inc_us(sk);
+}
+
 static void lbbr_set_cwnd(struct sock *sk, const struct rate_sample *rs,
 			  u32 acked, u32 bw, int gain)
 {
@@ -233,10 +292,12 @@ static void lbbr_set_cwnd(struct sock *sk, const struct rate_sample *rs,
 		return;
 	}
 
-	if (lbbr_in_first_slow_start(sk)) {
-		lbbr->cwnd_gain = lbbr_cwnd_gain;
-		lbbr->pacing_gain = lbbr_cwnd_gain;
+	if (lbbr_in_first_slow_start(sk))
 		lbbr->ssthresh = max(tp->snd_cwnd >> 1U, 2U);
+
+	if (lbbr->mode == LBBR_PROBE_RTT) {
+		tp->snd_cwnd = min(tp->snd_cwnd, lbbr_cwnd_min_target);
+		return;
 	}
 
 	if (lbbr->mode == LBBR_INCREASE) {
@@ -252,9 +313,9 @@ static void lbbr_set_cwnd(struct sock *sk, const struct rate_sample *rs,
 		tp->snd_cwnd += delta;
 		tp->snd_cwnd = min(tp->snd_cwnd, tp->snd_cwnd_clamp);
 
-		if (tp->snd_cwnd > upper_cwnd) {
-			lower_cwnd = lbbr_target_cwnd(sk, bw, LBBR_UNIT * 80 / 100);
-
+		lower_cwnd = lbbr_target_cwnd(sk, bw, LBBR_UNIT * 80 / 100);
+		if (tp->snd_cwnd > upper_cwnd ||
+		    (lbbr_rtt_inflated(sk, rs) && tp->snd_cwnd > lower_cwnd)) {
 			lbbr->mode = LBBR_DECREASE;
 			lbbr->prev_cwnd = lower_cwnd;
 			lbbr->cur_cnt = 0;
@@ -283,11 +344,14 @@ static void lbbr_update_max_bw(struct sock *sk, const struct rate_sample *rs)
 {
 	struct tcp_sock *tp = tcp_sk(sk);
 	struct lbbr *lbbr = inet_csk_ca(sk);
+	u32 alpha = lbbr_alpha(sk);
 	u64 bw;
 
+	lbbr->round_start = 0;
 	if (!before(rs->prior_delivered, lbbr->next_rtt_delivered)) {
 		lbbr->next_rtt_delivered = tp->delivered;
 		lbbr->rtt_cnt++;
+		lbbr->round_start = 1;
 	}
 
 	bw = (u64)rs->delivered * BW_UNIT;
@@ -300,38 +364,142 @@ static void lbbr_update_max_bw(struct sock *sk, const struct rate_sample *rs)
 	if (!lbbr->max_bw && bw)
 		lbbr->max_bw = bw;
 	else
-		lbbr->max_bw = lbbr->max_bw * (lbbr_alpha - 1) / lbbr_alpha + bw / lbbr_alpha;
+		lbbr->max_bw = div_u64((u64)lbbr->max_bw * (alpha - 1) + bw,
+				       alpha);
+}
+
+/* End the current phase of the pacing gain cycle? Same rules as BBR's
+ * PROBE_BW: stay in each phase for about one min_rtt, stay longer in the
+ * probing phase until inflight reaches pacing_gain * BDP, and leave the
+ * draining phase early once inflight is down to BDP.
+ */
+static bool lbbr_is_next_cycle_phase(struct sock *sk,
+				     const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct lbbr *lbbr = inet_csk_ca(sk);
+	bool is_full_length =
+		skb_mstamp_us_delta(&tp->delivered_mstamp, &lbbr->cycle_mstamp) >
+		lbbr->min_rtt_us;
+	u32 inflight, bw;
+
+	if (lbbr->pacing_gain == LBBR_UNIT)
+		return is_full_length;
+
+	inflight = rs->prior_in_flight;
+	bw = lbbr_pacing_bw(sk);
+
+	if (lbbr->pacing_gain > LBBR_UNIT)
+		return is_full_length &&
+			(rs->losses ||
+			 inflight >= lbbr_target_cwnd(sk, bw, lbbr->pacing_gain));
+
+	return is_full_length ||
+		inflight <= lbbr_target_cwnd(sk, bw, LBBR_UNIT);
 }
 
+/* Gain cycling: cycle pacing gain to converge to fair share of available bw. */
+static void lbbr_update_cycle_phase(struct sock *sk,
+				    const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct lbbr *lbbr = inet_csk_ca(sk);
+
+	if (!lbbr_full_bw_reached(sk) || lbbr->mode == LBBR_PROBE_RTT)
+		return;
+
+	if (lbbr_is_next_cycle_phase(sk, rs)) {
+		lbbr->cycle_idx = (lbbr->cycle_idx + 1) & (CYCLE_LEN - 1);
+		lbbr->cycle_mstamp = tp->delivered_mstamp;
+	}
+}
+
+/* Without a fresh min_rtt sample for lbbr_min_rtt_with_sec, enter
+ * LBBR_PROBE_RTT: cap cwnd at lbbr_cwnd_min_target for at least
+ * lbbr_probe_rtt_mode_ms and one round trip to drain the bottleneck queue
+ * and measure the unloaded RTT, then restore cwnd and resume LBBR_INCREASE.
+ * Otherwise once queues build, min_rtt goes stale and the BDP based
+ * targets derived from it collapse.
+ */
 static void lbbr_update_min_rtt(struct sock *sk, const struct rate_sample *rs)
 {
+	struct tcp_sock *tp = tcp_sk(sk);
 	struct lbbr *lbbr = inet_csk_ca(sk);
+	bool filter_expired;
 
 	/* Track min RTT seen in the min_rtt_win_sec filter window: */
-	/* filter_expired = after(tcp_time_stamp, */
-	/* 		       lbbr->min_rtt_stamp + lbbr_min_rtt_with_sec * HZ); */
-
-	/* if (rs->rtt_us >= 0 && (rs->rtt_us <= lbbr->min_rtt_us || filter_expired)) { */
-	if (rs->rtt_us >= 0 && rs->rtt_us <= lbbr->min_rtt_us) {
+	filter_expired = after(tcp_time_stamp,
+			       lbbr->min_rtt_stamp + lbbr_min_rtt_with_sec * HZ);
+	if (rs->rtt_us >= 0 &&
+	    (rs->rtt_us <= lbbr->min_rtt_us || filter_expired)) {
 		lbbr->min_rtt_us = rs->rtt_us;
 		lbbr->min_rtt_stamp = tcp_time_stamp;
 	}
+
+	if (lbbr_probe_rtt_mode_ms > 0 && filter_expired &&
+	    lbbr_full_bw_reached(sk) && lbbr->mode != LBBR_PROBE_RTT) {
+		lbbr->mode = LBBR_PROBE_RTT;	/* dip, drain queue */
+		lbbr->prior_cwnd = tp->snd_cwnd;
+		lbbr->probe_rtt_done_stamp = 0;
+	}
+
+	if (lbbr->mode == LBBR_PROBE_RTT) {
+		/* Ignore low rate samples during this mode. */
+		tp->app_limited =
+			(tp->delivered + tcp_packets_in_flight(tp)) ? : 1;
+		/* Maintain min packets in flight for max(200 ms, 1 round). */
+		if (!lbbr->probe_rtt_done_stamp &&
+		    tcp_packets_in_flight(tp) <= lbbr_cwnd_min_target) {
+			lbbr->probe_rtt_done_stamp = tcp_time_stamp +
+				msecs_to_jiffies(lbbr_probe_rtt_mode_ms);
+			lbbr->probe_rtt_round_done = 0;
+			lbbr->next_rtt_delivered = tp->delivered;
+		} else if (lbbr->probe_rtt_done_stamp) {
+			if (lbbr->round_start)
+				lbbr->probe_rtt_round_done = 1;
+			if (lbbr->probe_rtt_round_done &&
+			    after(tcp_time_stamp, lbbr->probe_rtt_done_stamp)) {
+				lbbr->min_rtt_stamp = tcp_time_stamp;
+				tp->snd_cwnd = max(tp->snd_cwnd,
+						   lbbr->prior_cwnd);
+				lbbr->mode = LBBR_INCREASE;
+			}
+		}
+	}
+}
+
+/* Pick the pacing and cwnd gains for the current phase. */
+static void lbbr_update_gains(struct sock *sk)
+{
+	struct lbbr *lbbr = inet_csk_ca(sk);
+
+	if (!lbbr_full_bw_reached(sk)) {
+		lbbr->pacing_gain = lbbr_startup_gain;
+		lbbr->cwnd_gain = lbbr_startup_gain;
+	} else if (lbbr->mode == LBBR_PROBE_RTT) {
+		lbbr->pacing_gain = LBBR_UNIT;
+		lbbr->cwnd_gain = LBBR_UNIT;
+	} else {
+		lbbr->pacing_gain = lbbr_pacing_gain[lbbr->cycle_idx];
+		lbbr->cwnd_gain = lbbr_cwnd_gain;
+	}
 }
 
 static void lbbr_update_model(struct sock *sk, const struct rate_sample *rs)
 {
 	lbbr_update_max_bw(sk, rs);
+	lbbr_update_cycle_phase(sk, rs);
 	lbbr_check_full_bw_reached(sk, rs);
 	lbbr_update_min_rtt(sk, rs);
+	lbbr_update_gains(sk);
 }
 
 static void lbbr_main(struct sock *sk, const struct rate_sample *rs)
 {
 	struct lbbr *lbbr = inet_csk_ca(sk);
-	u32 bw = lbbr_max_bw(sk);
-	
+
 	lbbr_update_model(sk, rs);
-	lbbr_set_pacing_rate(sk, bw, lbbr->pacing_gain);
+	lbbr_set_pacing_rate(sk, lbbr_pacing_bw(sk), lbbr->pacing_gain);
 	lbbr_set_cwnd(sk, rs, rs->acked_sacked, lbbr_max_bw(sk), lbbr->cwnd_gain);
 }
 
@@ -365,6 +533,10 @@ static size_t lbbr_get_info(struct sock *sk, u32 ext, int *attr,
 		info->lbbr.lbbr_min_rtt 	= lbbr_min_rtt(sk);
 		info->lbbr.lbbr_ssthresh 	= lbbr->ssthresh;
 		info->lbbr.lbbr_target_cwnd	= lbbr_target_cwnd(sk, lbbr_max_bw(sk), LBBR_UNIT);
+		info->lbbr.lbbr_mode		= lbbr->mode;
+		info->lbbr.lbbr_cycle_idx	= lbbr->cycle_idx;
+		info->lbbr.lbbr_pacing_gain	= lbbr->pacing_gain;
+		info->lbbr.lbbr_cwnd_gain	= lbbr->cwnd_gain;
 
 		*attr = INET_DIAG_LBBRINFO;
 		return sizeof(info->lbbr);
@@ -396,10 +568,17 @@ static void lbbr_init(struct sock *sk)
 	lbbr->mode = LBBR_INCREASE;
 	lbbr->cur_cnt = 0;
 	lbbr->has_seen_rtt = 0;
+
+	lbbr->round_start = 0;
+	lbbr->prior_cwnd = 0;
+	lbbr->probe_rtt_done_stamp = 0;
+	lbbr->probe_rtt_round_done = 0;
+	lbbr->cycle_idx = CYCLE_LEN - 1 - prandom_u32_max(lbbr_cycle_rand);
+	lbbr->cycle_mstamp.v64 = 0;
 }
 
 static struct tcp_congestion_ops tcp_lbbr_cong_ops __read_mostly = {
-	.flags 		= TCP_CONG_NON_RESTRICTED,
+	.flags 		= TCP_CONG_NON_RESTRICTED | TCP_CONG_NEEDS_PACING,
 	.name 		= "lbbr",
 	.owner 		= THIS_MODULE,
 	.init		= lbbr_init,
@@ -894,6 +894,87 @@ out:
 	sk_free(sk);
 }
 
+/* Internal pacing: when no pacing capable qdisc (sch_fq) handles this
+ * flow, sk_pacing_rate is enforced here.  After each data skb is sent,
+ * pacing_timer is armed for the time the skb needs on the wire at
+ * sk_pacing_rate; tcp_write_xmit() sends nothing while it is pending.
+ * On expiry the socket goes through the TSQ tasklet to resume xmit.
+ */
+enum hrtimer_restart tcp_pace_kick(struct hrtimer *timer)
+{
+	struct tcp_sock *tp = container_of(timer, struct tcp_sock, pacing_timer);
+	struct sock *sk = (struct sock *)tp;
+	struct tsq_tasklet *tsq;
+	unsigned long flags;
+
+	if (test_and_set_bit(TSQ_QUEUED, &tp->tsq_flags))
+		return HRTIMER_NORESTART;
+
+	/* Keep one reference on sk_wmem_alloc.
+	 * Will be released by sk_free() from tcp_tasklet_func()
+	 */
+	if (!atomic_inc_not_zero(&sk->sk_wmem_alloc)) {
+		clear_bit(TSQ_QUEUED, &tp->tsq_flags);
+		return HRTIMER_NORESTART;
+	}
+
+	/* queue this socket to tasklet queue */
+	local_irq_save(flags);
+	tsq = this_cpu_ptr(&tsq_tasklet);
+	list_add(&tp->tsq_node, &tsq->head);
+	tasklet_schedule(&tsq->tasklet);
+	local_irq_restore(flags);
+	return HRTIMER_NORESTART;
+}
+
+static bool tcp_needs_internal_pacing(const struct sock *sk)
+{
+	return smp_load_acquire(&sk->sk_pacing_status) == SK_PACING_NEEDED;
+}
+
+static void tcp_internal_pacing(struct sock *sk, const struct sk_buff *skb)
+{
+	u64 len_ns;
+	u32 rate;
+
+	if (!tcp_needs_internal_pacing(sk))
+		return;
+	rate = sk->sk_pacing_rate;
+	if (!rate || rate == ~0U)
+		return;
+
+	/* Should account for header sizes as sch_fq does,
+	 * but lets make things simple.
+	 */
+	len_ns = (u64)skb->len * NSEC_PER_SEC;
+	do_div(len_ns, rate);
+	hrtimer_start(&tcp_sk(sk)->pacing_timer,
+		      ktime_add_ns(ktime_get(), len_ns),
+		      HRTIMER_MODE_ABS_PINNED);
+}
+
+/* Returns true if internal pacing does not allow sending now.
+ * Time spent in this state while data is queued is reported
+ * to user space as tcpi_pacing_limited.
+ */
+static bool tcp_pacing_check(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (tcp_needs_internal_pacing(sk) &&
+	    hrtimer_active(&tp->pacing_timer)) {
+		if (!tp->pacing_limited_stamp)
+			tp->pacing_limited_stamp = ktime_get_ns();
+		return true;
+	}
+	if (unlikely(tp->pacing_limited_stamp)) {
+		tp->pacing_limited_ns += ktime_get_ns() -
+					 tp->pacing_limited_stamp;
+		tp->pacing_limited_stamp = 0;
+	}
+	return false;
+}
+
 /* This routine actually transmits TCP packets queued in by
  * tcp_do_sendmsg().  This is used by both the initial
  * transmission and possible later retransmissions.
@@ -1015,6 +1096,7 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb, int clone_it,
 	if (skb->len != tcp_header_size) {
 		tcp_event_data_sent(tp, sk);
 		tp->data_segs_out += tcp_skb_pcount(skb);
+		tcp_internal_pacing(sk, skb);
 	}
 
 	if (after(tcb->end_seq, tp->snd_nxt) || tcb->seq == tcb->end_seq)
@@ -2130,6 +2212,9 @@ static bool tcp_write_xmit(struct sock *sk, unsigned int mss_now, int nonagle,
 	while ((skb = tcp_send_head(sk))) {
 		unsigned int limit;
 
+		if (tcp_pacing_check(sk))
+			break;
+
 		tso_segs = tcp_init_tso_segs(skb, mss_now);
 		BUG_ON(!tso_segs);
 
@@ -2833,6 +2918,10 @@ void tcp_xmit_retransmit_queue(struct sock *sk)
 
 		if (skb == tcp_send_head(sk))
 			break;
+
+		if (tcp_pacing_check(sk))
+			break;
+
 		/* we could do better than to assign each time */
 		if (!hole)
 			tp->retransmit_skb_hint = skb;
@@ -429,6 +429,8 @@ try_again:
 		if (inet->cmsg_flags)
 			ip_cmsg_recv_offset(msg, skb,
 					    sizeof(struct udphdr), off);
+		if (udp_sk(sk)->gro_enabled)
+			udp_cmsg_recv(msg, skb);
 	} else {
 		if (np->rxopt.all)
 			ip6_datagram_recv_specific_ctl(sk, msg, skb);
@@ -1033,6 +1035,7 @@ int udpv6_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
 	int connected = 0;
 	int is_udplite = IS_UDPLITE(sk);
 	int (*getfrag)(void *, char *, int, int, int, struct sk_buff *);
+	u16 gso_size;
 	struct sockcm_cookie sockc;
 
 	ipc6.hlimit = -1;
@@ -1090,6 +1093,18 @@ do_udp_sendmsg:
 	if (up->pending == AF_INET)
 		return udp_sendmsg(sk, msg, len);
 
+	/* UDP_SEGMENT is only implemented for IPv4 so far, refuse it rather
+	 * than silently sending one oversized datagram
+	 */
+	gso_size = up->gso_size;
+	if (msg->msg_controllen) {
+		err = udp_cmsg_send(sk, msg, &gso_size);
+		if (err < 0)
+			return err;
+	}
+	if (gso_size)
+		return -EOPNOTSUPP;
+
 	/* Rough check on arithmetic overflow,
 	   better check is made in ip6_append_data().
 	   */
@@ -0,0 +1,33 @@
+/* XDP user-space packet buffer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#ifndef XDP_UMEM_H_
+#define XDP_UMEM_H_
+
+#include <linux/highmem.h>
+#include <linux/if_xdp.h>
+#include <net/xdp_sock.h>
+
+/* Chunks never cross a page, so a frame can be reached through a
+ * temporary mapping of the single page it lives in.
+ */
+static inline struct page *xdp_umem_get_page(struct xdp_umem *umem, u64 addr)
+{
+	return umem->pgs[addr >> PAGE_SHIFT];
+}
+
+static inline unsigned int xdp_umem_get_offset(u64 addr)
+{
+	return addr & (PAGE_SIZE - 1);
+}
+
+bool xdp_umem_validate_queues(struct xdp_umem *umem);
+void xdp_get_umem(struct xdp_umem *umem);
+void xdp_put_umem(struct xdp_umem *umem);
+struct xdp_umem *xdp_umem_create(struct xdp_umem_reg *mr);
+
+#endif /* XDP_UMEM_H_ */
@@ -18,6 +18,9 @@
 #include <string.h>
 #include <time.h>
 #include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include "libbpf.h"
 #include "bpf_load.h"
 
@@ -35,6 +38,10 @@ static __u64 time_get_ns(void)
 #define PERCPU_HASH_PREALLOC	(1 << 1)
 #define HASH_KMALLOC		(1 << 2)
 #define PERCPU_HASH_KMALLOC	(1 << 3)
+#define LPM_KMALLOC		(1 << 4)
+#define FIB_LOOKUP		(1 << 5)
+
+#define MAX_ENTRIES		1000
 
 static int test_flags = ~0;
 
@@ -86,6 +93,72 @@ static void test_percpu_hash_kmalloc(int cpu)
 	       cpu, MAX_CNT * 1000000000ll / (time_get_ns() - start_time));
 }
 
+static void test_lpm_kmalloc(int cpu)
+{
+	__u64 start_time;
+	int i;
+
+	start_time = time_get_ns();
+	for (i = 0; i < MAX_CNT; i++)
+		syscall(__NR_gettid);
+	printf("%d:lpm_perf kmalloc %lld events per sec\n",
+	       cpu, MAX_CNT * 1000000000ll / (time_get_ns() - start_time));
+}
+
+/* reference for the lpm case: each connect() of a UDP socket resolves its
+ * route with one fib_table_lookup() in the host's routing table.  The
+ * event cost includes the syscall and socket work, so it bounds a FIB
+ * lookup from above, to be set against an lpm event doing 32 trie lookups.
+ */
+static void test_fib_lookup(int cpu)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(9),
+	};
+	__u64 start_time;
+	int fd, i;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	assert(fd >= 0);
+	inet_pton(AF_INET, "192.168.0.1", &addr.sin_addr);
+
+	start_time = time_get_ns();
+	for (i = 0; i < MAX_CNT; i++)
+		connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+	printf("%d:fib_lookup %lld events per sec\n",
+	       cpu, MAX_CNT * 1000000000ll / (time_get_ns() - start_time));
+	close(fd);
+}
+
+/* give the trie the shape of a small routing table: random IPv4 prefixes
+ * between /8 and /32, plus the one the kernel side looks up
+ */
+static void fill_lpm_trie(int map_fd)
+{
+	struct {
+		__u32 prefixlen;
+		__u8 data[4];
+	} key;
+	long value = 0;
+	int i;
+
+	key.prefixlen = 16;
+	key.data[0] = 192;
+	key.data[1] = 168;
+	key.data[2] = 0;
+	key.data[3] = 0;
+	assert(bpf_update_elem(map_fd, &key, &value, BPF_ANY) == 0);
+
+	for (i = 1; i < MAX_ENTRIES; i++) {
+		__u32 addr = rand();
+
+		key.prefixlen = 8 + rand() % 25;
+		memcpy(key.data, &addr, sizeof(addr));
+		assert(bpf_update_elem(map_fd, &key, &value, BPF_ANY) == 0);
+	}
+}
+
 static void loop(int cpu)
 {
 	cpu_set_t cpuset;
@@ -105,6 +178,12 @@ static void loop(int cpu)
 
 	if (test_flags & PERCPU_HASH_KMALLOC)
 		test_percpu_hash_kmalloc(cpu);
+
+	if (test_flags & LPM_KMALLOC)
+		test_lpm_kmalloc(cpu);
+
+	if (test_flags & FIB_LOOKUP)
+		test_fib_lookup(cpu);
 }
 
 static void run_perf_test(int tasks)
@@ -150,6 +229,8 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	fill_lpm_trie(map_fd[4]);
+
 	run_perf_test(num_cpu);
 
 	return 0;
@@ -0,0 +1,380 @@
+/*
+ * Testsuite for the LPM trie map
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * Prefixes are kept in a trivial user-space reference list as well, and
+ * lookups of random keys in both are expected to agree.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/bpf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include "libbpf.h"
+
+struct tlpm_node {
+	struct tlpm_node *next;
+	size_t n_bits;
+	uint8_t key[];
+};
+
+static struct tlpm_node *tlpm_add(struct tlpm_node *list,
+				  const uint8_t *key, size_t n_bits)
+{
+	struct tlpm_node *node;
+	size_t n;
+
+	n = (n_bits + 7) / 8;
+
+	/* keys come in masked, so an equal prefix is an equal key */
+	for (node = list; node; node = node->next) {
+		if (node->n_bits == n_bits && !memcmp(node->key, key, n))
+			return list;
+	}
+
+	node = malloc(sizeof(*node) + n);
+	assert(node);
+
+	node->next = list;
+	node->n_bits = n_bits;
+	memcpy(node->key, key, n);
+
+	return node;
+}
+
+static void tlpm_clear(struct tlpm_node *list)
+{
+	struct tlpm_node *node;
+
+	while ((node = list)) {
+		list = list->next;
+		free(node);
+	}
+}
+
+static struct tlpm_node *tlpm_match(struct tlpm_node *list,
+				    const uint8_t *key, size_t n_bits)
+{
+	struct tlpm_node *best = NULL;
+	size_t i;
+
+	/* Linearly iterate over all entries and return the longest match */
+	for ( ; list; list = list->next) {
+		for (i = 0; i < n_bits && i < list->n_bits; ++i) {
+			if ((key[i / 8] & (1 << (7 - i % 8))) !=
+			    (list->key[i / 8] & (1 << (7 - i % 8))))
+				break;
+		}
+
+		if (i >= list->n_bits) {
+			if (!best || i > best->n_bits)
+				best = list;
+		}
+	}
+
+	return best;
+}
+
+static struct tlpm_node *tlpm_delete(struct tlpm_node *list,
+				     const uint8_t *key, size_t n_bits)
+{
+	struct tlpm_node *best = tlpm_match(list, key, n_bits);
+	struct tlpm_node *node;
+
+	if (!best || best->n_bits != n_bits)
+		return list;
+
+	if (best == list) {
+		node = best->next;
+		free(best);
+		return node;
+	}
+
+	for (node = list; node; node = node->next) {
+		if (node->next == best) {
+			node->next = best->next;
+			free(best);
+			return list;
+		}
+	}
+
+	/* should never get here */
+	assert(0);
+	return list;
+}
+
+/* clear the bits past the prefix, so that equal prefixes compare equal */
+static void mask_prefix(uint8_t *data, size_t keysize, size_t n_bits)
+{
+	size_t i;
+
+	for (i = n_bits; i < 8 * keysize; ++i)
+		data[i / 8] &= ~(1 << (7 - i % 8));
+}
+
+static int create_trie(size_t keysize, size_t valuesize, int max_entries)
+{
+	int map_fd;
+
+	map_fd = bpf_create_map(BPF_MAP_TYPE_LPM_TRIE,
+				sizeof(struct bpf_lpm_trie_key) + keysize,
+				valuesize, max_entries, BPF_F_NO_PREALLOC);
+	if (map_fd < 0) {
+		printf("failed to create lpm trie '%s'\n", strerror(errno));
+		exit(1);
+	}
+
+	return map_fd;
+}
+
+/* insert and delete random prefixes and check that the kernel trie gives
+ * the same answers as the reference list
+ */
+static void test_lpm_map(int keysize)
+{
+	size_t i, j, n_nodes, n_lookups;
+	struct tlpm_node *t, *list = NULL;
+	struct bpf_lpm_trie_key *key;
+	uint8_t *data, *value;
+	int map;
+
+	/* Compare behavior of tlpm vs. bpf-lpm. Create a randomized set of
+	 * prefixes and insert it into both tlpm and bpf-lpm. Then run some
+	 * randomized lookups and verify both maps return the same result.
+	 */
+
+	n_nodes = 1 << 8;
+	n_lookups = 1 << 16;
+
+	data = alloca(keysize);
+	memset(data, 0, keysize);
+
+	value = alloca(keysize + 1);
+	memset(value, 0, keysize + 1);
+
+	key = alloca(sizeof(*key) + keysize);
+	memset(key, 0, sizeof(*key) + keysize);
+
+	map = create_trie(keysize, keysize + 1, 4096);
+
+	for (i = 0; i < n_nodes; ++i) {
+		for (j = 0; j < keysize; ++j)
+			value[j] = rand() & 0xff;
+		value[keysize] = rand() % (8 * keysize + 1);
+		mask_prefix(value, keysize, value[keysize]);
+
+		list = tlpm_add(list, value, value[keysize]);
+
+		key->prefixlen = value[keysize];
+		memcpy(key->data, value, keysize);
+		assert(bpf_update_elem(map, key, value, 0) == 0);
+	}
+
+	/* remove a quarter of them again */
+	for (i = 0; i < n_nodes / 4; ++i) {
+		for (j = 0; j < keysize; ++j)
+			value[j] = rand() & 0xff;
+		value[keysize] = rand() % (8 * keysize + 1);
+
+		t = tlpm_match(list, value, value[keysize]);
+		if (!t)
+			continue;
+
+		key->prefixlen = t->n_bits;
+		memcpy(key->data, t->key, keysize);
+		assert(bpf_delete_elem(map, key) == 0);
+		list = tlpm_delete(list, t->key, t->n_bits);
+	}
+
+	for (i = 0; i < n_lookups; ++i) {
+		for (j = 0; j < keysize; ++j)
+			data[j] = rand() & 0xff;
+
+		t = tlpm_match(list, data, 8 * keysize);
+
+		key->prefixlen = 8 * keysize;
+		memcpy(key->data, data, keysize);
+		if (bpf_lookup_elem(map, key, value) == 0) {
+			assert(t);
+			assert(t->n_bits == value[keysize]);
+			for (j = 0; j < t->n_bits; ++j)
+				assert((t->key[j / 8] & (1 << (7 - j % 8))) ==
+				       (value[j / 8] & (1 << (7 - j % 8))));
+		} else {
+			assert(!t);
+			assert(errno == ENOENT);
+		}
+	}
+
+	close(map);
+	tlpm_clear(list);
+}
+
+static void test_lpm_ipaddr(void)
+{
+	struct bpf_lpm_trie_key *key_ipv4;
+	struct bpf_lpm_trie_key *key_ipv6;
+	size_t key_size_ipv4;
+	size_t key_size_ipv6;
+	int map_fd_ipv4;
+	int map_fd_ipv6;
+	__u64 value;
+
+	key_size_ipv4 = sizeof(*key_ipv4) + sizeof(__u32);
+	key_size_ipv6 = sizeof(*key_ipv6) + sizeof(__u32) * 4;
+	key_ipv4 = alloca(key_size_ipv4);
+	key_ipv6 = alloca(key_size_ipv6);
+
+	map_fd_ipv4 = create_trie(sizeof(__u32), sizeof(value), 100);
+	map_fd_ipv6 = create_trie(sizeof(__u32) * 4, sizeof(value), 100);
+
+	/* Fill in some IPv4 and IPv6 address ranges */
+	value = 1;
+	key_ipv4->prefixlen = 16;
+	inet_pton(AF_INET, "192.168.0.0", key_ipv4->data);
+	assert(bpf_update_elem(map_fd_ipv4, key_ipv4, &value, 0) == 0);
+
+	value = 2;
+	key_ipv4->prefixlen = 24;
+	inet_pton(AF_INET, "192.168.0.0", key_ipv4->data);
+	assert(bpf_update_elem(map_fd_ipv4, key_ipv4, &value, 0) == 0);
+
+	value = 3;
+	key_ipv4->prefixlen = 24;
+	inet_pton(AF_INET, "192.168.128.0", key_ipv4->data);
+	assert(bpf_update_elem(map_fd_ipv4, key_ipv4, &value, 0) == 0);
+
+	value = 5;
+	key_ipv4->prefixlen = 24;
+	inet_pton(AF_INET, "192.168.1.0", key_ipv4->data);
+	assert(bpf_update_elem(map_fd_ipv4, key_ipv4, &value, 0) == 0);
+
+	value = 4;
+	key_ipv4->prefixlen = 23;
+	inet_pton(AF_INET, "192.168.0.0", key_ipv4->data);
+	assert(bpf_update_elem(map_fd_ipv4, key_ipv4, &value, 0) == 0);
+
+	value = 0xdeadbeef;
+	key_ipv6->prefixlen = 64;
+	inet_pton(AF_INET6, "2a00:1450:4001:814::200e", key_ipv6->data);
+	assert(bpf_update_elem(map_fd_ipv6, key_ipv6, &value, 0) == 0);
+
+	/* Set prefixlen to maximum for lookups */
+	key_ipv4->prefixlen = 32;
+	key_ipv6->prefixlen = 128;
+
+	/* Test some lookups that should come back with a value */
+	inet_pton(AF_INET, "192.168.128.23", key_ipv4->data);
+	assert(bpf_lookup_elem(map_fd_ipv4, key_ipv4, &value) == 0);
+	assert(value == 3);
+
+	inet_pton(AF_INET, "192.168.0.1", key_ipv4->data);
+	assert(bpf_lookup_elem(map_fd_ipv4, key_ipv4, &value) == 0);
+	assert(value == 2);
+
+	inet_pton(AF_INET6, "2a00:1450:4001:814::", key_ipv6->data);
+	assert(bpf_lookup_elem(map_fd_ipv6, key_ipv6, &value) == 0);
+	assert(value == 0xdeadbeef);
+
+	inet_pton(AF_INET6, "2a00:1450:4001:814::1", key_ipv6->data);
+	assert(bpf_lookup_elem(map_fd_ipv6, key_ipv6, &value) == 0);
+	assert(value == 0xdeadbeef);
+
+	/* Test some lookups that should not match any entry */
+	inet_pton(AF_INET, "10.0.0.1", key_ipv4->data);
+	assert(bpf_lookup_elem(map_fd_ipv4, key_ipv4, &value) == -1 &&
+	       errno == ENOENT);
+
+	inet_pton(AF_INET, "11.11.11.11", key_ipv4->data);
+	assert(bpf_lookup_elem(map_fd_ipv4, key_ipv4, &value) == -1 &&
+	       errno == ENOENT);
+
+	inet_pton(AF_INET6, "2a00:ffff::", key_ipv6->data);
+	assert(bpf_lookup_elem(map_fd_ipv6, key_ipv6, &value) == -1 &&
+	       errno == ENOENT);
+
+	close(map_fd_ipv4);
+	close(map_fd_ipv6);
+}
+
+static void test_lpm_flags_and_limits(void)
+{
+	struct bpf_lpm_trie_key *key;
+	__u32 value = 0;
+	int map_fd;
+
+	key = alloca(sizeof(*key) + sizeof(__u32));
+	map_fd = create_trie(sizeof(__u32), sizeof(value), 2);
+
+	key->prefixlen = 8;
+	inet_pton(AF_INET, "10.0.0.0", key->data);
+	assert(bpf_update_elem(map_fd, key, &value, BPF_EXIST) == -1 &&
+	       errno == ENOENT);
+	assert(bpf_update_elem(map_fd, key, &value, BPF_NOEXIST) == 0);
+	assert(bpf_update_elem(map_fd, key, &value, BPF_NOEXIST) == -1 &&
+	       errno == EEXIST);
+	assert(bpf_update_elem(map_fd, key, &value, -1) == -1 &&
+	       errno == EINVAL);
+
+	key->prefixlen = 16;
+	assert(bpf_update_elem(map_fd, key, &value, BPF_ANY) == 0);
+
+	/* the trie is full, but replacing an entry must still work */
+	key->prefixlen = 24;
+	assert(bpf_update_elem(map_fd, key, &value, BPF_ANY) == -1 &&
+	       errno == ENOSPC);
+	key->prefixlen = 16;
+	value = 1;
+	assert(bpf_update_elem(map_fd, key, &value, BPF_EXIST) == 0);
+
+	key->prefixlen = 33;
+	assert(bpf_update_elem(map_fd, key, &value, BPF_ANY) == -1 &&
+	       errno == EINVAL);
+
+	/* a prefix that is covered but was never inserted is not an entry */
+	key->prefixlen = 12;
+	assert(bpf_delete_elem(map_fd, key) == -1 && errno == ENOENT);
+	key->prefixlen = 8;
+	assert(bpf_delete_elem(map_fd, key) == 0);
+	assert(bpf_delete_elem(map_fd, key) == -1 && errno == ENOENT);
+
+	key->prefixlen = 32;
+	inet_pton(AF_INET, "10.0.1.1", key->data);
+	assert(bpf_lookup_elem(map_fd, key, &value) == 0 && value == 1);
+
+	close(map_fd);
+
+	/* only the non-preallocated flavour exists */
+	map_fd = bpf_create_map(BPF_MAP_TYPE_LPM_TRIE, sizeof(*key) + 4,
+				sizeof(value), 16, 0);
+	assert(map_fd == -1 && errno == EINVAL);
+}
+
+int main(void)
+{
+	struct rlimit limit  = { RLIM_INFINITY, RLIM_INFINITY };
+	int i;
+
+	/* we allocate a lot of tries, remove the memlock limit */
+	setrlimit(RLIMIT_MEMLOCK, &limit);
+
+	srand(time(NULL));
+
+	for (i = 1; i <= 16; ++i)
+		test_lpm_map(i);
+
+	test_lpm_ipaddr();
+	test_lpm_flags_and_limits();
+
+	printf("test_lpm_map: OK\n");
+	return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Testsuite for the LRU hash maps
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <unistd.h>
+#include <linux/bpf.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+#include "libbpf.h"
+
+static int nr_cpus;
+
+static int create_map(int map_type, int map_flags, unsigned int size)
+{
+	int map_fd;
+
+	map_fd = bpf_create_map(map_type, sizeof(unsigned long long),
+				sizeof(unsigned long long), size, map_flags);
+	if (map_fd < 0) {
+		printf("failed to create lru map '%s'\n", strerror(errno));
+		exit(1);
+	}
+
+	return map_fd;
+}
+
+/* evictions are decided per list, keep them on a single cpu so that the
+ * outcome does not depend on the scheduler
+ */
+static void pin_to_cpu0(void)
+{
+	cpu_set_t cpuset;
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(0, &cpuset);
+	assert(!sched_setaffinity(0, sizeof(cpuset), &cpuset));
+}
+
+static int map_count(int map_fd)
+{
+	unsigned long long key = -1, next_key;
+	int n = 0;
+
+	while (!bpf_get_next_key(map_fd, &key, &next_key)) {
+		key = next_key;
+		n++;
+	}
+	assert(errno == ENOENT);
+
+	return n;
+}
+
+/* the usual flag semantics hold, and a full map makes room instead of
+ * failing with E2BIG
+ */
+static void test_lru_sanity(int map_type, int map_flags)
+{
+	unsigned long long key, value[nr_cpus];
+	unsigned int map_size = 4 * nr_cpus;
+	int map_fd, i;
+
+	map_fd = create_map(map_type, map_flags, map_size);
+
+	for (i = 0; i < nr_cpus; i++)
+		value[i] = 1234;
+
+	key = 1;
+	assert(bpf_update_elem(map_fd, &key, value, BPF_NOEXIST) == 0);
+	assert(bpf_update_elem(map_fd, &key, value, BPF_NOEXIST) == -1 &&
+	       errno == EEXIST);
+	assert(bpf_update_elem(map_fd, &key, value, -1) == -1 &&
+	       errno == EINVAL);
+	assert(bpf_update_elem(map_fd, &key, value, BPF_EXIST) == 0);
+
+	value[0] = 0;
+	assert(bpf_lookup_elem(map_fd, &key, value) == 0 && value[0] == 1234);
+
+	key = 2;
+	assert(bpf_update_elem(map_fd, &key, value, BPF_EXIST) == -1 &&
+	       errno == ENOENT);
+	assert(bpf_lookup_elem(map_fd, &key, value) == -1 && errno == ENOENT);
+
+	for (key = 2; key < 8 * map_size; key++)
+		assert(bpf_update_elem(map_fd, &key, value, BPF_NOEXIST) == 0);
+
+	assert(map_count(map_fd) <= map_size);
+
+	/* the most recent insertion cannot have been evicted */
+	key--;
+	assert(bpf_delete_elem(map_fd, &key) == 0);
+	assert(bpf_delete_elem(map_fd, &key) == -1 && errno == ENOENT);
+
+	close(map_fd);
+}
+
+/* a key that keeps being looked up survives a stream of new keys that
+ * is many times the size of the map
+ */
+static void test_lru_hot_key(int map_type, int map_flags)
+{
+	unsigned long long key, hot_key = 0, value[nr_cpus];
+	unsigned int map_size = 1000;
+	int map_fd;
+
+	memset(value, 0, sizeof(value));
+	map_fd = create_map(map_type, map_flags, map_size);
+
+	assert(bpf_update_elem(map_fd, &hot_key, value, BPF_NOEXIST) == 0);
+
+	for (key = 1; key < 10 * map_size; key++) {
+		assert(bpf_update_elem(map_fd, &key, value, BPF_NOEXIST) == 0);
+		assert(bpf_lookup_elem(map_fd, &hot_key, value) == 0);
+	}
+
+	close(map_fd);
+}
+
+static void test_lru_bad_flags(void)
+{
+	int map_fd;
+
+	/* evicted elements are recycled in place */
+	map_fd = bpf_create_map(BPF_MAP_TYPE_LRU_HASH, sizeof(int),
+				sizeof(int), 16, BPF_F_NO_PREALLOC);
+	assert(map_fd == -1 && errno == EINVAL);
+
+	/* per-cpu lists only mean something for an LRU map */
+	map_fd = bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(int),
+				sizeof(int), 16, BPF_F_NO_COMMON_LRU);
+	assert(map_fd == -1 && errno == EINVAL);
+}
+
+int main(void)
+{
+	int map_types[] = {BPF_MAP_TYPE_LRU_HASH,
+			   BPF_MAP_TYPE_LRU_PERCPU_HASH};
+	int map_flags[] = {0, BPF_F_NO_COMMON_LRU};
+	int t, f;
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	assert(nr_cpus > 0);
+
+	pin_to_cpu0();
+
+	for (t = 0; t < sizeof(map_types) / sizeof(*map_types); t++) {
+		for (f = 0; f < sizeof(map_flags) / sizeof(*map_flags); f++) {
+			test_lru_sanity(map_types[t], map_flags[f]);
+			test_lru_hot_key(map_types[t], map_flags[f]);
+		}
+	}
+	test_lru_bad_flags();
+
+	printf("test_lru_map: OK\n");
+	return 0;
+}
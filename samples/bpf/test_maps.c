@@ -16,6 +16,10 @@
 #include <assert.h>
 #include <sys/wait.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include "libbpf.h"
 
 static int map_flags;
@@ -339,6 +343,196 @@ static void test_percpu_arraymap_sanity(int i, void *data)
 }
 
 #define MAP_SIZE (32 * 1024)
+/* sanity tests for array and hash of maps */
+static void test_map_in_map(void)
+{
+	int inner_fd, other_fd, array_fd, hash_fd;
+	int key = 0, value;
+
+	inner_fd = bpf_create_map(BPF_MAP_TYPE_ARRAY, sizeof(key),
+				  sizeof(value), 4, 0);
+	assert(inner_fd >= 0);
+
+	/* same type, different max_entries */
+	other_fd = bpf_create_map(BPF_MAP_TYPE_ARRAY, sizeof(key),
+				  sizeof(value), 8, 0);
+	assert(other_fd >= 0);
+
+	array_fd = bpf_create_map_in_map(BPF_MAP_TYPE_ARRAY_OF_MAPS,
+					 sizeof(key), inner_fd, 2, 0);
+	if (array_fd < 0) {
+		printf("failed to create array of maps '%s'\n",
+		       strerror(errno));
+		exit(1);
+	}
+
+	hash_fd = bpf_create_map_in_map(BPF_MAP_TYPE_HASH_OF_MAPS,
+					sizeof(key), inner_fd, 2, map_flags);
+	if (hash_fd < 0) {
+		printf("failed to create hash of maps '%s'\n",
+		       strerror(errno));
+		exit(1);
+	}
+
+	/* only one level of nesting */
+	assert(bpf_create_map_in_map(BPF_MAP_TYPE_ARRAY_OF_MAPS, sizeof(key),
+				     array_fd, 2, 0) == -1 && errno == EINVAL);
+
+	/* inner maps must match the template */
+	assert(bpf_update_elem(array_fd, &key, &other_fd, BPF_ANY) == -1 &&
+	       errno == EINVAL);
+	assert(bpf_update_elem(hash_fd, &key, &other_fd, BPF_ANY) == -1 &&
+	       errno == EINVAL);
+
+	assert(bpf_update_elem(array_fd, &key, &inner_fd, BPF_ANY) == 0);
+	assert(bpf_update_elem(hash_fd, &key, &inner_fd, BPF_NOEXIST) == 0);
+	assert(bpf_update_elem(hash_fd, &key, &inner_fd, BPF_NOEXIST) == -1 &&
+	       errno == EEXIST);
+
+	/* values are kernel pointers, user space cannot read them */
+	assert(bpf_lookup_elem(array_fd, &key, &value) == -1);
+	assert(bpf_lookup_elem(hash_fd, &key, &value) == -1);
+
+	/* the outer maps keep the inner one alive */
+	close(inner_fd);
+
+	assert(bpf_delete_elem(array_fd, &key) == 0);
+	assert(bpf_delete_elem(array_fd, &key) == -1 && errno == ENOENT);
+
+	key = 1;
+	assert(bpf_get_next_key(hash_fd, &key, &value) == 0 && value == 0);
+
+	close(hash_fd);
+	close(array_fd);
+	close(other_fd);
+}
+
+/* messages of any length, each read is one message */
+static int sockmap_parse_prog(void)
+{
+	struct bpf_insn prog[] = {
+		BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_1,
+			    offsetof(struct __sk_buff, len)),
+		BPF_EXIT_INSN(),
+	};
+
+	return bpf_prog_load(BPF_PROG_TYPE_SK_SKB, prog, sizeof(prog),
+			     "GPL", 0);
+}
+
+/* everything goes out on the socket at key 1 */
+static int sockmap_verdict_prog(int map_fd)
+{
+	struct bpf_insn prog[] = {
+		BPF_LD_MAP_FD(BPF_REG_2, map_fd),
+		BPF_MOV64_IMM(BPF_REG_3, 1),
+		BPF_MOV64_IMM(BPF_REG_4, 0),
+		BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+			     BPF_FUNC_sk_redirect_map),
+		BPF_EXIT_INSN(),
+	};
+
+	return bpf_prog_load(BPF_PROG_TYPE_SK_SKB, prog, sizeof(prog),
+			     "GPL", 0);
+}
+
+static void test_sockmap(void)
+{
+	int map_fd, parse_fd, verdict_fd, lfd, udp_fd;
+	int c[2], p[2], key, i;
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	struct timeval tv = { .tv_sec = 1 };
+	char buf[16];
+
+	map_fd = bpf_create_map(BPF_MAP_TYPE_SOCKMAP, sizeof(key),
+				sizeof(key), 2, 0);
+	if (map_fd < 0) {
+		printf("failed to create sockmap '%s'\n", strerror(errno));
+		exit(1);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	assert(lfd >= 0);
+	assert(bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	assert(listen(lfd, 2) == 0);
+	assert(getsockname(lfd, (struct sockaddr *)&addr, &len) == 0);
+
+	for (i = 0; i < 2; i++) {
+		c[i] = socket(AF_INET, SOCK_STREAM, 0);
+		assert(c[i] >= 0);
+		assert(connect(c[i], (struct sockaddr *)&addr,
+			       sizeof(addr)) == 0);
+		p[i] = accept(lfd, NULL, NULL);
+		assert(p[i] >= 0);
+	}
+
+	/* only established TCP sockets */
+	key = 0;
+	udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	assert(udp_fd >= 0);
+	assert(bpf_update_elem(map_fd, &key, &udp_fd, BPF_ANY) == -1 &&
+	       errno == EOPNOTSUPP);
+	assert(bpf_update_elem(map_fd, &key, &lfd, BPF_ANY) == -1 &&
+	       errno == ENOTCONN);
+	close(udp_fd);
+
+	parse_fd = sockmap_parse_prog();
+	verdict_fd = sockmap_verdict_prog(map_fd);
+	if (parse_fd < 0 || verdict_fd < 0) {
+		printf("failed to load sk_skb programs '%s'\n%s",
+		       strerror(errno), bpf_log_buf);
+		exit(1);
+	}
+
+	assert(bpf_prog_attach(parse_fd, map_fd,
+			       BPF_SK_SKB_STREAM_PARSER, 0) == 0);
+	assert(bpf_prog_attach(verdict_fd, map_fd,
+			       BPF_SK_SKB_STREAM_VERDICT, 0) == 0);
+
+	for (key = 0; key < 2; key++)
+		assert(bpf_update_elem(map_fd, &key, &p[key],
+				       BPF_NOEXIST) == 0);
+	key = 0;
+	assert(bpf_update_elem(map_fd, &key, &p[0], BPF_NOEXIST) == -1 &&
+	       errno == EEXIST);
+
+	/* sockets cannot be read back */
+	assert(bpf_lookup_elem(map_fd, &key, &i) == -1);
+
+	/* sent on c[0], redirected from p[0] to p[1], received on c[1] */
+	assert(setsockopt(c[1], SOL_SOCKET, SO_RCVTIMEO,
+			  &tv, sizeof(tv)) == 0);
+	assert(send(c[0], "sockmap", 7, 0) == 7);
+	memset(buf, 0, sizeof(buf));
+	assert(recv(c[1], buf, sizeof(buf), 0) == 7);
+	assert(strcmp(buf, "sockmap") == 0);
+
+	assert(bpf_delete_elem(map_fd, &key) == 0);
+	assert(bpf_delete_elem(map_fd, &key) == -1 && errno == EINVAL);
+
+	assert(bpf_prog_detach(map_fd, BPF_SK_SKB_STREAM_PARSER) == 0);
+	assert(bpf_prog_detach(map_fd, BPF_SK_SKB_STREAM_PARSER) == -1 &&
+	       errno == ENOENT);
+
+	/* closing a socket takes it out of the map */
+	close(p[1]);
+	key = 1;
+	assert(bpf_delete_elem(map_fd, &key) == -1 && errno == EINVAL);
+
+	for (i = 0; i < 2; i++)
+		close(c[i]);
+	close(p[0]);
+	close(lfd);
+	close(parse_fd);
+	close(verdict_fd);
+	close(map_fd);
+}
+
 static void test_map_large(void)
 {
 	struct bigkey {
@@ -486,6 +680,8 @@ static void run_all_tests(void)
 	test_arraymap_sanity(0, NULL);
 	test_percpu_arraymap_sanity(0, NULL);
 	test_percpu_arraymap_many_keys();
+	test_map_in_map();
+	test_sockmap();
 
 	test_map_large();
 	test_map_parallel();
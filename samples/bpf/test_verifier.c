@@ -30,6 +30,7 @@ struct bpf_test {
 	int fixup[MAX_FIXUPS];
 	int prog_array_fixup[MAX_FIXUPS];
 	int test_val_map_fixup[MAX_FIXUPS];
+	int map_in_map_fixup[MAX_FIXUPS];
 	const char *errstr;
 	const char *errstr_unpriv;
 	enum {
@@ -179,7 +180,9 @@ static struct bpf_test tests[] = {
 			BPF_JMP_IMM(BPF_JA, 0, 0, -1),
 			BPF_EXIT_INSN(),
 		},
-		.errstr = "back-edge",
+		.errstr = "unreachable insn 1",
+		.errstr_unpriv = "back-edge",
+		.result_unpriv = REJECT,
 		.result = REJECT,
 	},
 	{
@@ -191,7 +194,9 @@ static struct bpf_test tests[] = {
 			BPF_JMP_IMM(BPF_JA, 0, 0, -4),
 			BPF_EXIT_INSN(),
 		},
-		.errstr = "back-edge",
+		.errstr = "unreachable insn 4",
+		.errstr_unpriv = "back-edge",
+		.result_unpriv = REJECT,
 		.result = REJECT,
 	},
 	{
@@ -203,7 +208,35 @@ static struct bpf_test tests[] = {
 			BPF_JMP_IMM(BPF_JEQ, BPF_REG_1, 0, -3),
 			BPF_EXIT_INSN(),
 		},
-		.errstr = "back-edge",
+		.errstr = "R0 !read_ok",
+		.errstr_unpriv = "back-edge",
+		.result_unpriv = REJECT,
+		.result = REJECT,
+	},
+	{
+		"bounded loop",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_MOV64_IMM(BPF_REG_1, 0),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_0, 2),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_1, 1),
+			BPF_JMP_IMM(BPF_JNE, BPF_REG_1, 10, -3),
+			BPF_EXIT_INSN(),
+		},
+		.errstr_unpriv = "back-edge",
+		.result_unpriv = REJECT,
+		.result = ACCEPT,
+	},
+	{
+		"infinite loop",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, -2),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "infinite loop detected",
+		.errstr_unpriv = "back-edge",
+		.result_unpriv = REJECT,
 		.result = REJECT,
 	},
 	{
@@ -2389,6 +2422,350 @@ static struct bpf_test tests[] = {
 		.errstr = "R0 min value is negative, either use unsigned index or do a if (index >=0) check.",
 		.result = REJECT,
 	},
+	{
+		"map in map access",
+		.insns = {
+			BPF_ST_MEM(0, BPF_REG_10, -4, 0),
+			BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+			BPF_LD_MAP_FD(BPF_REG_1, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+			BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 5),
+			BPF_ST_MEM(0, BPF_REG_10, -4, 0),
+			BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+			BPF_MOV64_REG(BPF_REG_1, BPF_REG_0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.map_in_map_fixup = {3},
+		.result = ACCEPT,
+	},
+	{
+		"invalid inner map pointer",
+		.insns = {
+			BPF_ST_MEM(0, BPF_REG_10, -4, 0),
+			BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+			BPF_LD_MAP_FD(BPF_REG_1, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+			BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 6),
+			BPF_ST_MEM(0, BPF_REG_10, -4, 0),
+			BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+			BPF_MOV64_REG(BPF_REG_1, BPF_REG_0),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_1, 8),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.map_in_map_fixup = {3},
+		.errstr = "R1 type=inv expected=map_ptr",
+		.result = REJECT,
+	},
+	{
+		"forgot null checking on the inner map pointer",
+		.insns = {
+			BPF_ST_MEM(0, BPF_REG_10, -4, 0),
+			BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+			BPF_LD_MAP_FD(BPF_REG_1, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+			BPF_ST_MEM(0, BPF_REG_10, -4, 0),
+			BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+			BPF_MOV64_REG(BPF_REG_1, BPF_REG_0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.map_in_map_fixup = {3},
+		.errstr = "R1 type=map_value_or_null expected=map_ptr",
+		.result = REJECT,
+	},
+	{
+		"map in map value is not memory",
+		.insns = {
+			BPF_ST_MEM(0, BPF_REG_10, -4, 0),
+			BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+			BPF_LD_MAP_FD(BPF_REG_1, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+			BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 1),
+			BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.map_in_map_fixup = {3},
+		.errstr = "R0 invalid mem access 'map_ptr'",
+		.result = REJECT,
+	},
+	{
+		"cgroup skb: skb_load_bytes",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_2, 0),
+			BPF_MOV64_REG(BPF_REG_3, BPF_REG_10),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_3, -8),
+			BPF_MOV64_IMM(BPF_REG_4, 8),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_skb_load_bytes),
+			BPF_MOV64_IMM(BPF_REG_0, 1),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+		.prog_type = BPF_PROG_TYPE_CGROUP_SKB,
+	},
+	{
+		"cgroup skb: no direct packet access",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+				    offsetof(struct __sk_buff, data)),
+			BPF_MOV64_IMM(BPF_REG_0, 1),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid bpf_context access",
+		.result = REJECT,
+		.prog_type = BPF_PROG_TYPE_CGROUP_SKB,
+	},
+	{
+		"cgroup skb: no write to mark",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_STX_MEM(BPF_W, BPF_REG_1, BPF_REG_0,
+				    offsetof(struct __sk_buff, mark)),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid bpf_context access",
+		.result = REJECT,
+		.prog_type = BPF_PROG_TYPE_CGROUP_SKB,
+	},
+	{
+		"cgroup sock: read all fields",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_1,
+				    offsetof(struct bpf_sock, bound_dev_if)),
+			BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_1,
+				    offsetof(struct bpf_sock, family)),
+			BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_1,
+				    offsetof(struct bpf_sock, type)),
+			BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_1,
+				    offsetof(struct bpf_sock, protocol)),
+			BPF_MOV64_IMM(BPF_REG_0, 1),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+		.prog_type = BPF_PROG_TYPE_CGROUP_SOCK,
+	},
+	{
+		"cgroup sock: write bound_dev_if",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_0, 1),
+			BPF_STX_MEM(BPF_W, BPF_REG_1, BPF_REG_0,
+				    offsetof(struct bpf_sock, bound_dev_if)),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+		.prog_type = BPF_PROG_TYPE_CGROUP_SOCK,
+	},
+	{
+		"cgroup sock: family is read-only",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_0, 1),
+			BPF_STX_MEM(BPF_W, BPF_REG_1, BPF_REG_0,
+				    offsetof(struct bpf_sock, family)),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid bpf_context access",
+		.result = REJECT,
+		.prog_type = BPF_PROG_TYPE_CGROUP_SOCK,
+	},
+	{
+		"cgroup sock: access beyond the context",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_1,
+				    sizeof(struct bpf_sock)),
+			BPF_MOV64_IMM(BPF_REG_0, 1),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid bpf_context access",
+		.result = REJECT,
+		.prog_type = BPF_PROG_TYPE_CGROUP_SOCK,
+	},
+	{
+		"sk_skb: direct packet read",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+				    offsetof(struct __sk_buff, data)),
+			BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_1,
+				    offsetof(struct __sk_buff, data_end)),
+			BPF_MOV64_REG(BPF_REG_0, BPF_REG_2),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_0, 8),
+			BPF_JMP_REG(BPF_JGT, BPF_REG_0, BPF_REG_3, 1),
+			BPF_LDX_MEM(BPF_B, BPF_REG_0, BPF_REG_2, 0),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+		.prog_type = BPF_PROG_TYPE_SK_SKB,
+	},
+	{
+		"sk_skb: direct packet write",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+				    offsetof(struct __sk_buff, data)),
+			BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_1,
+				    offsetof(struct __sk_buff, data_end)),
+			BPF_MOV64_REG(BPF_REG_0, BPF_REG_2),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_0, 8),
+			BPF_JMP_REG(BPF_JGT, BPF_REG_0, BPF_REG_3, 1),
+			BPF_STX_MEM(BPF_B, BPF_REG_2, BPF_REG_2, 0),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "cannot write into packet",
+		.result = REJECT,
+		.prog_type = BPF_PROG_TYPE_SK_SKB,
+	},
+	{
+		"sk_skb: write mark",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_STX_MEM(BPF_W, BPF_REG_1, BPF_REG_0,
+				    offsetof(struct __sk_buff, mark)),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+		.prog_type = BPF_PROG_TYPE_SK_SKB,
+	},
+	{
+		"sk_skb: no access to cb",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_1,
+				    offsetof(struct __sk_buff, cb[0])),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid bpf_context access",
+		.result = REJECT,
+		.prog_type = BPF_PROG_TYPE_SK_SKB,
+	},
+	{
+		"sk_skb: no access to ifindex",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_1,
+				    offsetof(struct __sk_buff, ifindex)),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid bpf_context access",
+		.result = REJECT,
+		.prog_type = BPF_PROG_TYPE_SK_SKB,
+	},
+	{
+		"calls: basic sanity",
+		.insns = {
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 1, 0, 1),
+			BPF_EXIT_INSN(),
+			BPF_MOV64_IMM(BPF_REG_0, 2),
+			BPF_EXIT_INSN(),
+		},
+		.errstr_unpriv = "function calls to other bpf functions are allowed for root only",
+		.result_unpriv = REJECT,
+		.result = ACCEPT,
+	},
+	{
+		"calls: write into caller stack frame",
+		.insns = {
+			BPF_ST_MEM(BPF_DW, BPF_REG_10, -8, 0),
+			BPF_MOV64_REG(BPF_REG_1, BPF_REG_10),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_1, -8),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 1, 0, 2),
+			BPF_LDX_MEM(BPF_DW, BPF_REG_0, BPF_REG_10, -8),
+			BPF_EXIT_INSN(),
+			BPF_ST_MEM(BPF_DW, BPF_REG_1, 0, 42),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr_unpriv = "function calls to other bpf functions are allowed for root only",
+		.result_unpriv = REJECT,
+		.result = ACCEPT,
+	},
+	{
+		"calls: callee cannot read caller registers",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_6, 1),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 1, 0, 1),
+			BPF_EXIT_INSN(),
+			BPF_MOV64_REG(BPF_REG_0, BPF_REG_6),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "R6 !read_ok",
+		.errstr_unpriv = "function calls to other bpf functions are allowed for root only",
+		.result = REJECT,
+	},
+	{
+		"calls: recursion",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 1, 0, -2),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "back-edge from insn 1 to 0",
+		.errstr_unpriv = "function calls to other bpf functions are allowed for root only",
+		.result = REJECT,
+	},
+	{
+		"calls: jump out of function",
+		.insns = {
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 1, 0, 2),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+			BPF_JMP_IMM(BPF_JA, 0, 0, -3),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "jump out of range from insn 3 to 1",
+		.errstr_unpriv = "function calls to other bpf functions are allowed for root only",
+		.result = REJECT,
+	},
+	{
+		"calls: return pointer to own stack",
+		.insns = {
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 1, 0, 1),
+			BPF_EXIT_INSN(),
+			BPF_MOV64_REG(BPF_REG_0, BPF_REG_10),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "cannot return stack pointer to the caller",
+		.errstr_unpriv = "function calls to other bpf functions are allowed for root only",
+		.result = REJECT,
+	},
+	{
+		"calls: tail_call in a program with calls",
+		.insns = {
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 1, 0, 1),
+			BPF_EXIT_INSN(),
+			BPF_MOV64_IMM(BPF_REG_3, 0),
+			BPF_LD_MAP_FD(BPF_REG_2, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_tail_call),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.prog_array_fixup = {3},
+		.errstr = "tail_calls are not allowed in programs with bpf-to-bpf calls",
+		.errstr_unpriv = "function calls to other bpf functions are allowed for root only",
+		.result = REJECT,
+	},
+	{
+		"calls: division by register in a callee",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_1, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 1, 0, 1),
+			BPF_EXIT_INSN(),
+			BPF_MOV64_IMM(BPF_REG_0, 1),
+			BPF_ALU64_REG(BPF_DIV, BPF_REG_0, BPF_REG_1),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "division by register is not allowed in programs with bpf-to-bpf calls",
+		.errstr_unpriv = "function calls to other bpf functions are allowed for root only",
+		.result = REJECT,
+	},
 };
 
 static int probe_filter_length(struct bpf_insn *fp)
@@ -2426,6 +2803,94 @@ static int create_prog_array(void)
 	return map_fd;
 }
 
+static int create_map_in_map(void)
+{
+	int inner_map_fd, outer_map_fd;
+
+	inner_map_fd = bpf_create_map(BPF_MAP_TYPE_ARRAY, sizeof(int),
+				      sizeof(int), 1, 0);
+	if (inner_map_fd < 0) {
+		printf("failed to create inner map '%s'\n", strerror(errno));
+		return inner_map_fd;
+	}
+
+	outer_map_fd = bpf_create_map_in_map(BPF_MAP_TYPE_ARRAY_OF_MAPS,
+					     sizeof(int), inner_map_fd, 1, 0);
+	if (outer_map_fd < 0)
+		printf("failed to create map in map '%s'\n", strerror(errno));
+
+	close(inner_map_fd);
+
+	return outer_map_fd;
+}
+
+static int load_with_stats(struct bpf_insn *insns, int insn_cnt,
+			   struct bpf_verifier_stats *stats)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+	attr.insns = (unsigned long) insns;
+	attr.insn_cnt = insn_cnt;
+	attr.license = (unsigned long) "GPL";
+	attr.stats = (unsigned long) stats;
+	attr.stats_size = sizeof(*stats);
+
+	memset(stats, 0, sizeof(*stats));
+	return syscall(__NR_bpf, BPF_PROG_LOAD, &attr, sizeof(attr));
+}
+
+/* attr.stats is filled in for accepted and rejected programs alike */
+static int test_stats(void)
+{
+	struct bpf_insn accept[] = {
+		BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+			     BPF_FUNC_get_prandom_u32),
+		BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 1),
+		BPF_MOV64_IMM(BPF_REG_0, 1),
+		BPF_EXIT_INSN(),
+	};
+	struct bpf_insn reject[] = {
+		BPF_EXIT_INSN(),
+	};
+	struct bpf_verifier_stats stats;
+	int prog_fd;
+
+	printf("#stats verifier statistics ");
+
+	prog_fd = load_with_stats(accept, ARRAY_SIZE(accept), &stats);
+	if (prog_fd < 0) {
+		printf("FAIL\nfailed to load prog '%s'\n", strerror(errno));
+		return 1;
+	}
+	close(prog_fd);
+	/* both sides of the branch are walked */
+	if (stats.insn_processed < ARRAY_SIZE(accept) ||
+	    stats.total_states + stats.pruned_states == 0 ||
+	    stats.peak_states == 0 || !stats.verification_time_ns) {
+		printf("FAIL\nunexpected stats of accepted prog: %u insns, %u states, %u peak, %u pruned\n",
+		       stats.insn_processed, stats.total_states,
+		       stats.peak_states, stats.pruned_states);
+		return 1;
+	}
+
+	prog_fd = load_with_stats(reject, ARRAY_SIZE(reject), &stats);
+	if (prog_fd >= 0) {
+		printf("FAIL\nunexpected success to load\n");
+		close(prog_fd);
+		return 1;
+	}
+	if (stats.insn_processed != 1) {
+		printf("FAIL\nunexpected stats of rejected prog: %u insns\n",
+		       stats.insn_processed);
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
+
 static int test(void)
 {
 	int prog_fd, i, pass_cnt = 0, err_cnt = 0;
@@ -2438,9 +2903,11 @@ static int test(void)
 		int *fixup = tests[i].fixup;
 		int *prog_array_fixup = tests[i].prog_array_fixup;
 		int *test_val_map_fixup = tests[i].test_val_map_fixup;
+		int *map_in_map_fixup = tests[i].map_in_map_fixup;
 		int expected_result;
 		const char *expected_errstr;
 		int map_fd = -1, prog_array_fd = -1, test_val_map_fd = -1;
+		int map_in_map_fd = -1;
 
 		if (*fixup) {
 			map_fd = create_map(sizeof(long long), 1024);
@@ -2469,6 +2936,16 @@ static int test(void)
 				test_val_map_fixup++;
 			} while (*test_val_map_fixup);
 		}
+		if (*map_in_map_fixup) {
+			/* Map-in-map lookups only make sense to root */
+			if (unpriv)
+				continue;
+			map_in_map_fd = create_map_in_map();
+			do {
+				prog[*map_in_map_fixup].imm = map_in_map_fd;
+				map_in_map_fixup++;
+			} while (*map_in_map_fixup);
+		}
 
 		printf("#%d %s ", i, tests[i].descr);
 
@@ -2518,9 +2995,17 @@ fail:
 			close(prog_array_fd);
 		if (test_val_map_fd >= 0)
 			close(test_val_map_fd);
+		if (map_in_map_fd >= 0)
+			close(map_in_map_fd);
 		close(prog_fd);
 
 	}
+
+	if (test_stats())
+		err_cnt++;
+	else
+		pass_cnt++;
+
 	printf("Summary: %d PASSED, %d FAILED\n", pass_cnt, err_cnt);
 
 	return 0;
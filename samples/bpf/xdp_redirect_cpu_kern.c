@@ -0,0 +1,67 @@
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * Spread IPv4 packets over the CPUs listed in cpus_available by a hash
+ * of their addresses, everything else goes to the first one.
+ */
+#define KBUILD_MODNAME "foo"
+#include <uapi/linux/bpf.h>
+#include <linux/in.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include "bpf_helpers.h"
+
+#define MAX_CPUS 64
+
+struct bpf_map_def SEC("maps") cpu_map = {
+	.type = BPF_MAP_TYPE_CPUMAP,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u32),
+	.max_entries = MAX_CPUS,
+};
+
+/* index -> cpu, the first cpus_count entries are valid */
+struct bpf_map_def SEC("maps") cpus_available = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u32),
+	.max_entries = MAX_CPUS,
+};
+
+struct bpf_map_def SEC("maps") cpus_count = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u32),
+	.max_entries = 1,
+};
+
+SEC("xdp_cpu_map")
+int xdp_redirect_cpu_prog(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	void *data = (void *)(long)ctx->data;
+	struct ethhdr *eth = data;
+	struct iphdr *iph = data + sizeof(*eth);
+	u32 key = 0, hash = 0;
+	u32 *count, *cpu;
+
+	if (data + sizeof(*eth) > data_end)
+		return XDP_DROP;
+
+	count = bpf_map_lookup_elem(&cpus_count, &key);
+	if (!count || !*count)
+		return XDP_PASS;
+
+	if (eth->h_proto == htons(ETH_P_IP) && (void *)(iph + 1) <= data_end)
+		hash = iph->saddr ^ iph->daddr;
+
+	key = hash % *count;
+	cpu = bpf_map_lookup_elem(&cpus_available, &key);
+	if (!cpu)
+		return XDP_ABORTED;
+
+	return bpf_redirect_map(&cpu_map, *cpu, 0);
+}
+
+char _license[] SEC("license") = "GPL";
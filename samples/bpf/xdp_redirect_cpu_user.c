@@ -0,0 +1,111 @@
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include "bpf_load.h"
+#include "libbpf.h"
+
+#define MAX_CPUS 64
+
+static int ifindex;
+static __u32 xdp_flags;
+
+static void int_exit(int sig)
+{
+	set_link_xdp_fd(ifindex, -1, xdp_flags);
+	exit(0);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [OPTS] IFINDEX\n\n"
+		"OPTS:\n"
+		"    -S        use skb-mode (generic XDP)\n"
+		"    -c CPU    steer packets to CPU, may be repeated\n"
+		"    -q QSIZE  remote backlog limit (default 1000)\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	__u32 cpus[MAX_CPUS], qsize = 1000;
+	const char *optstr = "Sc:q:";
+	char filename[256];
+	__u32 count = 0, i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, optstr)) != -1) {
+		switch (opt) {
+		case 'S':
+			xdp_flags |= XDP_FLAGS_SKB_MODE;
+			break;
+		case 'c':
+			if (count == MAX_CPUS) {
+				fprintf(stderr, "too many cpus\n");
+				return 1;
+			}
+			cpus[count++] = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			qsize = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(basename(argv[0]));
+			return 1;
+		}
+	}
+
+	if (optind == argc || !count) {
+		usage(basename(argv[0]));
+		return 1;
+	}
+
+	ifindex = strtoul(argv[optind], NULL, 0);
+
+	snprintf(filename, sizeof(filename), "%s_kern.o", argv[0]);
+
+	if (load_bpf_file(filename)) {
+		printf("%s", bpf_log_buf);
+		return 1;
+	}
+
+	if (!prog_fd[0]) {
+		printf("load_bpf_file: %s\n", strerror(errno));
+		return 1;
+	}
+
+	/* map_fd[0] cpu_map, [1] cpus_available, [2] cpus_count */
+	for (i = 0; i < count; i++) {
+		if (bpf_update_elem(map_fd[0], &cpus[i], &qsize, 0) ||
+		    bpf_update_elem(map_fd[1], &i, &cpus[i], 0)) {
+			printf("cpu %u: %s\n", cpus[i], strerror(errno));
+			return 1;
+		}
+	}
+	i = 0;
+	if (bpf_update_elem(map_fd[2], &i, &count, 0)) {
+		printf("bpf_update_elem: %s\n", strerror(errno));
+		return 1;
+	}
+
+	signal(SIGINT, int_exit);
+
+	if (set_link_xdp_fd(ifindex, prog_fd[0], xdp_flags) < 0) {
+		printf("link set xdp fd failed\n");
+		return 1;
+	}
+
+	pause();
+
+	return 0;
+}
@@ -0,0 +1,372 @@
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * Receive into, or transmit from, an AF_XDP socket bound to one queue
+ * of a device and report the packet rate.
+ */
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/if_ether.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <poll.h>
+#include <time.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "bpf_load.h"
+#include "libbpf.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#define NUM_FRAMES	4096
+#define FRAME_SIZE	2048
+#define NUM_DESCS	1024
+#define BATCH_SIZE	16
+
+#define barrier()	__asm__ __volatile__("" : : : "memory")
+
+enum benchmark_type {
+	BENCH_RXDROP = 0,
+	BENCH_TXONLY = 1,
+};
+
+struct xdp_uqueue {
+	__u32 cached_prod;
+	__u32 cached_cons;
+	__u32 mask;
+	__u32 size;
+	__u32 *producer;
+	__u32 *consumer;
+	void *ring;
+	void *map;
+	size_t map_len;
+};
+
+static enum benchmark_type opt_bench = BENCH_RXDROP;
+static __u32 opt_xdp_flags;
+static const char *opt_if = "";
+static int opt_ifindex;
+static int opt_queue;
+static char *bufs;
+static unsigned long pkts;
+
+/* A minimal Ethernet/IPv4/UDP frame, sent as is in txonly mode */
+static const char pkt_data[] =
+	"\x3c\xfd\xfe\x9e\x7f\x71\xec\xb1\xd7\x98\x3a\xc0\x08\x00\x45\x00"
+	"\x00\x2e\x00\x00\x00\x00\x40\x11\x88\x97\x05\x08\x07\x08\xc8\x14"
+	"\x1e\x04\x10\x92\x10\x92\x00\x1a\x6d\xa3\x34\x33\x1f\x69\x40\x6b"
+	"\x54\x59\xb6\x14\x2d\x11\x44\xbf\xaf\xd9\xbe\xaa";
+
+static void int_exit(int sig)
+{
+	set_link_xdp_fd(opt_ifindex, -1, opt_xdp_flags);
+	exit(0);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [OPTS] -i IFNAME\n\n"
+		"OPTS:\n"
+		"    -r    rxdrop: drop all received packets (default)\n"
+		"    -t    txonly: send the same packet over and over\n"
+		"    -q N  queue to bind to (default 0)\n"
+		"    -S    use skb-mode (generic XDP)\n",
+		prog);
+}
+
+static void *xq_map(int fd, struct xdp_uqueue *q, __u64 pgoff,
+		    struct xdp_ring_offset *off, size_t desc_size, __u32 size)
+{
+	q->map_len = off->desc + size * desc_size;
+	q->map = mmap(NULL, q->map_len, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_POPULATE, fd, pgoff);
+	if (q->map == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	q->producer = q->map + off->producer;
+	q->consumer = q->map + off->consumer;
+	q->ring = q->map + off->desc;
+	q->mask = size - 1;
+	q->size = size;
+	return q->ring;
+}
+
+static void setopt(int fd, int opt, const void *val, socklen_t len)
+{
+	if (setsockopt(fd, SOL_XDP, opt, val, len)) {
+		perror("setsockopt");
+		exit(1);
+	}
+}
+
+static int xsk_configure(struct xdp_uqueue *fq, struct xdp_uqueue *cq,
+			 struct xdp_uqueue *rx, struct xdp_uqueue *tx)
+{
+	struct sockaddr_xdp sxdp = {};
+	struct xdp_mmap_offsets off;
+	struct xdp_umem_reg mr;
+	socklen_t optlen;
+	int ndescs = NUM_DESCS;
+	__u64 *fill;
+	int fd, i;
+
+	fd = socket(AF_XDP, SOCK_RAW, 0);
+	if (fd < 0) {
+		perror("socket");
+		exit(1);
+	}
+
+	if (posix_memalign((void **)&bufs, getpagesize(),
+			   NUM_FRAMES * FRAME_SIZE)) {
+		perror("posix_memalign");
+		exit(1);
+	}
+
+	mr.addr = (__u64)(unsigned long)bufs;
+	mr.len = NUM_FRAMES * FRAME_SIZE;
+	mr.chunk_size = FRAME_SIZE;
+	mr.headroom = 0;
+
+	setopt(fd, XDP_UMEM_REG, &mr, sizeof(mr));
+	setopt(fd, XDP_UMEM_FILL_RING, &ndescs, sizeof(ndescs));
+	setopt(fd, XDP_UMEM_COMPLETION_RING, &ndescs, sizeof(ndescs));
+	if (opt_bench == BENCH_RXDROP)
+		setopt(fd, XDP_RX_RING, &ndescs, sizeof(ndescs));
+	else
+		setopt(fd, XDP_TX_RING, &ndescs, sizeof(ndescs));
+
+	optlen = sizeof(off);
+	if (getsockopt(fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen)) {
+		perror("getsockopt");
+		exit(1);
+	}
+
+	fill = xq_map(fd, fq, XDP_UMEM_PGOFF_FILL_RING, &off.fr,
+		      sizeof(__u64), NUM_DESCS);
+	xq_map(fd, cq, XDP_UMEM_PGOFF_COMPLETION_RING, &off.cr,
+	       sizeof(__u64), NUM_DESCS);
+	if (opt_bench == BENCH_RXDROP)
+		xq_map(fd, rx, XDP_PGOFF_RX_RING, &off.rx,
+		       sizeof(struct xdp_desc), NUM_DESCS);
+	else
+		xq_map(fd, tx, XDP_PGOFF_TX_RING, &off.tx,
+		       sizeof(struct xdp_desc), NUM_DESCS);
+
+	if (opt_bench == BENCH_RXDROP) {
+		/* hand the first NUM_DESCS frames to the kernel */
+		for (i = 0; i < NUM_DESCS; i++)
+			fill[i] = (__u64)i * FRAME_SIZE;
+		barrier();
+		*fq->producer = NUM_DESCS;
+		fq->cached_prod = NUM_DESCS;
+	} else {
+		for (i = 0; i < NUM_FRAMES; i++)
+			memcpy(bufs + i * FRAME_SIZE, pkt_data,
+			       sizeof(pkt_data) - 1);
+	}
+
+	sxdp.sxdp_family = AF_XDP;
+	sxdp.sxdp_ifindex = opt_ifindex;
+	sxdp.sxdp_queue_id = opt_queue;
+	sxdp.sxdp_flags = XDP_COPY;
+	if (bind(fd, (struct sockaddr *)&sxdp, sizeof(sxdp))) {
+		perror("bind");
+		exit(1);
+	}
+
+	return fd;
+}
+
+static void rx_drop(int fd, struct xdp_uqueue *fq, struct xdp_uqueue *rx)
+{
+	struct xdp_desc *descs = rx->ring;
+	__u64 *fill = fq->ring;
+	__u32 prod, n, i;
+
+	prod = *(volatile __u32 *)rx->producer;
+	barrier();
+	n = prod - rx->cached_cons;
+	if (!n)
+		return;
+
+	for (i = 0; i < n; i++) {
+		struct xdp_desc *d = &descs[(rx->cached_cons + i) & rx->mask];
+
+		/* recycle the frame straight back to the fill ring */
+		fill[fq->cached_prod++ & fq->mask] = d->addr;
+	}
+
+	rx->cached_cons += n;
+	barrier();
+	*rx->consumer = rx->cached_cons;
+	*fq->producer = fq->cached_prod;
+	pkts += n;
+}
+
+static void tx_only(int fd, struct xdp_uqueue *cq, struct xdp_uqueue *tx,
+		    __u32 *frame)
+{
+	struct xdp_desc *descs = tx->ring;
+	__u32 prod, n, i;
+
+	/* reap completed frames */
+	prod = *(volatile __u32 *)cq->producer;
+	barrier();
+	n = prod - cq->cached_cons;
+	if (n) {
+		cq->cached_cons += n;
+		barrier();
+		*cq->consumer = cq->cached_cons;
+		pkts += n;
+	}
+
+	n = tx->size - (tx->cached_prod - *(volatile __u32 *)tx->consumer);
+	if (n > BATCH_SIZE)
+		n = BATCH_SIZE;
+
+	for (i = 0; i < n; i++) {
+		struct xdp_desc *d = &descs[tx->cached_prod++ & tx->mask];
+
+		d->addr = (__u64)*frame * FRAME_SIZE;
+		d->len = sizeof(pkt_data) - 1;
+		d->options = 0;
+		*frame = (*frame + 1) % NUM_FRAMES;
+	}
+
+	barrier();
+	*tx->producer = tx->cached_prod;
+
+	if (sendto(fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+	    errno != EAGAIN && errno != ENOBUFS) {
+		perror("sendto");
+		exit(1);
+	}
+}
+
+static unsigned long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+int main(int argc, char **argv)
+{
+	struct xdp_uqueue fq = {}, cq = {}, rx = {}, tx = {};
+	struct rlimit r = {RLIM_INFINITY, RLIM_INFINITY};
+	const char *optstr = "rtq:i:S";
+	unsigned long last, prev = 0;
+	char filename[256];
+	__u32 frame = 0;
+	int key = 0;
+	int opt, fd;
+
+	while ((opt = getopt(argc, argv, optstr)) != -1) {
+		switch (opt) {
+		case 'r':
+			opt_bench = BENCH_RXDROP;
+			break;
+		case 't':
+			opt_bench = BENCH_TXONLY;
+			break;
+		case 'q':
+			opt_queue = atoi(optarg);
+			break;
+		case 'i':
+			opt_if = optarg;
+			break;
+		case 'S':
+			opt_xdp_flags |= XDP_FLAGS_SKB_MODE;
+			break;
+		default:
+			usage(basename(argv[0]));
+			return 1;
+		}
+	}
+
+	if (setrlimit(RLIMIT_MEMLOCK, &r)) {
+		perror("setrlimit(RLIMIT_MEMLOCK)");
+		return 1;
+	}
+
+	opt_ifindex = if_nametoindex(opt_if);
+	if (!opt_ifindex) {
+		usage(basename(argv[0]));
+		return 1;
+	}
+
+	fd = xsk_configure(&fq, &cq, &rx, &tx);
+
+	if (opt_bench == BENCH_RXDROP) {
+		snprintf(filename, sizeof(filename), "%s_kern.o", argv[0]);
+
+		if (load_bpf_file(filename)) {
+			printf("%s", bpf_log_buf);
+			return 1;
+		}
+
+		if (!prog_fd[0]) {
+			printf("load_bpf_file: %s\n", strerror(errno));
+			return 1;
+		}
+
+		if (bpf_update_elem(map_fd[0], &key, &fd, 0)) {
+			printf("bpf_update_elem: %s\n", strerror(errno));
+			return 1;
+		}
+
+		signal(SIGINT, int_exit);
+
+		if (set_link_xdp_fd(opt_ifindex, prog_fd[0],
+				    opt_xdp_flags) < 0) {
+			printf("link set xdp fd failed\n");
+			return 1;
+		}
+	}
+
+	last = now_ms();
+	for (;;) {
+		struct pollfd pfd = { .fd = fd };
+		unsigned long t;
+
+		if (opt_bench == BENCH_RXDROP) {
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, 1000) > 0)
+				rx_drop(fd, &fq, &rx);
+		} else {
+			tx_only(fd, &cq, &tx, &frame);
+		}
+
+		t = now_ms();
+		if (t - last >= 1000) {
+			printf("%s queue %d %s: %10lu pkt/s\n", opt_if,
+			       opt_queue,
+			       opt_bench == BENCH_RXDROP ? "rxdrop" : "txonly",
+			       (pkts - prev) * 1000 / (t - last));
+			prev = pkts;
+			last = t;
+		}
+	}
+
+	return 0;
+}
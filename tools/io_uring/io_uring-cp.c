@@ -0,0 +1,474 @@
+/*
+ * Simple test program that demonstrates a file copy through io_uring. This
+ * uses the API exposed to applications directly, without any library on
+ * top, to show how the shared rings are set up and driven.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/fs.h>
+#include <linux/io_uring.h>
+
+#define QD	64
+#define BS	(32*1024)
+
+/*
+ * Full barriers are stronger than what is needed on most architectures,
+ * but keep the example portable.
+ */
+#define read_barrier()	__sync_synchronize()
+#define write_barrier()	__sync_synchronize()
+
+struct app_sq_ring {
+	unsigned *head;
+	unsigned *tail;
+	unsigned *ring_mask;
+	unsigned *ring_entries;
+	unsigned *flags;
+	unsigned *array;
+};
+
+struct app_cq_ring {
+	unsigned *head;
+	unsigned *tail;
+	unsigned *ring_mask;
+	unsigned *ring_entries;
+	struct io_uring_cqe *cqes;
+};
+
+struct ring {
+	int ring_fd;
+	unsigned flags;
+	struct app_sq_ring sq_ring;
+	struct io_uring_sqe *sqes;
+	struct app_cq_ring cq_ring;
+	unsigned sqe_tail;
+};
+
+struct io_data {
+	int read;
+	off_t first_offset, offset;
+	size_t first_len;
+	struct iovec iov;
+};
+
+static int infd, outfd;
+static int fixed;
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+			  unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg,
+			     unsigned nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int setup_ring(struct ring *r, unsigned entries, unsigned flags)
+{
+	struct app_sq_ring *sring = &r->sq_ring;
+	struct app_cq_ring *cring = &r->cq_ring;
+	struct io_uring_params p;
+	void *ptr;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = flags;
+	r->ring_fd = io_uring_setup(entries, &p);
+	if (r->ring_fd < 0) {
+		perror("io_uring_setup");
+		return 1;
+	}
+	r->flags = flags;
+
+	ptr = mmap(0, p.sq_off.array + p.sq_entries * sizeof(__u32),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			r->ring_fd, IORING_OFF_SQ_RING);
+	if (ptr == MAP_FAILED) {
+		perror("mmap sq ring");
+		return 1;
+	}
+	sring->head = ptr + p.sq_off.head;
+	sring->tail = ptr + p.sq_off.tail;
+	sring->ring_mask = ptr + p.sq_off.ring_mask;
+	sring->ring_entries = ptr + p.sq_off.ring_entries;
+	sring->flags = ptr + p.sq_off.flags;
+	sring->array = ptr + p.sq_off.array;
+	r->sqe_tail = *sring->tail;
+
+	r->sqes = mmap(0, p.sq_entries * sizeof(struct io_uring_sqe),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			r->ring_fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) {
+		perror("mmap sqes");
+		return 1;
+	}
+
+	ptr = mmap(0, p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			r->ring_fd, IORING_OFF_CQ_RING);
+	if (ptr == MAP_FAILED) {
+		perror("mmap cq ring");
+		return 1;
+	}
+	cring->head = ptr + p.cq_off.head;
+	cring->tail = ptr + p.cq_off.tail;
+	cring->ring_mask = ptr + p.cq_off.ring_mask;
+	cring->ring_entries = ptr + p.cq_off.ring_entries;
+	cring->cqes = ptr + p.cq_off.cqes;
+	return 0;
+}
+
+static struct io_uring_sqe *get_sqe(struct ring *r)
+{
+	struct app_sq_ring *sring = &r->sq_ring;
+	unsigned next = r->sqe_tail + 1;
+	struct io_uring_sqe *sqe;
+
+	read_barrier();
+	if (next - *sring->head > *sring->ring_entries)
+		return NULL;
+
+	sqe = &r->sqes[r->sqe_tail & *sring->ring_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	sring->array[r->sqe_tail & *sring->ring_mask] =
+		r->sqe_tail & *sring->ring_mask;
+	r->sqe_tail = next;
+	return sqe;
+}
+
+/*
+ * Publish the queued sqes to the kernel. Returns the number of sqes the
+ * kernel should be told about through io_uring_enter(2), which is none when
+ * the SQ thread is running and doesn't need a wakeup call.
+ */
+static unsigned flush_sq(struct ring *r, unsigned *enter_flags)
+{
+	struct app_sq_ring *sring = &r->sq_ring;
+	unsigned submitted = r->sqe_tail - *sring->tail;
+
+	if (!submitted)
+		return 0;
+
+	/* order sqe and array stores with the tail update */
+	write_barrier();
+	*sring->tail = r->sqe_tail;
+	write_barrier();
+
+	if (!(r->flags & IORING_SETUP_SQPOLL))
+		return submitted;
+
+	/* the kernel thread may have gone to sleep, check the flag */
+	if (*sring->flags & IORING_SQ_NEED_WAKEUP)
+		*enter_flags |= IORING_ENTER_SQ_WAKEUP;
+	return 0;
+}
+
+static int submit_and_wait(struct ring *r, unsigned wait_nr)
+{
+	unsigned flags = 0;
+	unsigned to_submit;
+	int ret;
+
+	to_submit = flush_sq(r, &flags);
+	if (wait_nr)
+		flags |= IORING_ENTER_GETEVENTS;
+	if (!to_submit && !flags)
+		return 0;
+
+	ret = io_uring_enter(r->ring_fd, to_submit, wait_nr, flags);
+	if (ret < 0) {
+		perror("io_uring_enter");
+		return ret;
+	}
+	return 0;
+}
+
+static struct io_uring_cqe *peek_cqe(struct ring *r)
+{
+	struct app_cq_ring *cring = &r->cq_ring;
+	unsigned head = *cring->head;
+
+	read_barrier();
+	if (head == *cring->tail)
+		return NULL;
+	return &cring->cqes[head & *cring->ring_mask];
+}
+
+static void cqe_seen(struct ring *r)
+{
+	struct app_cq_ring *cring = &r->cq_ring;
+
+	/* done reading the cqe before the kernel may reuse it */
+	write_barrier();
+	(*cring->head)++;
+	write_barrier();
+}
+
+static int get_file_size(int fd, off_t *size)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) < 0)
+		return -1;
+	if (S_ISREG(st.st_mode)) {
+		*size = st.st_size;
+		return 0;
+	} else if (S_ISBLK(st.st_mode)) {
+		unsigned long long bytes;
+
+		if (ioctl(fd, BLKGETSIZE64, &bytes) != 0)
+			return -1;
+
+		*size = bytes;
+		return 0;
+	}
+
+	return -1;
+}
+
+static void queue_prepped(struct ring *r, struct io_data *data)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = get_sqe(r);
+	assert(sqe);
+
+	sqe->opcode = data->read ? IORING_OP_READV : IORING_OP_WRITEV;
+	sqe->fd = data->read ? infd : outfd;
+	if (fixed) {
+		sqe->fd = data->read ? 0 : 1;
+		sqe->flags = IOSQE_FIXED_FILE;
+	}
+	sqe->off = data->offset;
+	sqe->addr = (unsigned long) &data->iov;
+	sqe->len = 1;
+	sqe->user_data = (unsigned long) data;
+}
+
+static int queue_read(struct ring *r, off_t size, off_t offset)
+{
+	struct io_data *data;
+
+	data = malloc(size + sizeof(*data));
+	if (!data)
+		return 1;
+
+	data->read = 1;
+	data->offset = data->first_offset = offset;
+	data->iov.iov_base = data + 1;
+	data->iov.iov_len = size;
+	data->first_len = size;
+
+	queue_prepped(r, data);
+	return 0;
+}
+
+static void queue_write(struct ring *r, struct io_data *data)
+{
+	data->read = 0;
+	data->offset = data->first_offset;
+
+	data->iov.iov_base = data + 1;
+	data->iov.iov_len = data->first_len;
+
+	queue_prepped(r, data);
+}
+
+static int copy_file(struct ring *r, off_t insize)
+{
+	unsigned long reads, writes;
+	struct io_uring_cqe *cqe;
+	off_t write_left, offset;
+
+	write_left = insize;
+	writes = reads = offset = 0;
+
+	while (insize || write_left) {
+		unsigned long had_reads;
+		int got_comp;
+
+		/*
+		 * Queue up as many reads as we can
+		 */
+		had_reads = reads;
+		while (insize) {
+			off_t this_size = insize;
+
+			if (reads + writes >= QD)
+				break;
+			if (this_size > BS)
+				this_size = BS;
+			else if (!this_size)
+				break;
+
+			if (queue_read(r, this_size, offset))
+				break;
+
+			insize -= this_size;
+			offset += this_size;
+			reads++;
+		}
+
+		if (had_reads != reads || writes) {
+			if (submit_and_wait(r, 0) < 0)
+				return 1;
+		}
+
+		/*
+		 * Queue is full at this point. Find at least one completion.
+		 */
+		got_comp = 0;
+		while (write_left) {
+			struct io_data *data;
+
+			cqe = peek_cqe(r);
+			if (!cqe) {
+				if (got_comp)
+					break;
+				if (submit_and_wait(r, 1) < 0)
+					return 1;
+				continue;
+			}
+
+			data = (struct io_data *) (unsigned long) cqe->user_data;
+			if (cqe->res < 0) {
+				if (cqe->res == -ECANCELED) {
+					queue_prepped(r, data);
+					cqe_seen(r);
+					continue;
+				}
+				fprintf(stderr, "cqe failed: %s\n",
+						strerror(-cqe->res));
+				return 1;
+			} else if ((size_t) cqe->res != data->iov.iov_len) {
+				/* Short read/write, adjust and requeue */
+				data->iov.iov_base += cqe->res;
+				data->iov.iov_len -= cqe->res;
+				data->offset += cqe->res;
+				queue_prepped(r, data);
+				cqe_seen(r);
+				continue;
+			}
+
+			/*
+			 * All done. if write, nothing else to do. if read,
+			 * queue up corresponding write.
+			 */
+			if (data->read) {
+				queue_write(r, data);
+				write_left -= data->first_len;
+				reads--;
+				writes++;
+			} else {
+				free(data);
+				writes--;
+			}
+			cqe_seen(r);
+			got_comp = 1;
+		}
+	}
+
+	/* reap the writes still in flight */
+	while (writes) {
+		struct io_data *data;
+
+		if (submit_and_wait(r, 1) < 0)
+			return 1;
+		while ((cqe = peek_cqe(r)) != NULL) {
+			data = (struct io_data *) (unsigned long) cqe->user_data;
+			if (cqe->res < 0) {
+				fprintf(stderr, "write failed: %s\n",
+						strerror(-cqe->res));
+				return 1;
+			}
+			free(data);
+			writes--;
+			cqe_seen(r);
+		}
+	}
+
+	return 0;
+}
+
+static int usage(const char *argv0)
+{
+	printf("%s: [-p] infile outfile\n", argv0);
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned setup_flags = 0;
+	struct ring ring;
+	off_t insize;
+	int ret, opt;
+
+	while ((opt = getopt(argc, argv, "p")) != -1) {
+		switch (opt) {
+		case 'p':
+			setup_flags |= IORING_SETUP_SQPOLL;
+			break;
+		default:
+			return usage(argv[0]);
+		}
+	}
+	if (argc - optind < 2)
+		return usage(argv[0]);
+
+	infd = open(argv[optind], O_RDONLY);
+	if (infd < 0) {
+		perror("open infile");
+		return 1;
+	}
+	outfd = open(argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (outfd < 0) {
+		perror("open outfile");
+		return 1;
+	}
+
+	if (setup_ring(&ring, QD, setup_flags))
+		return 1;
+
+	/* the SQ thread can only use registered files */
+	if (setup_flags & IORING_SETUP_SQPOLL) {
+		int fds[2] = { infd, outfd };
+
+		ret = io_uring_register(ring.ring_fd, IORING_REGISTER_FILES,
+					fds, 2);
+		if (ret < 0) {
+			perror("io_uring_register");
+			return 1;
+		}
+		fixed = 1;
+	}
+
+	if (get_file_size(infd, &insize))
+		return 1;
+
+	ret = copy_file(&ring, insize);
+
+	close(infd);
+	close(outfd);
+	close(ring.ring_fd);
+	return ret;
+}
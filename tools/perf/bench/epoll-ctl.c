@@ -0,0 +1,296 @@
+/*
+ * epoll-ctl: Stress epoll_ctl(2) and the epoll RB tree.
+ *
+ * Each thread cycles its own set of nonblocking eventfds (or pipes) through
+ * EPOLL_CTL_ADD, EPOLL_CTL_MOD and EPOLL_CTL_DEL, either in order or, with
+ * --randomize, picking the next operation at random. By default all threads
+ * share one epoll instance, so they also contend on ep->mtx.
+ */
+
+/* For the CLR_() macros */
+#include <pthread.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+
+#include "../util/stat.h"
+#include <subcmd/parse-options.h>
+#include "bench.h"
+#include "epoll.h"
+
+#include <err.h>
+
+enum {
+	OP_EPOLL_ADD,
+	OP_EPOLL_MOD,
+	OP_EPOLL_DEL,
+	EPOLL_NR_OPS,
+};
+
+static const char * const op_names[EPOLL_NR_OPS] = { "ADD", "MOD", "DEL" };
+
+static unsigned int nthreads = 0;
+static unsigned int nsecs    = 8;
+/* amount of descriptors per thread */
+static unsigned int nfds     = 64;
+static bool multiq = false, done = false, silent = false, randomize = false;
+static bool pipes = false, edge = false, oneshot = false;
+
+static struct timeval start, end, runtime;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static struct stats all_stats[EPOLL_NR_OPS];
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int events_mask;
+
+struct worker {
+	int tid;
+	int epollfd;
+	struct epoll_bench_fd *fds;
+	pthread_t thread;
+	unsigned long ops[EPOLL_NR_OPS];
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads, "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime", &nsecs,    "Specify runtime (in seconds)"),
+	OPT_UINTEGER('f', "nfds",    &nfds,     "Specify amount of descriptors per thread"),
+	OPT_BOOLEAN( 'm', "multiq",  &multiq,   "Use an epoll instance per thread instead of a shared one"),
+	OPT_BOOLEAN( 'R', "randomize", &randomize, "Perform random operations on random descriptors"),
+	OPT_BOOLEAN( 'p', "pipes",   &pipes,    "Watch nonblocking pipes instead of eventfds"),
+	OPT_BOOLEAN( 'E', "edge",    &edge,     "Register edge-triggered events (EPOLLET)"),
+	OPT_BOOLEAN( 'O', "oneshot", &oneshot,  "Register events with EPOLLONESHOT"),
+	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_ctl_usage[] = {
+	"perf bench epoll ctl <options>",
+	NULL
+};
+
+static void do_epoll_op(struct worker *w, int op, unsigned int i)
+{
+	struct epoll_event ev;
+	int ret, fd = w->fds[i].rfd;
+
+	ev.events = events_mask;
+	ev.data.u32 = i;
+
+	switch (op) {
+	case OP_EPOLL_ADD:
+		ret = epoll_ctl(w->epollfd, EPOLL_CTL_ADD, fd, &ev);
+		break;
+	case OP_EPOLL_MOD:
+		/* flip EPOLLOUT so the modification is never a no-op */
+		ev.events |= (w->ops[OP_EPOLL_MOD] & 1) ? EPOLLOUT : 0;
+		ret = epoll_ctl(w->epollfd, EPOLL_CTL_MOD, fd, &ev);
+		break;
+	case OP_EPOLL_DEL:
+	default:
+		ret = epoll_ctl(w->epollfd, EPOLL_CTL_DEL, fd, NULL);
+		break;
+	}
+
+	/* random operations are expected to hit EEXIST and ENOENT */
+	if (!ret)
+		w->ops[op]++;
+	else if (!randomize || (errno != EEXIST && errno != ENOENT))
+		err(EXIT_FAILURE, "epoll_ctl(%s)", op_names[op]);
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	unsigned int i, seed = w->tid;
+	int op;
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	do {
+		if (randomize) {
+			i = rand_r(&seed) % nfds;
+			op = rand_r(&seed) % EPOLL_NR_OPS;
+			do_epoll_op(w, op, i);
+			continue;
+		}
+
+		for (op = 0; op < EPOLL_NR_OPS; op++) {
+			for (i = 0; i < nfds && !done; i++)
+				do_epoll_op(w, op, i);
+			if (done)
+				break;
+		}
+	} while (!done);
+
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+static void print_summary(void)
+{
+	int op;
+
+	printf("\n");
+	for (op = 0; op < EPOLL_NR_OPS; op++) {
+		unsigned long avg = avg_stats(&all_stats[op]);
+		double stddev = stddev_stats(&all_stats[op]);
+
+		printf("Averaged %ld %s operations/sec per thread (+- %.2f%%), total secs = %d\n",
+		       avg, op_names[op], rel_stddev_stats(stddev, avg),
+		       (int) runtime.tv_sec);
+	}
+}
+
+int bench_epoll_ctl(int argc, const char **argv,
+		    const char *prefix __maybe_unused)
+{
+	int ret = 0, epollfd = -1;
+	cpu_set_t cpu;
+	struct sigaction act;
+	unsigned int i, j, ncpus;
+	int op;
+	pthread_attr_t thread_attr;
+	struct worker *worker = NULL;
+
+	argc = parse_options(argc, argv, options, bench_epoll_ctl_usage, 0);
+	if (argc) {
+		usage_with_options(bench_epoll_ctl_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = ncpus;
+	if (!nfds)
+		nfds = 1;
+
+	events_mask = EPOLLIN;
+	if (edge)
+		events_mask |= EPOLLET;
+	if (oneshot)
+		events_mask |= EPOLLONESHOT;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		goto errmem;
+
+	printf("Run summary [PID %d]: %d threads doing epoll_ctl ops on %d %s each, %s epoll instance(s), for %d secs.\n\n",
+	       getpid(), nthreads, nfds, pipes ? "pipes" : "eventfds",
+	       multiq ? "per-thread" : "shared", nsecs);
+
+	for (op = 0; op < EPOLL_NR_OPS; op++)
+		init_stats(&all_stats[op]);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	pthread_attr_init(&thread_attr);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nthreads; i++) {
+		if (multiq || epollfd < 0) {
+			epollfd = epoll_create1(0);
+			if (epollfd < 0)
+				err(EXIT_FAILURE, "epoll_create1");
+		}
+
+		worker[i].tid = i;
+		worker[i].epollfd = epollfd;
+		worker[i].fds = calloc(nfds, sizeof(*worker[i].fds));
+		if (!worker[i].fds)
+			goto errmem;
+
+		for (j = 0; j < nfds; j++) {
+			if (epoll_bench_fd_open(&worker[i].fds[j], pipes))
+				err(EXIT_FAILURE, pipes ? "pipe2" : "eventfd");
+		}
+
+		CPU_ZERO(&cpu);
+		CPU_SET(i % ncpus, &cpu);
+
+		ret = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpu);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+
+		ret = pthread_create(&worker[i].thread, &thread_attr, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	pthread_attr_destroy(&thread_attr);
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* cleanup & report results */
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t[EPOLL_NR_OPS];
+
+		for (op = 0; op < EPOLL_NR_OPS; op++) {
+			t[op] = worker[i].ops[op] / runtime.tv_sec;
+			update_stats(&all_stats[op], t[op]);
+		}
+
+		if (!silent)
+			printf("[thread %2d] fds: %d ... %d [ add: %ld ops/sec, mod: %ld ops/sec, del: %ld ops/sec ]\n",
+			       worker[i].tid, worker[i].fds[0].rfd,
+			       worker[i].fds[nfds - 1].rfd,
+			       t[OP_EPOLL_ADD], t[OP_EPOLL_MOD], t[OP_EPOLL_DEL]);
+
+		for (j = 0; j < nfds; j++)
+			epoll_bench_fd_close(&worker[i].fds[j]);
+		if (multiq || i == nthreads - 1)
+			close(worker[i].epollfd);
+
+		free(worker[i].fds);
+	}
+
+	print_summary();
+
+	free(worker);
+	return ret;
+errmem:
+	err(EXIT_FAILURE, "calloc");
+}
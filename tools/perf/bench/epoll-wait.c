@@ -0,0 +1,436 @@
+/*
+ * epoll-wait: Stress the epoll ready list from many CPUs at once.
+ *
+ * A set of writer threads keeps signalling nonblocking eventfds (or pipes),
+ * all of which are watched by a single epoll instance, while waiter threads
+ * harvest the events with epoll_wait(). Every write runs ep_poll_callback()
+ * on the writer's CPU, so with enough writers this measures how well
+ * wakeups scale against each other and against the waiters transferring
+ * events to userspace. Use as many threads as there are CPUs, or more.
+ *
+ * The time from the first signal of a descriptor to a waiter draining it is
+ * collected into a log2 histogram of wakeup latencies.
+ */
+
+/* For the CLR_() macros */
+#include <pthread.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+
+#include "../util/stat.h"
+#include <subcmd/parse-options.h>
+#include "bench.h"
+#include "epoll.h"
+
+#include <err.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE	(1u << 28)
+#endif
+
+/* bucket 0 is < 1 usec, bucket n is [2^(n-1), 2^n) usecs */
+#define LAT_BUCKETS	24
+
+static unsigned int nthreads = 0;
+static unsigned int nwriters = 0;
+static unsigned int nsecs    = 8;
+/* amount of descriptors per waiter thread */
+static unsigned int nfds     = 64;
+static bool multiq = false, done = false, silent = false;
+static bool pipes = false, edge = false, oneshot = false, exclusive = false;
+
+static struct timeval start, end, runtime;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static struct stats throughput_stats;
+static pthread_cond_t thread_parent, thread_worker;
+
+static struct epoll_bench_fd *fds;
+/* CLOCK_MONOTONIC ns of the first signal not yet drained, per descriptor */
+static unsigned long long *stamps;
+static unsigned int events_mask;
+
+struct worker {
+	int tid;
+	int epollfd;
+	unsigned int first, nfds;	/* slice of fds[] */
+	pthread_t thread;
+	unsigned long ops;
+	unsigned long lat_hist[LAT_BUCKETS];
+	unsigned long long lat_total;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads, "Specify amount of waiter threads"),
+	OPT_UINTEGER('w', "writers", &nwriters, "Specify amount of writer threads"),
+	OPT_UINTEGER('r', "runtime", &nsecs,    "Specify runtime (in seconds)"),
+	OPT_UINTEGER('f', "nfds",    &nfds,     "Specify amount of descriptors per waiter thread"),
+	OPT_BOOLEAN( 'm', "multiq",  &multiq,   "Use an epoll instance per waiter thread instead of a shared one"),
+	OPT_BOOLEAN( 'p', "pipes",   &pipes,    "Watch nonblocking pipes instead of eventfds"),
+	OPT_BOOLEAN( 'E', "edge",    &edge,     "Use edge-triggered events (EPOLLET)"),
+	OPT_BOOLEAN( 'O', "oneshot", &oneshot,  "Use EPOLLONESHOT, re-arming after every event"),
+	OPT_BOOLEAN( 'X', "exclusive", &exclusive, "Watch every descriptor from every instance with EPOLLEXCLUSIVE (needs --multiq)"),
+	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_wait_usage[] = {
+	"perf bench epoll wait <options>",
+	NULL
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void wait_for_start(void)
+{
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+}
+
+static void account_latency(struct worker *w, unsigned int slot)
+{
+	unsigned long long stamp, usecs;
+	unsigned int bucket = 0;
+
+	stamp = __sync_lock_test_and_set(&stamps[slot], 0);
+	if (!stamp)
+		return;
+
+	usecs = (now_ns() - stamp) / 1000;
+	w->lat_total += usecs;
+	while (usecs && bucket < LAT_BUCKETS - 1) {
+		usecs >>= 1;
+		bucket++;
+	}
+	w->lat_hist[bucket]++;
+}
+
+static void *waiterfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	struct epoll_event ev;
+	unsigned int slot;
+	int ret;
+
+	wait_for_start();
+
+	do {
+		/* bounded sleep, so that we notice 'done' without a wakeup */
+		ret = epoll_wait(w->epollfd, &ev, 1, 100);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, "epoll_wait");
+		}
+		if (!ret)
+			continue;
+
+		/*
+		 * Level-triggered events on a shared instance may be reported
+		 * to several waiters; only the one draining the descriptor
+		 * counts it.
+		 */
+		slot = ev.data.u32;
+		if (epoll_bench_fd_drain(&fds[slot])) {
+			account_latency(w, slot);
+			w->ops++;
+		} else if (errno != EAGAIN && !silent) {
+			warn("read");
+		}
+
+		if (oneshot) {
+			ev.events = events_mask;
+			ev.data.u32 = slot;
+			if (epoll_ctl(w->epollfd, EPOLL_CTL_MOD,
+				      fds[slot].rfd, &ev))
+				err(EXIT_FAILURE, "epoll_ctl");
+		}
+	} while (!done);
+
+	return NULL;
+}
+
+static void *writerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	unsigned int i, slot;
+
+	wait_for_start();
+
+	do {
+		for (i = 0; i < w->nfds && !done; i++) {
+			slot = w->first + i;
+			/* only stamp the first signal that is not drained yet */
+			if (!stamps[slot])
+				__sync_val_compare_and_swap(&stamps[slot], 0,
+							    now_ns());
+			if (!epoll_bench_fd_signal(&fds[slot]))
+				w->ops++;
+		}
+	} while (!done);
+
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+static void print_histogram(struct worker *worker)
+{
+	unsigned long hist[LAT_BUCKETS] = { 0 }, nr = 0;
+	unsigned long long total = 0;
+	unsigned int i, b;
+
+	for (i = 0; i < nthreads; i++) {
+		for (b = 0; b < LAT_BUCKETS; b++)
+			hist[b] += worker[i].lat_hist[b];
+		total += worker[i].lat_total;
+	}
+	for (b = 0; b < LAT_BUCKETS; b++)
+		nr += hist[b];
+	if (!nr)
+		return;
+
+	printf("\nWakeup latency, averaged %llu usecs:\n", total / nr);
+	for (b = 0; b < LAT_BUCKETS; b++) {
+		if (!hist[b])
+			continue;
+		if (!b)
+			printf("  %9s <     1 usecs: %10lu (%6.2f%%)\n", "",
+			       hist[b], 100.0 * hist[b] / nr);
+		else if (b == LAT_BUCKETS - 1)
+			printf("  %9lu -   ... usecs: %10lu (%6.2f%%)\n",
+			       1UL << (b - 1), hist[b], 100.0 * hist[b] / nr);
+		else
+			printf("  %9lu - %5lu usecs: %10lu (%6.2f%%)\n",
+			       1UL << (b - 1), (1UL << b) - 1, hist[b],
+			       100.0 * hist[b] / nr);
+	}
+}
+
+static void print_summary(unsigned long writes)
+{
+	unsigned long avg = avg_stats(&throughput_stats);
+	double stddev = stddev_stats(&throughput_stats);
+
+	printf("%sAveraged %ld events/sec per waiter (+- %.2f%%), total secs = %d\n",
+	       !silent ? "\n" : "", avg, rel_stddev_stats(stddev, avg),
+	       (int) runtime.tv_sec);
+	printf("Writers signalled %ld descriptors/sec in total\n",
+	       writes / runtime.tv_sec);
+}
+
+static void start_thread(struct worker *w, unsigned int cpu_nr,
+			 void *(*fn)(void *), pthread_attr_t *thread_attr)
+{
+	cpu_set_t cpu;
+	int ret;
+
+	CPU_ZERO(&cpu);
+	CPU_SET(cpu_nr, &cpu);
+
+	ret = pthread_attr_setaffinity_np(thread_attr, sizeof(cpu_set_t), &cpu);
+	if (ret)
+		err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+
+	ret = pthread_create(&w->thread, thread_attr, fn, (void *) w);
+	if (ret)
+		err(EXIT_FAILURE, "pthread_create");
+}
+
+static void watch(int epollfd, unsigned int slot)
+{
+	struct epoll_event ev;
+
+	ev.events = events_mask;
+	ev.data.u32 = slot;
+	if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fds[slot].rfd, &ev))
+		err(EXIT_FAILURE, "epoll_ctl");
+}
+
+int bench_epoll_wait(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	int ret = 0, epollfd = -1;
+	struct sigaction act;
+	unsigned int i, j, ncpus, nr_fds, per_writer;
+	pthread_attr_t thread_attr;
+	struct worker *worker = NULL, *writer = NULL;
+	unsigned long writes = 0;
+
+	argc = parse_options(argc, argv, options, bench_epoll_wait_usage, 0);
+	if (argc || (exclusive && (!multiq || oneshot))) {
+		if (exclusive)
+			fprintf(stderr, "--exclusive needs --multiq and does not go with --oneshot\n");
+		usage_with_options(bench_epoll_wait_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = ncpus;
+	if (!nwriters)
+		nwriters = nthreads;
+	if (!nfds)
+		nfds = 1;
+
+	nr_fds = nthreads * nfds;
+	if (nwriters > nr_fds)
+		nwriters = nr_fds;
+
+	events_mask = EPOLLIN;
+	if (edge)
+		events_mask |= EPOLLET;
+	if (oneshot)
+		events_mask |= EPOLLONESHOT;
+	if (exclusive)
+		events_mask |= EPOLLEXCLUSIVE;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	writer = calloc(nwriters, sizeof(*writer));
+	fds = calloc(nr_fds, sizeof(*fds));
+	stamps = calloc(nr_fds, sizeof(*stamps));
+	if (!worker || !writer || !fds || !stamps)
+		goto errmem;
+
+	printf("Run summary [PID %d]: %d waiters and %d writers on %d %s, %s epoll instance(s)%s%s%s, for %d secs.\n\n",
+	       getpid(), nthreads, nwriters, nr_fds, pipes ? "pipes" : "eventfds",
+	       multiq ? "per-thread" : "shared", edge ? ", EPOLLET" : "",
+	       oneshot ? ", EPOLLONESHOT" : "",
+	       exclusive ? ", EPOLLEXCLUSIVE" : "", nsecs);
+
+	for (i = 0; i < nr_fds; i++) {
+		if (epoll_bench_fd_open(&fds[i], pipes))
+			err(EXIT_FAILURE, pipes ? "pipe2" : "eventfd");
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		if (multiq || epollfd < 0) {
+			epollfd = epoll_create1(0);
+			if (epollfd < 0)
+				err(EXIT_FAILURE, "epoll_create1");
+		}
+
+		worker[i].tid = i;
+		worker[i].epollfd = epollfd;
+		worker[i].first = i * nfds;
+		worker[i].nfds = nfds;
+
+		/* exclusive waiters all watch every descriptor */
+		if (exclusive) {
+			for (j = 0; j < nr_fds; j++)
+				watch(epollfd, j);
+		} else {
+			for (j = 0; j < nfds; j++)
+				watch(epollfd, worker[i].first + j);
+		}
+	}
+
+	/* the writers split all descriptors between them */
+	per_writer = nr_fds / nwriters;
+	for (i = 0; i < nwriters; i++) {
+		writer[i].tid = i;
+		writer[i].first = i * per_writer;
+		writer[i].nfds = per_writer;
+	}
+	writer[nwriters - 1].nfds += nr_fds % nwriters;
+
+	init_stats(&throughput_stats);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads + nwriters;
+	pthread_attr_init(&thread_attr);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nthreads; i++)
+		start_thread(&worker[i], i % ncpus, waiterfn, &thread_attr);
+	for (i = 0; i < nwriters; i++)
+		start_thread(&writer[i], (nthreads + i) % ncpus, writerfn,
+			     &thread_attr);
+	pthread_attr_destroy(&thread_attr);
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+	for (i = 0; i < nwriters; i++) {
+		ret = pthread_join(writer[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+		writes += writer[i].ops;
+	}
+
+	/* cleanup & report results */
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t = worker[i].ops/runtime.tv_sec;
+
+		update_stats(&throughput_stats, t);
+		if (!silent)
+			printf("[thread %2d] fds: %d ... %d [ %ld events/sec ]\n",
+			       worker[i].tid, fds[worker[i].first].rfd,
+			       fds[worker[i].first + nfds - 1].rfd, t);
+
+		if (multiq || i == nthreads - 1)
+			close(worker[i].epollfd);
+	}
+
+	for (i = 0; i < nr_fds; i++)
+		epoll_bench_fd_close(&fds[i]);
+
+	print_summary(writes);
+	if (!silent)
+		print_histogram(worker);
+
+	free(stamps);
+	free(fds);
+	free(writer);
+	free(worker);
+	return ret;
+errmem:
+	err(EXIT_FAILURE, "calloc");
+}
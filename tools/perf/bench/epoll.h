@@ -0,0 +1,70 @@
+/*
+ * Helpers shared by the epoll benchmarks: the watched descriptors are
+ * either eventfds or the read end of nonblocking pipes.
+ */
+
+#ifndef _EPOLL_H
+#define _EPOLL_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+struct epoll_bench_fd {
+	int rfd;	/* what epoll watches and waiters drain */
+	int wfd;	/* what writers signal */
+};
+
+static inline int epoll_bench_fd_open(struct epoll_bench_fd *f, bool pipes)
+{
+	int p[2];
+
+	if (!pipes) {
+		f->rfd = f->wfd = eventfd(0, EFD_NONBLOCK);
+		return f->rfd < 0 ? -1 : 0;
+	}
+
+	if (pipe2(p, O_NONBLOCK))
+		return -1;
+	f->rfd = p[0];
+	f->wfd = p[1];
+	return 0;
+}
+
+static inline void epoll_bench_fd_close(struct epoll_bench_fd *f)
+{
+	close(f->rfd);
+	if (f->wfd != f->rfd)
+		close(f->wfd);
+}
+
+/* Returns 0 on success, -1 with errno set (EAGAIN if the pipe is full). */
+static inline int epoll_bench_fd_signal(struct epoll_bench_fd *f)
+{
+	if (f->wfd == f->rfd)
+		return eventfd_write(f->wfd, 1);
+	return write(f->wfd, "x", 1) == 1 ? 0 : -1;
+}
+
+/*
+ * Drain everything pending, as edge-triggered users must. Returns true if
+ * anything was consumed; false with errno EAGAIN if another waiter got
+ * there first.
+ */
+static inline bool epoll_bench_fd_drain(struct epoll_bench_fd *f)
+{
+	char buf[512];
+	eventfd_t val;
+	bool drained = false;
+
+	if (f->wfd == f->rfd)
+		return !eventfd_read(f->rfd, &val);
+
+	while (read(f->rfd, buf, sizeof(buf)) > 0)
+		drained = true;
+	return drained;
+}
+
+#endif /* _EPOLL_H */
@@ -0,0 +1,350 @@
+/*
+ * Send data with MSG_ZEROCOPY and verify the completion notifications.
+ *
+ * Run as a sink ("-r") in one network namespace and as a sender in
+ * another.  The sender transmits fixed size buffers for -l seconds over
+ * TCP or UDP, IPv4 or IPv6.  With -z every send is issued with
+ * MSG_ZEROCOPY and the notifications read from the error queue are
+ * checked: every send call must be acknowledged exactly once and in
+ * order.  At the end it prints the number of sends and how many of them
+ * were completed without a copy:
+ *
+ *   tx=<calls> (<MB> MB) txc=<completions> zc=<y|n>
+ *
+ * The program exits with an error if a notification is malformed, out
+ * of order or missing.
+ *
+ * License (GPLv2):
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. * See the GNU General Public License for
+ * more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <error.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY		5
+#endif
+
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED	1
+#endif
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY	60
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY	0x4000000
+#endif
+
+static int cfg_family = PF_INET;
+static int cfg_type = SOCK_STREAM;
+static const char *cfg_host;
+static int cfg_port = 8000;
+static int cfg_payload_len = 1 << 16;
+static int cfg_runtime_s = 4;
+static bool cfg_receiver;
+static bool cfg_zerocopy;
+
+static uint32_t next_completion;
+static uint32_t completions;
+static uint32_t copied;
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		error(1, errno, "clock_gettime");
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static socklen_t build_addr(struct sockaddr_storage *ss, const char *host)
+{
+	struct sockaddr_in6 *sin6 = (void *)ss;
+	struct sockaddr_in *sin = (void *)ss;
+
+	memset(ss, 0, sizeof(*ss));
+	if (cfg_family == PF_INET) {
+		sin->sin_family = AF_INET;
+		sin->sin_port = htons(cfg_port);
+		if (host && inet_pton(AF_INET, host, &sin->sin_addr) != 1)
+			error(1, 0, "invalid address: %s", host);
+		return sizeof(*sin);
+	}
+
+	sin6->sin6_family = AF_INET6;
+	sin6->sin6_port = htons(cfg_port);
+	if (host && inet_pton(AF_INET6, host, &sin6->sin6_addr) != 1)
+		error(1, 0, "invalid address: %s", host);
+	return sizeof(*sin6);
+}
+
+/* Read one batch of notifications, return false if there was none */
+static bool do_recv_completion(int fd)
+{
+	char control[CMSG_SPACE(sizeof(struct sock_extended_err)) +
+		     CMSG_SPACE(sizeof(struct sockaddr_in6))];
+	struct sock_extended_err *serr;
+	struct msghdr msg = {0};
+	struct cmsghdr *cm;
+	uint32_t hi, lo;
+
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	if (recvmsg(fd, &msg, MSG_ERRQUEUE) == -1) {
+		if (errno == EAGAIN)
+			return false;
+		error(1, errno, "recvmsg errqueue");
+	}
+	if (msg.msg_flags & MSG_CTRUNC)
+		error(1, 0, "errqueue: control truncated");
+
+	cm = CMSG_FIRSTHDR(&msg);
+	if (!cm)
+		error(1, 0, "errqueue: no cmsg");
+	if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+	      (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+		error(1, 0, "errqueue: unexpected cmsg %d.%d",
+		      cm->cmsg_level, cm->cmsg_type);
+
+	serr = (void *)CMSG_DATA(cm);
+	if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+		error(1, 0, "errqueue: wrong origin %u", serr->ee_origin);
+	if (serr->ee_errno != 0)
+		error(1, 0, "errqueue: wrong error code %u", serr->ee_errno);
+
+	lo = serr->ee_info;
+	hi = serr->ee_data;
+	if (lo != next_completion)
+		error(1, 0, "errqueue: expected id %u, got %u",
+		      next_completion, lo);
+	if (hi < lo)
+		error(1, 0, "errqueue: bad range %u-%u", lo, hi);
+
+	next_completion = hi + 1;
+	completions += hi - lo + 1;
+	if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+		copied += hi - lo + 1;
+	return true;
+}
+
+static void do_recv_completions(int fd)
+{
+	while (do_recv_completion(fd))
+		;
+}
+
+/* Wait for all outstanding notifications after the last send */
+static void do_recv_remaining_completions(int fd, uint32_t sends)
+{
+	uint64_t tstop = now_ms() + 2000;
+
+	while (completions < sends) {
+		struct pollfd pfd = { .fd = fd };
+
+		if (now_ms() > tstop)
+			error(1, 0, "missing notifications: %u of %u",
+			      completions, sends);
+		if (poll(&pfd, 1, 100) == -1)
+			error(1, errno, "poll");
+		if (pfd.revents & POLLERR)
+			do_recv_completions(fd);
+	}
+}
+
+static void do_tx(void)
+{
+	struct sockaddr_storage addr;
+	uint64_t tstop, bytes = 0;
+	uint32_t sends = 0;
+	socklen_t alen;
+	char *buf;
+	int fd, one = 1;
+
+	buf = malloc(cfg_payload_len);
+	if (!buf)
+		error(1, ENOMEM, "malloc");
+	memset(buf, 'a', cfg_payload_len);
+
+	fd = socket(cfg_family, cfg_type, 0);
+	if (fd == -1)
+		error(1, errno, "socket");
+	if (cfg_zerocopy &&
+	    setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)))
+		error(1, errno, "setsockopt SO_ZEROCOPY");
+
+	alen = build_addr(&addr, cfg_host);
+	if (connect(fd, (void *)&addr, alen))
+		error(1, errno, "connect");
+
+	tstop = now_ms() + cfg_runtime_s * 1000ULL;
+	do {
+		int flags = cfg_zerocopy ? MSG_ZEROCOPY : 0;
+		ssize_t ret;
+
+		ret = send(fd, buf, cfg_payload_len, flags);
+		if (ret == -1 && errno == ENOBUFS && cfg_zerocopy) {
+			/* out of optmem or locked memory, drain and retry */
+			do_recv_completions(fd);
+			continue;
+		}
+		if (ret == -1 && errno == ECONNREFUSED && cfg_type == SOCK_DGRAM)
+			continue;
+		if (ret == -1)
+			error(1, errno, "send");
+		if (cfg_type == SOCK_DGRAM && ret != cfg_payload_len)
+			error(1, 0, "send: short datagram %zd", ret);
+
+		bytes += ret;
+		if (cfg_zerocopy) {
+			sends++;
+			do_recv_completions(fd);
+		}
+	} while (now_ms() < tstop);
+
+	if (cfg_zerocopy)
+		do_recv_remaining_completions(fd, sends);
+
+	if (close(fd))
+		error(1, errno, "close");
+
+	fprintf(stderr, "tx=%u (%llu MB) txc=%u zc=%c\n",
+		sends, (unsigned long long)bytes >> 20, completions,
+		cfg_zerocopy && completions && !copied ? 'y' : 'n');
+	free(buf);
+}
+
+/* Discard everything, exit when the sender closes or goes quiet */
+static void do_rx(void)
+{
+	struct sockaddr_storage addr;
+	static char buf[1 << 16];
+	int fd, rfd, one = 1;
+	socklen_t alen;
+	ssize_t ret;
+
+	fd = socket(cfg_family, cfg_type, 0);
+	if (fd == -1)
+		error(1, errno, "socket");
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)))
+		error(1, errno, "setsockopt SO_REUSEADDR");
+
+	alen = build_addr(&addr, NULL);
+	if (bind(fd, (void *)&addr, alen))
+		error(1, errno, "bind");
+
+	if (cfg_type == SOCK_STREAM) {
+		if (listen(fd, 1))
+			error(1, errno, "listen");
+		rfd = accept(fd, NULL, NULL);
+		if (rfd == -1)
+			error(1, errno, "accept");
+	} else {
+		struct timeval tv = { .tv_sec = 1 };
+
+		if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)))
+			error(1, errno, "setsockopt SO_RCVTIMEO");
+		rfd = fd;
+	}
+
+	do {
+		ret = read(rfd, buf, sizeof(buf));
+	} while (ret > 0 || (ret == -1 && errno == EINTR));
+
+	if (ret == -1 && !(cfg_type == SOCK_DGRAM && errno == EAGAIN))
+		error(1, errno, "read");
+
+	if (rfd != fd)
+		close(rfd);
+	close(fd);
+}
+
+static void usage(const char *prog)
+{
+	error(1, 0, "usage: %s [-4|-6] [-t tcp|udp] [-r] [-z] [-D host] "
+		    "[-p port] [-s size] [-l seconds]", prog);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "46t:rzD:p:s:l:")) != -1) {
+		switch (c) {
+		case '4':
+			cfg_family = PF_INET;
+			break;
+		case '6':
+			cfg_family = PF_INET6;
+			break;
+		case 't':
+			if (!strcmp(optarg, "tcp"))
+				cfg_type = SOCK_STREAM;
+			else if (!strcmp(optarg, "udp"))
+				cfg_type = SOCK_DGRAM;
+			else
+				usage(argv[0]);
+			break;
+		case 'r':
+			cfg_receiver = true;
+			break;
+		case 'z':
+			cfg_zerocopy = true;
+			break;
+		case 'D':
+			cfg_host = optarg;
+			break;
+		case 'p':
+			cfg_port = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			cfg_payload_len = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			cfg_runtime_s = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!cfg_receiver && !cfg_host)
+		usage(argv[0]);
+	if (cfg_payload_len <= 0 || cfg_runtime_s <= 0)
+		usage(argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+	parse_opts(argc, argv);
+
+	if (cfg_receiver)
+		do_rx();
+	else
+		do_tx();
+	return 0;
+}
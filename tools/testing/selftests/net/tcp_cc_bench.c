@@ -0,0 +1,353 @@
+/*
+ * Congestion control A/B benchmark.
+ *
+ * Run as a sink ("-r") in one network namespace and as a sender in another.
+ * The sender opens a number of concurrent TCP flows, all using the
+ * congestion control given with -C, and keeps them busy for -t seconds.
+ * Every -i milliseconds it samples TCP_INFO of each flow.  At the end it
+ * prints one line of results:
+ *
+ *   cc flows goodput_mbps rtt_p50_us rtt_p99_us retrans jain_fairness
+ *
+ * Goodput is computed per flow from tcpi_bytes_acked.  RTT percentiles are
+ * over all tcpi_rtt samples of all flows.  Retransmits are the sum of
+ * tcpi_total_retrans.  Jain's fairness index is over the per flow goodputs.
+ *
+ * The program exits with an error if a flow did not get any data acked,
+ * which indicates a stalled connection.
+ *
+ * License (GPLv2):
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. * See the GNU General Public License for
+ * more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_EVENTS	256
+
+static const char *cfg_cc = "cubic";
+static const char *cfg_host = "127.0.0.1";
+static int cfg_port = 8000;
+static int cfg_flows = 10;
+static int cfg_duration_s = 10;
+static int cfg_interval_ms = 100;
+static int cfg_receiver;
+
+struct flow {
+	int fd;
+	uint64_t bytes_acked;
+	uint32_t total_retrans;
+};
+
+static uint32_t *rtt_samples;
+static size_t rtt_nr, rtt_max;
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		error(1, errno, "clock_gettime");
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static void set_nonblock(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK))
+		error(1, errno, "fcntl O_NONBLOCK");
+}
+
+static void epoll_add(int epfd, int fd, uint32_t events, void *ptr)
+{
+	struct epoll_event ev = { .events = events, .data.ptr = ptr };
+
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev))
+		error(1, errno, "epoll_ctl add");
+}
+
+static void build_addr(struct sockaddr_in *addr, const char *host)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_port = htons(cfg_port);
+	if (inet_pton(AF_INET, host, &addr->sin_addr) != 1)
+		error(1, 0, "invalid address: %s", host);
+}
+
+/* Accept any number of connections and discard everything they send. */
+static void do_receiver(void)
+{
+	struct epoll_event events[MAX_EVENTS];
+	static char buf[1 << 16];
+	struct sockaddr_in addr;
+	int lfd, epfd, one = 1;
+	int i, n;
+
+	build_addr(&addr, "0.0.0.0");
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0)
+		error(1, errno, "socket");
+	if (setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)))
+		error(1, errno, "setsockopt SO_REUSEADDR");
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)))
+		error(1, errno, "bind");
+	if (listen(lfd, 1024))
+		error(1, errno, "listen");
+
+	epfd = epoll_create1(0);
+	if (epfd < 0)
+		error(1, errno, "epoll_create1");
+	epoll_add(epfd, lfd, EPOLLIN, NULL);
+
+	for (;;) {
+		n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			error(1, errno, "epoll_wait");
+		}
+		for (i = 0; i < n; i++) {
+			int fd;
+
+			if (!events[i].data.ptr) {
+				fd = accept(lfd, NULL, NULL);
+				if (fd < 0)
+					error(1, errno, "accept");
+				set_nonblock(fd);
+				epoll_add(epfd, fd, EPOLLIN,
+					  (void *)(long)(fd + 1));
+				continue;
+			}
+
+			fd = (long)events[i].data.ptr - 1;
+			while (1) {
+				ssize_t ret = read(fd, buf, sizeof(buf));
+
+				if (ret > 0)
+					continue;
+				if (ret < 0 && errno == EAGAIN)
+					break;
+				close(fd);
+				break;
+			}
+		}
+	}
+}
+
+static int connect_flow(void)
+{
+	struct sockaddr_in addr;
+	int fd;
+
+	build_addr(&addr, cfg_host);
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		error(1, errno, "socket");
+	if (setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, cfg_cc,
+		       strlen(cfg_cc)))
+		error(1, errno, "setsockopt TCP_CONGESTION %s", cfg_cc);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		error(1, errno, "connect");
+	set_nonblock(fd);
+	return fd;
+}
+
+static void sample_flow(struct flow *f)
+{
+	struct tcp_info info;
+	socklen_t len = sizeof(info);
+
+	memset(&info, 0, sizeof(info));
+	if (getsockopt(f->fd, IPPROTO_TCP, TCP_INFO, &info, &len))
+		error(1, errno, "getsockopt TCP_INFO");
+
+	f->bytes_acked = info.tcpi_bytes_acked;
+	f->total_retrans = info.tcpi_total_retrans;
+
+	if (!info.tcpi_rtt)
+		return;
+	if (rtt_nr == rtt_max) {
+		rtt_max = rtt_max ? rtt_max * 2 : 4096;
+		rtt_samples = realloc(rtt_samples,
+				      rtt_max * sizeof(*rtt_samples));
+		if (!rtt_samples)
+			error(1, ENOMEM, "realloc");
+	}
+	rtt_samples[rtt_nr++] = info.tcpi_rtt;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint32_t percentile(int pct)
+{
+	if (!rtt_nr)
+		return 0;
+	return rtt_samples[(rtt_nr - 1) * pct / 100];
+}
+
+static void report(struct flow *flows, uint64_t elapsed_ms)
+{
+	double sum = 0, sum_sq = 0, jain, mbps;
+	uint64_t retrans = 0;
+	int i, stalled = 0;
+
+	for (i = 0; i < cfg_flows; i++) {
+		double x = flows[i].bytes_acked;
+
+		sum += x;
+		sum_sq += x * x;
+		retrans += flows[i].total_retrans;
+		if (!flows[i].bytes_acked)
+			stalled++;
+	}
+	jain = sum_sq ? sum * sum / (cfg_flows * sum_sq) : 0;
+	mbps = sum * 8 / 1000 / elapsed_ms;
+
+	qsort(rtt_samples, rtt_nr, sizeof(*rtt_samples), cmp_u32);
+
+	printf("%-8s %5d %10.2f %10u %10u %8llu %6.3f\n",
+	       cfg_cc, cfg_flows, mbps, percentile(50), percentile(99),
+	       (unsigned long long)retrans, jain);
+
+	if (stalled)
+		error(1, 0, "%s: %d of %d flows stalled", cfg_cc, stalled,
+		      cfg_flows);
+}
+
+static void do_sender(void)
+{
+	struct epoll_event events[MAX_EVENTS];
+	static char buf[1 << 16];
+	uint64_t start, next_sample, end;
+	struct flow *flows;
+	int epfd, i, n;
+
+	flows = calloc(cfg_flows, sizeof(*flows));
+	if (!flows)
+		error(1, ENOMEM, "calloc");
+
+	epfd = epoll_create1(0);
+	if (epfd < 0)
+		error(1, errno, "epoll_create1");
+
+	for (i = 0; i < cfg_flows; i++) {
+		flows[i].fd = connect_flow();
+		epoll_add(epfd, flows[i].fd, EPOLLOUT, &flows[i]);
+	}
+
+	start = now_ms();
+	next_sample = start + cfg_interval_ms;
+	end = start + cfg_duration_s * 1000ULL;
+
+	while (now_ms() < end) {
+		n = epoll_wait(epfd, events, MAX_EVENTS, cfg_interval_ms);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			error(1, errno, "epoll_wait");
+		}
+		for (i = 0; i < n; i++) {
+			struct flow *f = events[i].data.ptr;
+
+			if (write(f->fd, buf, sizeof(buf)) < 0 &&
+			    errno != EAGAIN)
+				error(1, errno, "write");
+		}
+		if (now_ms() >= next_sample) {
+			for (i = 0; i < cfg_flows; i++)
+				sample_flow(&flows[i]);
+			next_sample += cfg_interval_ms;
+		}
+	}
+
+	for (i = 0; i < cfg_flows; i++)
+		sample_flow(&flows[i]);
+	report(flows, now_ms() - start);
+
+	for (i = 0; i < cfg_flows; i++)
+		close(flows[i].fd);
+	free(flows);
+	free(rtt_samples);
+}
+
+static void usage(const char *prog)
+{
+	error(1, 0, "usage: %s [-r] [-C cc] [-H host] [-p port] [-n flows] "
+		    "[-t seconds] [-i sample_ms]", prog);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "rC:H:p:n:t:i:")) != -1) {
+		switch (c) {
+		case 'r':
+			cfg_receiver = 1;
+			break;
+		case 'C':
+			cfg_cc = optarg;
+			break;
+		case 'H':
+			cfg_host = optarg;
+			break;
+		case 'p':
+			cfg_port = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			cfg_flows = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			cfg_duration_s = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			cfg_interval_ms = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (cfg_flows <= 0 || cfg_duration_s <= 0 || cfg_interval_ms <= 0)
+		usage(argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+	parse_opts(argc, argv);
+
+	if (cfg_receiver)
+		do_receiver();
+	else
+		do_sender();
+	return 0;
+}
@@ -0,0 +1,127 @@
+#!/bin/bash
+#
+# Congestion control A/B benchmark over emulated paths.
+#
+# Topology, one network namespace each:
+#
+#   ccb_cli (10.0.1.1) --veth-- ccb_rtr --veth-- (10.0.2.1) ccb_srv
+#
+# The router shapes the cli -> srv direction with sch_netem, using one
+# delay/loss/rate profile at a time.  For every profile and every
+# congestion control the sender in ccb_cli runs FLOWS concurrent flows
+# to a sink in ccb_srv, see tcp_cc_bench.c for the reported metrics.
+#
+# Environment:
+#   CCS       congestion controls to compare (default "lbbr bbr cubic")
+#   FLOWS     concurrent flows per run (default 10)
+#   DURATION  seconds per run (default 10)
+
+CCS=${CCS:-"lbbr bbr cubic"}
+FLOWS=${FLOWS:-10}
+DURATION=${DURATION:-10}
+PORT=8000
+
+# name:netem arguments
+PROFILES=(
+	"lan:delay 1ms rate 1gbit limit 10000"
+	"wan:delay 20ms rate 100mbit limit 1000"
+	"lossy:delay 50ms loss 1% rate 50mbit limit 1000"
+	"shallow:delay 20ms rate 100mbit limit 50"
+)
+
+ret=0
+
+cleanup() {
+	for ns in ccb_cli ccb_rtr ccb_srv; do
+		ip netns del $ns 2>/dev/null
+	done
+}
+
+setup() {
+	cleanup
+	for ns in ccb_cli ccb_rtr ccb_srv; do
+		ip netns add $ns || return 1
+		ip -netns $ns link set lo up
+	done
+
+	ip link add cli0 netns ccb_cli type veth peer name rtr0 netns ccb_rtr
+	ip link add srv0 netns ccb_srv type veth peer name rtr1 netns ccb_rtr
+
+	ip -netns ccb_cli addr add 10.0.1.1/24 dev cli0
+	ip -netns ccb_rtr addr add 10.0.1.2/24 dev rtr0
+	ip -netns ccb_rtr addr add 10.0.2.2/24 dev rtr1
+	ip -netns ccb_srv addr add 10.0.2.1/24 dev srv0
+
+	for dev in cli0 rtr0 rtr1 srv0; do
+		for ns in ccb_cli ccb_rtr ccb_srv; do
+			ip -netns $ns link set $dev up 2>/dev/null
+		done
+	done
+
+	ip -netns ccb_cli route add default via 10.0.1.2
+	ip -netns ccb_srv route add default via 10.0.2.2
+	ip netns exec ccb_rtr sysctl -qw net.ipv4.ip_forward=1
+
+	# Segmentation offloads would hand netem 64KB super packets
+	for dev in rtr0 rtr1; do
+		ip netns exec ccb_rtr ethtool -K $dev gro off gso off tso off \
+			>/dev/null 2>&1
+	done
+}
+
+run_profile() {
+	local name=$1
+	local netem=$2
+	local cc
+
+	ip netns exec ccb_rtr tc qdisc replace dev rtr1 root netem $netem || return 1
+
+	echo "profile $name: $netem"
+	printf "%-8s %5s %10s %10s %10s %8s %6s\n" \
+		cc flows "mbit/s" "rtt_p50" "rtt_p99" retrans jain
+	for cc in $CCS; do
+		if ! ip netns exec ccb_cli ./tcp_cc_bench -H 10.0.2.1 \
+			-p $PORT -C $cc -n $FLOWS -t $DURATION; then
+			echo "$cc: [FAIL]"
+			ret=1
+		fi
+	done
+	echo
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "tcp_cc_bench: need root, [SKIP]"
+	exit 0
+fi
+
+for cc in $CCS; do
+	modprobe -q tcp_$cc 2>/dev/null
+	if ! grep -qw $cc /proc/sys/net/ipv4/tcp_available_congestion_control; then
+		echo "tcp_cc_bench: $cc not available, [SKIP]"
+		exit 0
+	fi
+done
+
+trap cleanup EXIT
+if ! setup; then
+	echo "tcp_cc_bench: cannot set up namespaces, [SKIP]"
+	exit 0
+fi
+
+ip netns exec ccb_srv ./tcp_cc_bench -r -p $PORT &
+sink=$!
+sleep 1
+
+for p in "${PROFILES[@]}"; do
+	run_profile "${p%%:*}" "${p#*:}" || ret=1
+done
+
+kill $sink
+wait $sink 2>/dev/null
+
+if [ $ret -eq 0 ]; then
+	echo "tcp_cc_bench: [PASS]"
+else
+	echo "tcp_cc_bench: [FAIL]"
+fi
+exit $ret
@@ -0,0 +1,392 @@
+/*
+ * Check the TLS record layer on a loopback TCP connection.
+ *
+ * The sender attaches the "tls" ULP, installs an AES-GCM-128 key with
+ * TLS_TX and writes with send() and sendfile().  The receiver reads the
+ * raw TCP stream and checks the record framing: content type, version,
+ * length, the explicit nonce sequence and, when AF_ALG is available, that
+ * every record decrypts to what was sent.
+ *
+ * License (GPLv2):
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. * See the GNU General Public License for
+ * more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <errno.h>
+#include <error.h>
+#include <linux/if_alg.h>
+#include <linux/tcp.h>
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef TCP_ULP
+#define TCP_ULP		31
+#endif
+
+#ifndef SOL_TLS
+#define SOL_TLS		282
+#endif
+
+#ifndef SOL_ALG
+#define SOL_ALG		279
+#endif
+
+#define HDR_LEN		5
+#define NONCE_LEN	TLS_CIPHER_AES_GCM_128_IV_SIZE
+#define TAG_LEN		TLS_CIPHER_AES_GCM_128_TAG_SIZE
+#define AAD_LEN		13
+#define MAX_PAYLOAD	(1 << 14)
+#define MAX_RECORD	(HDR_LEN + NONCE_LEN + MAX_PAYLOAD + TAG_LEN)
+
+static struct tls12_crypto_info_aes_gcm_128 crypto_info;
+static uint64_t next_seq;
+static int alg_fd = -1;
+
+static void setup_crypto_info(void)
+{
+	int i;
+
+	memset(&crypto_info, 0, sizeof(crypto_info));
+	crypto_info.info.version = TLS_1_2_VERSION;
+	crypto_info.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+	for (i = 0; i < TLS_CIPHER_AES_GCM_128_KEY_SIZE; i++)
+		crypto_info.key[i] = i;
+	for (i = 0; i < TLS_CIPHER_AES_GCM_128_SALT_SIZE; i++)
+		crypto_info.salt[i] = 0xa0 + i;
+	for (i = 0; i < TLS_CIPHER_AES_GCM_128_IV_SIZE; i++)
+		crypto_info.iv[i] = 0x10 * i;
+}
+
+/* Optional: a gcm(aes) AF_ALG socket to decrypt what we received */
+static void setup_alg(void)
+{
+	struct sockaddr_alg sa = {
+		.salg_family = AF_ALG,
+		.salg_type = "aead",
+		.salg_name = "gcm(aes)",
+	};
+	int fd;
+
+	fd = socket(AF_ALG, SOCK_SEQPACKET, 0);
+	if (fd == -1)
+		goto skip;
+	if (bind(fd, (void *)&sa, sizeof(sa)) ||
+	    setsockopt(fd, SOL_ALG, ALG_SET_KEY, crypto_info.key,
+		       sizeof(crypto_info.key)) ||
+	    setsockopt(fd, SOL_ALG, ALG_SET_AEAD_AUTHSIZE, NULL, TAG_LEN)) {
+		close(fd);
+		goto skip;
+	}
+	alg_fd = fd;
+	return;
+
+skip:
+	fprintf(stderr, "tls: no AF_ALG gcm(aes), not checking payloads\n");
+}
+
+static void connect_pair(int *cfd, int *sfd)
+{
+	struct sockaddr_in addr = { .sin_family = AF_INET };
+	socklen_t len = sizeof(addr);
+	int lfd;
+
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd == -1)
+		error(1, errno, "socket");
+	if (bind(lfd, (void *)&addr, sizeof(addr)))
+		error(1, errno, "bind");
+	if (getsockname(lfd, (void *)&addr, &len))
+		error(1, errno, "getsockname");
+	if (listen(lfd, 1))
+		error(1, errno, "listen");
+
+	*cfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (*cfd == -1)
+		error(1, errno, "socket");
+	if (connect(*cfd, (void *)&addr, sizeof(addr)))
+		error(1, errno, "connect");
+	*sfd = accept(lfd, NULL, NULL);
+	if (*sfd == -1)
+		error(1, errno, "accept");
+	close(lfd);
+}
+
+static void read_full(int fd, void *buf, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = read(fd, buf, len);
+		if (ret == -1)
+			error(1, errno, "read");
+		if (ret == 0)
+			error(1, 0, "read: unexpected EOF");
+		buf += ret;
+		len -= ret;
+	}
+}
+
+static void decrypt_record(const unsigned char *rec, size_t payload,
+			   unsigned char *plain)
+{
+	char cbuf[CMSG_SPACE(sizeof(uint32_t)) +
+		  CMSG_SPACE(sizeof(struct af_alg_iv) + 12) +
+		  CMSG_SPACE(sizeof(uint32_t))] = {0};
+	static unsigned char in[AAD_LEN + MAX_PAYLOAD + TAG_LEN];
+	static unsigned char out[AAD_LEN + MAX_PAYLOAD + TAG_LEN];
+	struct msghdr msg = {0};
+	struct af_alg_iv *iv;
+	struct cmsghdr *cm;
+	struct iovec iov;
+	ssize_t ret;
+	int i, fd;
+
+	fd = accept(alg_fd, NULL, 0);
+	if (fd == -1)
+		error(1, errno, "accept AF_ALG");
+
+	/* aad: seq_num(8) type(1) version(2) length(2) */
+	for (i = 0; i < 8; i++)
+		in[i] = next_seq >> (56 - 8 * i);
+	in[8] = rec[0];
+	in[9] = rec[1];
+	in[10] = rec[2];
+	in[11] = payload >> 8;
+	in[12] = payload & 0xff;
+	memcpy(in + AAD_LEN, rec + HDR_LEN + NONCE_LEN, payload + TAG_LEN);
+
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_ALG;
+	cm->cmsg_type = ALG_SET_OP;
+	cm->cmsg_len = CMSG_LEN(sizeof(uint32_t));
+	*(uint32_t *)CMSG_DATA(cm) = ALG_OP_DECRYPT;
+
+	cm = CMSG_NXTHDR(&msg, cm);
+	cm->cmsg_level = SOL_ALG;
+	cm->cmsg_type = ALG_SET_IV;
+	cm->cmsg_len = CMSG_LEN(sizeof(struct af_alg_iv) + 12);
+	iv = (void *)CMSG_DATA(cm);
+	iv->ivlen = 12;
+	memcpy(iv->iv, crypto_info.salt, 4);
+	memcpy(iv->iv + 4, rec + HDR_LEN, NONCE_LEN);
+
+	cm = CMSG_NXTHDR(&msg, cm);
+	cm->cmsg_level = SOL_ALG;
+	cm->cmsg_type = ALG_SET_AEAD_ASSOCLEN;
+	cm->cmsg_len = CMSG_LEN(sizeof(uint32_t));
+	*(uint32_t *)CMSG_DATA(cm) = AAD_LEN;
+
+	iov.iov_base = in;
+	iov.iov_len = AAD_LEN + payload + TAG_LEN;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (sendmsg(fd, &msg, 0) != iov.iov_len)
+		error(1, errno, "sendmsg AF_ALG");
+
+	/* Depending on the kernel the output does or does not repeat the
+	 * associated data, the plaintext is at the end either way.
+	 */
+	ret = read(fd, out, sizeof(out));
+	if (ret == -1)
+		error(1, errno, "record %llu does not decrypt",
+		      (unsigned long long)next_seq);
+	if (ret < payload)
+		error(1, 0, "short decrypt: %zd", ret);
+	if (ret == AAD_LEN + payload + TAG_LEN)
+		ret -= TAG_LEN;
+	memcpy(plain, out + ret - payload, payload);
+	close(fd);
+}
+
+/* Read one record, return its payload length */
+static size_t recv_record(int fd, unsigned char *plain)
+{
+	static unsigned char rec[MAX_RECORD];
+	uint64_t nonce = 0;
+	size_t len, payload;
+	int i;
+
+	read_full(fd, rec, HDR_LEN);
+	if (rec[0] != 0x17)
+		error(1, 0, "record type %x", rec[0]);
+	if (rec[1] != TLS_1_2_VERSION_MAJOR || rec[2] != TLS_1_2_VERSION_MINOR)
+		error(1, 0, "record version %x.%x", rec[1], rec[2]);
+
+	len = rec[3] << 8 | rec[4];
+	if (len <= NONCE_LEN + TAG_LEN || len > MAX_RECORD - HDR_LEN)
+		error(1, 0, "record length %zu", len);
+	payload = len - NONCE_LEN - TAG_LEN;
+	read_full(fd, rec + HDR_LEN, len);
+
+	/* the explicit nonce is the initial iv plus the record number */
+	for (i = 0; i < NONCE_LEN; i++)
+		nonce = nonce << 8 | rec[HDR_LEN + i];
+	if (nonce != be64toh(*(uint64_t *)crypto_info.iv) + next_seq)
+		error(1, 0, "record %llu: unexpected nonce",
+		      (unsigned long long)next_seq);
+
+	if (alg_fd != -1)
+		decrypt_record(rec, payload, plain);
+	next_seq++;
+	return payload;
+}
+
+static void expect_data(int fd, const unsigned char *data, size_t total,
+			bool one_record)
+{
+	static unsigned char plain[MAX_PAYLOAD];
+	size_t off = 0, payload;
+
+	while (off < total) {
+		payload = recv_record(fd, plain);
+		if (off + payload > total)
+			error(1, 0, "received %zu bytes, expected %zu",
+			      off + payload, total);
+		if (one_record && payload != total)
+			error(1, 0, "record of %zu bytes, expected %zu",
+			      payload, total);
+		if (alg_fd != -1 && memcmp(plain, data + off, payload))
+			error(1, 0, "record %llu: payload mismatch",
+			      (unsigned long long)next_seq - 1);
+		off += payload;
+	}
+}
+
+static void send_full(int fd, const void *buf, size_t len, int flags)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = send(fd, buf, len, flags);
+		if (ret == -1)
+			error(1, errno, "send");
+		buf += ret;
+		len -= ret;
+	}
+}
+
+static void test_sendfile(int cfd, int sfd, const unsigned char *data,
+			  size_t len)
+{
+	char path[] = "/tmp/tls_sendfile_XXXXXX";
+	off_t off = 0;
+	ssize_t ret;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd == -1)
+		error(1, errno, "mkstemp");
+	unlink(path);
+	if (write(fd, data, len) != len)
+		error(1, errno, "write");
+
+	while (off < len) {
+		ret = sendfile(cfd, fd, &off, len - off);
+		if (ret == -1)
+			error(1, errno, "sendfile");
+	}
+	close(fd);
+
+	expect_data(sfd, data, len, false);
+}
+
+int main(int argc, char **argv)
+{
+	static unsigned char data[3 * MAX_PAYLOAD + 1000];
+	struct tls12_crypto_info_aes_gcm_128 info;
+	socklen_t len;
+	char ulp[16];
+	int cfd, sfd;
+	size_t i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = rand();
+
+	setup_crypto_info();
+	connect_pair(&cfd, &sfd);
+
+	if (setsockopt(cfd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls"))) {
+		if (errno == ENOENT || errno == ENOPROTOOPT) {
+			fprintf(stderr, "tls: no tls ULP, [SKIP]\n");
+			return 0;
+		}
+		error(1, errno, "setsockopt TCP_ULP");
+	}
+
+	len = sizeof(ulp);
+	if (getsockopt(cfd, IPPROTO_TCP, TCP_ULP, ulp, &len))
+		error(1, errno, "getsockopt TCP_ULP");
+	if (len < 3 || strncmp(ulp, "tls", 3))
+		error(1, 0, "getsockopt TCP_ULP: %.*s", (int)len, ulp);
+
+	if (!setsockopt(cfd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")))
+		error(1, 0, "second TCP_ULP succeeded");
+
+	if (setsockopt(cfd, SOL_TLS, TLS_TX, &crypto_info,
+		       sizeof(crypto_info)))
+		error(1, errno, "setsockopt TLS_TX");
+	if (!setsockopt(cfd, SOL_TLS, TLS_TX, &crypto_info,
+			sizeof(crypto_info)))
+		error(1, 0, "second TLS_TX succeeded");
+
+	setup_alg();
+
+	/* one small record */
+	send_full(cfd, data, 100, 0);
+	expect_data(sfd, data, 100, true);
+
+	/* MSG_MORE keeps the record open */
+	send_full(cfd, data, 10, MSG_MORE);
+	send_full(cfd, data + 10, 20, 0);
+	expect_data(sfd, data, 30, true);
+
+	/* larger writes are split in full records */
+	send_full(cfd, data, sizeof(data), 0);
+	expect_data(sfd, data, sizeof(data), false);
+
+	test_sendfile(cfd, sfd, data, sizeof(data));
+
+	/* TLS_TX reports the explicit iv of the next record */
+	memset(&info, 0, sizeof(info));
+	len = sizeof(info);
+	if (getsockopt(cfd, SOL_TLS, TLS_TX, &info, &len))
+		error(1, errno, "getsockopt TLS_TX");
+	if (be64toh(*(uint64_t *)info.iv) !=
+	    be64toh(*(uint64_t *)crypto_info.iv) + next_seq)
+		error(1, 0, "getsockopt TLS_TX: stale iv");
+
+	close(cfd);
+	close(sfd);
+	if (alg_fd != -1)
+		close(alg_fd);
+
+	fprintf(stderr, "tls: %llu records [PASS]\n",
+		(unsigned long long)next_seq);
+	return 0;
+}
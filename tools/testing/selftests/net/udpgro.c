@@ -0,0 +1,264 @@
+/*
+ * Send UDP_SEGMENT trains and receive them with or without UDP_GRO.
+ *
+ * Run as a receiver ("-r") in one network namespace and as a sender in
+ * another, connected through a veth pair with GRO enabled on the
+ * receiving end.  The sender transmits buffers of -s bytes, split into
+ * -S byte datagrams, for -l seconds.  The receiver reads until the
+ * sender has been quiet for one second, then prints
+ *
+ *   rx: calls=<recv calls> segs=<datagrams> <segs per call> segs/call <MB> MB
+ *
+ * and verifies every read: with -G (UDP_GRO) a read may carry several
+ * segments and must then report a UDP_GRO cmsg equal to -S; without
+ * it, every read must be a single datagram.  With -C the receiver also
+ * fails if no read carried more than one segment.
+ *
+ * License (GPLv2):
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. * See the GNU General Public License for
+ * more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <error.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP		17
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT	103
+#endif
+
+#ifndef UDP_GRO
+#define UDP_GRO		104
+#endif
+
+#define MAX_PAYLOAD	(0xFFFF - 28)
+
+static bool cfg_rx;
+static bool cfg_gro;
+static bool cfg_expect_coalesce;
+static int cfg_port = 8000;
+static int cfg_runtime_sec = 1;
+static int cfg_size = 1000 * 32;
+static int cfg_gso_size = 1000;
+static const char *cfg_dst;
+
+static char buf[MAX_PAYLOAD];
+
+static uint64_t gettimeofday_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static void do_tx(void)
+{
+	struct sockaddr_in addr = {0};
+	unsigned long calls = 0;
+	uint64_t tstop;
+	int fd;
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(cfg_port);
+	if (inet_pton(AF_INET, cfg_dst, &addr.sin_addr) != 1)
+		error(1, 0, "ipv4 parse error: %s", cfg_dst);
+
+	fd = socket(PF_INET, SOCK_DGRAM, 0);
+	if (fd == -1)
+		error(1, errno, "socket");
+	if (connect(fd, (void *)&addr, sizeof(addr)))
+		error(1, errno, "connect");
+	if (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &cfg_gso_size,
+		       sizeof(cfg_gso_size)))
+		error(1, errno, "setsockopt udp segment");
+
+	tstop = gettimeofday_ms() + cfg_runtime_sec * 1000;
+	do {
+		if (send(fd, buf, cfg_size, 0) != cfg_size) {
+			/* the receiver may be slower, that is fine */
+			if (errno != ENOBUFS)
+				error(1, errno, "send");
+			continue;
+		}
+		calls++;
+	} while (gettimeofday_ms() < tstop);
+
+	fprintf(stderr, "tx: calls=%lu segs=%lu\n", calls,
+		calls * ((cfg_size + cfg_gso_size - 1) / cfg_gso_size));
+
+	if (close(fd))
+		error(1, errno, "close");
+}
+
+/* Returns the segment size reported for a coalesced read, or 0 */
+static int recv_gso_size(struct msghdr *msg)
+{
+	struct cmsghdr *cm;
+
+	for (cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm)) {
+		if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO)
+			return *(int *)CMSG_DATA(cm);
+	}
+	return 0;
+}
+
+static void do_rx(void)
+{
+	char control[CMSG_SPACE(sizeof(int))];
+	struct sockaddr_in addr = {0};
+	struct pollfd pfd = { .events = POLLIN };
+	unsigned long calls = 0, segs = 0, bytes = 0, coalesced = 0;
+	int fd, ret, gso_size, val;
+
+	fd = socket(PF_INET, SOCK_DGRAM, 0);
+	if (fd == -1)
+		error(1, errno, "socket");
+
+	val = 1 << 21;
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &val, sizeof(val)))
+		error(1, errno, "setsockopt rcvbuf");
+	val = cfg_gro;
+	if (setsockopt(fd, SOL_UDP, UDP_GRO, &val, sizeof(val)))
+		error(1, errno, "setsockopt udp gro");
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(cfg_port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(fd, (void *)&addr, sizeof(addr)))
+		error(1, errno, "bind");
+
+	pfd.fd = fd;
+	while (1) {
+		struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+		struct msghdr msg = {0};
+
+		/* wait long for the first packet, then until tx goes quiet */
+		ret = poll(&pfd, 1, calls ? 1000 : 5000);
+		if (ret == -1)
+			error(1, errno, "poll");
+		if (!ret)
+			break;
+
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		ret = recvmsg(fd, &msg, MSG_DONTWAIT);
+		if (ret == -1)
+			error(1, errno, "recvmsg");
+		if (msg.msg_flags & MSG_TRUNC)
+			error(1, 0, "truncated read of %d bytes", ret);
+
+		gso_size = recv_gso_size(&msg);
+		if (gso_size) {
+			if (!cfg_gro)
+				error(1, 0, "UDP_GRO cmsg without UDP_GRO");
+			if (gso_size != cfg_gso_size)
+				error(1, 0, "gso size %d, expected %d",
+				      gso_size, cfg_gso_size);
+			segs += (ret + gso_size - 1) / gso_size;
+			coalesced++;
+		} else {
+			if (ret > cfg_gso_size)
+				error(1, 0, "read %d bytes, expected at most %d",
+				      ret, cfg_gso_size);
+			segs++;
+		}
+		bytes += ret;
+		calls++;
+	}
+
+	if (!calls)
+		error(1, 0, "no data received");
+
+	fprintf(stderr, "rx: calls=%lu segs=%lu %.1f segs/call %lu MB\n",
+		calls, segs, (double)segs / calls, bytes >> 20);
+
+	if (cfg_expect_coalesce && !coalesced)
+		error(1, 0, "no read carried more than one segment");
+
+	if (close(fd))
+		error(1, errno, "close");
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "CD:Gl:p:rs:S:")) != -1) {
+		switch (c) {
+		case 'C':
+			cfg_expect_coalesce = true;
+			break;
+		case 'D':
+			cfg_dst = optarg;
+			break;
+		case 'G':
+			cfg_gro = true;
+			break;
+		case 'l':
+			cfg_runtime_sec = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg_port = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			cfg_rx = true;
+			break;
+		case 's':
+			cfg_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			cfg_gso_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			error(1, 0, "usage: %s [-r [-G] [-C]] [-D dst] [-l sec] "
+				    "[-p port] [-s size] [-S gso_size]", argv[0]);
+		}
+	}
+
+	if (cfg_size > MAX_PAYLOAD || cfg_gso_size <= 0 ||
+	    cfg_gso_size > cfg_size)
+		error(1, 0, "invalid size %d or gso size %d",
+		      cfg_size, cfg_gso_size);
+	if (!cfg_rx && !cfg_dst)
+		error(1, 0, "sender requires a destination (-D)");
+}
+
+int main(int argc, char **argv)
+{
+	parse_opts(argc, argv);
+
+	if (cfg_rx)
+		do_rx();
+	else
+		do_tx();
+
+	return 0;
+}
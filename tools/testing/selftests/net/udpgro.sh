@@ -0,0 +1,81 @@
+#!/bin/bash
+#
+# Receive UDP_SEGMENT trains over veth with and without UDP_GRO, see
+# udpgro.c.
+#
+# Topology, one network namespace each:
+#
+#   ugro_tx (10.0.0.1) --veth-- (10.0.0.2) ugro_rx
+#
+# GRO is enabled on the receiving veth, so frames sent back to back are
+# handed to the stack through NAPI.  Each run prints the datagrams per
+# receive call: without UDP_GRO it must be 1, with UDP_GRO it shows how
+# many datagrams share one trip through the stack.
+#
+# Environment:
+#   DURATION  seconds per run (default 2)
+
+DURATION=${DURATION:-2}
+PORT=8000
+ret=0
+
+cleanup() {
+	for ns in ugro_tx ugro_rx; do
+		ip netns del $ns 2>/dev/null
+	done
+}
+
+setup() {
+	cleanup
+	for ns in ugro_tx ugro_rx; do
+		ip netns add $ns || return 1
+		ip -netns $ns link set lo up
+	done
+
+	ip link add tx0 netns ugro_tx type veth peer name rx0 netns ugro_rx ||
+		return 1
+	ip -netns ugro_tx addr add 10.0.0.1/24 dev tx0
+	ip -netns ugro_rx addr add 10.0.0.2/24 dev rx0
+	ip -netns ugro_tx link set tx0 up
+	ip -netns ugro_rx link set rx0 up
+
+	ip netns exec ugro_rx ethtool -K rx0 gro on >/dev/null || return 1
+}
+
+run_test() {
+	local name=$1
+	local rx_args=$2
+	local tx_args=$3
+	local sink
+
+	echo "$name:"
+	ip netns exec ugro_rx ./udpgro -r -p $PORT $rx_args &
+	sink=$!
+	sleep 0.5
+
+	ip netns exec ugro_tx ./udpgro -D 10.0.0.2 -p $PORT -l $DURATION \
+		$tx_args
+	if ! wait $sink; then
+		echo "$name: [FAIL]"
+		ret=1
+	fi
+	PORT=$((PORT + 1))
+}
+
+trap cleanup EXIT
+
+if ! setup; then
+	echo "udpgro: could not set up veth namespaces [SKIP]"
+	exit 0
+fi
+
+run_test "no UDP_GRO" "-S 1000" "-s 32000 -S 1000"
+run_test "UDP_GRO" "-G -C -S 1000" "-s 32000 -S 1000"
+run_test "UDP_GRO short tail" "-G -C -S 1400" "-s 30000 -S 1400"
+
+if [ $ret -eq 0 ]; then
+	echo "udpgro: [PASS]"
+else
+	echo "udpgro: [FAIL]"
+fi
+exit $ret
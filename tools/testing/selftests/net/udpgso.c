@@ -0,0 +1,203 @@
+/*
+ * Send UDP_SEGMENT (UDP GSO) buffers over IPv4 loopback and verify that
+ * they arrive as the expected train of datagrams.
+ *
+ * Every test case sends one buffer with a given segment size, once with
+ * the size set through setsockopt(UDP_SEGMENT) and once through a
+ * SOL_UDP cmsg.  The receiver checks the number and the length of the
+ * datagrams; a trailing segment may be shorter than the segment size.
+ * A buffer that would need more than UDP_MAX_SEGMENTS datagrams must
+ * fail with EINVAL, one that fits a single segment is sent as is.
+ *
+ * License (GPLv2):
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. * See the GNU General Public License for
+ * more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <error.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP		17
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT	103
+#endif
+
+#define UDP_MAX_SEGMENTS	64
+#define MAX_PAYLOAD		(0xFFFF - 28)
+
+struct testcase {
+	const char *name;
+	int gso_size;
+	int len;
+	int err;		/* expected errno of the send, 0 on success */
+};
+
+static const struct testcase testcases[] = {
+	{ "one segment",	1000,	1000,			0 },
+	{ "below gso size",	1000,	500,			0 },
+	{ "short tail",		1000,	1001,			0 },
+	{ "exact multiple",	1000,	10 * 1000,		0 },
+	{ "max segments",	1000,	UDP_MAX_SEGMENTS * 1000, 0 },
+	{ "too many segments",	1000,	UDP_MAX_SEGMENTS * 1000 + 1, EINVAL },
+	{ "quic sized",		1350,	40 * 1350 + 100,	0 },
+	{ "gso size above mtu",	65509,	MAX_PAYLOAD,		0 },
+};
+
+static char buf[MAX_PAYLOAD];
+static char rbuf[MAX_PAYLOAD];
+
+static int do_socket(struct sockaddr_in *addr)
+{
+	socklen_t alen = sizeof(*addr);
+	int fd;
+
+	fd = socket(PF_INET, SOCK_DGRAM, 0);
+	if (fd == -1)
+		error(1, errno, "socket");
+
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr->sin_port = 0;
+	if (bind(fd, (void *)addr, sizeof(*addr)))
+		error(1, errno, "bind");
+	if (getsockname(fd, (void *)addr, &alen))
+		error(1, errno, "getsockname");
+
+	return fd;
+}
+
+static int send_one(int fd, const struct sockaddr_in *dst,
+		    const struct testcase *tc, bool cmsg)
+{
+	char control[CMSG_SPACE(sizeof(uint16_t))] = {0};
+	struct iovec iov = { .iov_base = buf, .iov_len = tc->len };
+	struct msghdr msg = {0};
+	struct cmsghdr *cm;
+	int val = cmsg ? 0 : tc->gso_size;
+
+	if (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &val, sizeof(val)))
+		error(1, errno, "setsockopt udp segment");
+
+	msg.msg_name = (void *)dst;
+	msg.msg_namelen = sizeof(*dst);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (cmsg) {
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		cm = CMSG_FIRSTHDR(&msg);
+		cm->cmsg_level = SOL_UDP;
+		cm->cmsg_type = UDP_SEGMENT;
+		cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		*((uint16_t *)CMSG_DATA(cm)) = tc->gso_size;
+	}
+
+	if (sendmsg(fd, &msg, 0) == -1)
+		return errno;
+	return 0;
+}
+
+/* Returns the number of bytes received in the datagram, 0 on timeout */
+static int recv_one(int fd)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	int ret;
+
+	ret = poll(&pfd, 1, 100);
+	if (ret == -1)
+		error(1, errno, "poll");
+	if (!ret)
+		return 0;
+
+	ret = recv(fd, rbuf, sizeof(rbuf), MSG_DONTWAIT);
+	if (ret == -1)
+		error(1, errno, "recv");
+	return ret;
+}
+
+static bool run_one(int fdt, int fdr, const struct sockaddr_in *dst,
+		    const struct testcase *tc, bool cmsg)
+{
+	int left, err, len, nsegs = 0;
+
+	/* start from an empty queue even if an earlier case failed */
+	while (recv_one(fdr))
+		;
+
+	err = send_one(fdt, dst, tc, cmsg);
+	if (err != tc->err) {
+		fprintf(stderr, "%s: send returned %s, expected %s\n", tc->name,
+			strerror(err), strerror(tc->err));
+		return false;
+	}
+	if (err)
+		return recv_one(fdr) == 0;
+
+	for (left = tc->len; left > 0; left -= len) {
+		len = recv_one(fdr);
+		if (len != (left < tc->gso_size ? left : tc->gso_size)) {
+			fprintf(stderr, "%s: segment %d is %d bytes\n",
+				tc->name, nsegs, len);
+			return false;
+		}
+		nsegs++;
+	}
+
+	/* nothing may follow the last segment */
+	return recv_one(fdr) == 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in dst;
+	int fdt, fdr, i, val = 1 << 21;
+	bool ok = true;
+
+	memset(buf, 'a', sizeof(buf));
+
+	fdr = do_socket(&dst);
+	if (setsockopt(fdr, SOL_SOCKET, SO_RCVBUF, &val, sizeof(val)))
+		error(1, errno, "setsockopt rcvbuf");
+	fdt = do_socket(&(struct sockaddr_in){0});
+
+	for (i = 0; i < sizeof(testcases) / sizeof(testcases[0]); i++) {
+		const struct testcase *tc = &testcases[i];
+		bool pass;
+
+		pass = run_one(fdt, fdr, &dst, tc, false);
+		pass &= run_one(fdt, fdr, &dst, tc, true);
+		printf("%-20s gso=%-6d len=%-6d %s\n", tc->name, tc->gso_size,
+		       tc->len, pass ? "[OK]" : "[FAIL]");
+		ok &= pass;
+	}
+
+	if (close(fdt) || close(fdr))
+		error(1, errno, "close");
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+#!/bin/bash
+#
+# Send UDP_SEGMENT buffers over loopback, see udpgso.c.
+#
+# Loopback does not advertise tx-udp-segmentation, so this exercises
+# the software segmentation in udp_offload.c.
+
+if ./udpgso; then
+	echo "udpgso: [PASS]"
+else
+	echo "udpgso: [FAIL]"
+	exit 1
+fi